@@ -3,11 +3,66 @@
 #include <xloil/ExcelObj.h>
 #include <cassert>
 #include <vector>
+#include <memory>
+#include <algorithm>
+#include <unordered_set>
+#include <string_view>
+#include <cstring>
 
 namespace xloil
 {
+  /// <summary>
+  /// Counts of the strings written to an array builder with interning enabled
+  /// </summary>
+  struct ArrayBuilderInternStats
+  {
+    /// Number of strings copied into the builder
+    size_t strings = 0;
+    /// Number of distinct strings, which is the number actually stored
+    size_t unique = 0;
+    /// Characters, including length prefixes, which did not need storing
+    size_t charsSaved = 0;
+  };
+
   namespace detail
   {
+    /// <summary>
+    /// A hash set over the pstrings in an array builder's string store, so
+    /// that identical strings can share storage. This is safe because array
+    /// elements are views which never free their strings: the array block
+    /// is freed in one go.
+    /// </summary>
+    class StringInterner
+    {
+    public:
+      /// <summary>
+      /// Returns a pstring equal to the given string: either one previously
+      /// copied or a new one obtained from <code>newString(len)</code>.
+      /// </summary>
+      template<class TNewString>
+      wchar_t* copy(const wchar_t* str, size_t len, TNewString&& newString)
+      {
+        ++_stats.strings;
+        const auto found = _strings.find(std::wstring_view(str, len));
+        if (found != _strings.end())
+        {
+          _stats.charsSaved += len + 1;
+          return const_cast<wchar_t*>(found->data()) - 1;
+        }
+        auto pstr = newString(len);
+        wmemcpy_s(pstr + 1, len, str, len);
+        _strings.emplace(pstr + 1, len);
+        ++_stats.unique;
+        return pstr;
+      }
+
+      const ArrayBuilderInternStats& stats() const { return _stats; }
+
+    private:
+      std::unordered_set<std::wstring_view> _strings;
+      ArrayBuilderInternStats _stats;
+    };
+
     struct ArrayBuilderCharAllocator
     {
       ArrayBuilderCharAllocator(wchar_t*& data, const wchar_t* endData)
@@ -87,28 +142,70 @@ namespace xloil
       {
         auto buffer = _buffer;
         _buffer = nullptr;
-        return buffer;
+        return _interner ? compact(buffer) : buffer;
+      }
+
+      void enableInterning()
+      {
+        if (!_interner)
+          _interner.reset(new StringInterner());
       }
 
+      StringInterner* interner() const { return _interner.get(); }
+
     private:
       ExcelObj* _buffer;
       size_t _nObjects;
       const char* _endBuffer;
       wchar_t* _stringData;
+      std::unique_ptr<StringInterner> _interner;
+
+      /// <summary>
+      /// The string store is sized for every string, so with interning much
+      /// of it may be unused. If so, moves the array to a smaller block and
+      /// repoints the strings.
+      /// </summary>
+      ExcelObj* compact(ExcelObj* buffer)
+      {
+        const auto strings = (wchar_t*)(buffer + _nObjects);
+        const auto used = size_t(_stringData - strings);
+        const auto unused = size_t((const wchar_t*)_endBuffer - _stringData);
+        const auto objectBytes = sizeof(ExcelObj) * _nObjects;
+        if (unused * sizeof(wchar_t) * 4 < objectBytes + (used + unused) * sizeof(wchar_t))
+          return buffer;
+
+        auto target = (ExcelObj*)new char[objectBytes + sizeof(wchar_t) * used];
+        memcpy(target, buffer, objectBytes);
+        const auto targetStrings = (wchar_t*)(target + _nObjects);
+        wmemcpy(targetStrings, strings, used);
+        for (auto p = target; p != target + _nObjects; ++p)
+          if (p->xltype == msxll::xltypeStr
+            && p->val.str.data >= strings && p->val.str.data < _stringData)
+            p->val.str.data = targetStrings + (p->val.str.data - strings);
+
+        delete[] (char*)buffer;
+        return target;
+      }
     };
 
     class ArrayBuilderIterator;
 
+    /// <summary>
+    /// Writes to a single element of an array being built. The allocator
+    /// must provide <code>ownsString(const wchar_t*)</code> and 
+    /// <code>newString(size_t len)</code>.
+    /// </summary>
     // TODO: share with SequentialArrayBuilder
-    class ArrayBuilderElement
+    template<class TAlloc>
+    class BasicArrayBuilderElement
     {
     public:
-      ArrayBuilderElement(size_t index, ArrayBuilderAlloc& allocator)
+      BasicArrayBuilderElement(size_t index, TAlloc& allocator)
         : _target(&allocator.object(index))
         , _alloc(&allocator)
       {}
 
-      ArrayBuilderElement(ExcelObj* target, ArrayBuilderAlloc& allocator)
+      BasicArrayBuilderElement(ExcelObj* target, TAlloc& allocator)
         : _target(target)
         , _alloc(&allocator)
       {}
@@ -197,6 +294,11 @@ namespace xloil
         {
           xlObj->val.str.data = Const::EmptyStr().val.str.data;
         }
+        else if (auto interner = _alloc->interner())
+        {
+          xlObj->val.str.data = interner->copy(str, len,
+            [this](size_t n) { return _alloc->newString(n); });
+        }
         else
         {
           auto pstr = _alloc->newString(len);
@@ -207,12 +309,14 @@ namespace xloil
 
     private:
       ExcelObj* _target;
-      ArrayBuilderAlloc* _alloc;
+      TAlloc* _alloc;
 
       auto increment(int n) { _target += n; return *this; }
       friend class ArrayBuilderIterator;
     };
 
+    using ArrayBuilderElement = BasicArrayBuilderElement<ArrayBuilderAlloc>;
+
     class ArrayBuilderIterator
     {
     public:
@@ -272,6 +376,36 @@ namespace xloil
       ArrayBuilderElement _current;
       int _step;
     };
+
+    /// <summary>
+    /// Expands dictionary-encoded values into the elements [start, end). Each
+    /// element gets the value at its code, or \#N/A for a negative code. The
+    /// codes are read every <paramref name="stride"/> bytes. String values
+    /// must be in the builder's string store: elements point to them rather
+    /// than making a copy.
+    /// </summary>
+    template<class TCode>
+    void arrayExpandCodes(
+      const char* codes,
+      ptrdiff_t stride,
+      const std::vector<ExcelObj>& values,
+      ArrayBuilderIterator& start,
+      const ArrayBuilderIterator& end)
+    {
+      const auto nValues = (int64_t)values.size();
+      for (; start != end; codes += stride, ++start)
+      {
+        const auto code = (int64_t)*(const TCode*)codes;
+        if (code < 0)
+          *start = CellError::NA;
+        else if (code >= nValues)
+          XLO_THROW("Dictionary code {} out of range", code);
+        else if (values[code].isType(ExcelType::Str))
+          start->emplace_pstr(values[code].val.str.data);
+        else
+          *start = values[code];
+      }
+    }
   }
 
   /// <summary>
@@ -318,6 +452,30 @@ namespace xloil
       return BasicPString<wchar_t, detail::ArrayBuilderCharAllocator>(len, charAllocator());
     }
 
+    /// <summary>
+    /// Enables string interning: a string copied into the array which equals
+    /// one copied earlier shares its storage. This saves time and memory when
+    /// values repeat, such as in categorical data. When the array is created
+    /// any unused string store is released. Strings written with string() or
+    /// charAllocator() are not interned. Interning is not thread-safe.
+    /// </summary>
+    void internStrings() { _allocator.enableInterning(); }
+
+    /// <summary>
+    /// Returns true if <see cref="internStrings"/> has been called
+    /// </summary>
+    bool interningStrings() const { return _allocator.interner() != nullptr; }
+
+    /// <summary>
+    /// Returns counts of the strings interned, which are all zero if
+    /// interning is not enabled. Call before toExcelObj().
+    /// </summary>
+    ArrayBuilderInternStats internStats() const
+    {
+      auto interner = _allocator.interner();
+      return interner ? interner->stats() : ArrayBuilderInternStats();
+    }
+
     /// <summary>
     /// Open a writer on the element (i, j), write to it with
     /// <code>builder(i,j) = value;</code>
@@ -532,6 +690,16 @@ namespace xloil
     XLOIL_EXPORT void copyToBuilder(
       detail::ArrayBuilderIterator targetBegin, detail::ArrayBuilderIterator targetEnd);
 
+    /// <summary>
+    /// As <see cref="copyToBuilder"/>, but strings are allocated from 
+    /// <paramref name="chars"/>, which should have room for stringLength()
+    /// chars. Targets with their own region of the string store can then
+    /// be written concurrently.
+    /// </summary>
+    XLOIL_EXPORT void copyToBuilder(
+      detail::ArrayBuilderIterator targetBegin, detail::ArrayBuilderIterator targetEnd,
+      detail::ArrayBuilderCharAllocator chars);
+
   private:
     row_t _nRows;
     col_t _nColumns;
@@ -566,4 +734,271 @@ namespace xloil
       return p;
     }
   };
-}
\ No newline at end of file
+
+  namespace detail
+  {
+    /// <summary>
+    /// Allocates strings from a list of chunks, so that, unlike 
+    /// PStringStackAllocator, existing strings never move in memory when
+    /// more space is required. 
+    /// </summary>
+    class ChunkedStringArena
+    {
+    public:
+      ChunkedStringArena(size_t initialChunkSize = 0)
+        : _nextChunkSize(std::max<size_t>(initialChunkSize, 4096))
+      {}
+
+      wchar_t* allocate(size_t n)
+      {
+        if (_current + n > _chunkEnd)
+          addChunk(n);
+        auto ptr = _current;
+        _current += n;
+        _used += n;
+        return ptr;
+      }
+
+      bool owns(const wchar_t* str) const
+      {
+        // Most recent chunk is the most likely owner
+        for (auto c = _chunks.rbegin(); c != _chunks.rend(); ++c)
+          if (str >= c->first.get() && str < c->first.get() + c->second)
+            return true;
+        return false;
+      }
+
+      /// <summary>
+      /// Total number of characters allocated
+      /// </summary>
+      size_t size() const { return _used; }
+
+    private:
+      std::vector<std::pair<std::unique_ptr<wchar_t[]>, size_t>> _chunks;
+      wchar_t* _current = nullptr;
+      wchar_t* _chunkEnd = nullptr;
+      size_t _used = 0;
+      size_t _nextChunkSize;
+
+      void addChunk(size_t n)
+      {
+        const auto size = std::max(n, _nextChunkSize);
+        _chunks.emplace_back(std::unique_ptr<wchar_t[]>(new wchar_t[size]), size);
+        _current = _chunks.back().first.get();
+        _chunkEnd = _current + size;
+        _nextChunkSize = std::min<size_t>(_nextChunkSize * 2, 1u << 20);
+      }
+    };
+
+    struct ChunkedCharAllocator
+    {
+      ChunkedCharAllocator(ChunkedStringArena& arena)
+        : _arena(arena)
+      {}
+
+      wchar_t* allocate(size_t n) { return _arena.allocate(n); }
+
+      void deallocate(wchar_t*, size_t) { }
+
+    private:
+      ChunkedStringArena& _arena;
+    };
+
+    /// <summary>
+    /// Storage for the GrowableArrayBuilder: rows of ExcelObj are held in 
+    /// fixed-size chunks and strings in a ChunkedStringArena, so neither
+    /// moves as rows are appended.
+    /// </summary>
+    class GrowableArrayAlloc
+    {
+    public:
+      GrowableArrayAlloc(size_t nCols, size_t expectedStrLength)
+        : _nCols(nCols)
+        , _strings(expectedStrLength)
+      {
+        assert(nCols > 0);
+        // Aim for chunks of at least 1024 objects
+        while (((size_t)1 << _chunkShift) * nCols < 1024)
+          ++_chunkShift;
+      }
+
+      ExcelObj* row(size_t i)
+      {
+        return (ExcelObj*)_chunks[i >> _chunkShift].get()
+          + (i & (((size_t)1 << _chunkShift) - 1)) * _nCols;
+      }
+
+      /// <summary>
+      /// Appends a row, initialised to \#N/A
+      /// </summary>
+      ExcelObj* addRow()
+      {
+        const auto rowsPerChunk = (size_t)1 << _chunkShift;
+        if (_nRows == _chunks.size() * rowsPerChunk)
+          _chunks.emplace_back(new char[sizeof(ExcelObj) * rowsPerChunk * _nCols]);
+        auto p = row(_nRows++);
+        for (auto q = p; q != p + _nCols; ++q)
+          new (q) ExcelObj(CellError::NA);
+        return p;
+      }
+
+      auto nRows() const { return _nRows; }
+
+      auto charAllocator() { return ChunkedCharAllocator(_strings); }
+
+      auto newString(size_t len)
+      {
+        auto ptr = _strings.allocate(len + 1);
+        ptr[0] = wchar_t(len);
+        return ptr;
+      }
+
+      bool ownsString(const wchar_t* str) const
+      {
+        return _strings.owns(str);
+      }
+
+      size_t stringLength() const { return _strings.size(); }
+
+      void enableInterning()
+      {
+        if (!_interner)
+          _interner.reset(new StringInterner());
+      }
+
+      StringInterner* interner() const { return _interner.get(); }
+
+    private:
+      size_t _nCols;
+      size_t _nRows = 0;
+      size_t _chunkShift = 0;
+      std::vector<std::unique_ptr<char[]>> _chunks;
+      ChunkedStringArena _strings;
+      std::unique_ptr<StringInterner> _interner;
+    };
+  }
+
+  /// <summary>
+  /// Constructs ExcelObj arrays when the number of rows and the total string 
+  /// length are not known upfront. Rows are appended as required and strings
+  /// are written to a chunked arena. On calling toExcelObj(), the objects and
+  /// strings are compacted into the single contiguous block expected by 
+  /// ExcelObj. Unwritten elements are \#N/A.
+  /// Usage:
+  /// <code>
+  ///    GrowableArrayBuilder builder(2);
+  ///    for (auto i = 0; i < n; ++i)
+  ///    {
+  ///      auto row = builder.appendRow();
+  ///      builder(row, 0) = i;
+  ///      builder(row, 1) = L"foo";
+  ///    }
+  ///    return builder.toExcelObj();
+  /// </code>
+  /// </summary>
+  class GrowableArrayBuilder
+  {
+  public:
+    using row_t = ExcelObj::row_t;
+    using col_t = ExcelObj::col_t;
+    using element_t = detail::BasicArrayBuilderElement<detail::GrowableArrayAlloc>;
+
+    /// <summary>
+    /// Creates an empty GrowableArrayBuilder with a fixed number of columns. 
+    /// </summary>
+    /// <param name="nCols"></param>
+    /// <param name="expectedStrLength">Optional hint for the size of the first
+    /// string chunk</param>
+    GrowableArrayBuilder(col_t nCols, size_t expectedStrLength = 0)
+      : _nColumns(nCols)
+      , _allocator(nCols, expectedStrLength)
+    {}
+
+    /// <summary>
+    /// Appends a row initialised to \#N/A and returns its index
+    /// </summary>
+    row_t appendRow()
+    {
+      _allocator.addRow();
+      return row_t(_allocator.nRows() - 1);
+    }
+
+    /// <summary>
+    /// Appends rows until the array has at least <paramref name="nRows"/>
+    /// </summary>
+    void resize(row_t nRows)
+    {
+      while (_allocator.nRows() < nRows)
+        _allocator.addRow();
+    }
+
+    auto charAllocator() { return _allocator.charAllocator(); }
+
+    /// <summary>
+    /// Allocate a PString in the array's string store. 
+    /// See <see cref="ExcelArrayBuilder::string"/>.
+    /// </summary>
+    auto string(uint16_t len)
+    {
+      return BasicPString<wchar_t, detail::ChunkedCharAllocator>(len, charAllocator());
+    }
+
+    /// <summary>
+    /// Open a writer on the element (i, j), write to it with
+    /// <code>builder(i,j) = value;</code>
+    /// Writing to a row beyond the current end appends rows.
+    /// </summary>
+    element_t operator()(size_t i, size_t j)
+    {
+      assert(j < _nColumns);
+      if (i >= _allocator.nRows())
+        resize(row_t(i + 1));
+      return element_t(_allocator.row(i) + j, _allocator);
+    }
+
+    ExcelObj& element(size_t i, size_t j)
+    {
+      assert(i < _allocator.nRows() && j < _nColumns);
+      return _allocator.row(i)[j];
+    }
+
+    row_t nRows() const { return row_t(_allocator.nRows()); }
+    col_t nCols() const { return _nColumns; }
+
+    /// <summary>
+    /// Total length of string data written so far, including the length 
+    /// prefix of each string
+    /// </summary>
+    size_t stringLength() const { return _allocator.stringLength(); }
+
+    /// <summary>
+    /// Enables string interning, see <see cref="ExcelArrayBuilder::internStrings"/>
+    /// </summary>
+    void internStrings() { _allocator.enableInterning(); }
+
+    /// <summary>
+    /// Returns counts of the strings interned, which are all zero if
+    /// interning is not enabled. Call before toExcelObj().
+    /// </summary>
+    ArrayBuilderInternStats internStats() const
+    {
+      auto interner = _allocator.interner();
+      return interner ? interner->stats() : ArrayBuilderInternStats();
+    }
+
+    /// <summary>
+    /// Compacts the rows and strings into a single block and creates an 
+    /// ExcelObj of type array. This invalidates the builder.  Throws if 
+    /// no rows have been added.
+    /// </summary>
+    /// <param name="transpose">If true, the array rows become the output
+    /// columns</param>
+    XLOIL_EXPORT ExcelObj toExcelObj(bool transpose = false);
+
+    operator ExcelObj() { return toExcelObj(); }
+
+  private:
+    col_t _nColumns;
+    detail::GrowableArrayAlloc _allocator;
+  };
+}
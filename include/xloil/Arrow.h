@@ -0,0 +1,160 @@
+#pragma once
+#include <xlOil/ExportMacro.h>
+#include <xlOil/ExcelObj.h>
+#include <cstdint>
+#include <cstddef>
+
+// The Arrow C data and stream interface structs, as given in the
+// specification. The guards allow other headers which declare them.
+// https://arrow.apache.org/docs/format/CDataInterface.html
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+  // Array type description
+  const char* format;
+  const char* name;
+  const char* metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema** children;
+  struct ArrowSchema* dictionary;
+
+  // Release callback
+  void (*release)(struct ArrowSchema*);
+  // Opaque producer-specific data
+  void* private_data;
+};
+
+struct ArrowArray {
+  // Array data description
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void** buffers;
+  struct ArrowArray** children;
+  struct ArrowArray* dictionary;
+
+  // Release callback
+  void (*release)(struct ArrowArray*);
+  // Opaque producer-specific data
+  void* private_data;
+};
+
+#endif  // ARROW_C_DATA_INTERFACE
+
+#ifndef ARROW_C_STREAM_INTERFACE
+#define ARROW_C_STREAM_INTERFACE
+
+struct ArrowArrayStream {
+  int (*get_schema)(struct ArrowArrayStream*, struct ArrowSchema* out);
+  int (*get_next)(struct ArrowArrayStream*, struct ArrowArray* out);
+  const char* (*get_last_error)(struct ArrowArrayStream*);
+  void (*release)(struct ArrowArrayStream*);
+  void* private_data;
+};
+
+#endif  // ARROW_C_STREAM_INTERFACE
+
+namespace xloil
+{
+  class ExcelArray;
+
+  /// <summary>
+  /// Exports an array as an Arrow struct array with one child per column.
+  /// Each column gets the narrowest type which holds its values:
+  /// <list type="bullet">
+  ///   <item>numbers, ints and bools: float64</item>
+  ///   <item>only bools: boolean</item>
+  ///   <item>strings: utf8, or large_utf8 over 2GB. Other values in the
+  ///     column are written as their string representation.</item>
+  ///   <item>no values: null</item>
+  /// </list>
+  /// Nil, missing and error values are null. Strings are transcoded to
+  /// UTF-8. An xloper12 interleaves type and value, so numeric data is
+  /// copied into Arrow buffers rather than shared.
+  ///
+  /// The caller owns the outputs and must call their release callbacks.
+  /// </summary>
+  /// <param name="headings">If true, the first row gives the column names,
+  ///   otherwise they are "0", "1", ...</param>
+  XLOIL_EXPORT void arrowExport(
+    const ExcelArray& arr,
+    bool headings,
+    ArrowSchema* schema,
+    ArrowArray* array);
+
+  /// <summary>
+  /// Exports only the schema which <see cref="arrowExport"/> would give for
+  /// the array. Column types are inferred in the same way but no data
+  /// buffers are written.
+  ///
+  /// The caller owns the output and must call its release callback.
+  /// </summary>
+  XLOIL_EXPORT void arrowExportSchema(
+    const ExcelArray& arr,
+    bool headings,
+    ArrowSchema* schema);
+
+  /// <summary>
+  /// Creates an Excel array from Arrow record batches which share the given
+  /// schema. A struct schema gives one column per child, any other schema
+  /// gives a single column. Supports null, boolean, integer, float, utf8,
+  /// large_utf8, date and timestamp types and dictionary encoding of these.
+  /// Dates and timestamps become Excel serial dates, ignoring any time zone.
+  /// Nulls become \#N/A.
+  ///
+  /// Does not release the inputs.
+  /// </summary>
+  /// <param name="headings">If true, the first row is the column names</param>
+  XLOIL_EXPORT ExcelObj arrowImport(
+    const ArrowSchema& schema,
+    const ArrowArray* batches,
+    size_t nBatches,
+    bool headings);
+
+  inline ExcelObj arrowImport(
+    const ArrowSchema& schema,
+    const ArrowArray& array,
+    bool headings)
+  {
+    return arrowImport(schema, &array, 1, headings);
+  }
+
+  /// <summary>
+  /// Reads all batches from the stream into an Excel array, as
+  /// <see cref="arrowImport"/>. Releases the stream.
+  /// </summary>
+  XLOIL_EXPORT ExcelObj arrowImport(ArrowArrayStream& stream, bool headings);
+
+  namespace detail
+  {
+    /// <summary>
+    /// Returns the number of bytes required to write the UTF-16 string as UTF-8
+    /// </summary>
+    XLOIL_EXPORT size_t utf8Length(const wchar_t* str, size_t len) noexcept;
+
+    /// <summary>
+    /// Writes the UTF-16 string as UTF-8, returning the number of bytes
+    /// written, which is given by <see cref="utf8Length"/>. Unpaired
+    /// surrogates become U+FFFD.
+    /// </summary>
+    XLOIL_EXPORT size_t transcodeUtf16ToUtf8(
+      const wchar_t* str, size_t len, char* out) noexcept;
+
+    /// <summary>
+    /// Writes the UTF-8 string as UTF-16, returning the number of characters
+    /// written, which is at most <paramref name="len"/>. Invalid sequences
+    /// become U+FFFD.
+    /// </summary>
+    XLOIL_EXPORT size_t transcodeUtf8ToUtf16(
+      const char* str, size_t len, wchar_t* out) noexcept;
+  }
+}
@@ -53,5 +53,9 @@ namespace xloil
     {
       asyncReturn(_asyncHandle, value);
     }
+    const ExcelObj& asyncHandle() const
+    {
+      return _asyncHandle;
+    }
   };
 }
\ No newline at end of file
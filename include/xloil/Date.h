@@ -2,6 +2,7 @@
 #include "ExportMacro.h"
 #include <xloil/ExcelObj.h>
 #include <string_view>
+#include <cstdint>
 #include <time.h>
 #include <vector>
 
@@ -51,6 +52,31 @@ namespace xloil
       tm.tm_hour, tm.tm_min, tm.tm_sec, uSecs);
   }
 
+  /// <summary>
+  /// The tick count marking an invalid date in <see cref="excelSerialToTicks"/>.
+  /// This is numpy's NaT value.
+  /// </summary>
+  constexpr int64_t XL_NULL_DATE_TICKS = INT64_MIN;
+
+  /// <summary>
+  /// Converts Excel serial dates to a count of ticks since 1970-01-01, where
+  /// there are <paramref name="ticksPerDay"/> ticks in a day, rounding to the
+  /// nearest tick. Values which are not valid Excel dates or overflow the tick
+  /// count give <see cref="XL_NULL_DATE_TICKS"/>. Accounts for Excel's
+  /// non-existent 29-Feb-1900, which is read as 1-Mar-1900. Vectorised, so
+  /// much faster than converting each value to a date struct.
+  /// </summary>
+  XLOIL_EXPORT void excelSerialToTicks(
+    const double* serials, size_t n, int64_t* ticks, double ticksPerDay) noexcept;
+
+  /// <summary>
+  /// The inverse of <see cref="excelSerialToTicks"/>: converts tick counts
+  /// since 1970-01-01 to Excel serial dates. <see cref="XL_NULL_DATE_TICKS"/>
+  /// gives NaN.
+  /// </summary>
+  XLOIL_EXPORT void ticksToExcelSerial(
+    const int64_t* ticks, size_t n, double* serials, double ticksPerDay) noexcept;
+
   /// <summary>
   /// Parses a string into a std::tm struct. Note that in
   /// the tm struct, the fields do not have the "most natural"
@@ -30,6 +30,47 @@ namespace xloil
       size = (TSize)sz;
       return true;
     }
+
+    // Kernels which scan a contiguous block of ExcelObj. On x64 they use
+    // AVX2 if the CPU supports it, otherwise a scalar loop.
+
+    /// <summary>
+    /// Returns the bitwise OR of the xltype of each object in [begin, end)
+    /// </summary>
+    XLOIL_EXPORT int arrayTypeMask(const ExcelObj* begin, const ExcelObj* end) noexcept;
+
+    /// <summary>
+    /// Returns the total length of the strings in [begin, end). If 
+    /// <paramref name="nStrings"/> is not null, it receives the number of strings.
+    /// </summary>
+    XLOIL_EXPORT size_t arrayStringLength(
+      const ExcelObj* begin, const ExcelObj* end, size_t* nStrings = nullptr) noexcept;
+
+    /// <summary>
+    /// Returns one past the last non-empty (not Nil, \#N/A or "") object in
+    /// [begin, end), or begin if all objects are empty.
+    /// </summary>
+    XLOIL_EXPORT const ExcelObj* arrayLastNonEmpty(const ExcelObj* begin, const ExcelObj* end) noexcept;
+
+    /// <summary>
+    /// Writes the numeric, int or bool objects in [begin, end) to a contiguous
+    /// array of double. Stops at the first other type and returns the number
+    /// of values written.
+    /// </summary>
+    XLOIL_EXPORT size_t arrayGatherDoubles(const ExcelObj* begin, const ExcelObj* end, double* out) noexcept;
+
+    /// <summary>
+    /// Writes <paramref name="n"/> doubles to the uninitialised objects at
+    /// <paramref name="out"/>, as the ExcelObj(double) constructor would: NaN
+    /// becomes \#N/A and infinities become \#NUM!.
+    /// </summary>
+    XLOIL_EXPORT void arrayScatterDoubles(const double* in, size_t n, ExcelObj* out) noexcept;
+
+    /// <summary>
+    /// Writes <paramref name="n"/> ints to the uninitialised objects at
+    /// <paramref name="out"/> as xltypeInt.
+    /// </summary>
+    XLOIL_EXPORT void arrayScatterInts(const int* in, size_t n, ExcelObj* out) noexcept;
   }
 
   class ExcelArray;
@@ -354,9 +395,11 @@ namespace xloil
     {
       using namespace msxll;
       int type = 0;
-      for (decltype(_rows) i = 0; i < _rows; ++i)
-        for (auto j = row_begin(i); j < row_end(i); ++j)
-          type |= j->xltype;
+      if (_columns == _baseCols)
+        type = detail::arrayTypeMask(_data, _data + size());
+      else
+        for (decltype(_rows) i = 0; i < _rows; ++i)
+          type |= detail::arrayTypeMask(row_begin(i), row_end(i));
 
       switch (type)
       {
@@ -392,6 +435,15 @@ namespace xloil
     /// </summary>
     XLOIL_EXPORT ExcelObj toExcelObj() const;
 
+    /// <summary>
+    /// Writes the array to a contiguous row-major array of double. Int and
+    /// bool values are converted. Returns false if any other type is found,
+    /// in which case the output is only partially written.
+    /// </summary>
+    /// <param name="out">Destination which must hold at least size() values</param>
+    /// <param name="outSize">The number of values <paramref name="out"/> can hold</param>
+    XLOIL_EXPORT bool toDoubles(double* out, size_t outSize) const;
+
     /// <summary>
     /// Determine the size of array data when blanks and \#N/A is ignored.
     /// </summary>
@@ -475,4 +527,16 @@ namespace xloil
       --_p;
     return *this;
   }
+
+  namespace detail
+  {
+    /// <summary>
+    /// Dictionary-encodes the array: assigns each distinct value a code in
+    /// order of first appearance, writes the code of each element to
+    /// <paramref name="codes"/> and returns the distinct values. Nil, error
+    /// and zero-length string values get code -1.
+    /// </summary>
+    XLOIL_EXPORT std::vector<const ExcelObj*> arrayDictionaryEncode(
+      const ExcelArray& arr, int32_t* codes);
+  }
 }
\ No newline at end of file
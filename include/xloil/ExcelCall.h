@@ -92,7 +92,8 @@ namespace xloil
 
   /// <summary>
   /// A wrapper around the Excel12 call. Avoid using directly unless for 
-  /// performance reasons.
+  /// performance reasons. Returns xlretInvCount if given more than the 255
+  /// arguments Excel accepts.
   /// </summary>
   XLOIL_EXPORT int callExcelRaw(
     int func, ExcelObj* result,
@@ -280,6 +280,7 @@ namespace xloil
       val.array.columns = nCols;
       val.array.lparray = (Base*)data;
       val.array.xloil_view = isView;
+      val.array.xloil_shared = false;
       xltype = msxll::xltypeMulti;
     }
 
@@ -656,7 +657,12 @@ namespace xloil
       else if (from.type() == ExcelType::Str)
         to.val.str.xloil_view = true;
       else if (from.type() == ExcelType::Multi)
+      {
+        // A view does not hold a reference to a shared block
         to.val.array.xloil_view = true;
+        to.val.array.xloil_shared = false;
+        to.xltype &= ~msxll::xlbitXloilShared;
+      }
       else
         overwriteComplex(to, from);
     }
@@ -676,15 +682,49 @@ namespace xloil
 
     ExcelObj* setDllFreeFlag() noexcept
     {
+      // Excel does not understand the shared bit, so we record it in the
+      // array struct, which Excel ignores, for xlAutoFree12 to find.
+      if (isShared())
+      {
+        xltype &= ~msxll::xlbitXloilShared;
+        val.array.xloil_shared = true;
+      }
       xltype |= msxll::xlbitDLLFree;
       return this;
     }
+
+    /// <summary>
+    /// Returns a copy of this object in which an array is held in a 
+    /// refcounted block. Further copies of the result share the block 
+    /// rather than deep-copying the array and its strings. Useful for
+    /// large arrays which are stored, for example in the object cache,
+    /// and copied repeatedly. Non-array types are copied as usual.
+    /// 
+    /// Shared blocks are converted to plain xloper12 when passed to Excel
+    /// via <see cref="setDllFreeFlag"/> or callExcel.
+    /// </summary>
+    ExcelObj share() const;
+
+    /// <summary>
+    /// Returns true if this is an array held in a refcounted block
+    /// </summary>
+    bool isShared() const noexcept
+    {
+      return (xltype & msxll::xlbitXloilShared) != 0;
+    }
+
+    /// <summary>
+    /// If this is a shared array, replaces it with a uniquely owned deep
+    /// copy. This must be called before writing to the elements of an 
+    /// array which may be shared.
+    /// </summary>
+    ExcelObj& unshare();
   
     /// The xloper type made safe for use in switch statements by zeroing
     /// the memory control flags. Generally, prefer the type() function.
     int xtype() const
     {
-      return xltype & ~(msxll::xlbitXLFree | msxll::xlbitDLLFree);
+      return xltype & ~(msxll::xlbitXLFree | msxll::xlbitDLLFree | msxll::xlbitXloilShared);
     }
 
     /// <summary>
@@ -6,12 +6,41 @@
 namespace xloil
 {
   /// <summary>
-  /// The CacheUniquifier character for the Excel Object Cache
+  /// The CacheUniquifier character for the Excel Object Cache. Since
+  /// every cacheCheck looks up this cache, it uses compact keys which 
+  /// can be fetched without hashing the reference string.
   /// </summary>
   template<>
   struct CacheUniquifier<std::unique_ptr<const ExcelObj>>
   {
     static constexpr wchar_t value = L'\x6C38';
+    static constexpr bool compactKeys = true;
+  };
+
+  /// <summary>
+  /// Counts the array elements and string characters owned by an ExcelObj
+  /// </summary>
+  template<>
+  struct CacheObjectSize<ExcelObj>
+  {
+    size_t operator()(const ExcelObj& obj) const
+    {
+      switch (obj.xtype())
+      {
+      case msxll::xltypeStr:
+        return sizeof(ExcelObj) + (1 + obj.val.str.data[0]) * sizeof(wchar_t);
+      case msxll::xltypeMulti:
+      {
+        const auto n = (size_t)obj.val.array.rows * obj.val.array.columns;
+        size_t total = sizeof(ExcelObj);
+        for (auto p = (const ExcelObj*)obj.val.array.lparray, end = p + n; p != end; ++p)
+          total += (*this)(*p);
+        return total;
+      }
+      default:
+        return sizeof(ExcelObj);
+      }
+    }
   };
 
   template struct XLOIL_EXPORT ObjectCacheFactory<std::unique_ptr<const ExcelObj>>;
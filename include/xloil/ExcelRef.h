@@ -360,13 +360,46 @@ namespace xloil
 
     std::unique_ptr<Range> trim() const final override
     {
-      auto val = _ref.value();
-      if (!val.isType(ExcelType::Multi))
+      if (size() == 1)
         return std::make_unique<XllRange>(*this);
-      ExcelArray array(val);
-      return range(0, 0, 
-        array.nRows() > 0 ? array.nRows() - 1 : 0, 
-        array.nCols() > 1 ? array.nCols() - 1 : 0);
+
+      // Cells past the sheet's last used row and column are empty, so we
+      // only need to search the part of the range inside the used area.
+      // This makes trimming whole-column references like A:Z cheap.
+      // GET.DOCUMENT needs macro sheet permissions: if it fails, the whole
+      // range is searched.
+      size_t usedRows = _ref.nRows(), usedCols = _ref.nCols();
+      const auto [sheetName, ret] = tryCallExcel(msxll::xlSheetNm, (const ExcelObj&)_ref);
+      if (ret == msxll::xlretSuccess)
+      {
+        // Gives the 1-based last used row and column, or zero for an empty sheet
+        const auto lastRow = tryCallExcel(msxll::xlfGetDocument, 10, sheetName).first;
+        const auto lastCol = tryCallExcel(msxll::xlfGetDocument, 12, sheetName).first;
+        if (lastRow.isType(ExcelType::Num) && lastCol.isType(ExcelType::Num))
+        {
+          const auto fromRow = (size_t)std::get<0>(_ref.bounds());
+          const auto fromCol = (size_t)std::get<1>(_ref.bounds());
+          const auto rowEnd = (size_t)lastRow.val.num;
+          const auto colEnd = (size_t)lastCol.val.num;
+          usedRows = rowEnd > fromRow ? std::min(usedRows, rowEnd - fromRow) : 0;
+          usedCols = colEnd > fromCol ? std::min(usedCols, colEnd - fromCol) : 0;
+        }
+      }
+
+      // Read the range in blocks from the end rather than all at once
+      const auto [nRows, nCols] = trimmedExtent(usedRows, usedCols,
+        [this](size_t i, size_t j, size_t n, size_t m)
+        {
+          const auto val = _ref.range(
+            (int)i, (int)j, int(i + n - 1), int(j + m - 1)).value();
+          row_t rows; col_t cols;
+          if (!ExcelArray::trimmedArraySize(val, rows, cols))
+            return val.isNonEmpty() ? std::pair<size_t, size_t>(1, 1) : std::pair<size_t, size_t>(0, 0);
+          return std::pair<size_t, size_t>(rows, cols);
+        });
+      return range(0, 0,
+        nRows > 0 ? (int)nRows - 1 : 0,
+        nCols > 0 ? (int)nCols - 1 : 0);
     }
 
     std::tuple<row_t, col_t> shape() const final override
@@ -7,6 +7,14 @@
 #include <unordered_map>
 #include <string_view>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <array>
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <vector>
 
 namespace xloil
 {
@@ -21,6 +29,38 @@ namespace xloil
     wchar_t value;
   };
 
+  /// <summary>
+  /// Estimates the memory in bytes held by a cached object, which is used
+  /// to account for an ObjectCache's byte budget. Specialise this for 
+  /// types which own significant memory.
+  /// </summary>
+  template<class T>
+  struct CacheObjectSize
+  {
+    size_t operator()(const T&) const { return sizeof(T); }
+  };
+
+  template<class T>
+  struct CacheObjectSize<std::unique_ptr<T>>
+  {
+    size_t operator()(const std::unique_ptr<T>& p) const
+    {
+      return sizeof(p) + (p ? CacheObjectSize<std::remove_const_t<T>>()(*p) : 0);
+    }
+  };
+
+  /// <summary>
+  /// Counters describing the usage of an ObjectCache
+  /// </summary>
+  struct ObjectCacheStats
+  {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t residentBytes = 0;
+    size_t keys = 0;
+  };
+
   namespace detail
   {
     template<uint16_t NPadding>
@@ -52,32 +92,78 @@ namespace xloil
       return pascalStr;
     }
 
-    // We need to explicitly define our own lookup function for undordered_map
-    // to use string_view objects without copying.  In std::map the find function 
-    // is templated on the key type so we're just replicating that behaviour.
+    /// <summary>
+    /// Key for Lookup which carries its precomputed hash, so a search 
+    /// with a string_view neither copies the string nor rehashes it.
+    /// </summary>
+    struct CacheKey
+    {
+      std::wstring_view str;
+      size_t hash;
+      bool operator==(const CacheKey& that) const { return str == that.str; }
+    };
+
+    struct CacheKeyHash
+    {
+      size_t operator()(const CacheKey& key) const { return key.hash; }
+    };
+
+    /// <summary>
+    /// A string-keyed hash map which can be searched with a string_view 
+    /// without allocating. Heterogeneous lookup in std::unordered_map needs
+    /// C++20, so instead the map keys are views of separately allocated
+    /// buffers, which do not move when the map rehashes.
+    /// </summary>
     template<class Val>
-    struct Lookup : public std::unordered_map<std::wstring, Val>
+    class Lookup
     {
-      using base = typename std::unordered_map<std::wstring, Val>;
+    public:
+      struct Entry
+      {
+        std::unique_ptr<wchar_t[]> keyData;
+        Val value;
+      };
+      using map_type = std::unordered_map<CacheKey, Entry, CacheKeyHash>;
+      using iterator = typename map_type::iterator;
+      using const_iterator = typename map_type::const_iterator;
+
+      static size_t hash(const std::wstring_view& key)
+      {
+        return std::hash<std::wstring_view>()(key);
+      }
 
-      template <class T>
-      _NODISCARD typename base::const_iterator search(const T& _Keyval) const
+      iterator search(const std::wstring_view& key, size_t hash)
       {
-        size_type _Bucket = std::hash<T>()(_Keyval) & _Mask;
-        for (auto _Where = begin(_Bucket); _Where != end(_Bucket); ++_Where)
-          if (_Where->first == _Keyval)
-            return _Where;
-        return (end());
+        return _map.find(CacheKey{ key, hash });
       }
-      template <class T>
-      _NODISCARD typename base::iterator search(const T& _Keyval)
+      const_iterator search(const std::wstring_view& key, size_t hash) const
       {
-        size_type _Bucket = std::hash<T>()(_Keyval) & _Mask;
-        for (auto _Where = begin(_Bucket); _Where != end(_Bucket); ++_Where)
-          if (_Where->first == _Keyval)
-            return _Where;
-        return (end());
+        return _map.find(CacheKey{ key, hash });
       }
+
+      /// <summary>
+      /// Inserts a new key, which must not already exist in the map
+      /// </summary>
+      iterator emplace(const std::wstring_view& key, size_t hash, Val&& value)
+      {
+        std::unique_ptr<wchar_t[]> keyData(new wchar_t[key.size()]);
+        std::copy(key.begin(), key.end(), keyData.get());
+        const auto keyView = std::wstring_view(keyData.get(), key.size());
+        return _map.emplace(
+          CacheKey{ keyView, hash },
+          Entry{ std::move(keyData), std::forward<Val>(value) }).first;
+      }
+
+      iterator erase(const_iterator where) { return _map.erase(where); }
+
+      iterator begin() { return _map.begin(); }
+      iterator end() { return _map.end(); }
+      const_iterator begin() const { return _map.begin(); }
+      const_iterator end() const { return _map.end(); }
+      size_t size() const { return _map.size(); }
+
+    private:
+      map_type _map;
     };
 
     template<typename TObj>
@@ -87,25 +173,67 @@ namespace xloil
       size_t _calcId;
       std::vector<TObj> _objects;
       TObj _obj;
+      size_t _bytes;
+      // Written by fetch under a shared lock, so must be atomic
+      mutable std::atomic<size_t> _lastUsed;
 
     public:
-      CellCache(TObj&& obj, size_t calcId)
+      CellCache(TObj&& obj, size_t calcId, size_t bytes)
         : _calcId(calcId)
         , _obj(std::move(obj))
+        , _bytes(bytes)
+        , _lastUsed(calcId)
+      {}
+
+      CellCache(CellCache&& that) noexcept
+        : _calcId(that._calcId)
+        , _objects(std::move(that._objects))
+        , _obj(std::move(that._obj))
+        , _bytes(that._bytes)
+        , _lastUsed(that._lastUsed.load(std::memory_order_relaxed))
+        , slot(that.slot)
+        , generation(that.generation)
       {}
 
+      /// Slot and generation when the cache uses compact keys
+      uint32_t slot = 0;
+      uint32_t generation = 0;
+
       auto count() const { return (uint16_t)(_objects.size() + 1); }
 
-      auto add(TObj&& obj, size_t calcId)
+      /// <summary>
+      /// Estimated memory held by the objects in this cell
+      /// </summary>
+      size_t bytes() const { return _bytes; }
+
+      /// <summary>
+      /// The calcId when the cell was last added to or fetched
+      /// </summary>
+      size_t lastUsed() const { return _lastUsed.load(std::memory_order_relaxed); }
+
+      void touch(size_t calcId) const
+      {
+        // Avoid writing to a cache line shared between calc threads 
+        // if nothing has changed
+        if (_lastUsed.load(std::memory_order_relaxed) != calcId)
+          _lastUsed.store(calcId, std::memory_order_relaxed);
+      }
+
+      auto add(TObj&& obj, size_t calcId, size_t bytes)
       {
         if (_calcId != calcId)
         {
           std::swap(_obj, obj);
           _calcId = calcId;
           _objects.clear();
+          _bytes = bytes;
         }
         else
+        {
           _objects.emplace_back(std::forward<TObj>(obj));
+          _bytes += bytes;
+        }
+        touch(calcId);
         return _objects.size();
       }
 
@@ -119,6 +247,13 @@ namespace xloil
           return nullptr;
       }
     };
+
+    template<class T, class = void>
+    struct UsesCompactKeys : std::false_type {};
+
+    template<class T>
+    struct UsesCompactKeys<T, std::void_t<decltype(T::compactKeys)>>
+      : std::bool_constant<T::compactKeys> {};
   }
 
   /// <summary>
@@ -134,6 +269,23 @@ namespace xloil
   /// during lookup. The uniquifier should be choosen to be unlikely to occur 
   /// at the start of a string before a '['.
   /// 
+  /// The cache is split into shards, selected by the hash of the key, 
+  /// each with its own reader-writer lock, so that multithreaded recalc
+  /// can add and fetch in parallel. Fetches only take a shared lock so 
+  /// never block one another.
+  /// 
+  /// A byte budget can be set with <see cref="setBudget"/>. When an add takes
+  /// the estimated resident size, given by CacheObjectSize<TObj>, over 
+  /// budget, entries not added or fetched for a number of calc cycles are
+  /// evicted by sweeping the shards in turn, CLOCK-style. Recently used
+  /// entries are never evicted, so the budget is a soft limit.
+  /// 
+  /// If TUniquifier declares <code>static constexpr bool compactKeys = true</code>,
+  /// reference strings additionally embed a slot index and generation
+  /// counter before the ",X" suffix. Fetching then indexes the slot directly
+  /// and validates the generation and key rather than hashing the reference
+  /// string and searching the map.
+  /// 
   /// Example
   /// -------
   /// <code>
@@ -147,21 +299,75 @@ namespace xloil
   template<class TObj, class TUniquifier>
   class ObjectCache
   {
+  public:
+    typedef detail::CellCache<TObj> CellCache;
+
   private:
     typedef ObjectCache<TObj, TUniquifier> self;
-    typedef detail::CellCache<TObj> CellCache;
+    typedef detail::Lookup<CellCache> Lookup;
 
-    detail::Lookup<CellCache> _cache;
-    mutable std::mutex _cacheLock;
+    static constexpr size_t SHARD_BITS = 6;
+    static constexpr bool COMPACT_KEYS = detail::UsesCompactKeys<TUniquifier>::value;
 
-    size_t _calcId;
+    /// <summary>
+    /// Compact keys encode 14 bits per character, offset into the CJK block 
+    /// so the characters are printable. The slot and generation take two
+    /// characters each.
+    /// </summary>
+    static constexpr wchar_t SLOT_CHAR_BASE = L'\x4E00';
+    static constexpr uint32_t SLOT_CHAR_BITS = 14;
+    static constexpr uint32_t SLOT_MASK = (1u << (2 * SLOT_CHAR_BITS)) - 1;
+    static constexpr uint16_t SLOT_CHARS = COMPACT_KEYS ? 4 : 0;
+
+    struct Slot
+    {
+      CellCache* cell;
+      std::wstring_view key;
+      uint32_t generation;
+    };
+
+    struct Shard
+    {
+      Lookup cache;
+      std::vector<Slot> slots;
+      std::vector<uint32_t> freeSlots;
+      mutable std::shared_mutex lock;
+      // Counters are per-shard to avoid contention between calc threads
+      mutable std::atomic<size_t> hits{ 0 };
+      mutable std::atomic<size_t> misses{ 0 };
+      std::atomic<size_t> evictions{ 0 };
+    };
+    std::array<Shard, 1u << SHARD_BITS> _shards;
+
+    // Only written by the AfterCalculate event, but read on calc threads
+    std::atomic<size_t> _calcId;
+
+    std::atomic<size_t> _residentBytes{ 0 };
+    std::atomic<size_t> _maxBytes{ 0 };
+    std::atomic<size_t> _minIdleCalcs{ 2 };
+    std::mutex _evictLock;
+    size_t _clockHand = 0;
+
+    /// <summary>
+    /// Selects the shard using the top bits of the hash, as the lower
+    /// bits select the bucket within each shard's map
+    /// </summary>
+    Shard& shard(size_t hash)
+    {
+      return _shards[hash >> (std::numeric_limits<size_t>::digits - SHARD_BITS)];
+    }
+    const Shard& shard(size_t hash) const
+    {
+      return _shards[hash >> (std::numeric_limits<size_t>::digits - SHARD_BITS)];
+    }
 
     std::shared_ptr<const void> _calcEndHandler;
     std::shared_ptr<const void> _workbookCloseHandler;
 
     void onAfterCalculate()
     {
-      // Called by Excel event so will always be synchonised
+      // Called by Excel event so will always be synchonised with other
+      // writes, but calc threads may be reading
       ++_calcId; // Wraps at MAX_UINT - but this doesn't matter
     }
 
@@ -170,6 +376,12 @@ namespace xloil
     /// </summary>
     static constexpr uint8_t PADDING = 2;
 
+    /// <summary>
+    /// Number of characters after the cell key: the slot, if using compact
+    /// keys, then ",X"
+    /// </summary>
+    static constexpr uint16_t KEY_SUFFIX = PADDING + SLOT_CHARS;
+
     TUniquifier _uniquifier;
 
     ObjectCache()
@@ -192,17 +404,82 @@ namespace xloil
 
     const TObj* fetch(const std::wstring_view& key) const
     {
-      if (key.size() < PADDING) return nullptr;
+      if (key.size() < KEY_SUFFIX) return nullptr;
 
       const auto iResult = readCount(key[key.size() - 1]);
-      const auto cacheKey = key.substr(0, key.size() - PADDING);
 
-      std::scoped_lock lock(_cacheLock);
-      const auto found = _cache.search(cacheKey);
+      if constexpr (COMPACT_KEYS)
+      {
+        uint32_t slot, generation;
+        if (!readSlot(key.data() + key.size() - KEY_SUFFIX, slot, generation))
+        {
+          ++_shards[0].misses;
+          return nullptr;
+        }
+
+        const auto& cacheShard = _shards[slot & ((1u << SHARD_BITS) - 1)];
+        const auto iSlot = slot >> SHARD_BITS;
+
+        std::shared_lock lock(cacheShard.lock);
+        // The generation rejects stale references to a recycled slot. We
+        // also compare the key, as a reference saved in a workbook from 
+        // a previous session could match another cell's slot and generation.
+        const auto* found = iSlot < cacheShard.slots.size() ? &cacheShard.slots[iSlot] : nullptr;
+        if (found && found->cell && found->generation == generation
+          && found->key == key.substr(0, key.size() - KEY_SUFFIX))
+        {
+          return fetched(cacheShard, *found->cell, iResult);
+        }
+        ++cacheShard.misses;
+        return nullptr;
+      }
+      else
+      {
+        const auto cacheKey = key.substr(0, key.size() - KEY_SUFFIX);
+        const auto hash = Lookup::hash(cacheKey);
+        const auto& cacheShard = shard(hash);
+
+        std::shared_lock lock(cacheShard.lock);
+        const auto found = cacheShard.cache.search(cacheKey, hash);
+        if (found == cacheShard.cache.end())
+        {
+          ++cacheShard.misses;
+          return nullptr;
+        }
+        return fetched(cacheShard, found->second.value, iResult);
+      }
+    }
+
+    /// <summary>
+    /// Sets a soft limit on the estimated memory held by the cache. When 
+    /// exceeded, entries which have not been added to or fetched for at
+    /// least <paramref name="minIdleCalcs"/> calc cycles are evicted until
+    /// usage is 10% below the budget. Object sizes are only estimated whilst
+    /// a budget is set, so objects added before then count as zero bytes.
+    /// </summary>
+    /// <param name="maxBytes">Budget in bytes, zero means unlimited</param>
+    /// <param name="minIdleCalcs">Minimum number of calc cycles, at least 1,
+    /// since an entry was used before it can be evicted</param>
+    void setBudget(size_t maxBytes, size_t minIdleCalcs = 2)
+    {
+      _maxBytes = maxBytes;
+      _minIdleCalcs = std::max<size_t>(1, minIdleCalcs);
+      enforceBudget();
+    }
 
-      return found == _cache.end()
-        ? nullptr
-        : found->second.fetch(iResult);
+    ObjectCacheStats stats() const
+    {
+      ObjectCacheStats result;
+      for (auto& cacheShard : _shards)
+      {
+        result.hits += cacheShard.hits;
+        result.misses += cacheShard.misses;
+        result.evictions += cacheShard.evictions;
+        std::shared_lock lock(cacheShard.lock);
+        result.keys += cacheShard.cache.size();
+      }
+      result.residentBytes = _residentBytes;
+      return result;
     }
 
     ExcelObj add(
@@ -210,7 +487,7 @@ namespace xloil
       const CallerInfo& caller = CallerInfo(),
       const std::wstring_view& name = std::wstring_view())
     {
-      auto fullKey = detail::writeCacheId<PADDING>(caller, name);
+      auto fullKey = detail::writeCacheId<KEY_SUFFIX>(caller, name);
       return _add(std::move(obj), std::move(fullKey));
     }
 
@@ -218,7 +495,7 @@ namespace xloil
       TObj&& obj,
       const std::wstring_view& key)
     {
-      PString fullKey((uint16_t)key.size() + PADDING + 2u);
+      PString fullKey((uint16_t)key.size() + KEY_SUFFIX + 2u);
       std::copy(key.cbegin(), key.cend(), fullKey.begin() + 2u);
       return _add(std::move(obj), std::move(fullKey));
     }
@@ -233,55 +510,75 @@ namespace xloil
     /// <returns>true if removal succeeded, otherwise false</returns>
     bool erase(const std::wstring_view& key)
     {
-      auto cacheKey = key.substr(0, key.length() - PADDING);
+      if (key.size() < KEY_SUFFIX) return false;
+
+      auto cacheKey = key.substr(0, key.length() - KEY_SUFFIX);
+      const auto hash = Lookup::hash(cacheKey);
+      auto& cacheShard = shard(hash);
 
-      std::scoped_lock lock(_cacheLock);
-      auto found = _cache.search(cacheKey);
-      if (found == _cache.end())
+      std::unique_lock lock(cacheShard.lock);
+      auto found = cacheShard.cache.search(cacheKey, hash);
+      if (found == cacheShard.cache.end())
         return false;
-      _cache.erase(found);
+      eraseEntry(cacheShard, found);
       return true;
     }
 
     void onWorkbookClose(const wchar_t* wbName)
     {
-      // Called by Excel Event so will always be synchonised
       const auto len = wcslen(wbName);
-      auto i = _cache.begin();
-      while (i != _cache.end())
+      for (auto& cacheShard : _shards)
       {
-        // Key looks like UNIQ[WbName]BlahBlah, so skip 2 chars and check for match
-        if (wcsncmp(wbName, i->first.c_str() + 2, len) == 0)
-          i = _cache.erase(i);
-        else
-          ++i;
+        std::unique_lock lock(cacheShard.lock);
+        auto i = cacheShard.cache.begin();
+        while (i != cacheShard.cache.end())
+        {
+          // Key looks like UNIQ[WbName]BlahBlah, so skip 2 chars and check for match
+          const auto& key = i->first.str;
+          if (key.size() >= len + 2 && wcsncmp(wbName, key.data() + 2, len) == 0)
+            i = eraseEntry(cacheShard, i);
+          else
+            ++i;
+        }
       }
     }
 
-    auto begin() const
-    {
-      return _cache.cbegin();
-    }
-
-    auto end() const
+    /// <summary>
+    /// Calls <code>func(const std::wstring_view& key, const CellCache& objects)</code>
+    /// for every key in the cache. Each shard is locked whilst its keys are 
+    /// visited, so <paramref name="func"/> must not modify the cache.
+    /// </summary>
+    template<class TFunc>
+    void forEach(TFunc&& func) const
     {
-      return _cache.cend();
+      for (auto& cacheShard : _shards)
+      {
+        std::shared_lock lock(cacheShard.lock);
+        for (auto& [key, entry] : cacheShard.cache)
+          func(key.str, entry.value);
+      }
     }
 
+    /// <summary>
+    /// Writes the reference string for the i-th object in a cell, given 
+    /// the key and CellCache passed to a <see cref="forEach"/> callback
+    /// </summary>
     std::wstring writeKey(
       const std::wstring_view& cacheKey,
+      const CellCache& cell,
       uint16_t count) const
     {
-      std::wstring key;
-      key.resize(cacheKey.length() + PADDING);
-      key = cacheKey;
-      writeCount(key.data() + cacheKey.length(), count);
+      std::wstring key(cacheKey.length() + KEY_SUFFIX, L'\0');
+      std::copy(cacheKey.begin(), cacheKey.end(), key.begin());
+      if constexpr (COMPACT_KEYS)
+        writeSlot(key.data() + cacheKey.length(), cell.slot, cell.generation);
+      writeCount(key.data() + key.length() - PADDING, count);
       return key;
     }
 
     bool valid(const std::wstring_view& cacheString)
     {
-      return cacheString.size() > 4
+      return cacheString.size() > 4 + SLOT_CHARS
         && cacheString[0] == _uniquifier.value
         && cacheString[1] == L'['
         && cacheString[cacheString.length() - PADDING] == L',';
@@ -297,34 +594,177 @@ namespace xloil
       // not a worksheet function or a custom cache string is used
       fullKey[1] = L'[';
 
-      auto cacheKey = fullKey.view(0, fullKey.length() - PADDING);
-
-      decltype(_cache)::iterator found;
+      auto cacheKey = fullKey.view(0, fullKey.length() - KEY_SUFFIX);
+      const auto hash = Lookup::hash(cacheKey);
+      auto& cacheShard = shard(hash);
+      const auto calcId = _calcId.load(std::memory_order_relaxed);
+      // Sizing can walk a whole array, so is skipped unless there is a budget
+      const auto objBytes = _maxBytes.load(std::memory_order_relaxed) > 0
+        ? CacheObjectSize<TObj>()(obj) : 0;
 
       uint16_t iPos = 0;
+      uint32_t slot = 0, generation = 0;
       {
-        std::scoped_lock lock(_cacheLock);
+        std::unique_lock lock(cacheShard.lock);
 
-        found = _cache.search(cacheKey);
-        if (found == _cache.end())
+        auto found = cacheShard.cache.search(cacheKey, hash);
+        if (found == cacheShard.cache.end())
         {
-          found = _cache.emplace(
-            std::pair(
-              std::wstring(cacheKey),
-              CellCache(std::forward<TObj>(obj), _calcId))).first;
+          found = cacheShard.cache.emplace(cacheKey, hash,
+            CellCache(std::forward<TObj>(obj), calcId, objBytes));
+          if constexpr (COMPACT_KEYS)
+            assignSlot(cacheShard, found->first.str, found->second.value);
+          _residentBytes += objBytes;
         }
         else
         {
-          iPos = (uint16_t)found->second.add(
-            std::forward<TObj>(obj), _calcId);
+          auto& cell = found->second.value;
+          const auto before = cell.bytes();
+          iPos = (uint16_t)cell.add(std::forward<TObj>(obj), calcId, objBytes);
+          // Unsigned arithmetic wraps correctly if the cell shrank
+          _residentBytes += cell.bytes() - before;
         }
+        slot = found->second.value.slot;
+        generation = found->second.value.generation;
       }
 
+      enforceBudget();
+
+      if constexpr (COMPACT_KEYS)
+        writeSlot(fullKey.end() - KEY_SUFFIX, slot, generation);
       writeCount(fullKey.end() - PADDING, iPos);
 
       return ExcelObj(std::move(fullKey));
     }
 
+    /// <summary>
+    /// Gives the cell a slot, recycling a free one if possible. The shard 
+    /// index is stored in the low bits of the slot number. Called with the
+    /// shard lock held.
+    /// </summary>
+    void assignSlot(Shard& cacheShard, const std::wstring_view& key, CellCache& cell)
+    {
+      uint32_t iSlot;
+      if (!cacheShard.freeSlots.empty())
+      {
+        iSlot = cacheShard.freeSlots.back();
+        cacheShard.freeSlots.pop_back();
+      }
+      else
+      {
+        iSlot = (uint32_t)cacheShard.slots.size();
+        if ((((size_t)iSlot + 1) << SHARD_BITS) > SLOT_MASK)
+          XLO_THROW("Object cache slots exhausted");
+        cacheShard.slots.push_back(Slot{ nullptr, std::wstring_view(), 0 });
+      }
+      auto& entry = cacheShard.slots[iSlot];
+      entry.cell = &cell;
+      entry.key = key;
+      entry.generation = (entry.generation + 1) & SLOT_MASK;
+      cell.slot = (iSlot << SHARD_BITS) | (uint32_t)(&cacheShard - _shards.data());
+      cell.generation = entry.generation;
+    }
+
+    const TObj* fetched(const Shard& cacheShard, const CellCache& cell, size_t i) const
+    {
+      auto result = cell.fetch(i);
+      if (result)
+      {
+        ++cacheShard.hits;
+        cell.touch(_calcId.load(std::memory_order_relaxed));
+      }
+      else
+        ++cacheShard.misses;
+      return result;
+    }
+
+    /// <summary>
+    /// If over budget, sweeps shards from the clock hand onwards, evicting
+    /// idle entries until 10% under budget. Only one thread sweeps at a 
+    /// time: others continue without waiting.
+    /// </summary>
+    void enforceBudget()
+    {
+      const auto maxBytes = _maxBytes.load(std::memory_order_relaxed);
+      if (maxBytes == 0 || _residentBytes.load(std::memory_order_relaxed) <= maxBytes)
+        return;
+
+      std::unique_lock evictLock(_evictLock, std::try_to_lock);
+      if (!evictLock)
+        return;
+
+      const auto target = maxBytes - maxBytes / 10;
+      const auto calcId = _calcId.load();
+      const auto minIdle = _minIdleCalcs.load();
+
+      for (size_t n = 0; n < _shards.size() && _residentBytes > target; ++n)
+      {
+        auto& cacheShard = _shards[_clockHand++ % _shards.size()];
+        // Evicted objects are destroyed after the shard lock is released, 
+        // as their destructors may re-enter the cache, e.g. Python's __del__
+        std::vector<CellCache> evicted;
+        std::unique_lock lock(cacheShard.lock);
+        auto i = cacheShard.cache.begin();
+        while (i != cacheShard.cache.end())
+        {
+          // Unsigned arithmetic handles wrapping of the calcId
+          if (calcId - i->second.value.lastUsed() >= minIdle)
+          {
+            i = eraseEntry(cacheShard, i, &evicted);
+            ++cacheShard.evictions;
+          }
+          else
+            ++i;
+        }
+        lock.unlock();
+      }
+    }
+
+    /// <summary>
+    /// Removes an entry and releases its slot. Called with the shard lock held.
+    /// If <paramref name="evicted"/> is given, the entry's objects are moved
+    /// there rather than destroyed.
+    /// </summary>
+    typename Lookup::iterator eraseEntry(
+      Shard& cacheShard, typename Lookup::iterator where,
+      std::vector<CellCache>* evicted = nullptr)
+    {
+      _residentBytes -= where->second.value.bytes();
+      if constexpr (COMPACT_KEYS)
+      {
+        const auto iSlot = where->second.value.slot >> SHARD_BITS;
+        cacheShard.slots[iSlot].cell = nullptr;
+        cacheShard.slots[iSlot].key = std::wstring_view();
+        cacheShard.freeSlots.push_back(iSlot);
+      }
+      if (evicted)
+        evicted->emplace_back(std::move(where->second.value));
+      return cacheShard.cache.erase(where);
+    }
+
+    static void writeSlot(wchar_t* key, uint32_t slot, uint32_t generation)
+    {
+      constexpr uint32_t mask = (1u << SLOT_CHAR_BITS) - 1;
+      key[0] = SLOT_CHAR_BASE + (wchar_t)(slot >> SLOT_CHAR_BITS);
+      key[1] = SLOT_CHAR_BASE + (wchar_t)(slot & mask);
+      key[2] = SLOT_CHAR_BASE + (wchar_t)(generation >> SLOT_CHAR_BITS);
+      key[3] = SLOT_CHAR_BASE + (wchar_t)(generation & mask);
+    }
+
+    static bool readSlot(const wchar_t* key, uint32_t& slot, uint32_t& generation)
+    {
+      uint32_t digits[4];
+      for (auto i = 0; i < 4; ++i)
+      {
+        digits[i] = (uint32_t)(key[i] - SLOT_CHAR_BASE);
+        if (digits[i] >= (1u << SLOT_CHAR_BITS))
+          return false;
+      }
+      slot = (digits[0] << SLOT_CHAR_BITS) | digits[1];
+      generation = (digits[2] << SLOT_CHAR_BITS) | digits[3];
+      return true;
+    }
+
     size_t readCount(wchar_t count) const
     {
       return (size_t)(count - 65);
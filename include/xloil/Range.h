@@ -1,6 +1,9 @@
 #pragma once
 #include <xlOil/ExcelObj.h>
 #include <xlOil/EnumHelper.h>
+#include <algorithm>
+#include <functional>
+#include <utility>
 
 namespace Excel { struct Range; }
 
@@ -156,10 +159,119 @@ namespace xloil
     /// </summary>
     virtual void clear() = 0;
 
+    /// <summary>
+    /// Reads the range in blocks of at most <paramref name="rowsPerBlock"/>
+    /// rows, so memory use is bounded by the block size rather than the
+    /// range size. The callback is passed the first row of each block,
+    /// relative to the range, and the block's value. It may return false
+    /// to stop reading.
+    /// </summary>
+    void readBlocks(
+      row_t rowsPerBlock,
+      const std::function<bool(row_t, const ExcelObj&)>& callback) const
+    {
+      if (rowsPerBlock == 0)
+        XLO_THROW("Rows per block must be positive");
+      row_t nRows; col_t nCols;
+      std::tie(nRows, nCols) = shape();
+      for (row_t i = 0; i < nRows; i += rowsPerBlock)
+      {
+        const auto n = std::min(rowsPerBlock, nRows - i);
+        if (!callback(i, range((int)i, 0, int(i + n - 1), int(nCols - 1))->value()))
+          return;
+      }
+    }
+
+    /// <summary>
+    /// Writes blocks of rows downwards from the top-left of the range. The
+    /// generator is called repeatedly to fill in the next block and returns
+    /// false when there are no more. Each block is written below the previous
+    /// one with the same shape as the block, so may extend beyond the range.
+    /// Only one block is held in memory at a time. Returns the number of rows
+    /// written: if writing fails, the rows before the failed block have
+    /// already been written.
+    /// </summary>
+    size_t writeBlocks(const std::function<bool(ExcelObj&)>& generator)
+    {
+      size_t row = 0;
+      ExcelObj block;
+      while (generator(block))
+      {
+        size_t n = 1, m = 1;
+        if (block.isType(ExcelType::Multi))
+        {
+          n = block.val.array.rows;
+          m = block.val.array.columns;
+        }
+        if (n > 0 && m > 0)
+          range((int)row, 0, int(row + n - 1), int(m - 1))->set(block);
+        row += n;
+        block.reset();
+      }
+      return row;
+    }
+
     /// <summary>
     /// Returns a pointer to the the underlying Excel API Range object
     /// if this Range is based on one, otherwise returns null.
     /// </summary>
     virtual Excel::Range* asComPtr() const = 0;
   };
+
+  namespace detail
+  {
+    /// <summary>
+    /// Number of cells read at a time by <see cref="trimmedExtent"/>
+    /// </summary>
+    constexpr size_t TRIM_BLOCK_CELLS = 1 << 14;
+  }
+
+  /// <summary>
+  /// Finds the number of rows and columns of a range after trimming to the
+  /// last non-empty row and column, without reading the whole range. Blocks
+  /// of about <paramref name="blockCells"/> cells are read backwards from
+  /// the last row until one contains a value, then the same is done for
+  /// columns, limited to the rows found. Columns before the last value
+  /// found in the row scan are known to be needed and are not read again.
+  ///
+  /// <paramref name="blockExtent"/> is called as <code>blockExtent(fromRow,
+  /// fromCol, nRows, nCols)</code> with coordinates relative to the range. It
+  /// should return the trimmed (rows, cols) of that block, or (0, 0) if it
+  /// is empty. Returns (0, 0) if the range is empty.
+  /// </summary>
+  template<class F>
+  std::pair<size_t, size_t> trimmedExtent(
+    size_t nRows, size_t nCols, F&& blockExtent,
+    size_t blockCells = detail::TRIM_BLOCK_CELLS)
+  {
+    if (nRows == 0 || nCols == 0)
+      return { 0, 0 };
+
+    size_t lastRow = 0, knownCols = 0;
+    const auto rowChunk = std::max<size_t>(1, blockCells / nCols);
+    for (auto end = nRows; end > 0 && lastRow == 0;)
+    {
+      const auto start = end > rowChunk ? end - rowChunk : 0;
+      const auto [rows, cols] = blockExtent(start, (size_t)0, end - start, nCols);
+      if (rows > 0)
+      {
+        lastRow = start + rows;
+        knownCols = cols;
+      }
+      end = start;
+    }
+    if (lastRow == 0)
+      return { 0, 0 };
+
+    const auto colChunk = std::max<size_t>(1, blockCells / lastRow);
+    for (auto end = nCols; end > knownCols;)
+    {
+      const auto start = std::max(knownCols, end > colChunk ? end - colChunk : 0);
+      const auto cols = blockExtent((size_t)0, start, lastRow, end - start).second;
+      if (cols > 0)
+        return { lastRow, start + cols };
+      end = start;
+    }
+    return { lastRow, knownCols };
+  }
 }
\ No newline at end of file
@@ -0,0 +1,24 @@
+#pragma once
+#include <chrono>
+
+namespace xloil
+{
+  /// <summary>
+  /// Controls how often an <see cref="IRtdServer"/> tells Excel that new values
+  /// are available. Values published whilst a topic is waiting to be delivered
+  /// replace the waiting value, so Excel only sees the latest one.
+  /// </summary>
+  struct RtdDeliveryPolicy
+  {
+    /// <summary>
+    /// Minimum time between UpdateNotify calls to Excel. Frequent notifications
+    /// cause Excel to call RefreshData repeatedly which makes the UI stutter.
+    /// </summary>
+    std::chrono::milliseconds notifyInterval{ 0 };
+    /// <summary>
+    /// Minimum time between deliveries of any single topic, i.e. the inverse
+    /// of the maximum update rate per topic.
+    /// </summary>
+    std::chrono::milliseconds topicInterval{ 0 };
+  };
+}
@@ -1,8 +1,10 @@
 #pragma once
 #include <xlOil/ExcelObj.h>
 #include <xlOil/ExportMacro.h>
+#include <xlOil/RtdDeliveryPolicy.h>
 #include <memory>
 #include <future>
+#include <chrono>
 
 namespace xloil
 {
@@ -254,6 +256,23 @@ namespace xloil
   };
   
 
+  /// <summary>
+  /// Counters describing the values passed through an <see cref="IRtdServer"/>
+  /// </summary>
+  struct RtdServerStats
+  {
+    /// Values published to the server
+    size_t published = 0;
+    /// Values replaced by a later value for the same topic before delivery
+    size_t coalesced = 0;
+    /// Topic deliveries delayed by the per-topic interval
+    size_t throttled = 0;
+    /// Values discarded because the topic had no publisher or subscribers
+    size_t dropped = 0;
+    /// Batches of updated topics sent to Excel
+    size_t notifies = 0;
+  };
+
   /// <summary>
   /// An IRtdServer is a wrapper around an RTD COM Server. An RTD Server is a
   /// producer/consumer queue which can trigger recalculations in cells marked
@@ -372,6 +391,17 @@ namespace xloil
     /// <returns></returns>
     virtual const wchar_t* progId() const noexcept = 0;
 
+    /// <summary>
+    /// Sets the policy which limits how often new values are delivered to
+    /// Excel. Takes effect from the next published value.
+    /// </summary>
+    virtual void setDeliveryPolicy(const RtdDeliveryPolicy& policy) = 0;
+
+    /// <summary>
+    /// Returns counters of the values passed through the server
+    /// </summary>
+    virtual RtdServerStats stats() const = 0;
+
     /// <summary>
     /// Initiates a connect as if Excel has requested the topic.  Will 
     /// conflict if Excel uses the topicID.  Used only for testing and 
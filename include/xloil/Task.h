@@ -0,0 +1,554 @@
+#pragma once
+#include <xloil/ExportMacro.h>
+#include <xloil/ExcelObj.h>
+#include <xloil/RtdServer.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <exception>
+#include <stdexcept>
+#include <atomic>
+#include <vector>
+#include <future>
+#include <string>
+#include <type_traits>
+
+namespace xloil
+{
+  /// <summary>
+  /// A pool of worker threads which run posted jobs. Each worker has its own
+  /// queue: a job posted from a worker goes on the back of that worker's
+  /// queue and is run last-in-first-out, so continuations run whilst their
+  /// inputs are still in cache. Jobs posted from other threads are spread
+  /// over the queues. An idle worker steals from the front of the other
+  /// queues before it sleeps.
+  ///
+  /// Jobs should not block waiting for other jobs: use <see cref="Task::then"/>
+  /// to chain work rather than <see cref="Task::get"/>.
+  /// </summary>
+  class XLOIL_EXPORT TaskExecutor
+  {
+    struct Impl;
+
+  public:
+    /// <summary>
+    /// Starts the given number of worker threads, or one per hardware thread
+    /// if zero.
+    /// </summary>
+    explicit TaskExecutor(size_t nThreads = 0);
+
+    /// <summary>
+    /// Runs any jobs left in the queues, then joins the worker threads
+    /// </summary>
+    ~TaskExecutor();
+
+    TaskExecutor(const TaskExecutor&) = delete;
+    TaskExecutor& operator=(const TaskExecutor&) = delete;
+
+    /// <summary>
+    /// Queues a job. Safe to call from any thread, including a worker.
+    /// Exceptions thrown by the job are logged and discarded. Throws if the
+    /// executor is being destroyed, unless called from one of its workers:
+    /// jobs posted by jobs are run before the executor stops.
+    /// </summary>
+    void post(std::function<void()>&& job);
+
+    /// <summary>
+    /// A weak reference to an executor, for posting jobs from continuations
+    /// which may run after the executor has been destroyed
+    /// </summary>
+    class XLOIL_EXPORT Ref
+    {
+    public:
+      /// <summary>
+      /// Queues a job, returning false if the executor is being or has been
+      /// destroyed
+      /// </summary>
+      bool post(std::function<void()>&& job) const;
+
+    private:
+      friend class TaskExecutor;
+      std::weak_ptr<Impl> _impl;
+    };
+
+    Ref ref() const;
+
+    size_t nThreads() const;
+
+    /// <summary>
+    /// Number of jobs which have been run by a worker other than the one
+    /// whose queue they were posted to.
+    /// </summary>
+    size_t nStolen() const;
+
+    /// <summary>
+    /// The executor used by default for tasks. It is created on first use
+    /// and stopped when xlOil closes, so a reference to it should not be
+    /// held beyond that. Throws once the executor has been stopped.
+    /// </summary>
+    static TaskExecutor& shared();
+
+  private:
+    std::shared_ptr<Impl> _impl;
+  };
+
+  /// <summary>
+  /// The exception held by a task which was cancelled before it ran
+  /// </summary>
+  class TaskCancelled : public std::runtime_error
+  {
+  public:
+    TaskCancelled() : std::runtime_error("Task cancelled") {}
+  };
+
+  /// <summary>
+  /// A shared cancellation flag. Copies refer to the same flag. Tasks check
+  /// the flag before they start; long-running jobs should also check it
+  /// periodically and return early once it is set.
+  /// </summary>
+  class CancellationToken
+  {
+  public:
+    CancellationToken()
+      : _flag(std::make_shared<std::atomic<bool>>(false))
+    {}
+
+    bool cancelled() const noexcept
+    {
+      return _flag->load(std::memory_order_relaxed);
+    }
+    void cancel() const noexcept
+    {
+      _flag->store(true, std::memory_order_relaxed);
+    }
+    void throwIfCancelled() const
+    {
+      if (cancelled())
+        throw TaskCancelled();
+    }
+    bool operator==(const CancellationToken& that) const
+    {
+      return _flag == that._flag;
+    }
+
+  private:
+    std::shared_ptr<std::atomic<bool>> _flag;
+  };
+
+  /// <summary>
+  /// Returns a token which is cancelled when Excel cancels the current
+  /// calculation, for example when the user presses Esc or edits a cell.
+  /// A fresh token is issued after each cancellation, so the token should
+  /// be fetched when the calculation starts a task.
+  /// </summary>
+  XLOIL_EXPORT CancellationToken calcCancellationToken();
+
+  template<class T> class Task;
+  template<class T> class TaskSource;
+
+  namespace detail
+  {
+    template<class T>
+    struct TaskState
+    {
+      TaskState(const CancellationToken& t) : token(t) {}
+
+      std::mutex lock;
+      std::condition_variable signal;
+      std::optional<T> value;
+      std::exception_ptr error;
+      bool done = false;
+      std::vector<std::function<void()>> continuations;
+      CancellationToken token;
+
+      template<class TSetter>
+      void complete(TSetter&& setter)
+      {
+        decltype(continuations) toRun;
+        {
+          std::scoped_lock l(lock);
+          if (done)
+            return;
+          setter();
+          done = true;
+          std::swap(toRun, continuations);
+        }
+        signal.notify_all();
+        for (auto& f : toRun)
+          f();
+      }
+
+      void onComplete(std::function<void()>&& func)
+      {
+        {
+          std::scoped_lock l(lock);
+          if (!done)
+          {
+            continuations.emplace_back(std::move(func));
+            return;
+          }
+        }
+        func();
+      }
+    };
+
+    template<class T> struct TaskResult { using type = T; static constexpr bool isTask = false; };
+    template<class T> struct TaskResult<Task<T>> { using type = T; static constexpr bool isTask = true; };
+  }
+
+  /// <summary>
+  /// The result of asynchronous work: a value of type T or an exception,
+  /// available once the task completes. Copies refer to the same result.
+  ///
+  /// Work is chained with <see cref="then"/>, which runs a function on the
+  /// executor when this task completes, without holding a thread whilst it
+  /// waits. Use <see cref="spawn"/> to start a task and <see cref="TaskSource"/>
+  /// to complete one from a callback-based API.
+  /// </summary>
+  template<class T>
+  class Task
+  {
+    static_assert(!std::is_void_v<T>, "Task<void> is not supported, return a value");
+
+  public:
+    using value_type = T;
+
+    /// <summary>
+    /// Constructs an invalid task with no result
+    /// </summary>
+    Task() {}
+
+    bool valid() const { return (bool)_state; }
+
+    bool ready() const
+    {
+      std::scoped_lock lock(_state->lock);
+      return _state->done;
+    }
+
+    void wait() const
+    {
+      std::unique_lock lock(_state->lock);
+      _state->signal.wait(lock, [&]() { return _state->done; });
+    }
+
+    /// <summary>
+    /// Waits for the task to complete then returns its value or rethrows its
+    /// exception. The reference is valid as long as a copy of the task exists.
+    /// </summary>
+    const T& get() const
+    {
+      wait();
+      if (_state->error)
+        std::rethrow_exception(_state->error);
+      return *_state->value;
+    }
+
+    /// <summary>
+    /// Returns the exception held by a completed task, or null
+    /// </summary>
+    std::exception_ptr exception() const
+    {
+      std::scoped_lock lock(_state->lock);
+      return _state->error;
+    }
+
+    const CancellationToken& token() const { return _state->token; }
+
+    /// <summary>
+    /// Calls <paramref name="func"/>() once the task completes, immediately
+    /// if it already has. The function runs on the completing thread so it
+    /// should be quick.
+    /// </summary>
+    template<class F>
+    void onComplete(F&& func) const
+    {
+      _state->onComplete(std::forward<F>(func));
+    }
+
+    /// <summary>
+    /// Returns a task which runs <paramref name="func"/>(value) on the executor
+    /// once this task completes. If <paramref name="func"/> returns a task, the
+    /// returned task completes when that one does. An exception in this task
+    /// passes to the returned task without calling <paramref name="func"/>.
+    /// If the executor has been destroyed by then, the returned task holds 
+    /// <see cref="TaskCancelled"/>. The returned task shares this task's
+    /// cancellation token.
+    /// </summary>
+    template<class F>
+    auto then(F&& func, TaskExecutor& executor = TaskExecutor::shared()) const;
+
+  private:
+    friend class TaskSource<T>;
+    Task(const std::shared_ptr<detail::TaskState<T>>& state)
+      : _state(state)
+    {}
+    std::shared_ptr<detail::TaskState<T>> _state;
+  };
+
+  /// <summary>
+  /// The producer side of a <see cref="Task"/>, analogous to std::promise. Only
+  /// the first value or exception set is kept. Copies refer to the same task.
+  /// </summary>
+  template<class T>
+  class TaskSource
+  {
+  public:
+    TaskSource(const CancellationToken& token = CancellationToken())
+      : _state(std::make_shared<detail::TaskState<T>>(token))
+    {}
+
+    Task<T> task() const { return Task<T>(_state); }
+
+    const CancellationToken& token() const { return _state->token; }
+
+    template<class V>
+    void setValue(V&& value) const
+    {
+      _state->complete([&]() { _state->value.emplace(std::forward<V>(value)); });
+    }
+
+    void setException(const std::exception_ptr& error) const
+    {
+      _state->complete([&]() { _state->error = error; });
+    }
+
+    /// <summary>
+    /// Completes with the result of another task, which must be complete
+    /// </summary>
+    void setFrom(const Task<T>& that) const
+    {
+      auto error = that.exception();
+      if (error)
+        setException(error);
+      else
+        setValue(that.get());
+    }
+
+  private:
+    std::shared_ptr<detail::TaskState<T>> _state;
+  };
+
+  namespace detail
+  {
+    /// <summary>
+    /// Completes <paramref name="target"/> with the result of func(), unless
+    /// its token is cancelled. If func returns a task, target completes with
+    /// that task.
+    /// </summary>
+    template<class T, class F>
+    void runTask(const TaskSource<T>& target, F&& func) noexcept
+    {
+      try
+      {
+        target.token().throwIfCancelled();
+        if constexpr (TaskResult<std::invoke_result_t<F>>::isTask)
+        {
+          auto inner = func();
+          inner.onComplete([inner, target]() { target.setFrom(inner); });
+        }
+        else
+          target.setValue(func());
+      }
+      catch (...)
+      {
+        target.setException(std::current_exception());
+      }
+    }
+
+    template<class F>
+    auto invokeWithToken(F& func, const CancellationToken& token)
+    {
+      if constexpr (std::is_invocable_v<F&, const CancellationToken&>)
+        return func(token);
+      else
+        return func();
+    }
+  }
+
+  template<class T>
+  template<class F>
+  auto Task<T>::then(F&& func, TaskExecutor& executor) const
+  {
+    using Result = typename detail::TaskResult<std::invoke_result_t<F&, const T&>>::type;
+    TaskSource<Result> next(token());
+    onComplete([prev = *this, next, ex = executor.ref(), func = std::forward<F>(func)]() mutable
+    {
+      auto error = prev.exception();
+      if (error)
+        next.setException(error);
+      else if (!ex.post([prev, next, func = std::move(func)]() mutable
+        {
+          detail::runTask(next, [&]() { return func(prev.get()); });
+        }))
+        next.setException(std::make_exception_ptr(TaskCancelled()));
+    });
+    return next.task();
+  }
+
+  /// <summary>
+  /// Runs <paramref name="func"/> on the executor and returns a task for its
+  /// result. The function may take a <see cref="CancellationToken"/> to poll
+  /// whilst it runs. If it returns a task, the returned task completes when
+  /// that one does. If the token is cancelled before the function starts,
+  /// the function is not called and the task holds <see cref="TaskCancelled"/>.
+  /// </summary>
+  template<class F>
+  auto spawn(
+    F&& func,
+    const CancellationToken& token = CancellationToken(),
+    TaskExecutor& executor = TaskExecutor::shared())
+  {
+    using Result = typename detail::TaskResult<
+      decltype(detail::invokeWithToken(func, token))>::type;
+    TaskSource<Result> source(token);
+    executor.post([source, func = std::forward<F>(func)]() mutable
+    {
+      detail::runTask(source, [&]()
+      {
+        return detail::invokeWithToken(func, source.token());
+      });
+    });
+    return source.task();
+  }
+
+  /// <summary>
+  /// Returns a task which has already completed with the given value
+  /// </summary>
+  template<class T>
+  Task<std::decay_t<T>> makeReadyTask(T&& value)
+  {
+    TaskSource<std::decay_t<T>> source;
+    source.setValue(std::forward<T>(value));
+    return source.task();
+  }
+
+  /// <summary>
+  /// Returns the result of a task to an XLL async function via
+  /// <see cref="asyncReturn"/> when it completes. An exception is returned
+  /// as its error string. If the task is cancelled because Excel cancelled 
+  /// the calculation, nothing is returned since Excel has already abandoned
+  /// the call; a task cancelled for any other reason returns #N/A.
+  ///
+  /// Pass <see cref="calcCancellationToken"/> when creating the task so it
+  /// is cancelled along with the calculation:
+  /// <code>
+  ///   XLO_ENTRY_POINT(void) myFunc(const AsyncHandle& handle, const ExcelObj& x)
+  ///   {
+  ///     asyncReturn(handle, spawn([x]() { return ExcelObj(...); },
+  ///       calcCancellationToken()));
+  ///   }
+  /// </code>
+  /// </summary>
+  XLOIL_EXPORT void asyncReturn(
+    const ExcelObj& asyncHandle, const Task<ExcelObj>& task);
+
+  /// <summary>
+  /// An <see cref="RtdAsyncTask"/> which gets its result from a <see cref="Task"/>.
+  /// A factory creates the task each time the RTD topic starts, passing a
+  /// token which is cancelled when the topic is cancelled. Two instances
+  /// are equal if they have the same name and arguments, so the name should
+  /// identify the worksheet function.
+  /// </summary>
+  class RtdTaskAdapter : public RtdAsyncTask
+  {
+  public:
+    using Factory = std::function<Task<ExcelObj>(const CancellationToken&)>;
+
+    RtdTaskAdapter(
+      const std::wstring_view& name,
+      std::vector<ExcelObj>&& args,
+      Factory&& factory)
+      : _name(name)
+      , _args(std::move(args))
+      , _factory(std::move(factory))
+    {}
+
+    std::future<void> operator()(RtdNotifier notify) override
+    {
+      CancellationToken token;
+      {
+        std::scoped_lock lock(_lock);
+        _token = token;
+      }
+      auto done = std::make_shared<std::promise<void>>();
+      auto future = done->get_future();
+      try
+      {
+        auto task = _factory(token);
+        task.onComplete([task, notify, done]()
+        {
+          publishResult(notify, task);
+          done->set_value();
+        });
+      }
+      catch (const std::exception& e)
+      {
+        notify.publish(ExcelObj(e.what()));
+        done->set_value();
+      }
+      return future;
+    }
+
+    void cancel() noexcept override
+    {
+      RtdAsyncTask::cancel();
+      std::scoped_lock lock(_lock);
+      _token.cancel();
+    }
+
+    bool operator==(const IRtdAsyncTask& that) const override
+    {
+      const auto* other = dynamic_cast<const RtdTaskAdapter*>(&that);
+      return other && other->_name == _name && other->_args == _args;
+    }
+
+  private:
+    std::wstring _name;
+    std::vector<ExcelObj> _args;
+    Factory _factory;
+    std::mutex _lock;
+    CancellationToken _token;
+
+    static void publishResult(const RtdNotifier& notify, const Task<ExcelObj>& task) noexcept
+    {
+      try
+      {
+        notify.publish(ExcelObj(task.get()));
+      }
+      catch (const TaskCancelled&)
+      {}
+      catch (const std::exception& e)
+      {
+        notify.publish(ExcelObj(e.what()));
+      }
+    }
+  };
+
+  /// <summary>
+  /// Runs a task through the RTD async mechanism, see <see cref="rtdAsync"/>.
+  /// Returns the result if the task for the calling cell has completed or
+  /// null if it is pending, in which case the function should return #N/A:
+  /// <code>
+  ///   XLO_FUNC_START(myFunc(const ExcelObj& x))
+  ///   {
+  ///     auto value = rtdAsync(L"myFunc", { x }, [x](const CancellationToken& token)
+  ///     {
+  ///       return spawn([x](const CancellationToken& token) { ... }, token);
+  ///     });
+  ///     return returnValue(value ? *value : CellError::NA);
+  ///   }
+  ///   XLO_FUNC_END(myFunc);
+  /// </code>
+  /// </summary>
+  inline std::shared_ptr<ExcelObj> rtdAsync(
+    const std::wstring_view& name,
+    std::vector<ExcelObj>&& args,
+    RtdTaskAdapter::Factory&& factory)
+  {
+    return rtdAsync(std::make_shared<RtdTaskAdapter>(
+      name, std::move(args), std::move(factory)));
+  }
+}
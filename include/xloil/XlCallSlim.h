@@ -221,6 +221,7 @@ namespace msxll
         RW rows;
         COL columns;
         bool xloil_view; // Clearly wasn't in Microsoft's spec!
+        bool xloil_shared; // Refcounted block, see ExcelObj::share
       } array;					/* xltypeMulti */
       struct
       {
@@ -267,6 +268,8 @@ namespace msxll
      
   constexpr int xlbitXLFree = 0x1000;
   constexpr int xlbitDLLFree = 0x4000;
+  // Our modification: marks a refcounted array block. Never passed to Excel.
+  constexpr int xlbitXloilShared = 0x8000;
           
   constexpr int xltypeBigData = (xltypeStr | xltypeInt);
 
@@ -33,6 +33,7 @@
 #include "State.h"
 #include "StaticRegister.h"
 #include "StringUtils.h"
+#include "Task.h"
 #include "Throw.h"
 #include "TypeConverters.h"
 #include "Version.h"
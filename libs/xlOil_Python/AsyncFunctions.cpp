@@ -7,13 +7,17 @@
 #include "PyEvents.h"
 #include "EventLoop.h"
 #include "PyAddin.h"
+#include "TypeConversion/Numpy.h"
 #include <xloil/ExcelObj.h>
 #include <xloil/Async.h>
+#include <xloil/Task.h>
 #include <xloil/RtdServer.h>
 #include <xloil/StaticRegister.h>
 #include <xloil/Caller.h>
 #include <CTPL/ctpl_stl.h>
 #include <vector>
+#include <mutex>
+#include <atomic>
 
 using std::shared_ptr;
 using std::vector;
@@ -33,6 +37,124 @@ namespace xloil
       return *theCoreAddin()->thread;
     }
 
+    /// <summary>
+    /// Returns the results of python async functions to Excel in batches.
+    /// Results are queued by the event loop thread and passed to Excel by a
+    /// job on the shared TaskExecutor, so the event loop does not wait on
+    /// xlAsyncReturn whilst holding the GIL. Results which arrive whilst a
+    /// job is pending join its batch.
+    ///
+    /// Numeric numpy arrays, if there is no custom return converter, are
+    /// copied with the GIL held and converted to Excel arrays by executor
+    /// jobs without it, in parallel when a batch has several.
+    /// </summary>
+    class AsyncReturnQueue
+    {
+    public:
+      static AsyncReturnQueue& instance()
+      {
+        static AsyncReturnQueue queue;
+        return queue;
+      }
+
+      /// <summary>
+      /// Must hold the GIL to call this
+      /// </summary>
+      void push(
+        const ExcelObj& asyncHandle,
+        const py::object& value,
+        const IPyToExcel* returnConverter)
+      {
+        Item item{ asyncHandle };
+        try
+        {
+          if (returnConverter)
+            item.value = (*returnConverter)(value.ptr());
+          else if (!copyNumericArray(value.ptr(), item.array))
+            item.value = FromPyObj()(value.ptr());
+        }
+        catch (const std::exception& e)
+        {
+          item.value = ExcelObj(e.what());
+        }
+
+        bool startJob;
+        {
+          std::scoped_lock lock(_lock);
+          _pending.emplace_back(std::move(item));
+          startJob = !_jobQueued;
+          _jobQueued = true;
+        }
+        if (startJob)
+          TaskExecutor::shared().post([this]() { takeBatch(); });
+      }
+
+    private:
+      struct Item
+      {
+        ExcelObj handle;
+        ExcelObj value;
+        NumericArrayCopy array;
+      };
+      struct Batch
+      {
+        vector<Item> items;
+        std::atomic<size_t> remaining = 0;
+      };
+
+      std::mutex _lock;
+      vector<Item> _pending;
+      bool _jobQueued = false;
+
+      void takeBatch()
+      {
+        auto batch = make_shared<Batch>();
+        {
+          std::scoped_lock lock(_lock);
+          std::swap(batch->items, _pending);
+          _jobQueued = false;
+        }
+
+        vector<size_t> arrays;
+        for (size_t i = 0; i < batch->items.size(); ++i)
+          if (!batch->items[i].array.data.empty())
+            arrays.push_back(i);
+
+        if (arrays.empty())
+          return returnBatch(*batch);
+
+        // The last job to finish converting returns the batch. This job
+        // converts one array itself rather than wait on the others.
+        batch->remaining = arrays.size();
+        auto& executor = TaskExecutor::shared();
+        for (size_t k = 1; k < arrays.size(); ++k)
+          executor.post([this, batch, i = arrays[k]]() { convert(batch, i); });
+        convert(batch, arrays[0]);
+      }
+
+      void convert(const shared_ptr<Batch>& batch, size_t i)
+      {
+        auto& item = batch->items[i];
+        try
+        {
+          item.value = numericArrayToExcel(item.array);
+        }
+        catch (const std::exception& e)
+        {
+          item.value = ExcelObj(e.what());
+        }
+        item.array.data = vector<char>();
+        if (--batch->remaining == 0)
+          returnBatch(*batch);
+      }
+
+      void returnBatch(Batch& batch)
+      {
+        for (auto& item : batch.items)
+          asyncReturn(item.handle, item.value);
+      }
+    };
+
     struct AsyncReturn : public AsyncHelper
     {
       AsyncReturn(
@@ -61,10 +183,8 @@ namespace xloil
 
       void set_result(const py::object& value)
       {
-        static ExcelObj obj = _returnConverter
-          ? (*_returnConverter)(value.ptr())
-          : FromPyObj()(value.ptr());
-        result(obj);
+        AsyncReturnQueue::instance().push(
+          asyncHandle(), value, _returnConverter.get());
       }
       void set_done()
       {}
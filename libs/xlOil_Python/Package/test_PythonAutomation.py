@@ -85,6 +85,24 @@ class Test_PythonAutomation(unittest.TestCase):
 
 class Test_PythonUtils(unittest.TestCase):
     
+    @unittest.skipIf((os.cpu_count() or 1) < 2, "Needs more than one CPU")
+    def test_table_write_parallel(self):
+        import xloil_core
+
+        n, m = 300, 200
+        columns = [np.arange(m, dtype=float) for _ in range(n)]
+        headings = [np.array([f"Col{i}" for i in range(n)], dtype=object)]
+        index = [np.array([f"Row{i}" for i in range(m)], dtype=object)]
+
+        # String headings and index have object dtype, but are converted
+        # up front so do not prevent a parallel write
+        self.assertTrue(xloil_core._table_write_parallel(
+            n, m, columns=columns, headings=headings, index=index))
+
+        columns[0] = np.array([str(x) for x in range(m)], dtype=object)
+        self.assertFalse(xloil_core._table_write_parallel(
+            n, m, columns=columns, headings=headings, index=index))
+
     def test_convert_address_a1(self):
         import xloil as xlo
 
@@ -0,0 +1,23 @@
+import pyarrow as pa
+import xloil as xlo
+
+@xlo.returner(target=pa.Table, register=True)
+class ReturnArrowTable:
+
+    """
+        Writes a pyarrow Table, or any object supporting the Arrow PyCapsule 
+        interface such as a RecordBatch, directly from its Arrow buffers
+        without converting via pandas.
+
+        Parameters
+        ----------
+
+        headings:
+            If True, the column names are written in the first row
+    """
+    def __init__(self, headings=True):
+        self._headings = headings
+
+    def write(self, val):
+        import xloil_core
+        return xloil_core._arrow_to_excel(val, headings=self._headings)
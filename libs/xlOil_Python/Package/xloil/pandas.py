@@ -19,6 +19,16 @@ from xloil import converter, to_datetime, ExcelArray, CannotConvert
 import numpy as np
 from collections.abc import Iterable
 
+def _table_values(values):
+    """
+    Passes a categorical to the table converter as a tuple (codes, categories), 
+    so each category is converted once rather than once per element
+    """
+    if isinstance(values, pd.Categorical):
+        return (values.codes, np.asarray(values.categories))
+    return values
+
+
 @converter(pd.DataFrame, register=True)
 class PDFrame:
     """
@@ -73,12 +83,20 @@ class PDFrame:
         localised time.  This is done with tz_convert and this specified timezone.
         If None, the local timezone is used.
 
+    categories: bool / list
+        When reading: if True, reads every column as a *pandas.Categorical*, 
+        otherwise reads the named columns, or column numbers, as categoricals.
+        Values are dictionary-encoded without creating a python object per 
+        cell, so this is much faster and smaller for columns with repeated 
+        values. When writing, categorical columns are always written by 
+        converting each category once.
+
     dtype: type
         Not currently implemented!
 
     """
     def __init__(self, headings=True, index=None, cache_objects=False, 
-                 dates=None, dtype=None, timezone=None):
+                 dates=None, dtype=None, timezone=None, categories=None):
         # TODO: use element_type in the dataframe construction
         self._element_type = dtype
         self._headings = headings
@@ -86,6 +104,7 @@ class PDFrame:
         self._cache_objects = cache_objects
         self._parse_dates = dates
         self._timezone = timezone if timezone is not None else tz.tzlocal()
+        self._categories = [categories] if isinstance(categories, str) else categories
 
     def read(self, x):
         # A converter should check if provided value is already of the correct type.
@@ -99,13 +118,18 @@ class PDFrame:
             if x.nrows < n_headings:
                 raise ArgumentError(f"Expected at least {n_headings} rows")
 
-            data = {i: x[n_headings:, i].to_numpy(dims=1) for i in range(x.ncols)}
+            headings = x[0,:].to_numpy(dims=1) if n_headings == 1 else None
+            names = headings if headings is not None else [None] * x.ncols
+
+            data = {
+                i: self._read_column(x[n_headings:, i], self._is_categorical(i, names[i]))
+                for i in range(x.ncols)
+            }
             # This will do a copy.  The copy can be avoided by monkey
             # patching pandas - see stackoverflow
             df = pd.DataFrame(data, copy=False)
 
             if n_headings == 1:
-                headings = x[0,:].to_numpy(dims=1)
                 df.columns = headings
 
             elif n_headings > 1:
@@ -124,6 +148,18 @@ class PDFrame:
         
         raise CannotConvert(f"Unsupported type: {type(x)!r}")
 
+    def _is_categorical(self, i, name):
+        if self._categories is None or isinstance(self._categories, bool):
+            return bool(self._categories)
+        return i in self._categories or (name is not None and name in self._categories)
+
+    @staticmethod
+    def _read_column(x: ExcelArray, categorical: bool):
+        if categorical:
+            codes, categories = x.to_categorical()
+            return pd.Categorical.from_codes(codes, categories)
+        return x.to_numpy(dims=1)
+
     def _convert_timezone(self, x: pd.Series):
        return x.dt.tz_convert(tz=self._timezone).dt.tz_localize(None).values 
 
@@ -140,14 +176,14 @@ class PDFrame:
         from pandas.api.types import is_datetime64tz_dtype
 
         columns = [
-            col.values if not is_datetime64tz_dtype(col) else self._convert_timezone(col) 
+            _table_values(col.values) if not is_datetime64tz_dtype(col) else self._convert_timezone(col) 
             for _, col in frame.items()
             ]
 
         # If outputting the index, we prepare an array for each index level
         if self._index is not False:
             index = [
-                frame.index.get_level_values(i).values
+                _table_values(frame.index.get_level_values(i).values)
                 for i in range(frame.index.nlevels)
                 ]
         else:
@@ -156,7 +192,7 @@ class PDFrame:
         # If outputting the columns, we prepare an array for each column level
         if self._headings:
             headings = [
-                frame.columns.get_level_values(i).values
+                _table_values(frame.columns.get_level_values(i).values)
                 for i in range(frame.columns.nlevels)
                 ]
         else:
@@ -546,6 +546,15 @@ class ExcelArray():
 
         x[:-1, :-1] # A sub-array omitting the last row and column
     """
+    def __arrow_c_array__(self, requested_schema: object = None) -> tuple: 
+        """
+        Implements the Arrow PyCapsule interface, taking column names from
+        the first row. The *requested_schema* is ignored.
+        """
+    def __arrow_c_schema__(self) -> object: 
+        """
+        Implements the Arrow PyCapsule interface
+        """
     def __getitem__(self, arg0: tuple) -> object: 
         """
         Given a 2-tuple, slices the array to return a sub ExcelArray or a single element.
@@ -561,6 +570,23 @@ class ExcelArray():
         cannot be converted to a specified *dtype*. The array dimension *dims* 
         can be 1 or 2 (default is 2).
         """
+    def to_categorical(self) -> tuple: 
+        """
+        Dictionary-encodes a 1-dim array, returning a tuple of numpy arrays
+        *(codes, categories)* which can be passed to `pandas.Categorical.from_codes`.
+        Codes are assigned in order of first appearance and are -1 for empty
+        cells, empty strings or error values. Only the categories are converted to
+        python objects.
+        """
+    def to_arrow(self, headings: bool = True) -> tuple: 
+        """
+        Converts the array to an Arrow struct array with one child per column,
+        returning a tuple of PyCapsules *(arrow_schema, arrow_array)* following
+        the Arrow C data interface. Columns holding any strings have type utf8, 
+        columns of only booleans have type boolean, other columns are float64. 
+        Empty and error values become nulls. If *headings* is True, the first row
+        gives the column names.
+        """
     @property
     def dims(self) -> int:
         """
@@ -938,6 +964,18 @@ class ObjectCache():
         specified key - in this case the user owns the lifecycle 
         management. 
         """
+    def set_budget(self, max_mb: int, min_idle_calcs: int = 2) -> None: 
+        """
+        Sets a soft limit on the memory held by the cache, estimated
+        with `sys.getsizeof`. When exceeded, objects which have not been
+        created or fetched for at least `min_idle_calcs` calculation 
+        cycles are evicted. A `max_mb` of zero removes the limit.
+        """
+    def stats(self) -> dict: 
+        """
+        Returns a dict of cache hit, miss and eviction counts, the 
+        estimated resident bytes and the number of keys
+        """
     pass
 class Range():
     """
@@ -1006,6 +1044,13 @@ class Range():
         """
         Clears all values and formatting.  Any cell in the range will then have Empty type.
         """
+    def iter_blocks(self, rows_per_block: int = 65536) -> _RangeBlockIter: 
+        """
+        Returns an iterator which reads the range in blocks of at most `rows_per_block`
+        rows, yielding tuples `(first_row, value)` where `first_row` is relative to the
+        range and `value` is converted as for `Range.value`. Only one block is held in
+        memory at a time, so this is suitable for very large ranges.
+        """
     def offset(self, from_row: int, from_col: int, num_rows: object = None, num_cols: object = None) -> Range: 
         """
         Similar to the *range* function, but with different defaults  
@@ -1114,6 +1159,14 @@ class Range():
         row and column. The top-left remains the same so the function always returns
         at least a single cell, even if it's empty.  
         """
+    def write_blocks(self, blocks: object) -> int: 
+        """
+        Writes each array in the iterable `blocks` below the previous one, starting at
+        the top-left of the range. Each block is written with its own shape so may
+        extend beyond the range. Only one converted block is held in memory at a time.
+        Returns the number of rows written. If a write fails, the preceding blocks have
+        already been written.
+        """
     @property
     def areas(self) -> object:
         """
@@ -2278,6 +2331,10 @@ class _PyObjectFutureIter():
     def __iter__(self) -> object: ...
     def __next__(self) -> None: ...
     pass
+class _RangeBlockIter():
+    def __iter__(self) -> object: ...
+    def __next__(self) -> object: ...
+    pass
 class _Read_Array_bool_1d(IPyFromExcel):
     def __init__(self, trim: bool = True) -> None: ...
     pass
@@ -2448,6 +2505,14 @@ class _TomlTable():
     pass
 class _XllRange(Range):
     pass
+def _arrow_to_excel(obj: object, headings: bool = True) -> _RawExcelValue:
+    """
+    For internal use. Converts an object supporting the Arrow PyCapsule 
+    interface, such as a pyarrow Table or RecordBatch, to a RawExcelValue
+    suitable for returning to xlOil. Prefers *__arrow_c_stream__* to 
+    *__arrow_c_array__*. If *headings* is True, the column names are 
+    written in the first row.
+    """
 def _get_onedrive_source(arg0: str) -> str:
     pass
 def _register_functions(funcs: typing.List[_FuncSpec], module: object = None, addin: object = None, append: bool = False) -> None:
@@ -2461,7 +2526,8 @@ def _table_converter(n: int, m: int, columns: object = None, rows: object = None
       the number of data fields and the length of the fields
     columns / rows: 
       a iterable of numpy array containing data, specified as columns 
-      or rows (not both)
+      or rows (not both). A categorical is given as a tuple of arrays
+      (codes, categories): each category is converted only once
     headings:
       optional array of data field headings
     index:
@@ -2473,6 +2539,11 @@ def _table_converter(n: int, m: int, columns: object = None, rows: object = None
       if True, place unconvertible objects in the cache and return a ref string
       if False, call str(x) on unconvertible objects
     """
+def _table_write_parallel(n: int, m: int, columns: object = None, rows: object = None, headings: object = None, index: object = None) -> bool:
+    """
+    For internal use. Returns True if _table_converter would write the
+    given table in parallel. Takes the same arguments as _table_converter.
+    """
 def active_cell() -> object:
     """
     Returns the currently active cell as a Range or None. Will raise an exception if xlOil
@@ -134,6 +134,64 @@ namespace xloil
         py::gil_scoped_release noGil;
         r.clear();
       }
+
+      /// <summary>
+      /// Python iterator which reads a Range in blocks of rows, yielding
+      /// (first_row, value) tuples. Keeps its own copy of the Range.
+      /// </summary>
+      class RangeBlockIter
+      {
+      public:
+        RangeBlockIter(const Range& r, Range::row_t rowsPerBlock)
+          : _rowsPerBlock(rowsPerBlock)
+        {
+          if (rowsPerBlock == 0)
+            throw py::value_error("rows_per_block must be positive");
+          py::gil_scoped_release noGil;
+          std::tie(_nRows, _nCols) = r.shape();
+          _range = r.range(0, 0, (int)_nRows - 1, (int)_nCols - 1);
+        }
+
+        py::object next()
+        {
+          if (_row >= _nRows)
+            throw py::stop_iteration();
+          const auto n = std::min(_rowsPerBlock, _nRows - _row);
+          ExcelObj val;
+          {
+            py::gil_scoped_release noGil;
+            val = _range->range(
+              (int)_row, 0, int(_row + n - 1), (int)_nCols - 1)->value();
+          }
+          auto result = py::make_tuple(_row, convertExcelObj(std::move(val)));
+          _row += n;
+          return result;
+        }
+
+      private:
+        std::unique_ptr<Range> _range;
+        Range::row_t _rowsPerBlock, _nRows = 0, _row = 0;
+        Range::col_t _nCols = 0;
+      };
+
+      auto range_WriteBlocks(Range& r, const py::object& blocks)
+      {
+        auto iter = PySteal(PyObject_GetIter(blocks.ptr()));
+        py::gil_scoped_release noGil;
+        return r.writeBlocks([&](ExcelObj& block)
+        {
+          py::gil_scoped_acquire gil;
+          auto item = py::reinterpret_steal<py::object>(PyIter_Next(iter.ptr()));
+          if (!item)
+          {
+            if (PyErr_Occurred())
+              throw py::error_already_set();
+            return false;
+          }
+          block = FromPyObj()(item.ptr());
+          return true;
+        });
+      }
       
       auto range_Address(Range& r, std::string& style, const bool local)
       {
@@ -824,6 +882,10 @@ namespace xloil
 
           )" XLO_CITE_API_SUFFIX(Application, (object)));
 
+      py::class_<RangeBlockIter>(mod, "_RangeBlockIter")
+        .def("__iter__", [](const py::object& self) { return self; })
+        .def("__next__", &RangeBlockIter::next);
+
       auto declare_Range = py::class_<Range>(mod, "Range", R"(
           Represents a cell, a row, a column or a selection of cells containing a contiguous 
           blocks of cells. (Non contiguous ranges are not currently supported).
@@ -989,6 +1051,25 @@ namespace xloil
             row and column. The top-left remains the same so the function always returns
             at least a single cell, even if it's empty.  
           )")
+        .def("iter_blocks",
+          [](const Range& r, Range::row_t rowsPerBlock) { return RangeBlockIter(r, rowsPerBlock); },
+          R"(
+            Returns an iterator which reads the range in blocks of at most `rows_per_block`
+            rows, yielding tuples `(first_row, value)` where `first_row` is relative to the
+            range and `value` is converted as for `Range.value`. Only one block is held in
+            memory at a time, so this is suitable for very large ranges.
+          )",
+          py::arg("rows_per_block") = 65536)
+        .def("write_blocks",
+          range_WriteBlocks,
+          R"(
+            Writes each array in the iterable `blocks` below the previous one, starting at
+            the top-left of the range. Each block is written with its own shape so may
+            extend beyond the range. Only one converted block is held in memory at a time.
+            Returns the number of rows written. If a write fails, the preceding blocks have
+            already been written.
+          )",
+          py::arg("blocks"))
         .def("__iter__", 
           range_Iter)
         .def("__getitem__", 
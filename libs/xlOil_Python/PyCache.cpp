@@ -17,6 +17,43 @@ namespace xloil
   };
   using pyCacheUnquifier = CacheUniquifier<py::object>;
 
+  /// <summary>
+  /// Uses sys.getsizeof, which is shallow: containers do not count the 
+  /// size of their elements, but it is good enough for arrays and frames
+  /// which typically dominate the cache. Called with the GIL held.
+  /// </summary>
+  template<>
+  struct CacheObjectSize<py::object>
+  {
+    size_t operator()(const py::object& obj) const
+    {
+      // Looked up once and deliberately never released, as the cache may
+      // outlive the interpreter
+      static PyObject* getSizeOf = []() {
+        auto func = PySys_GetObject("getsizeof");
+        Py_XINCREF(func);
+        return func;
+      }();
+
+      Py_ssize_t size = -1;
+      if (getSizeOf)
+      {
+        auto result = PyObject_CallFunctionObjArgs(getSizeOf, obj.ptr(), nullptr);
+        if (result)
+        {
+          size = PyLong_AsSsize_t(result);
+          Py_DECREF(result);
+        }
+      }
+      if (size < 0)
+      {
+        PyErr_Clear();
+        return sizeof(PyObject);
+      }
+      return (size_t)size;
+    }
+  };
+
   namespace Python {
 
     namespace
@@ -102,9 +139,28 @@ namespace xloil
         py::list keys() const
         {
           py::list out;
-          for (auto& [key, cellCache] : *_cache)
+          _cache->forEach([&](auto& key, auto& cellCache)
+          {
             for (uint16_t i = 0u; i < cellCache.count(); ++i)
-              out.append(py::wstr(_cache->writeKey(key, i)));
+              out.append(py::wstr(_cache->writeKey(key, cellCache, i)));
+          });
+          return out;
+        }
+
+        void setBudget(size_t maxMb, size_t minIdleCalcs)
+        {
+          _cache->setBudget(maxMb << 20, minIdleCalcs);
+        }
+
+        py::dict stats() const
+        {
+          const auto s = _cache->stats();
+          py::dict out;
+          out["hits"] = s.hits;
+          out["misses"] = s.misses;
+          out["evictions"] = s.evictions;
+          out["resident_bytes"] = s.residentBytes;
+          out["keys"] = s.keys;
           return out;
         }
 
@@ -234,6 +290,21 @@ namespace xloil
           .def("keys", 
             &PyCache::keys,
             "Returns all cache keys as a list of strings")
+          .def("set_budget",
+            &PyCache::setBudget,
+            R"(
+              Sets a soft limit on the memory held by the cache, estimated
+              with `sys.getsizeof`. When exceeded, objects which have not been
+              created or fetched for at least `min_idle_calcs` calculation 
+              cycles are evicted. A `max_mb` of zero removes the limit.
+            )",
+            py::arg("max_mb"), py::arg("min_idle_calcs") = 2)
+          .def("stats",
+            &PyCache::stats,
+            R"(
+              Returns a dict of cache hit, miss and eviction counts, the 
+              estimated resident bytes and the number of keys
+            )")
           .def("__contains__", &PyCache::contains)
           .def("__getitem__", &PyCache::getitem)
           .def("__call__", 
@@ -253,9 +253,15 @@ namespace xloil
               return returner(xlArgs[j]->cast<CellError>(), info);
         }
 
+        auto getArg = [&](auto i) -> auto& { return *xlArgs[i]; };
+
+        // Read numeric arrays before taking the GIL, so other threads can
+        // run python code whilst we copy
+        auto prepared = info->prepareArgs(getArg);
+
         py::gil_scoped_acquire gilAcquired;
         PyErr_Clear(); // TODO: required?
-        return returner(info->invoke([&](auto i) -> auto& { return *xlArgs[i]; }).ptr());
+        return returner(info->invoke(getArg, &prepared).ptr());
       }
       catch (const py::error_already_set& e)
       {
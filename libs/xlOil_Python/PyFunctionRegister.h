@@ -1,6 +1,7 @@
 #pragma once
 #include "PyCore.h"
 #include "TypeConversion/PyDictType.h"
+#include "TypeConversion/ConverterInterface.h"
 #include <xlOil/Register.h>
 #include <xlOil/Throw.h>
 #include <xlOil/Interface.h>
@@ -114,6 +115,30 @@ namespace xloil
           const std::shared_ptr<PyFuncInfo>& funcInfo,
           const PyAddin& addin);
 
+      using PreparedArgs = std::vector<std::unique_ptr<IPyFromExcelPrepared>>;
+
+      /// <summary>
+      /// Runs the GIL-free phase of conversion for positional args whose
+      /// converter supports it, see <see cref="IPyFromExcel::prepare"/>. 
+      /// Must be called *without* the GIL. The result is empty if no 
+      /// args could be prepared.
+      /// </summary>
+      template<class TXlArgs>
+      PreparedArgs prepareArgs(TXlArgs xlArgs) const
+      {
+        PreparedArgs prepared;
+        for (size_t i = 0; i < _numPositionalArgs; ++i)
+        {
+          auto p = _args[i].converter->prepare(xlArgs(i));
+          if (!p)
+            continue;
+          if (prepared.empty())
+            prepared.resize(_numPositionalArgs);
+          prepared[i] = std::move(p);
+        }
+        return prepared;
+      }
+
       /// <summary>
       /// Convert the array of ExcelObj arguments to PyObject values, with 
       /// option kwargs.
@@ -121,19 +146,29 @@ namespace xloil
       /// <param name="xlArgs">Size must be equal to `args().size()`</param>
       /// <param name="pyArgs">Size must equal `argArraySize()`</param>
       /// <param name="kwargs"></param>
+      /// <param name="prepared">Optional result of <see cref="prepareArgs"/></param>
       template<class TXlArgs, class TPyArgs>
       void convertArgs(
         TXlArgs xlArgs,
         TPyArgs& pyArgs,
-        pybind11::object& kwargs) const
+        pybind11::object& kwargs,
+        PreparedArgs* prepared = nullptr) const
       {
         assert(pyArgs.capacity() >= _numPositionalArgs + (isRtdAsync || isAsync ? 1u : 0u));
 
+        if (prepared && prepared->empty())
+          prepared = nullptr;
+
         size_t i = 0;
         try
         {
           for (; i < _numPositionalArgs; ++i)
           {
+            if (prepared && (*prepared)[i])
+            {
+              pyArgs.push_back((*prepared)[i]->finish());
+              continue;
+            }
             auto* defaultValue = _args[i].default.ptr();
             pyArgs.push_back((*_args[i].converter)(xlArgs(i), defaultValue));
           }
@@ -167,7 +202,7 @@ namespace xloil
       }
 
       template<class TXlArgs>
-      auto invoke(TXlArgs&& xlArgs) const
+      auto invoke(TXlArgs&& xlArgs, PreparedArgs* prepared = nullptr) const
       {
         PyCallArgs<> pyArgs;
         py::object kwargs;
@@ -175,7 +210,8 @@ namespace xloil
         convertArgs(
           std::forward<TXlArgs>(xlArgs),
           pyArgs,
-          kwargs);
+          kwargs,
+          prepared);
 
         return pyArgs.call(_func, kwargs);
       }
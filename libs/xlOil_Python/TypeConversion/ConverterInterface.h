@@ -2,11 +2,27 @@
 
 #include <xlOil/ExcelObj.h>
 #include "CPython.h"
+#include <memory>
 
 namespace xloil
 {
   namespace Python
   {
+    /// <summary>
+    /// Holds the result of the first phase of a two-phase conversion, see
+    /// <see cref="IPyFromExcel::prepare"/>.
+    /// </summary>
+    class IPyFromExcelPrepared
+    {
+    public:
+      virtual ~IPyFromExcelPrepared() {}
+      /// <summary>
+      /// Creates the python object and returns a new reference. Must be 
+      /// called with the GIL held and at most once.
+      /// </summary>
+      virtual PyObject* finish() = 0;
+    };
+
     class IPyFromExcel : public IConvertFromExcel<PyObject*>
     {
     public:
@@ -15,6 +31,18 @@ namespace xloil
       /// Currently used only for log diagnostics.
       /// </summary>
       virtual const char* name() const = 0;
+
+      /// <summary>
+      /// Called *without* the GIL. Converters which can do the bulk of their
+      /// work without touching python objects, such as reading numeric 
+      /// arrays, can do it here and leave <see cref="IPyFromExcelPrepared::finish"/>
+      /// to wrap the result. Returning null, the default, means the value 
+      /// should be converted as usual with <see cref="operator()"/>. 
+      /// </summary>
+      virtual std::unique_ptr<IPyFromExcelPrepared> prepare(const ExcelObj&) const
+      {
+        return nullptr;
+      }
     };
     class IPyToExcel : public IConvertToExcel<PyObject*>
     {
@@ -8,6 +8,7 @@
 #include "CPython.h"
 #include <xlOil/ExcelObj.h>
 #include <memory>
+#include <vector>
 
 namespace xloil { 
   class FPArray;
@@ -29,8 +30,40 @@ namespace xloil
 
     PyObject* excelArrayToNumpyArray(const ExcelArray& arr, int dims = 2, int dtype = -1);
 
+    /// <summary>
+    /// Dictionary-encodes a 1-dim array, returning a tuple (codes, categories)
+    /// suitable for pandas.Categorical.from_codes. Values are hashed to int32
+    /// codes without creating python objects, so only the categories are 
+    /// converted. Empty cells, empty strings and error values have code -1.
+    /// </summary>
+    PyObject* excelArrayToCategorical(const ExcelArray& arr);
+
     ExcelObj numpyArrayToExcel(const PyObject* p);
 
+    /// <summary>
+    /// A row-major copy of the data in a non-empty 1 or 2-d numpy array of
+    /// bool, integer or float type. A 1-d array is copied as a column.
+    /// </summary>
+    struct NumericArrayCopy
+    {
+      int dtype = -1;
+      size_t rows = 0;
+      size_t columns = 0;
+      std::vector<char> data;
+    };
+
+    /// <summary>
+    /// If the object is a numeric array, copies it and returns true. Copying
+    /// needs the GIL, but is much faster than converting to an ExcelObj.
+    /// </summary>
+    bool copyNumericArray(const PyObject* p, NumericArrayCopy& copy);
+
+    /// <summary>
+    /// Converts the result of <see cref="copyNumericArray"/> to an Excel array
+    /// in the same way as <see cref="numpyArrayToExcel"/>. Does not need the GIL.
+    /// </summary>
+    ExcelObj numericArrayToExcel(const NumericArrayCopy& copy);
+
     PyObject* toNumpyDatetimeFromExcelDateArray(const PyObject* p);
   }
 }
\ No newline at end of file
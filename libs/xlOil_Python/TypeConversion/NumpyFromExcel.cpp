@@ -78,17 +78,19 @@ namespace xloil
 
       npy_datetime operator()(int x) const noexcept
       {
-        int day, month, year;
-        excelSerialDateToYMD(x, year, month, day);
-        npy_datetimestruct dt{ year, month, day, 0, 0, 0, 0, 0 };
-        return convertDateTime<NPY_FR_us>(dt);
+        return operator()((double)x);
       }
       npy_datetime operator()(double x) const noexcept
       {
-        int day, month, year, hours, mins, secs, usecs;
-        excelSerialDatetoYMDHMS(x, year, month, day, hours, mins, secs, usecs);
-        npy_datetimestruct dt{ year, month, day, hours, mins, secs, usecs };
-        return convertDateTime<NPY_FR_us>(dt);
+        // Serial dates and datetime64 differ only by an epoch and scale, so
+        // there's no need for a date struct
+        npy_datetime result;
+        excelSerialToDatetime64(&x, 1, &result);
+        return result;
+      }
+      npy_datetime operator()(CellError) const noexcept
+      {
+        return NPY_DATETIME_NAT;
       }
       npy_datetime operator()(const PStringRef& str) const
       {
@@ -300,6 +302,22 @@ namespace xloil
           auto pyArray = newNumpyArray(TNpType, dims, itemsize, data);
 
           NumpyBeginThreadsDescr releaseGil(TNpType);
+          if constexpr (TNpType == NPY_DOUBLE)
+          {
+            // Fast path for purely numeric data. Otherwise we start again 
+            // with the converter, which handles errors and other types
+            if (arr.toDoubles((double*)data, arraySize))
+              return pyArray.release().ptr();
+          }
+          else if constexpr (TNpType == NPY_DATETIME)
+          {
+            // For purely numeric data, convert the serial dates in-place
+            if (arr.toDoubles((double*)data, arraySize))
+            {
+              excelSerialToDatetime64((double*)data, arraySize, (npy_datetime*)data);
+              return pyArray.release().ptr();
+            }
+          }
           for (auto p = arr.begin(); p != arr.end(); ++p, data += itemsize)
             _conv((data_type*)data, itemsize, *p);
           return pyArray.release().ptr();
@@ -356,6 +374,19 @@ namespace xloil
           auto pyArray = newNumpyArray(TNpType, dims, itemsize, data);
 
           NumpyBeginThreadsDescr releaseGil(TNpType);
+          if constexpr (TNpType == NPY_DOUBLE)
+          {
+            if (arr.toDoubles((double*)data, arraySize))
+              return pyArray.release().ptr();
+          }
+          else if constexpr (TNpType == NPY_DATETIME)
+          {
+            if (arr.toDoubles((double*)data, arraySize))
+            {
+              excelSerialToDatetime64((double*)data, arraySize, (npy_datetime*)data);
+              return pyArray.release().ptr();
+            }
+          }
           auto d = data;
           for (auto i = 0; i < dims[0]; ++i)
           {
@@ -432,6 +463,43 @@ namespace xloil
       };
     }
 
+    PyObject* excelArrayToCategorical(const ExcelArray& arr)
+    {
+      if (arr.size() > 0 && arr.dims() != 1)
+        XLO_THROW("Expecting a 1-dim array");
+
+      Py_intptr_t dims[] = { (intptr_t)arr.size() };
+      char* data;
+      auto codes = newNumpyArray(NPY_INT32, dims, sizeof(int32_t), data);
+
+      vector<const ExcelObj*> distinct;
+      size_t stringLength = 0;
+      {
+        NumpyBeginThreadsDescr releaseGil(NPY_INT32);
+        distinct = xloil::detail::arrayDictionaryEncode(arr, (int32_t*)data);
+        for (auto* value : distinct)
+          stringLength += value->stringLength();
+      }
+
+      // Only the distinct values become python objects
+      py::object categories;
+      if (distinct.empty())
+      {
+        Py_intptr_t noDims[] = { 0 };
+        categories = PySteal<>(PyArray_EMPTY(1, noDims, NPY_OBJECT, 0));
+      }
+      else
+      {
+        ExcelArrayBuilder builder((row_t)distinct.size(), 1, stringLength);
+        for (auto i = 0u; i < distinct.size(); ++i)
+          builder(i, 0) = *distinct[i];
+        const auto values = builder.toExcelObj();
+        categories = PySteal<>(excelArrayToNumpyArray(ExcelArray(values, false), 1));
+      }
+
+      return PyTuple_Pack(2, codes.ptr(), categories.ptr());
+    }
+
     PyObject* toNumpyDatetimeFromExcelDateArray(const PyObject* obj)
     {
       auto [pyArr, dims, nDims] = getArrayInfo(obj);
@@ -488,11 +556,16 @@ namespace xloil
           const char* in = dataptrarray[0];
           char* out = dataptrarray[1];
 
-          for (npy_intp i = 0; i < N; i++)
+          if (innerstride == sizeof(double) && itemsize == sizeof(npy_datetime))
+            excelSerialToDatetime64((const double*)in, N, (npy_datetime*)out);
+          else
           {
-            *((npy_datetime*)out) = NumpyDateFromDate()(*(double*)in);
-            in += innerstride;
-            out += itemsize;
+            for (npy_intp i = 0; i < N; i++)
+            {
+              *((npy_datetime*)out) = NumpyDateFromDate()(*(double*)in);
+              in += innerstride;
+              out += itemsize;
+            }
           }
 
         } while (iternext(iter));
@@ -513,12 +586,153 @@ namespace xloil
 
     namespace
     {
+      /// <summary>
+      /// Numeric array data read from Excel without the GIL into a malloc'd
+      /// buffer. The buffer is handed to a numpy array by finish(), so no
+      /// copy is made whilst holding the GIL.
+      /// </summary>
+      class PreparedNumpyArray : public IPyFromExcelPrepared
+      {
+        int _dtype;
+        int _nDims;
+        Py_intptr_t _dims[2];
+        char* _data;
+
+      public:
+        PreparedNumpyArray(int dtype, int nDims, const ExcelArray& arr, size_t itemsize)
+          : _dtype(dtype)
+          , _nDims(nDims)
+          , _dims{ (intptr_t)arr.nRows(), (intptr_t)arr.nCols() }
+        {
+          if (nDims == 1)
+            _dims[0] = (intptr_t)arr.size();
+          _data = (char*)malloc(arr.size() * itemsize);
+          if (!_data)
+            throw std::bad_alloc();
+        }
+
+        ~PreparedNumpyArray()
+        {
+          free(_data);
+        }
+
+        char* data() const { return _data; }
+
+        PyObject* finish() override
+        {
+          // The capsule owns the buffer as soon as it exists: it becomes the
+          // array's base object, so the buffer is freed with the array
+          auto capsule = PyCapsule_New(_data, nullptr, [](PyObject* p)
+          {
+            free(PyCapsule_GetPointer(p, nullptr));
+          });
+          if (!capsule)
+            throw py::error_already_set();
+          auto data = _data;
+          _data = nullptr;
+
+          auto array = PyArray_NewFromDescr(
+            &PyArray_Type,
+            _dtype == NPY_DATETIME ? createDatetimeDtype() : PyArray_DescrFromType(_dtype),
+            _nDims,
+            _dims,
+            nullptr,  // strides
+            data,
+            NPY_ARRAY_CARRAY,
+            nullptr);
+          if (!array)
+          {
+            Py_DECREF(capsule);
+            throw py::error_already_set();
+          }
+          // Steals the reference to the capsule, even on failure
+          if (PyArray_SetBaseObject((PyArrayObject*)array, capsule) < 0)
+          {
+            Py_DECREF(array);
+            throw py::error_already_set();
+          }
+          return array;
+        }
+      };
+
       template <int TNpType>
-      using Array1dFromXL = PyFromExcelConverter<PyFromArray1d<TNpType>>;
+      constexpr bool canPrepareArray =
+        TNpType == NPY_DOUBLE || TNpType == NPY_INT || TNpType == NPY_BOOL
+        || TNpType == NPY_DATETIME;
+
+      /// <summary>
+      /// Reads a numeric array from Excel into native memory. Called without
+      /// the GIL, so returns null for anything which needs python: cache
+      /// references, strings, defaulted args and values which fail to convert
+      /// are left to the usual converter.
+      /// </summary>
+      template <int TNpType>
+      std::unique_ptr<IPyFromExcelPrepared> prepareNumpyArray(
+        const ExcelObj& xl, bool trim, int nDims) noexcept
+      {
+        if (!xl.isType(ExcelType::Multi))
+          return nullptr;
+        try
+        {
+          ExcelArray arr(xl, trim);
+          if (arr.size() == 0 || (nDims == 1 && arr.dims() != 1))
+            return nullptr;
+
+          using TDataType = typename TypeTraits<TNpType>::storage;
+          auto prepared = std::make_unique<PreparedNumpyArray>(
+            TNpType, nDims, arr, sizeof(TDataType));
+          auto data = (TDataType*)prepared->data();
+
+          if constexpr (TNpType == NPY_DOUBLE)
+          {
+            if (arr.toDoubles(data, arr.size()))
+              return prepared;
+          }
+          else if constexpr (TNpType == NPY_DATETIME)
+          {
+            if (arr.toDoubles((double*)data, arr.size()))
+            {
+              excelSerialToDatetime64((double*)data, arr.size(), data);
+              return prepared;
+            }
+          }
+          typename FromExcel<TNpType>::value conv;
+          for (ExcelArray::row_t i = 0; i < arr.nRows(); ++i)
+            for (auto p = arr.row_begin(i); p != arr.row_end(i); ++p, ++data)
+              conv(data, sizeof(TDataType), *p);
+          return prepared;
+        }
+        catch (...)
+        {
+          return nullptr;
+        }
+      }
+
+      template <class TImpl, int TNpType, int TNDims>
+      class NumpyArrayFromXL : public PyFromExcelConverter<TImpl>
+      {
+        bool _trim;
+      public:
+        NumpyArrayFromXL(bool trim = true)
+          : PyFromExcelConverter<TImpl>(trim)
+          , _trim(trim)
+        {}
+
+        std::unique_ptr<IPyFromExcelPrepared> prepare(const ExcelObj& xl) const override
+        {
+          if constexpr (canPrepareArray<TNpType>)
+            return prepareNumpyArray<TNpType>(xl, _trim, TNDims);
+          else
+            return nullptr;
+        }
+      };
 
       template <int TNpType>
-      using Array2dFromXL = PyFromExcelConverter<PyFromArray2d<TNpType>>;
-  
+      using Array1dFromXL = NumpyArrayFromXL<PyFromArray1d<TNpType>, TNpType, 1>;
+
+      template <int TNpType>
+      using Array2dFromXL = NumpyArrayFromXL<PyFromArray2d<TNpType>, TNpType, 2>;
+
       template<template<int N> class T, int TNpType, int TNDims>
       struct Reader
       {
@@ -56,8 +56,35 @@ namespace xloil
       return result;
     }
 
+    double datetimeTicksPerDay(const PyArray_DatetimeMetaData& meta) noexcept
+    {
+      double perDay;
+      switch (meta.base)
+      {
+      case NPY_FR_W:  perDay = 1.0 / 7; break;
+      case NPY_FR_D:  perDay = 1; break;
+      case NPY_FR_h:  perDay = 24; break;
+      case NPY_FR_m:  perDay = 1440; break;
+      case NPY_FR_s:  perDay = 86400; break;
+      case NPY_FR_ms: perDay = 86400e3; break;
+      case NPY_FR_us: perDay = 86400e6; break;
+      case NPY_FR_ns: perDay = 86400e9; break;
+      default: 
+        return 0;
+      }
+      return meta.num > 0 ? perDay / meta.num : 0;
+    }
+
+    void excelSerialToDatetime64(const double* serials, size_t n, npy_datetime* out) noexcept
+    {
+      static_assert(sizeof(npy_datetime) == sizeof(int64_t));
+      static_assert(NPY_DATETIME_NAT == XL_NULL_DATE_TICKS);
+      excelSerialToTicks(serials, n, (int64_t*)out, 86400e6);
+    }
+
     FromArrayImpl<NPY_DATETIME>::FromArrayImpl(PyArrayObject* pArr)
       : _meta(get_datetime_metadata_from_dtype(PyArray_DESCR(pArr)))
+      , _ticksPerDay(datetimeTicksPerDay(*_meta))
     {}
 
     ExcelObj FromArrayImpl<NPY_DATETIME>::toExcelObj(
@@ -65,7 +92,11 @@ namespace xloil
       void* arrayPtr) const
     {
       auto x = (npy_datetime*)arrayPtr;
-      const auto serial = excelDateFromNumpyDate(*x, *_meta);
+      double serial;
+      if (_ticksPerDay > 0)
+        ticksToExcelSerial((const int64_t*)x, 1, &serial, _ticksPerDay);
+      else
+        serial = excelDateFromNumpyDate(*x, *_meta);
       return ExcelObj(serial);
     }
   }
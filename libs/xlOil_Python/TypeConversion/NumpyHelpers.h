@@ -32,7 +32,7 @@ namespace xloil
     template<> struct TypeTraits<NPY_LONG> { using storage = long; };
     template<> struct TypeTraits<NPY_ULONG> { using storage = unsigned long; };
     template<> struct TypeTraits<NPY_LONGLONG> { using storage = long long; };
-    template<> struct TypeTraits<NPY_ULONGLONG> { using storage = unsigned long; };
+    template<> struct TypeTraits<NPY_ULONGLONG> { using storage = unsigned long long; };
     template<> struct TypeTraits<NPY_FLOAT> { using storage = float; };
     template<> struct TypeTraits<NPY_DOUBLE> { using storage = double; };
     template<> struct TypeTraits<NPY_DATETIME> { using storage = npy_datetime; };
@@ -101,6 +101,19 @@ namespace xloil
     template<NPY_DATETIMEUNIT TGranularity>
     npy_datetime convertDateTime(const npy_datetimestruct& dt) noexcept;
 
+    /// <summary>
+    /// Returns the number of datetime64 ticks in a day for the given units, or
+    /// zero if the units are not a fixed fraction of a day (e.g. months), in 
+    /// which case the bulk conversions cannot be used.
+    /// </summary>
+    double datetimeTicksPerDay(const PyArray_DatetimeMetaData& meta) noexcept;
+
+    /// <summary>
+    /// Converts Excel serial dates to datetime64[us] in bulk. Invalid dates 
+    /// become NaT. The input and output may be the same buffer.
+    /// </summary>
+    void excelSerialToDatetime64(const double* serials, size_t n, npy_datetime* out) noexcept;
+
     template<
       template<template<int> class, int, int> class Declarer,
       template<int N> class Converter,
@@ -217,7 +230,8 @@ namespace xloil
             USHRT_MAX,
             (uint16_t)PyArray_ITEMSIZE(pArr) / sizeof(data_type)))
       {
-        _stringLength = _charMultiple * _elementLength * PyArray_SIZE(pArr);
+        // Each string also needs a character for its length
+        _stringLength = (_charMultiple * _elementLength + 1) * PyArray_SIZE(pArr);
         const auto type = PyArray_TYPE(pArr);
         if (type != NPY_UNICODE && type != NPY_STRING)
           XLO_THROW("Incorrect array type: expected string or unicode");
@@ -225,13 +239,25 @@ namespace xloil
 
       auto stringLength() const { return _stringLength; }
 
-      auto toExcelObj(
+      ExcelObj toExcelObj(
         ExcelArrayBuilder& builder,
         void* arrayPtr) const
+      {
+        return toExcelObj(builder.charAllocator(), arrayPtr);
+      }
+
+      /// <summary>
+      /// Writes the string data using the given allocator, which may point
+      /// to a region of the builder's string store reserved for this array
+      /// </summary>
+      ExcelObj toExcelObj(
+        detail::ArrayBuilderCharAllocator chars,
+        void* arrayPtr) const
       {
         auto x = (const char32_t*)arrayPtr;
         const auto len = strlen32(x, _elementLength);
-        auto pstr = builder.string((uint16_t)len);
+        auto pstr = BasicPString<wchar_t, detail::ArrayBuilderCharAllocator>(
+          (uint16_t)len, chars);
         const auto nChars = ConvertUTF32ToUTF16()(
           (char16_t*)pstr.pstr(), pstr.length(), x, x + len);
 
@@ -248,9 +274,16 @@ namespace xloil
       static constexpr size_t stringLength() { return 0; }
 
       const PyArray_DatetimeMetaData* _meta;
+      double _ticksPerDay;
 
       FromArrayImpl(PyArrayObject* pArr);
 
+      /// <summary>
+      /// Ticks per day for the array's units, or zero if the bulk conversion 
+      /// <see cref="ticksToExcelSerial"/> cannot be used
+      /// </summary>
+      double ticksPerDay() const { return _ticksPerDay; }
+
       ExcelObj toExcelObj(
         ExcelArrayBuilder& /*builder*/,
         void* arrayPtr) const;
@@ -1,6 +1,11 @@
 #include "NumpyHelpers.h"
 #include "PyCore.h"
 #include "BasicTypes.h"
+#include <xloil/Date.h>
+#include <execution>
+#include <mutex>
+#include <numeric>
+#include <thread>
 
 using row_t = xloil::ExcelArray::row_t;
 using col_t = xloil::ExcelArray::col_t;
@@ -14,10 +19,20 @@ namespace xloil
   {
     namespace TableHelpers
     {
+      using CharAllocator = xloil::detail::ArrayBuilderCharAllocator;
+
       struct ApplyConverter
       {
         virtual ~ApplyConverter() {}
+        virtual size_t stringLength() const = 0;
+
+        /// <summary>
+        /// Writes the array to [start, end). Any strings are allocated from
+        /// <paramref name="chars"/>, which allows columns with their own 
+        /// region of the string store to be written concurrently.
+        /// </summary>
         virtual void operator()(ExcelArrayBuilder& builder,
+          CharAllocator chars,
           xloil::detail::ArrayBuilderIterator& start,
           xloil::detail::ArrayBuilderIterator& end) = 0;
       };
@@ -35,17 +50,67 @@ namespace xloil
 
         virtual ~ConverterHolder() {}
 
-        auto stringLength() const { return _impl.stringLength(); }
+        size_t stringLength() const override { return _impl.stringLength(); }
 
         virtual void operator()(ExcelArrayBuilder& builder,
+          CharAllocator chars,
           xloil::detail::ArrayBuilderIterator& start,
-          xloil::detail::ArrayBuilderIterator& end)
+          xloil::detail::ArrayBuilderIterator& end) override
         {
           char* arrayPtr = PyArray_BYTES(_array);
           const auto step = PyArray_STRIDE(_array, 0);
           for (; start != end; arrayPtr += step, ++start)
           {
-            start->take(_impl.toExcelObj(builder, arrayPtr));
+            if constexpr (NPDtype == NPY_UNICODE || NPDtype == NPY_STRING)
+              start->take(_impl.toExcelObj(chars, arrayPtr));
+            else
+              start->take(_impl.toExcelObj(builder, arrayPtr));
+          }
+        }
+      };
+
+      /// <summary>
+      /// Converts datetime columns and indices, such as a pandas DatetimeIndex, 
+      /// to serial dates in blocks using the bulk conversion
+      /// </summary>
+      template<>
+      struct ConverterHolder<NPY_DATETIME> : public ApplyConverter
+      {
+        FromArrayImpl<NPY_DATETIME> _impl;
+        PyArrayObject* _array;
+
+        ConverterHolder(PyArrayObject* array, bool)
+          : _impl(array)
+          , _array(array)
+        {}
+
+        size_t stringLength() const override { return 0; }
+
+        virtual void operator()(ExcelArrayBuilder& builder,
+          CharAllocator /*chars*/,
+          xloil::detail::ArrayBuilderIterator& start,
+          xloil::detail::ArrayBuilderIterator& end) override
+        {
+          char* arrayPtr = PyArray_BYTES(_array);
+          const auto step = PyArray_STRIDE(_array, 0);
+          if (_impl.ticksPerDay() <= 0)
+          {
+            for (; start != end; arrayPtr += step, ++start)
+              start->take(_impl.toExcelObj(builder, arrayPtr));
+            return;
+          }
+
+          constexpr size_t blockSize = 1024;
+          int64_t ticks[blockSize];
+          double serials[blockSize];
+          while (start != end)
+          {
+            size_t n = 0;
+            for (auto p = start; p != end && n < blockSize; ++p, ++n, arrayPtr += step)
+              ticks[n] = *(const int64_t*)arrayPtr;
+            ticksToExcelSerial(ticks, n, serials, _impl.ticksPerDay());
+            for (size_t i = 0; i < n; ++i, ++start)
+              *start = serials[i];
           }
         }
       };
@@ -80,13 +145,23 @@ namespace xloil
 
         virtual ~ConverterHolder() {}
 
-        size_t stringLength() const { return _builder.stringLength(); }
+        size_t stringLength() const override { return _builder.stringLength(); }
 
-        virtual void operator()(ExcelArrayBuilder& /*builder*/,
+        /// <summary>
+        /// The values were converted in the constructor, so this only copies
+        /// them. Strings are interned via the builder if it is interning, 
+        /// otherwise they are copied to <paramref name="chars"/>, so the
+        /// column can be written concurrently with others.
+        /// </summary>
+        virtual void operator()(ExcelArrayBuilder& builder,
+          CharAllocator chars,
           xloil::detail::ArrayBuilderIterator& start,
-          xloil::detail::ArrayBuilderIterator& end)
+          xloil::detail::ArrayBuilderIterator& end) override
         {
-          _builder.copyToBuilder(start, end);
+          if (builder.interningStrings())
+            _builder.copyToBuilder(start, end);
+          else
+            _builder.copyToBuilder(start, end, chars);
         }
       };
 
@@ -104,6 +179,85 @@ namespace xloil
         }
       };
 
+      /// <summary>
+      /// Converts a pandas Categorical given as its integer codes and its
+      /// categories. Each category is converted once when the converter is
+      /// created, then the codes are expanded into the builder. A string
+      /// category is copied to the string store once and shared by all its
+      /// elements. Code -1, a missing value, gives #N/A.
+      /// </summary>
+      struct CategoricalConverter : public ApplyConverter
+      {
+        PyArrayObject* _codes;
+        ExcelObj _categories;
+        size_t _stringLength = 0;
+
+        CategoricalConverter(PyArrayObject* codes, PyArrayObject* categories, bool objectToString)
+          : _codes(codes)
+        {
+          if (!PyArray_ISINTEGER(codes))
+            XLO_THROW("Expected integer categorical codes");
+
+          const auto nCategories = (size_t)PyArray_DIMS(categories)[0];
+          if (nCategories == 0)
+            return;
+
+          size_t stringLength = 0;
+          unique_ptr<ApplyConverter> converter(switchDataType<CreateConverter>(
+            PyArray_TYPE(categories), categories, std::ref(stringLength), objectToString));
+
+          ExcelArrayBuilder builder((row_t)nCategories, 1, stringLength);
+          auto start = builder.col_begin(0);
+          auto end = builder.col_end(0);
+          (*converter)(builder, builder.charAllocator(), start, end);
+          _categories = builder.toExcelObj();
+
+          // Each string category is written once, with its length prefix
+          for (auto& category : ExcelArray(_categories, false))
+            if (category.isType(ExcelType::Str))
+              _stringLength += category.stringLength() + 1;
+        }
+
+        size_t stringLength() const override { return _stringLength; }
+
+        virtual void operator()(ExcelArrayBuilder& /*builder*/,
+          CharAllocator chars,
+          xloil::detail::ArrayBuilderIterator& start,
+          xloil::detail::ArrayBuilderIterator& end) override
+        {
+          // Copy string categories to the string store once. The elements
+          // then point to these copies.
+          vector<ExcelObj> values;
+          if (!_categories.isType(ExcelType::Nil))
+          {
+            ExcelArray categories(_categories, false);
+            values.reserve(categories.size());
+            for (auto& category : categories)
+            {
+              if (category.isType(ExcelType::Str))
+              {
+                values.emplace_back(BasicPString<wchar_t, CharAllocator>(
+                  category.cast<PStringRef>().view(), chars));
+              }
+              else
+                values.push_back(category);
+            }
+          }
+
+          const char* codes = PyArray_BYTES(_codes);
+          const auto stride = PyArray_STRIDE(_codes, 0);
+          switch (PyArray_ITEMSIZE(_codes))
+          {
+          case 1: xloil::detail::arrayExpandCodes<int8_t>(codes, stride, values, start, end); break;
+          case 2: xloil::detail::arrayExpandCodes<int16_t>(codes, stride, values, start, end); break;
+          case 4: xloil::detail::arrayExpandCodes<int32_t>(codes, stride, values, start, end); break;
+          case 8: xloil::detail::arrayExpandCodes<int64_t>(codes, stride, values, start, end); break;
+          default:
+            XLO_THROW("Unsupported categorical code size {}", PyArray_ITEMSIZE(_codes));
+          }
+        }
+      };
+
       size_t arrayShape(const py::handle& p)
       {
         if (p.is_none())
@@ -129,17 +283,28 @@ namespace xloil
         vector<unique_ptr<ApplyConverter>> _converters;
         size_t stringLength = 0;
         bool _hasObjectDtype;
+        bool _hasObjectData;
         bool _objectToString;
 
         Converters(size_t n, bool objectToString)
           : _objectToString(objectToString)
           , _hasObjectDtype(false)
+          , _hasObjectData(false)
         {
           _converters.reserve(n);
         }
 
-        auto collect(const py::handle& p, size_t expectedLength)
+        /// <summary>
+        /// Creates a converter for the array <paramref name="p"/>. Set 
+        /// <paramref name="isData"/> for table data, as opposed to headings
+        /// or index levels.
+        /// </summary>
+        void collect(const py::handle& p, size_t expectedLength, bool isData)
         {
+          // A tuple (codes, categories) is a pandas Categorical
+          if (PyTuple_Check(p.ptr()))
+            return collectCategorical(py::reinterpret_borrow<py::tuple>(p), expectedLength);
+
           auto shape = arrayShape(p);
 
           if (shape != expectedLength)
@@ -148,13 +313,42 @@ namespace xloil
           auto pyArr = (PyArrayObject*)p.ptr();
           const auto dtype = PyArray_TYPE(pyArr);
           if (dtype == NPY_OBJECT)
+          {
             _hasObjectDtype = true;
+            _hasObjectData |= isData;
+          }
 
           _converters.emplace_back(unique_ptr<ApplyConverter>(
             switchDataType<CreateConverter>(dtype, pyArr, std::ref(stringLength), _objectToString)));
         }
 
-        auto write(size_t iArray, ExcelArrayBuilder& builder, int startX, int startY, bool byRow)
+        void collectCategorical(const py::tuple& p, size_t expectedLength)
+        {
+          if (p.size() != 2)
+            XLO_THROW("Expected a categorical as a tuple (codes, categories)");
+
+          const py::object codes = p[0], categories = p[1];
+          if (codes.is_none() || categories.is_none())
+            XLO_THROW("Expected categorical codes and categories as arrays");
+          if (arrayShape(codes) != expectedLength)
+            XLO_THROW("Expected categorical codes of size {}", expectedLength);
+          arrayShape(categories);
+
+          // Categories are converted here, so even object categories do
+          // not need the GIL when writing
+          auto converter = new CategoricalConverter(
+            (PyArrayObject*)codes.ptr(), (PyArrayObject*)categories.ptr(), _objectToString);
+          _converters.emplace_back(unique_ptr<ApplyConverter>(converter));
+          stringLength += converter->stringLength();
+        }
+
+        void write(size_t iArray, ExcelArrayBuilder& builder, int startX, int startY, bool byRow)
+        {
+          write(iArray, builder, builder.charAllocator(), startX, startY, byRow);
+        }
+
+        void write(size_t iArray, ExcelArrayBuilder& builder, CharAllocator chars,
+          int startX, int startY, bool byRow)
         {
           auto start = byRow
             ? builder.row_begin(startX) + startY
@@ -164,14 +358,109 @@ namespace xloil
             ? builder.row_end(startX)
             : builder.col_end(startX);
 
-          (*_converters[iArray])(builder, start, end);
+          (*_converters[iArray])(builder, chars, start, end);
+        }
+
+        size_t columnStringLength(size_t iArray) const
+        {
+          return _converters[iArray]->stringLength();
         }
 
         /// <summary>
         /// Used to determine if we can release the GIL for the duration of the conversion
         /// </summary>
         auto hasObjectDtype() const { return _hasObjectDtype; }
+
+        /// <summary>
+        /// True if a data column, rather than a heading or index level, has 
+        /// object dtype. Such columns are written serially with interning.
+        /// </summary>
+        auto hasObjectData() const { return _hasObjectData; }
       };
+
+      /// <summary>
+      /// Collects converters for the index levels, then the data, then the 
+      /// heading levels. Returns the number of index and heading levels.
+      /// </summary>
+      auto collectTable(
+        Converters& converters,
+        uint32_t nOuter,
+        uint32_t nInner,
+        const py::object& tableData,
+        const py::object& headings,
+        const py::object& index)
+      {
+        auto nIndexLevels = 0u;
+        auto nHeadingLevels = 0u;
+        auto iInput = 0u; // Only used for error messages
+
+        // Examine data frame index
+        if (!index.is_none())
+        {
+          try
+          {
+            for (auto iter = py::iter(index); iter != py::iterator::sentinel(); ++iter, ++iInput)
+            {
+              converters.collect(*iter, nInner, false);
+              ++nIndexLevels;
+            }
+          }
+          catch (const std::exception& e)
+          {
+            XLO_THROW("Whilst reading index level {}: {}", iInput, e.what());
+          }
+        }
+
+        iInput = 0;
+        // First loop to establish array size and length of strings
+        for (auto iter = py::iter(tableData); iter != py::iterator::sentinel(); ++iter, ++iInput)
+        {
+          try
+          {
+            converters.collect(*iter, nInner, true);
+          }
+          catch (const std::exception& e)
+          {
+            XLO_THROW("Whilst reading column {}: {}", iInput, e.what());
+          }
+        }
+
+        if (!headings.is_none())
+        {
+          iInput = 0;
+          try
+          {
+            for (auto iter = py::iter(headings); iter != py::iterator::sentinel(); ++iter, ++iInput)
+            {
+              converters.collect(*iter, nOuter, false);
+              ++nHeadingLevels;
+            }
+          }
+          catch (const std::exception& e)
+          {
+            XLO_THROW("Whilst reading heading level {}: {}", iInput, e.what());
+          }
+        }
+
+        return std::make_pair(nIndexLevels, nHeadingLevels);
+      }
+
+      // Below this many cells, the table is written on the calling thread
+      constexpr size_t theParallelTableMinSize = 1 << 15;
+
+      /// <summary>
+      /// Returns the number of tasks used to write the table: 1 means it is 
+      /// written serially on the calling thread.
+      /// </summary>
+      size_t parallelTableChunks(const Converters& converters, size_t nTargets, size_t nCells)
+      {
+        const auto nChunks = std::min<size_t>(nTargets, std::thread::hardware_concurrency());
+        if (converters.hasObjectData()
+          || nChunks < 2
+          || nCells < theParallelTableMinSize)
+          return 1;
+        return nChunks;
+      }
     }
 
     ExcelObj numpyTableHelper(
@@ -191,70 +480,16 @@ namespace xloil
       const auto hasHeadings = !headings.is_none();
       const auto hasIndex = !index.is_none();
 
-      auto tableData = const_cast<PyObject*>(byRow ? rows.ptr() : columns.ptr());
-
-      // The row or column headings can be multi-level indices. We determine the number
-      // of levels from iterators later.
-      auto nHeadingLevels = 0u;
-      auto nIndexLevels = 0u;
-
+      const auto& tableData = byRow ? rows : columns;
 
       // Converters may end up larger if we have multi-level indices
       TableHelpers::Converters converters(
         nOuter + (hasHeadings ? 1 : 0) + (hasIndex ? 1 : 0), !useObjectCache);
 
-      
-      auto iInput = 0u; // Only used for error messages
-
-      // Examine data frame index
-      if (hasIndex)
-      {
-        iInput = 0;
-        try
-        {
-          for (auto iter = py::iter(index); iter != py::iterator::sentinel(); ++iter, ++iInput)
-          {
-            converters.collect(*iter, nInner);
-            ++nIndexLevels;
-          }
-        }
-        catch (const std::exception& e)
-        {
-          XLO_THROW("Whilst reading index level {}: {}", iInput, e.what());
-        }
-      }
-
-      
-      iInput = 0;
-      // First loop to establish array size and length of strings
-      for (auto iter = py::iter(tableData); iter != py::iterator::sentinel(); ++iter, ++iInput)
-      {
-        try
-        {
-          converters.collect(*iter, nInner);
-        }
-        catch (const std::exception& e)
-        {
-          XLO_THROW("Whilst reading column {}: {}", iInput, e.what());
-        }
-      }
-
-      if (hasHeadings)
-      {
-        iInput = 0;
-        try
-        {
-          for (auto iter = py::iter(headings); iter != py::iterator::sentinel(); ++iter, ++iInput)
-          {
-            converters.collect(*iter, nOuter);
-            ++nHeadingLevels;
-          }
-        }
-        catch (const std::exception& e)
-        {
-          XLO_THROW("Whilst reading heading level {}: {}", iInput, e.what());
-        }
-      }
+      // The row or column headings can be multi-level indices. The number
+      // of levels is determined whilst collecting.
+      const auto [nIndexLevels, nHeadingLevels] = TableHelpers::collectTable(
+        converters, nOuter, nInner, tableData, headings, index);
 
       vector<ExcelObj> indexNames(nIndexLevels * nHeadingLevels, CellError::NA);
       auto indexNameStringLength = 0;
@@ -283,6 +518,12 @@ namespace xloil
         nCols,
         converters.stringLength + indexNameStringLength);
 
+      // Object data columns, which include pandas strings, are written serially
+      // and their values often repeat, so intern them. Object headings and 
+      // index levels do not prevent a parallel write.
+      if (converters.hasObjectData())
+        builder.internStrings();
+
       // Write the index names in the top left
       if (!byRow)
       {
@@ -299,16 +540,81 @@ namespace xloil
             builder(i, j) = indexNames[k++];
       }
 
-      auto iConv = 0;
-
-      for (auto i = 0u; i < nOuter + nIndexLevels; ++i, ++iConv)
-        converters.write(iConv, builder, i, nHeadingLevels, byRow);
+      // Each converter writes one column (or row) of the output: the index
+      // levels and data, followed by the heading levels
+      struct Target { uint32_t outer, offset; bool byRow; };
+      vector<Target> targets;
+      targets.reserve(nOuter + nIndexLevels + nHeadingLevels);
+      for (auto i = 0u; i < nOuter + nIndexLevels; ++i)
+        targets.push_back({ i, nHeadingLevels, byRow });
+      for (auto i = 0u; i < nHeadingLevels; ++i)
+        targets.push_back({ i, nIndexLevels, !byRow });
+
+      const auto nTargets = targets.size();
+      const auto nChunks = TableHelpers::parallelTableChunks(
+        converters, nTargets, (size_t)nRows * nCols);
+
+      if (nChunks < 2)
+      {
+        for (auto k = 0u; k < nTargets; ++k)
+          converters.write(k, builder, targets[k].outer, targets[k].offset, targets[k].byRow);
+      }
+      else
+      {
+        // Give each converter its own region of the string store, then write
+        // in parallel. Each task takes a contiguous block of converters so 
+        // tasks only share cache lines in the builder at block boundaries.
+        vector<wchar_t*> regions(nTargets);
+        auto builderChars = builder.charAllocator();
+        for (auto k = 0u; k < nTargets; ++k)
+          regions[k] = builderChars.allocate(converters.columnStringLength(k));
+
+        vector<size_t> chunks(nChunks);
+        std::iota(chunks.begin(), chunks.end(), 0);
+        std::exception_ptr error;
+        std::mutex lockError;
+
+        std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](size_t iChunk)
+        {
+          try
+          {
+            for (auto k = iChunk * nTargets / nChunks; k < (iChunk + 1) * nTargets / nChunks; ++k)
+            {
+              auto stringData = regions[k];
+              TableHelpers::CharAllocator chars(stringData, stringData + converters.columnStringLength(k));
+              converters.write(k, builder, chars, targets[k].outer, targets[k].offset, targets[k].byRow);
+            }
+          }
+          catch (...)
+          {
+            std::scoped_lock lock(lockError);
+            error = std::current_exception();
+          }
+        });
 
-      for (auto i = 0u; i < nHeadingLevels; ++i, ++iConv)
-        converters.write(iConv, builder, i, nIndexLevels, !byRow);
+        if (error)
+          std::rethrow_exception(error);
+      }
 
       return builder.toExcelObj();
     }
+
+    bool numpyTableWriteParallel(
+      uint32_t nOuter,
+      uint32_t nInner,
+      const py::object& columns,
+      const py::object& rows,
+      const py::object& headings,
+      const py::object& index)
+    {
+      TableHelpers::Converters converters(nOuter, false);
+      const auto [nIndexLevels, nHeadingLevels] = TableHelpers::collectTable(
+        converters, nOuter, nInner, columns.is_none() ? rows : columns, headings, index);
+      const auto nCells = (size_t)(nOuter + nIndexLevels) * (nInner + nHeadingLevels);
+      return TableHelpers::parallelTableChunks(
+        converters, converters._converters.size(), nCells) > 1;
+    }
+
     namespace
     {
       static int theBinder = addBinder([](py::module& mod)
@@ -323,7 +629,8 @@ namespace xloil
             the number of data fields and the length of the fields
           columns / rows: 
             a iterable of numpy array containing data, specified as columns 
-            or rows (not both)
+            or rows (not both). A categorical is given as a tuple of arrays
+            (codes, categories): each category is converted only once
           headings:
             optional array of data field headings
           index:
@@ -343,6 +650,19 @@ namespace xloil
           py::arg("index") = py::none(),
           py::arg("index_name") = py::none(),
           py::arg("cache_objects") = false);
+
+        mod.def("_table_write_parallel",
+          &numpyTableWriteParallel,
+          R"(
+          For internal use. Returns True if _table_converter would write the
+          given table in parallel. Takes the same arguments as _table_converter.
+          )",
+          py::arg("n"),
+          py::arg("m"),
+          py::arg("columns") = py::none(),
+          py::arg("rows") = py::none(),
+          py::arg("headings") = py::none(),
+          py::arg("index") = py::none());
       });
     }
   }
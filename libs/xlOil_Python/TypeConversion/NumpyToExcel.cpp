@@ -2,6 +2,8 @@
 #include "PyCore.h"
 #include "BasicTypes.h"
 #include <xloil/FPArray.h>
+#include <xloil/Date.h>
+#include <optional>
 
 using std::vector;
 using std::string;
@@ -28,6 +30,114 @@ namespace xloil
             return true;
         return false;
       }
+
+      /// <summary>
+      /// Float64 and int32 arrays are written straight into the builder's
+      /// objects with a vectorised kernel rather than element-by-element.
+      /// So are datetime64 arrays, via a bulk conversion to serial dates,
+      /// when their units are a fixed fraction of a day.
+      /// </summary>
+      template <int TNpType>
+      constexpr bool hasBulkWriter = TNpType == NPY_DOUBLE || TNpType == NPY_INT
+        || TNpType == NPY_DATETIME;
+
+      inline void scatter(const double* in, size_t n, ExcelObj* out)
+      {
+        detail::arrayScatterDoubles(in, n, out);
+      }
+      inline void scatter(const int* in, size_t n, ExcelObj* out)
+      {
+        detail::arrayScatterInts(in, n, out);
+      }
+
+      struct ScatterNumbers
+      {
+        template <class T>
+        void operator()(const T* in, size_t n, ExcelObj* out) const
+        {
+          scatter(in, n, out);
+        }
+      };
+
+      struct ScatterDatetimes
+      {
+        double ticksPerDay;
+
+        void operator()(const npy_datetime* in, size_t n, ExcelObj* out) const
+        {
+          // Convert in blocks which stay in cache before writing them out
+          constexpr size_t blockSize = 1024;
+          double serials[blockSize];
+          for (size_t i = 0; i < n; i += blockSize)
+          {
+            const auto m = std::min(blockSize, n - i);
+            ticksToExcelSerial((const int64_t*)in + i, m, serials, ticksPerDay);
+            scatter(serials, m, out + i);
+          }
+        }
+      };
+
+      template <int TNpType>
+      bool canBulkWrite(const FromArrayImpl<TNpType>& converter)
+      {
+        if constexpr (TNpType == NPY_DATETIME)
+          return converter.ticksPerDay() > 0;
+        else
+          return hasBulkWriter<TNpType>;
+      }
+
+      template <int TNpType>
+      auto bulkScatter(const FromArrayImpl<TNpType>& converter)
+      {
+        if constexpr (TNpType == NPY_DATETIME)
+          return ScatterDatetimes{ converter.ticksPerDay() };
+        else
+          return ScatterNumbers();
+      }
+
+      /// <summary>
+      /// Writes a (rows x cols) array with the given byte strides into the 
+      /// builder, which must have rows * cols elements. Releases the GIL
+      /// if it is held.
+      /// </summary>
+      template <int TNpType, class TScatter>
+      void bulkWrite(
+        ExcelArrayBuilder& builder,
+        PyArrayObject* pyArr,
+        npy_intp rows, npy_intp cols,
+        npy_intp rowStride, npy_intp colStride,
+        const TScatter& scatter)
+      {
+        using TDataType = typename TypeTraits<TNpType>::storage;
+
+        // When called via numpyArrayToExcel the GIL has already been released
+        std::optional<py::gil_scoped_release> noGil;
+        if (PyGILState_Check())
+          noGil.emplace();
+
+        const auto data = PyArray_BYTES(pyArr);
+        auto out = &builder.element(0, 0);
+
+        if (colStride == sizeof(TDataType) && rowStride == cols * colStride)
+          scatter((const TDataType*)data, rows * cols, out);
+        else if (colStride == sizeof(TDataType))
+        {
+          for (npy_intp i = 0; i < rows; ++i, out += cols)
+            scatter((const TDataType*)(data + i * rowStride), cols, out);
+        }
+        else
+        {
+          // Gather each row so the kernel sees contiguous data
+          vector<TDataType> row(cols);
+          for (npy_intp i = 0; i < rows; ++i, out += cols)
+          {
+            auto elementPtr = data + i * rowStride;
+            for (npy_intp j = 0; j < cols; ++j, elementPtr += colStride)
+              row[j] = *(const TDataType*)elementPtr;
+            scatter(row.data(), cols, out);
+          }
+        }
+      }
     }
 
     template <int TNpType>
@@ -56,10 +166,23 @@ namespace xloil
         TImpl converter(pyArr);
 
         ExcelArrayBuilder builder((row_t)dims[0], 1, converter.stringLength());
-        auto elementPtr = PyArray_BYTES(pyArr);
         const auto stride = PyArray_STRIDE(pyArr, 0);
-        for (auto j = 0; j < dims[0]; ++j, elementPtr += stride)
-          builder(j, 0).take(converter.toExcelObj(builder, elementPtr));
+        bool written = false;
+        if constexpr (hasBulkWriter<TNpType>)
+        {
+          if (canBulkWrite(converter))
+          {
+            // A column has the same layout as a single row
+            bulkWrite<TNpType>(builder, pyArr, 1, dims[0], 0, stride, bulkScatter(converter));
+            written = true;
+          }
+        }
+        if (!written)
+        {
+          auto elementPtr = PyArray_BYTES(pyArr);
+          for (auto j = 0; j < dims[0]; ++j, elementPtr += stride)
+            builder(j, 0).take(converter.toExcelObj(builder, elementPtr));
+        }
 
         return _cache
           ? makeCached<ExcelObj>(builder.toExcelObj())
@@ -97,11 +220,24 @@ namespace xloil
 
         const auto stride1 = PyArray_STRIDE(pyArr, 0);
         const auto stride2 = PyArray_STRIDE(pyArr, 1);
-        for (auto i = 0; i < dims[0]; ++i)
+        bool written = false;
+        if constexpr (hasBulkWriter<TNpType>)
+        {
+          if (canBulkWrite(converter))
+          {
+            bulkWrite<TNpType>(builder, pyArr, dims[0], dims[1], stride1, stride2,
+              bulkScatter(converter));
+            written = true;
+          }
+        }
+        if (!written)
         {
-          auto elementPtr = PyArray_BYTES(pyArr) + i * stride1;
-          for (auto j = 0; j < dims[1]; ++j, elementPtr += stride2)
-            builder(i, j).take(converter.toExcelObj(builder, elementPtr));
+          for (auto i = 0; i < dims[0]; ++i)
+          {
+            auto elementPtr = PyArray_BYTES(pyArr) + i * stride1;
+            for (auto j = 0; j < dims[1]; ++j, elementPtr += stride2)
+              builder(i, j).take(converter.toExcelObj(builder, elementPtr));
+          }
         }
         return _cache
           ? xloil::makeCached<ExcelObj>(builder.toExcelObj())
@@ -216,7 +352,94 @@ namespace xloil
         XLO_THROW("Expected 1 or 2 dim array");
       }
     }
-  
+
+    namespace
+    {
+      template <int TNpType>
+      ExcelObj numericCopyToExcel(const NumericArrayCopy& copy)
+      {
+        using TDataType = typename TypeTraits<TNpType>::storage;
+        ExcelArrayBuilder builder((row_t)copy.rows, (col_t)copy.columns);
+        auto elementPtr = (TDataType*)copy.data.data();
+        if constexpr (hasBulkWriter<TNpType>)
+          scatter(elementPtr, copy.rows * copy.columns, &builder.element(0, 0));
+        else
+        {
+          FromArrayImpl<TNpType> converter(nullptr);
+          for (size_t i = 0; i < copy.rows; ++i)
+            for (size_t j = 0; j < copy.columns; ++j, ++elementPtr)
+              builder((row_t)i, (col_t)j).take(converter.toExcelObj(builder, elementPtr));
+        }
+        return builder.toExcelObj();
+      }
+    }
+
+    bool copyNumericArray(const PyObject* p, NumericArrayCopy& copy)
+    {
+      if (!isNumpyArray((PyObject*)p))
+        return false;
+
+      auto pyArr = (PyArrayObject*)p;
+      const auto nDims = PyArray_NDIM(pyArr);
+      const auto dims = PyArray_DIMS(pyArr);
+      if (nDims < 1 || nDims > 2 || isEmptyArray(dims, nDims))
+        return false;
+
+      const auto dtype = PyArray_TYPE(pyArr);
+      switch (dtype)
+      {
+      case NPY_BOOL: case NPY_SHORT: case NPY_USHORT: case NPY_INT: case NPY_UINT:
+      case NPY_LONG: case NPY_ULONG: case NPY_LONGLONG: case NPY_ULONGLONG:
+      case NPY_FLOAT: case NPY_DOUBLE:
+        break;
+      default:
+        return false;
+      }
+
+      copy.dtype = dtype;
+      copy.rows = (size_t)dims[0];
+      copy.columns = nDims == 2 ? (size_t)dims[1] : 1;
+
+      const auto itemsize = (size_t)PyArray_ITEMSIZE(pyArr);
+      copy.data.resize(copy.rows * copy.columns * itemsize);
+
+      if (PyArray_IS_C_CONTIGUOUS(pyArr))
+        memcpy(copy.data.data(), PyArray_DATA(pyArr), copy.data.size());
+      else
+      {
+        const auto stride1 = PyArray_STRIDE(pyArr, 0);
+        const auto stride2 = nDims == 2 ? PyArray_STRIDE(pyArr, 1) : 0;
+        auto target = copy.data.data();
+        for (size_t i = 0; i < copy.rows; ++i)
+        {
+          auto source = PyArray_BYTES(pyArr) + i * stride1;
+          for (size_t j = 0; j < copy.columns; ++j, source += stride2, target += itemsize)
+            memcpy(target, source, itemsize);
+        }
+      }
+      return true;
+    }
+
+    ExcelObj numericArrayToExcel(const NumericArrayCopy& copy)
+    {
+      switch (copy.dtype)
+      {
+      case NPY_BOOL:      return numericCopyToExcel<NPY_BOOL>(copy);
+      case NPY_SHORT:     return numericCopyToExcel<NPY_SHORT>(copy);
+      case NPY_USHORT:    return numericCopyToExcel<NPY_USHORT>(copy);
+      case NPY_INT:       return numericCopyToExcel<NPY_INT>(copy);
+      case NPY_UINT:      return numericCopyToExcel<NPY_UINT>(copy);
+      case NPY_LONG:      return numericCopyToExcel<NPY_LONG>(copy);
+      case NPY_ULONG:     return numericCopyToExcel<NPY_ULONG>(copy);
+      case NPY_LONGLONG:  return numericCopyToExcel<NPY_LONGLONG>(copy);
+      case NPY_ULONGLONG: return numericCopyToExcel<NPY_ULONGLONG>(copy);
+      case NPY_FLOAT:     return numericCopyToExcel<NPY_FLOAT>(copy);
+      case NPY_DOUBLE:    return numericCopyToExcel<NPY_DOUBLE>(copy);
+      default:
+        XLO_THROW("Unsupported numpy data type");
+      }
+    }
+
     std::shared_ptr<FPArray> numpyToFPArray(const PyObject* obj)
     {
       auto [pyArr, dims, nDims] = getArrayInfo(obj);
@@ -234,7 +457,7 @@ namespace xloil
 
       // Check if the array is in row-major order like the FPArray so we can
       // use memcpy (note the strides are in bytes).
-      if (strides[0] == itemsize * dims[0] && strides[1] == itemsize)
+      if (strides[0] == itemsize * dims[1] && strides[1] == itemsize)
       {
         const auto* raw = PyArray_BYTES(pyArr);
         const auto databytes = itemsize * dims[0] * dims[1];
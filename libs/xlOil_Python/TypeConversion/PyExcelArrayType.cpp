@@ -3,6 +3,7 @@
 #include "PyExcelArrayType.h"
 #include "PyCore.h"
 #include "BasicTypes.h"
+#include <xloil/Arrow.h>
 
 using std::vector;
 namespace py = pybind11;
@@ -138,8 +139,161 @@ namespace xloil
       return PySteal<>(excelArrayToNumpyArray(arr.base(), dims ? *dims : 2, dtype ? *dtype : -1));
     }
 
+    auto toCategorical(const PyExcelArray& arr)
+    {
+      return PySteal<py::tuple>(excelArrayToCategorical(arr.base()));
+    }
+
     namespace
     {
+      void deleteSchemaCapsule(PyObject* capsule)
+      {
+        auto* schema = (ArrowSchema*)PyCapsule_GetPointer(capsule, "arrow_schema");
+        if (!schema)
+          return;
+        if (schema->release)
+          schema->release(schema);
+        delete schema;
+      }
+
+      void deleteArrayCapsule(PyObject* capsule)
+      {
+        auto* array = (ArrowArray*)PyCapsule_GetPointer(capsule, "arrow_array");
+        if (!array)
+          return;
+        if (array->release)
+          array->release(array);
+        delete array;
+      }
+
+      py::tuple toArrow(const PyExcelArray& arr, bool headings)
+      {
+        auto schema = std::make_unique<ArrowSchema>();
+        auto array = std::make_unique<ArrowArray>();
+        {
+          py::gil_scoped_release noGil;
+          arrowExport(arr.base(), headings, schema.get(), array.get());
+        }
+        auto pySchema = PySteal<>(PyCapsule_New(schema.get(), "arrow_schema", deleteSchemaCapsule));
+        schema.release();
+        auto pyArray = PySteal<>(PyCapsule_New(array.get(), "arrow_array", deleteArrayCapsule));
+        array.release();
+        return py::make_tuple(pySchema, pyArray);
+      }
+
+      py::object arrowSchema(const PyExcelArray& arr)
+      {
+        auto schema = std::make_unique<ArrowSchema>();
+        {
+          py::gil_scoped_release noGil;
+          arrowExportSchema(arr.base(), true, schema.get());
+        }
+        auto pySchema = PySteal<>(PyCapsule_New(schema.get(), "arrow_schema", deleteSchemaCapsule));
+        schema.release();
+        return pySchema;
+      }
+
+      template<class T>
+      T* capsulePointer(const py::handle& capsule, const char* name)
+      {
+        auto* p = (T*)PyCapsule_GetPointer(capsule.ptr(), name);
+        if (!p)
+          throw py::error_already_set();
+        return p;
+      }
+
+      /// <summary>
+      /// Moves the struct out of a capsule created by another library, 
+      /// marking the original as released so the capsule destructor 
+      /// does nothing
+      /// </summary>
+      template<class T>
+      T takeFromCapsule(T* p)
+      {
+        T result = *p;
+        p->release = nullptr;
+        return result;
+      }
+
+      ExcelObj arrowToExcel(const py::object& obj, bool headings)
+      {
+        if (py::hasattr(obj, "__arrow_c_stream__"))
+        {
+          auto stream = takeFromCapsule(capsulePointer<ArrowArrayStream>(
+            obj.attr("__arrow_c_stream__")(), "arrow_array_stream"));
+          // The producer may need the GIL to read batches, so we only
+          // release it when we have them all
+          ArrowSchema schema;
+          schema.release = nullptr;
+          vector<ArrowArray> batches;
+          auto cleanup = [&]()
+          {
+            for (auto& batch : batches)
+              batch.release(&batch);
+            if (schema.release)
+              schema.release(&schema);
+            stream.release(&stream);
+          };
+          try
+          {
+            if (stream.get_schema(&stream, &schema) != 0)
+              XLO_THROW("Failed to read Arrow stream schema: {0}", stream.get_last_error(&stream));
+            while (true)
+            {
+              ArrowArray batch;
+              if (stream.get_next(&stream, &batch) != 0)
+                XLO_THROW("Failed to read Arrow stream: {0}", stream.get_last_error(&stream));
+              if (!batch.release)
+                break;
+              batches.push_back(batch);
+            }
+            ExcelObj result;
+            {
+              py::gil_scoped_release noGil;
+              result = arrowImport(schema, batches.data(), batches.size(), headings);
+            }
+            cleanup();
+            return result;
+          }
+          catch (...)
+          {
+            cleanup();
+            throw;
+          }
+        }
+        else if (py::hasattr(obj, "__arrow_c_array__"))
+        {
+          auto capsules = obj.attr("__arrow_c_array__")().cast<py::tuple>();
+          // Take ownership only once both capsules are known to be valid,
+          // so neither struct leaks if the other is not
+          auto pSchema = capsulePointer<ArrowSchema>(capsules[0], "arrow_schema");
+          auto pArray = capsulePointer<ArrowArray>(capsules[1], "arrow_array");
+          auto schema = takeFromCapsule(pSchema);
+          auto array = takeFromCapsule(pArray);
+          auto cleanup = [&]()
+          {
+            array.release(&array);
+            schema.release(&schema);
+          };
+          try
+          {
+            ExcelObj result;
+            {
+              py::gil_scoped_release noGil;
+              result = arrowImport(schema, array, headings);
+            }
+            cleanup();
+            return result;
+          }
+          catch (...)
+          {
+            cleanup();
+            throw;
+          }
+        }
+        throw py::type_error("Object does not support the Arrow PyCapsule interface");
+      }
+
       static int theBinder = addBinder([](pybind11::module& mod)
       {
         // Bind the PyExcelArray type to ExcelArray. PyExcelArray is a wrapper
@@ -180,6 +334,39 @@ namespace xloil
             )",
             py::arg("dtype") = py::none(), 
             py::arg("dims") = 2)
+          .def("to_categorical",
+            &toCategorical,
+            R"(
+              Dictionary-encodes a 1-dim array, returning a tuple of numpy arrays
+              *(codes, categories)* which can be passed to `pandas.Categorical.from_codes`.
+              Codes are assigned in order of first appearance and are -1 for empty
+              cells, empty strings or error values. Only the categories are converted to
+              python objects.
+            )")
+          .def("to_arrow",
+            &toArrow,
+            R"(
+              Converts the array to an Arrow struct array with one child per column,
+              returning a tuple of PyCapsules *(arrow_schema, arrow_array)* following
+              the Arrow C data interface. Columns holding any strings have type utf8, 
+              columns of only booleans have type boolean, other columns are float64. 
+              Empty and error values become nulls. If *headings* is True, the first row
+              gives the column names.
+            )",
+            py::arg("headings") = true)
+          .def("__arrow_c_array__",
+            [](const PyExcelArray& arr, const py::object& /*requested_schema*/)
+            {
+              return toArrow(arr, true);
+            },
+            R"(
+              Implements the Arrow PyCapsule interface, taking column names from
+              the first row. The *requested_schema* is ignored.
+            )",
+            py::arg("requested_schema") = py::none())
+          .def("__arrow_c_schema__",
+            &arrowSchema,
+            "Implements the Arrow PyCapsule interface")
           .def("__getitem__", 
             &PyExcelArray::getItem,
             R"(
@@ -199,6 +386,18 @@ namespace xloil
             "Returns a tuple (nrows, ncols) like numpy's array.shape");
 
         ExcelArrayType = (PyTypeObject*)aType.get_type().ptr();
+
+        mod.def("_arrow_to_excel",
+          &arrowToExcel,
+          R"(
+            For internal use. Converts an object supporting the Arrow PyCapsule 
+            interface, such as a pyarrow Table or RecordBatch, to a RawExcelValue
+            suitable for returning to xlOil. Prefers *__arrow_c_stream__* to 
+            *__arrow_c_array__*. If *headings* is True, the column names are 
+            written in the first row.
+          )",
+          py::arg("obj"),
+          py::arg("headings") = true);
       });
     }
   }
@@ -2,6 +2,8 @@
 #include <xloil/Interface.h>
 #include "XlArrayTable.h"
 #include <xlOil/ExcelArray.h>
+#include <xlOil/ArrayBuilder.h>
+#include <climits>
 
 using std::shared_ptr;
 using std::string;
@@ -135,80 +137,59 @@ namespace xloil
 
     ExcelObj sqlQueryToArray(const std::shared_ptr<sqlite3_stmt>& prepared)
     {
-      // Since we don't know the number of results in advance, our strategy is
-      // to collect ExcelObj values in a vector and (pascal) strings in separate 
-      // store. When we see a string, we put an empty string ExcelObj in results 
-      // (this allocates no internal storage) and the string value in strings.
-      // Later we allocate a contiguous block for both of these this data, copy 
-      // them and fix-up the string objects to point to the right place.
-      vector<ExcelObj> results;
-      vector<wchar_t> strings;
-
-      auto rc = sqlite3_step(prepared.get());
-      auto nCols = sqlite3_column_count(prepared.get());
-      int nRows = 0;
+      // Since we don't know the number of results in advance, we stream rows
+      // into a GrowableArrayBuilder, which writes values and strings into 
+      // chunked storage and compacts them into a single block at the end.
+      auto stmt = prepared.get();
+      auto rc = sqlite3_step(stmt);
+      const auto nCols = sqlite3_column_count(stmt);
+      if (rc != SQLITE_ROW || nCols == 0)
+        return Const::Error(CellError::NA);
+
+      GrowableArrayBuilder builder((ExcelObj::col_t)nCols);
+      // Text columns in query results tend to repeat a few values
+      builder.internStrings();
       while (rc == SQLITE_ROW)
       {
+        const auto i = builder.appendRow();
         for (auto j = 0; j < nCols; ++j)
         {
-          switch (sqlite3_column_type(prepared.get(), j))
+          switch (sqlite3_column_type(stmt, j))
           {
           case SQLITE_INTEGER:
-            results.emplace_back(sqlite3_column_int(prepared.get(), j));
+          {
+            // ExcelObj integers are 32-bit, so larger values become doubles
+            const auto value = sqlite3_column_int64(stmt, j);
+            if (value >= INT_MIN && value <= INT_MAX)
+              builder(i, j) = (int)value;
+            else
+              builder(i, j) = (double)value;
             break;
+          }
           case SQLITE_FLOAT:
-            results.emplace_back(sqlite3_column_double(prepared.get(), j));
+            builder(i, j) = sqlite3_column_double(stmt, j);
             break;
           case SQLITE_TEXT:
           {
-            auto text = (const wchar_t*)sqlite3_column_text16(prepared.get(), j);
-            auto len = std::min<wchar_t>(USHRT_MAX, (unsigned short)wcslen(text));
-            strings.push_back(len);
-            strings.insert(strings.end(), text, text + len);
-            // Empty string into results - we will fix it later
-            results.emplace_back(ExcelType::Str);
+            // Must call text16 before bytes16 so the length refers to the
+            // UTF-16 representation
+            auto text = (const wchar_t*)sqlite3_column_text16(stmt, j);
+            auto len = std::min<size_t>(XL_STRING_MAX_LEN,
+              sqlite3_column_bytes16(stmt, j) / sizeof(wchar_t));
+            builder(i, j) = std::wstring_view(text, len);
             break;
           }
           case SQLITE_BLOB:
           case SQLITE_NULL:
           default:
-            results.emplace_back(CellError::NA);
+            // Rows are initialised to #N/A
             break;
           }
         }
-        rc = sqlite3_step(prepared.get());
-        ++nRows;
-      }
-
-      if (results.empty())
-        return Const::Error(CellError::NA);
-
-      // Memcpy the ExcelObj and string values into a single block
-      // Since Excel expects arrays by-row, we don't need to re-order
-      auto resultsNBytes = sizeof(ExcelObj) * results.size();
-      auto stringsNBytes = sizeof(wchar_t) * strings.size();
-      auto* arrayData = new char[resultsNBytes + stringsNBytes];
-      auto* stringData = arrayData + resultsNBytes;
-      memcpy_s(arrayData, resultsNBytes, results.data(), resultsNBytes);
-      memcpy_s(stringData, stringsNBytes, strings.data(), stringsNBytes);
-
-      // Fix up strings
-      auto pObj = (ExcelObj*)arrayData;
-      auto pEnd = pObj + results.size();
-      auto pStr = (wchar_t*)stringData;
-      for (; pObj != pEnd; ++pObj)
-      {
-        if (pObj->xltype == msxll::xltypeStr)
-        {
-          assert((char*)pStr < stringData + stringsNBytes);
-          pObj->val.str.data = pStr;
-          pObj->val.str.xloil_view = true;
-          // Skip to the next string by adding the string length
-          pStr += pStr[0] + 1;
-        }
+        rc = sqlite3_step(stmt);
       }
 
-      return ExcelObj((const ExcelObj*)arrayData, nRows, nCols);
+      return builder.toExcelObj();
     }
   }
 }
\ No newline at end of file
@@ -0,0 +1,104 @@
+#pragma once
+#include <cctype>
+
+namespace xloil
+{
+  namespace SQL
+  {
+    /*
+    ** The idxNum passed from xBestIndex to xFilter holds the column in the
+    ** upper bits and a combination of these flags in the lower byte
+    */
+    enum IndexPlan
+    {
+      PLAN_EQ = 1,
+      PLAN_GT = 2,
+      PLAN_GE = 4,
+      PLAN_LT = 8,
+      PLAN_LE = 16,
+      PLAN_LOWER = PLAN_EQ | PLAN_GT | PLAN_GE,
+      PLAN_UPPER = PLAN_LT | PLAN_LE
+    };
+
+    /*
+    ** Collects the usable constraints on a single column into a plan. An
+    ** equality constraint replaces any bounds, since it selects fewer rows
+    ** and needs only one argument. Otherwise the first lower and upper
+    ** bounds seen are used. Each constraint kept becomes one argument to
+    ** xFilter: the lower (or EQ) constraint first, then the upper.
+    */
+    struct ColumnPlan
+    {
+      int flags = 0;
+      int lower = -1;  // Constraint index for EQ or lower bound
+      int upper = -1;  // Constraint index for upper bound
+
+      void addEqual(int iConstraint)
+      {
+        flags = (flags & ~(PLAN_LOWER | PLAN_UPPER)) | PLAN_EQ;
+        lower = iConstraint;
+        upper = -1;
+      }
+
+      void addLower(int iConstraint, bool inclusive)
+      {
+        if ((flags & PLAN_LOWER) != 0)
+          return;
+        flags |= inclusive ? PLAN_GE : PLAN_GT;
+        lower = iConstraint;
+      }
+
+      void addUpper(int iConstraint, bool inclusive)
+      {
+        if ((flags & (PLAN_UPPER | PLAN_EQ)) != 0)
+          return;
+        flags |= inclusive ? PLAN_LE : PLAN_LT;
+        upper = iConstraint;
+      }
+
+      /*
+      ** Adds a constraint given the IndexPlan flag for its operator and its
+      ** collation, returning false if it cannot be used. The index is in
+      ** code-point order, so only BINARY comparisons can use it: under NOCASE
+      ** or RTRIM, 'abc' = 'ABC' and a lookup would miss matching rows.
+      */
+      bool addConstraint(int iConstraint, IndexPlan op, const char* collation)
+      {
+        if (!isBinaryCollation(collation))
+          return false;
+        switch (op)
+        {
+        case PLAN_EQ: addEqual(iConstraint); return true;
+        case PLAN_GT: addLower(iConstraint, false); return true;
+        case PLAN_GE: addLower(iConstraint, true); return true;
+        case PLAN_LT: addUpper(iConstraint, false); return true;
+        case PLAN_LE: addUpper(iConstraint, true); return true;
+        default: return false;
+        }
+      }
+
+      /*
+      ** Collation names are case-insensitive. A null name means the default,
+      ** which is BINARY.
+      */
+      static bool isBinaryCollation(const char* collation)
+      {
+        if (!collation)
+          return true;
+        const char binary[] = "BINARY";
+        for (auto i = 0u; i < sizeof(binary); ++i)
+          if (std::toupper((unsigned char)collation[i]) != binary[i])
+            return false;
+        return true;
+      }
+
+      /*
+      ** The number of arguments xFilter receives for this plan
+      */
+      static int nArgs(int flags)
+      {
+        return ((flags & PLAN_LOWER) ? 1 : 0) + ((flags & PLAN_UPPER) ? 1 : 0);
+      }
+    };
+  }
+}
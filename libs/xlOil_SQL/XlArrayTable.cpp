@@ -1,24 +1,231 @@
 #include "XlArrayTable.h"
+#include "IndexPlan.h"
 #include <sqlite/sqlite3.h>
 #include <sqlite/sqlite3ext.h>
 #include <xlOil/ExcelArray.h>
 #include <xlOil/ExcelRef.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <type_traits>
+#include <vector>
 
 using std::shared_ptr;
 using std::pair;
+using std::vector;
+using std::unique_ptr;
+using std::wstring_view;
 
 namespace xloil
 {
   namespace SQL
   {
+    /*
+    ** Compares UTF-16 strings in code point order, which matches sqlite's 
+    ** BINARY collation on UTF-8 text. Plain wchar_t order differs for 
+    ** surrogate pairs versus code units above 0xE000.
+    */
+    inline int compareCodePoints(const wstring_view& l, const wstring_view& r)
+    {
+      auto fixup = [](wchar_t c) 
+      {
+        return c < 0xD800 ? (unsigned)c : (c < 0xE000 ? c + 0x2000u : c - 0x800u);
+      };
+      const auto len = std::min(l.size(), r.size());
+      for (size_t i = 0; i < len; ++i)
+      {
+        if (l[i] != r[i])
+          return fixup(l[i]) < fixup(r[i]) ? -1 : 1;
+      }
+      return l.size() < r.size() ? -1 : (l.size() == r.size() ? 0 : 1);
+    }
+
+    /*
+    ** A sorted index over one column of an ExcelArray, built lazily when 
+    ** sqlite plans a query with a constraint on that column. Only columns
+    ** whose values are all numeric or all text are indexed, so the key order
+    ** agrees with sqlite's. Errors and empties are NULL to sqlite and can
+    ** never satisfy a comparison, so they are left out of the index.
+    **
+    ** Constraints are not marked as omitted, so sqlite re-checks each row;
+    ** the index only needs to produce a superset of matching rows. That
+    ** holds only for the BINARY collation, so other constraints are not
+    ** used with the index.
+    */
+    class ColumnIndex
+    {
+    public:
+      enum class KeyType { None, Numeric, Text };
+
+      ColumnIndex(const ExcelArray& data, ExcelArray::col_t col)
+      {
+        const auto nRows = data.nRows();
+        _rows.reserve(nRows);
+
+        // Determine the key type, giving up on mixed-type columns
+        for (ExcelArray::row_t i = 0; i < nRows; ++i)
+        {
+          const auto& val = data(i, col);
+          KeyType type;
+          switch (val.type())
+          {
+          case ExcelType::Num:
+          case ExcelType::Int:
+          case ExcelType::Bool:
+            type = KeyType::Numeric; break;
+          case ExcelType::Str:
+            type = KeyType::Text; break;
+          default:
+            continue;
+          }
+          if (_keyType != KeyType::None && type != _keyType)
+          {
+            _keyType = KeyType::None;
+            _rows.clear();
+            return;
+          }
+          _keyType = type;
+          _rows.push_back(i);
+        }
+
+        if (_keyType == KeyType::Numeric)
+        {
+          vector<double> keys(nRows);
+          for (auto i : _rows)
+            keys[i] = data(i, col).get<double>();
+          std::stable_sort(_rows.begin(), _rows.end(),
+            [&](auto l, auto r) { return keys[l] < keys[r]; });
+          _numKeys.reserve(_rows.size());
+          for (auto i : _rows)
+            _numKeys.push_back(keys[i]);
+          _nDistinct = countDistinct(_numKeys,
+            [](double l, double r) { return l == r; });
+        }
+        else if (_keyType == KeyType::Text)
+        {
+          vector<wstring_view> keys(nRows);
+          for (auto i : _rows)
+            keys[i] = data(i, col).asStringView();
+          std::stable_sort(_rows.begin(), _rows.end(),
+            [&](auto l, auto r) { return compareCodePoints(keys[l], keys[r]) < 0; });
+          _textKeys.reserve(_rows.size());
+          for (auto i : _rows)
+            _textKeys.push_back(keys[i]);
+          _nDistinct = countDistinct(_textKeys, 
+            [](const wstring_view& l, const wstring_view& r) { return l == r; });
+        }
+      }
+
+      KeyType keyType() const { return _keyType; }
+      size_t nDistinct() const { return _nDistinct; }
+      bool unique() const { return _nDistinct == _rows.size(); }
+
+      /*
+      ** Finds the range of row ids satisfying the given bounds, either of 
+      ** which may be null. Returns false if the bound values cannot be 
+      ** compared using the index, in which case a full scan is required.
+      */
+      bool find(
+        sqlite3_value* lower, bool lowerInclusive, 
+        sqlite3_value* upper, bool upperInclusive,
+        const unsigned** begin, const unsigned** end) const
+      {
+        size_t iBegin = 0, iEnd = _rows.size();
+        // Comparisons with NULL are never true
+        if ((lower && sqlite3_value_type(lower) == SQLITE_NULL)
+          || (upper && sqlite3_value_type(upper) == SQLITE_NULL))
+        {
+          *begin = *end = _rows.data();
+          return true;
+        }
+        if (lower && !bound(lower, !lowerInclusive, iBegin))
+          return false;
+        if (upper && !bound(upper, upperInclusive, iEnd))
+          return false;
+        *begin = _rows.data() + iBegin;
+        *end = _rows.data() + std::max(iBegin, iEnd);
+        return true;
+      }
+
+    private:
+      KeyType _keyType = KeyType::None;
+      vector<unsigned> _rows;
+      vector<double> _numKeys;
+      vector<wstring_view> _textKeys;
+      size_t _nDistinct = 0;
+
+      template<class T, class TEq>
+      static size_t countDistinct(const vector<T>& sorted, TEq equal)
+      {
+        size_t n = sorted.empty() ? 0 : 1;
+        for (size_t i = 1; i < sorted.size(); ++i)
+          if (!equal(sorted[i - 1], sorted[i]))
+            ++n;
+        return n;
+      }
+
+      /*
+      ** Sets position to the first key greater than (if after is true) or
+      ** not less than the value
+      */
+      bool bound(sqlite3_value* value, bool after, size_t& position) const
+      {
+        switch (sqlite3_value_type(value))
+        {
+        case SQLITE_INTEGER:
+        case SQLITE_FLOAT:
+        {
+          if (_keyType != KeyType::Numeric)
+            return false;
+          const auto x = sqlite3_value_double(value);
+          auto i = after
+            ? std::upper_bound(_numKeys.begin(), _numKeys.end(), x)
+            : std::lower_bound(_numKeys.begin(), _numKeys.end(), x);
+          position = i - _numKeys.begin();
+          return true;
+        }
+        case SQLITE_TEXT:
+        {
+          if (_keyType != KeyType::Text)
+            return false;
+          auto text = (const wchar_t*)sqlite3_value_text16(value);
+          wstring_view x(text, sqlite3_value_bytes16(value) / sizeof(wchar_t));
+          auto less = [](const wstring_view& l, const wstring_view& r) 
+          { 
+            return compareCodePoints(l, r) < 0; 
+          };
+          auto i = after
+            ? std::upper_bound(_textKeys.begin(), _textKeys.end(), x, less)
+            : std::lower_bound(_textKeys.begin(), _textKeys.end(), x, less);
+          position = i - _textKeys.begin();
+          return true;
+        }
+        default:
+          return false;
+        }
+      }
+    };
+
     /* An instance of the XlArray virtual table */
    
     struct XlArrayTable
     {
       using InputType = XlArrayInput;
-      XlArrayTable(const InputType& input) : data(input) {};
+      XlArrayTable(const InputType& input) 
+        : data(input)
+        , indices(input.nCols())
+      {};
       sqlite3_vtab base;              /* Base class.  Must be first */
       ExcelArray data;
+      vector<unique_ptr<ColumnIndex>> indices;
+
+      const ColumnIndex& index(int col)
+      {
+        auto& idx = indices[col];
+        if (!idx)
+          idx.reset(new ColumnIndex(data, col));
+        return *idx;
+      }
     };
 
     struct XlRangeTable
@@ -49,6 +256,8 @@ namespace xloil
     {
       sqlite3_vtab_cursor base;  /* Base class.  Must be first */
       int iRowid;                /* The current rowid.  Negative for EOF */
+      const unsigned* pIndex;    /* Current position in a ColumnIndex, or null for a full scan */
+      const unsigned* pIndexEnd;
     };
 
     template<class T>
@@ -88,14 +297,125 @@ namespace xloil
       return xConnect<T>(db, pAux, argc, argv, ppVtab, pzErr);
     }
 
-    static int xBestIndex(
-      sqlite3_vtab*,
+    /*
+    ** Range tables read directly from Excel, so only a full table scan 
+    ** is supported.
+    */
+    static int xBestIndexScan(
+      sqlite3_vtab* pVtab,
       sqlite3_index_info *pIdxInfo)
     {
-      pIdxInfo->estimatedCost = 1000000;
+      auto *pTab = (const XlRangeTable*)pVtab;
+      pIdxInfo->estimatedCost = (double)pTab->data.nRows() * pTab->data.nCols();
+      pIdxInfo->estimatedRows = pTab->data.nRows();
       return SQLITE_OK;
     }
 
+    /*
+    ** Chooses the cheapest of a full scan, an equality lookup or a range
+    ** scan on a single column. The column indices required for costing 
+    ** are built here, since a constrained column is likely to be a join 
+    ** key which will be looked up many times.
+    */
+    static int xBestIndexArray(
+      sqlite3_vtab* pVtab,
+      sqlite3_index_info *pIdxInfo)
+    {
+      auto *pTab = (XlArrayTable*)pVtab;
+      const auto nRows = std::max<double>(1, pTab->data.nRows());
+      const auto logRows = std::log2(nRows) + 1;
+
+      struct Candidate : public ColumnPlan
+      {
+        int column = -1;
+        double cost;
+        double rows;
+        bool unique = false;
+      };
+
+      Candidate best;
+      best.cost = nRows;
+      best.rows = nRows;
+
+      // Group usable constraints by column 
+      vector<Candidate> byColumn(pTab->data.nCols());
+      for (auto i = 0; i < pIdxInfo->nConstraint; ++i)
+      {
+        const auto& constraint = pIdxInfo->aConstraint[i];
+        if (!constraint.usable || constraint.iColumn < 0
+          || constraint.iColumn >= (int)byColumn.size())
+          continue;
+
+        IndexPlan op;
+        switch (constraint.op)
+        {
+        case SQLITE_INDEX_CONSTRAINT_EQ: op = PLAN_EQ; break;
+        case SQLITE_INDEX_CONSTRAINT_GT: op = PLAN_GT; break;
+        case SQLITE_INDEX_CONSTRAINT_GE: op = PLAN_GE; break;
+        case SQLITE_INDEX_CONSTRAINT_LT: op = PLAN_LT; break;
+        case SQLITE_INDEX_CONSTRAINT_LE: op = PLAN_LE; break;
+        default:
+          continue;
+        }
+        byColumn[constraint.iColumn].addConstraint(
+          i, op, sqlite3_vtab_collation(pIdxInfo, i));
+      }
+
+      for (auto j = 0; j < (int)byColumn.size(); ++j)
+      {
+        auto& candidate = byColumn[j];
+        if (candidate.flags == 0)
+          continue;
+
+        const auto& index = pTab->index(j);
+        if (index.keyType() == ColumnIndex::KeyType::None)
+          continue;
+
+        candidate.column = j;
+        if (candidate.flags & PLAN_EQ)
+        {
+          candidate.unique = index.unique();
+          candidate.rows = std::max<double>(1, nRows / std::max<size_t>(1, index.nDistinct()));
+        }
+        else
+        {
+          // Usual heuristic: each range bound selects a quarter of the rows
+          const auto nBounds = (candidate.lower >= 0 ? 1 : 0) + (candidate.upper >= 0 ? 1 : 0);
+          candidate.rows = std::max<double>(1, nRows / (nBounds == 2 ? 16 : 4));
+        }
+        candidate.cost = logRows + candidate.rows;
+        if (candidate.cost < best.cost)
+          best = candidate;
+      }
+
+      if (best.column >= 0)
+      {
+        auto argvIndex = 1;
+        if (best.lower >= 0)
+          pIdxInfo->aConstraintUsage[best.lower].argvIndex = argvIndex++;
+        if (best.upper >= 0)
+          pIdxInfo->aConstraintUsage[best.upper].argvIndex = argvIndex++;
+        pIdxInfo->idxNum = (best.column << 8) | best.flags;
+        if (best.unique)
+          pIdxInfo->idxFlags |= SQLITE_INDEX_SCAN_UNIQUE;
+      }
+
+      pIdxInfo->estimatedCost = best.cost;
+      pIdxInfo->estimatedRows = (sqlite3_int64)best.rows;
+      return SQLITE_OK;
+    }
+
+    template<class T>
+    static int xBestIndex(
+      sqlite3_vtab* pVtab,
+      sqlite3_index_info *pIdxInfo)
+    {
+      if constexpr (std::is_same_v<T, XlArrayTable>)
+        return xBestIndexArray(pVtab, pIdxInfo);
+      else
+        return xBestIndexScan(pVtab, pIdxInfo);
+    }
+
     /*
     ** This is the destructor for the vtable.
     */
@@ -122,16 +442,43 @@ namespace xloil
     }
 
     /*
-    ** Only a full table scan is supported.  So xFilter simply rewinds to
-    ** the beginning.
+    ** Starts a full table scan if idxNum is zero, otherwise looks up the
+    ** the range of rows to visit in the column index.
     */
+    template<class T>
     static int xFilter(
       sqlite3_vtab_cursor *pVtabCursor,
-      int /*idxNum*/, const char* /*idxStr*/,
-      int /*argc*/, sqlite3_value** /*argv*/)
+      int idxNum, const char* /*idxStr*/,
+      int argc, sqlite3_value** argv)
     {
       auto *pCur = (XlTableCursor*)pVtabCursor;
-      pCur->iRowid = 0;
+      auto *pTab = (T*)pVtabCursor->pVtab;
+      pCur->pIndex = pCur->pIndexEnd = nullptr;
+      pCur->iRowid = pTab->data.nRows() > 0 ? 0 : -1;
+
+      if constexpr (std::is_same_v<T, XlArrayTable>)
+      {
+        const auto flags = idxNum & 0xff;
+        if (flags == 0)
+          return SQLITE_OK;
+
+        const auto& index = pTab->index(idxNum >> 8);
+        const auto hasLower = (flags & PLAN_LOWER) != 0;
+        assert(argc == ColumnPlan::nArgs(flags));
+
+        auto lower = hasLower ? argv[0] : nullptr;
+        auto upper = (flags & PLAN_EQ) ? argv[0] : ((flags & PLAN_UPPER) ? argv[argc - 1] : nullptr);
+        
+        // If the index cannot be used for these values, we leave the cursor
+        // set for a full scan
+        if (index.find(
+          lower, (flags & (PLAN_EQ | PLAN_GE)) != 0,
+          upper, (flags & (PLAN_EQ | PLAN_LE)) != 0,
+          &pCur->pIndex, &pCur->pIndexEnd))
+        {
+          pCur->iRowid = pCur->pIndex != pCur->pIndexEnd ? (int)*pCur->pIndex : -1;
+        }
+      }
       return SQLITE_OK;
     }
 
@@ -144,7 +491,9 @@ namespace xloil
     {
       auto *pCur = (XlTableCursor*)cur;
       auto *pTab = (const T*)cur->pVtab;
-      if (++pCur->iRowid >= (int)pTab->data.nRows())
+      if (pCur->pIndex)
+        pCur->iRowid = ++pCur->pIndex != pCur->pIndexEnd ? (int)*pCur->pIndex : -1;
+      else if (++pCur->iRowid >= (int)pTab->data.nRows())
         pCur->iRowid = -1;
       return SQLITE_OK;
     }
@@ -217,12 +566,12 @@ namespace xloil
       0,                  /* iVersion */
       xCreate<T>,         /* xCreate */
       xConnect<T>,        /* xConnect */
-      xBestIndex,         /* xBestIndex */
+      xBestIndex<T>,      /* xBestIndex */
       xDisconnect<T>,     /* xDisconnect */
       xDisconnect<T>,     /* xDestroy */
       xOpen,              /* xOpen - open a cursor */
       xClose,             /* xClose - close a cursor */
-      xFilter,            /* xFilter - configure scan constraints */
+      xFilter<T>,         /* xFilter - configure scan constraints */
       xNext<T>,           /* xNext - advance a cursor */
       xEof,               /* xEof - check for end of scan */
       xColumn<T>,         /* xColumn - read data */
@@ -1,6 +1,14 @@
 #pragma once
 #include <xloil/Throw.h>
 #include <regex>
+#include <string>
+#include <string_view>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+#include <cwctype>
 
 namespace xloil
 {
@@ -22,4 +30,208 @@ namespace xloil
   }
   constexpr auto _GrammerHelp =
     L"(ecma) Choice of regex syntax: ecma, basic, extended, awk, grep, egrep. See https://en.cppreference.com/w/cpp/regex/syntax_option_type";
-}
\ No newline at end of file
+
+  /// <summary>
+  /// A compiled regex. Patterns which contain no metacharacters in any of
+  /// the grammars are also matched by a Boyer-Moore-Horspool literal search,
+  /// which avoids std::regex's backtracking engine. Other patterns, and
+  /// anything needing capture groups or formatting, use the std::wregex.
+  ///
+  /// Not copyable as the searcher refers to the pattern string. Use
+  /// <see cref="compileRegex"/> to get a shared, cached instance.
+  /// </summary>
+  class CompiledRegex
+  {
+  public:
+    CompiledRegex(
+      const std::wstring_view& pattern,
+      std::regex_constants::syntax_option_type options)
+      : _regex(pattern.begin(), pattern.end(), options)
+      , _icase((options & std::regex_constants::icase) != 0)
+      , _isLiteral(isLiteralPattern(pattern))
+      , _literal(_isLiteral ? fold(pattern) : std::wstring())
+      , _searcher(_literal.begin(), _literal.end(), FoldHash{ _icase }, FoldEqual{ _icase })
+    {}
+
+    CompiledRegex(const CompiledRegex&) = delete;
+    CompiledRegex& operator=(const CompiledRegex&) = delete;
+
+    const std::wregex& regex() const { return _regex; }
+
+    size_t markCount() const { return _regex.mark_count(); }
+
+    /// <summary>
+    /// True if the pattern is matched as a literal string
+    /// </summary>
+    bool isLiteral() const { return _isLiteral; }
+
+    /// <summary>
+    /// For a literal pattern, returns the position of the first match at or
+    /// after <paramref name="from"/>, or npos if there is none.
+    /// </summary>
+    size_t findLiteral(const std::wstring_view& str, size_t from = 0) const
+    {
+      if (from > str.size())
+        return std::wstring_view::npos;
+      const auto found = _searcher(str.begin() + from, str.end()).first;
+      return found == str.end()
+        ? std::wstring_view::npos
+        : (size_t)(found - str.begin());
+    }
+
+    /// <summary>
+    /// For a literal pattern, the length of a match
+    /// </summary>
+    size_t literalLength() const { return _literal.size(); }
+
+    /// <summary>
+    /// Returns true if the pattern matches the whole string or, if
+    /// <paramref name="wholeString"/> is false, any part of it.
+    /// </summary>
+    bool test(const std::wstring_view& str, bool wholeString) const
+    {
+      if (_isLiteral)
+        return wholeString
+          ? str.size() == _literal.size() && findLiteral(str) == 0
+          : findLiteral(str) != std::wstring_view::npos;
+
+      return wholeString
+        ? std::regex_match(str.begin(), str.end(), _regex)
+        : std::regex_search(str.begin(), str.end(), _regex);
+    }
+
+  private:
+    struct FoldHash
+    {
+      bool icase;
+      size_t operator()(wchar_t c) const
+      {
+        return std::hash<wchar_t>()(icase ? (wchar_t)::towlower(c) : c);
+      }
+    };
+    struct FoldEqual
+    {
+      bool icase;
+      bool operator()(wchar_t a, wchar_t b) const
+      {
+        return a == b || (icase && ::towlower(a) == ::towlower(b));
+      }
+    };
+
+    using Searcher = std::boyer_moore_horspool_searcher<
+      std::wstring::const_iterator, FoldHash, FoldEqual>;
+
+    std::wregex _regex;
+    bool _icase;
+    bool _isLiteral;
+    std::wstring _literal;
+    Searcher _searcher;
+
+    std::wstring fold(const std::wstring_view& str) const
+    {
+      std::wstring result(str);
+      if (_icase)
+        for (auto& c : result)
+          c = (wchar_t)::towlower(c);
+      return result;
+    }
+
+    static bool isLiteralPattern(const std::wstring_view& pattern)
+    {
+      // Newline is an alternation in grep and egrep. An empty pattern
+      // matches at every position, which the regex iterator handles.
+      return !pattern.empty()
+        && pattern.find_first_of(L"^$\\.*+?()[]{}|\n") == std::wstring_view::npos;
+    }
+  };
+
+  /// <summary>
+  /// A thread-safe, bounded cache of compiled regexes keyed on the pattern
+  /// and options, i.e. grammar and icase. Least recently used entries are
+  /// discarded when full. Regexes are compiled outside the lock, so two
+  /// threads may occasionally compile the same pattern.
+  /// </summary>
+  class RegexCache
+  {
+  public:
+    explicit RegexCache(size_t capacity = 256)
+      : _capacity(capacity)
+    {}
+
+    std::shared_ptr<const CompiledRegex> get(
+      const std::wstring_view& pattern,
+      std::regex_constants::syntax_option_type options)
+    {
+      // Prepend the option flags to the pattern to make the key
+      std::wstring key;
+      key.reserve(pattern.size() + 2);
+      key.push_back((wchar_t)(options & 0xFFFF));
+      key.push_back((wchar_t)((unsigned)options >> 16));
+      key.append(pattern);
+
+      {
+        std::scoped_lock lock(_mutex);
+        auto found = _lookup.find(key);
+        if (found != _lookup.end())
+        {
+          ++_hits;
+          _entries.splice(_entries.begin(), _entries, found->second);
+          return found->second->second;
+        }
+        ++_misses;
+      }
+
+      auto compiled = std::make_shared<const CompiledRegex>(pattern, options);
+
+      std::scoped_lock lock(_mutex);
+      auto [found, isNew] = _lookup.try_emplace(key);
+      if (!isNew)
+        return found->second->second;
+
+      _entries.emplace_front(std::move(key), compiled);
+      found->second = _entries.begin();
+      if (_entries.size() > _capacity)
+      {
+        _lookup.erase(_entries.back().first);
+        _entries.pop_back();
+      }
+      return compiled;
+    }
+
+    size_t hits() const
+    {
+      std::scoped_lock lock(_mutex);
+      return _hits;
+    }
+    size_t misses() const
+    {
+      std::scoped_lock lock(_mutex);
+      return _misses;
+    }
+    size_t size() const
+    {
+      std::scoped_lock lock(_mutex);
+      return _entries.size();
+    }
+
+  private:
+    using Entry = std::pair<std::wstring, std::shared_ptr<const CompiledRegex>>;
+    std::list<Entry> _entries;
+    std::unordered_map<std::wstring, std::list<Entry>::iterator> _lookup;
+    size_t _capacity;
+    size_t _hits = 0, _misses = 0;
+    mutable std::mutex _mutex;
+  };
+
+  /// <summary>
+  /// Returns a compiled regex from a cache shared by all functions in this
+  /// module.
+  /// </summary>
+  inline std::shared_ptr<const CompiledRegex> compileRegex(
+    const std::wstring_view& pattern,
+    std::regex_constants::syntax_option_type options)
+  {
+    static RegexCache theCache;
+    return theCache.get(pattern, options);
+  }
+}
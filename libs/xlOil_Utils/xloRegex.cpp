@@ -44,7 +44,9 @@ namespace xloil
     if (ignoreCase.get<bool>(false))
       regexOptions |= std::regex_constants::icase;
 
-    const std::wregex expression(searchRegex.toString(), regexOptions);
+    // Compiling a regex is expensive, so we reuse them across calls
+    const auto compiled = compileRegex(searchRegex.toString(), regexOptions);
+    const auto& expression = compiled->regex();
 
     const auto replaceExpression = replaceExpr.toString();
     const auto doReplace = !replaceExpression.empty();
@@ -65,75 +67,66 @@ namespace xloil
       // Orient output array consistent with input
       const bool byRow = inputArray.nCols() == 1;
 
-      // Do first parse to determine string length
-      auto totalStrLength = 0u;
-      for (auto& val : inputArray)
-        if (val.isType(ExcelType::Str))
-          totalStrLength += val.cast<PStringRef>().length();
-
       // Output array has 1 field if a replace string or no capture groups
       // have be specified, else one field per capture group
       const auto outputWidth = (doReplace || nGroups == 0) ? 1 : nGroups;
 
-      ExcelArrayBuilder builder(
-        byRow ? inputArray.size() : outputWidth,
-        byRow ? outputWidth : inputArray.size(),
-        totalStrLength);
-
-      // We may not write to every cell, so need to initialise
-      builder.fillNA();
+      // Build one row per input value and transpose at the end if required,
+      // this avoids a pass through the input to determine the string length.
+      // Unwritten elements default to #N/A.
+      GrowableArrayBuilder builder((ExcelObj::col_t)outputWidth);
+      builder.resize((ExcelObj::row_t)inputArray.size());
 
       auto k = 0u;
       for (const auto& val : inputArray)
       {
-        // First row/column entry
-        auto writePosition = byRow ? builder(k, 0) : builder(0, k);
-
         if (val.isType(ExcelType::Str))
         {
           const auto pStr = val.cast<PStringRef>();
 
+          if (nGroups == 0)
+          {
+            builder(k++, 0) = compiled->test(pStr.view(), isMatch);
+            continue;
+          }
+
           std::wcmatch matchResults;
           const auto success = doMatch(pStr, expression, matchResults, isMatch);
           const auto N = matchResults.size();
 
-          if (nGroups == 0)
-            writePosition = success;
-          else if (success)
+          if (success)
           {
             assert(N > 1);
 
             if (doReplace)
-              writePosition = matchResults.format(replaceExpression);
-            else if (byRow)
+              builder(k, 0) = matchResults.format(replaceExpression);
+            else
               for (size_t j = 1; j < N; ++j)
                 builder(k, j - 1) = strView(matchResults[j]);
-            else
-              for (size_t i = 1; i < N; ++i)
-                builder(i - 1, k) = strView(matchResults[i]);
           }
         }
         else
         {
-          writePosition = notStringValue;
+          builder(k, 0) = notStringValue;
         }
         ++k;
       }
 
-      return returnValue(builder.toExcelObj());
+      return returnValue(builder.toExcelObj(!byRow));
     }
     else if (input.isType(ExcelType::Str))
     {
       const auto pStr = input.cast<PStringRef>();
+      if (nGroups == 0)
+        return returnValue(compiled->test(pStr.view(), isMatch));
+
       std::wcmatch matchResults;
 
       const auto success = doMatch(pStr, expression, matchResults, isMatch);
 
       const auto N = (ExcelObj::row_t)matchResults.size();
 
-      if (nGroups == 0)
-        return returnValue(success);
-      else if (!success)
+      if (!success)
         return returnValue(CellError::NA);
       else if (doReplace)
         return returnValue(matchResults.format(replaceExpression));
@@ -29,7 +29,9 @@ namespace xloil
     if (ignoreCase.get<bool>(false))
       regexOptions |= std::regex_constants::icase;
 
-    const std::wregex expression(searchRegex.toString(), regexOptions);
+    // Compiling a regex is expensive, so we reuse them across calls
+    const auto compiled = compileRegex(searchRegex.toString(), regexOptions);
+    const auto& expression = compiled->regex();
 
     const auto giveIndices = replaceExpr.getIf<double>() == -1;
     const auto replaceExpression = giveIndices ? wstring() : replaceExpr.toString();
@@ -39,57 +41,55 @@ namespace xloil
     
     const auto pStr = input.cast<PStringRef>();
 
-    vector<std::wcmatch> matchResults;
-    size_t totalStrLength = 0;
-    auto beginIterator = std::wcregex_iterator(pStr.begin(), pStr.end(), expression);
-    auto endIterator = std::wcregex_iterator();
-    for (auto i = beginIterator; i != endIterator; ++i)
-    {
-      matchResults.push_back(*i);
-      totalStrLength += (size_t)i->length();
-    }
-
-    const auto N = (ExcelObj::row_t)matchResults.size();
-    if (N == 0)
-      return returnValue(CellError::NA);
-
     const auto width = doReplace ? 1 : (nGroups == 0 ? 1 : nGroups);
-    ExcelArrayBuilder builder(N, width, giveIndices ? 0 : totalStrLength);
 
-    if (doReplace)
-    {
-      for (ExcelObj::row_t i = 0; i < N; ++i)
-        builder(i, 0) = matchResults[i].format(replaceExpression);
-    }
-    else if (nGroups > 0)
+    // The number of matches and total string length are not known in 
+    // advance, so we grow the output array as we iterate 
+    GrowableArrayBuilder builder((ExcelObj::col_t)width, giveIndices ? 0 : pStr.length());
+
+    if (compiled->isLiteral() && !doReplace)
     {
-      if (giveIndices)
-      {
-        for (ExcelObj::row_t i = 0; i < N; ++i)
-          for (size_t j = 0; j < nGroups; ++j)
-            builder(i, j) = matchResults[i][j + 1].first - pStr.begin();
-      }
-      else
+      // Literal patterns have no groups, so each match gives one value
+      const auto str = pStr.view();
+      const auto len = compiled->literalLength();
+      for (auto pos = compiled->findLiteral(str); pos != wstring_view::npos;
+        pos = compiled->findLiteral(str, pos + len))
       {
-        for (ExcelObj::row_t i = 0; i < N; ++i)
-          for (size_t j = 0; j < nGroups; ++j)
-            builder(i, j) = strView(matchResults[i][j + 1]);
+        const auto i = builder.appendRow();
+        if (giveIndices)
+          builder(i, 0) = (int)pos;
+        else
+          builder(i, 0) = str.substr(pos, len);
       }
     }
-    else 
+    else
     {
-      if (giveIndices)
+      auto beginIterator = std::wcregex_iterator(pStr.begin(), pStr.end(), expression);
+      auto endIterator = std::wcregex_iterator();
+      for (auto match = beginIterator; match != endIterator; ++match)
       {
-        for (ExcelObj::row_t i = 0; i < N; ++i)
-          builder(i, 0) = strView(matchResults[i][0]);
-      }
-      else
-      {
-        for (ExcelObj::row_t i = 0; i < N; ++i)
-          builder(i, 0) = matchResults[i][0].first - pStr.begin();
+        const auto i = builder.appendRow();
+        if (doReplace)
+          builder(i, 0) = match->format(replaceExpression);
+        else if (nGroups > 0)
+        {
+          if (giveIndices)
+            for (size_t j = 0; j < nGroups; ++j)
+              builder(i, j) = (*match)[j + 1].first - pStr.begin();
+          else
+            for (size_t j = 0; j < nGroups; ++j)
+              builder(i, j) = strView((*match)[j + 1]);
+        }
+        else if (giveIndices)
+          builder(i, 0) = (*match)[0].first - pStr.begin();
+        else
+          builder(i, 0) = strView((*match)[0]);
       }
     }
 
+    if (builder.nRows() == 0)
+      return returnValue(CellError::NA);
+
     return returnValue(builder.toExcelObj());
       
   }
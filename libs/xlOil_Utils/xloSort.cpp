@@ -5,8 +5,12 @@
 #include <xlOil/Preprocessor.h>
 #include <xloil/ExcelObjCache.h>
 #include <algorithm>
+#include <execution>
 #include <numeric>
 #include <array>
+#include <memory>
+#include <cstring>
+#include <cwctype>
 
 using std::array;
 using std::vector;
@@ -25,47 +29,134 @@ namespace xloil
     };
 
     using MyArray = array<ExcelArray::col_t, XLOSORT_NARGS + 1>;
+    using row_t = ExcelArray::row_t;
+    using col_t = ExcelArray::col_t;
 
-    // TOOD: template<int N>
-    struct LessThan
+    // Above this many rows we use a parallel sort
+    constexpr row_t PARALLEL_SORT_ROWS = 1 << 15;
+
+    /// <summary>
+    /// The sort key for one column, extracted up-front so comparisons do not
+    /// need to switch on xltype or fold case. Ordering matches ExcelObj::compare
+    /// under the default C locale: numbers, then strings, missing, nil and
+    /// finally errors.
+    /// </summary>
+    class SortColumn
     {
-      LessThan(const ExcelArray& data, const MyArray& directions, const MyArray& columns)
-        : _data(data)
-        , _directions(directions)
-        , _columns(columns)
-      {}
-      bool operator()(const ExcelObj::row_t left, const ExcelObj::row_t right)
+    public:
+      SortColumn(const ExcelArray& data, col_t column, bool caseSensitive, bool descending)
+        : _descending(descending)
       {
-        ExcelObj::row_t i = 0;
-        while (_directions[i] != StopSearch)
+        const auto nRows = data.nRows();
+        _keys.resize(nRows);
+
+        // Case-insensitive keys point into a buffer of folded strings, 
+        // which we size up-front so it is never reallocated
+        if (!caseSensitive)
         {
-          bool cased = _directions[i] & CaseSensitive;
-          auto cmp = ExcelObj::compare(
-            _data.at(left, _columns[i]), 
-            _data.at(right, _columns[i]), 
-            cased);
-          if (cmp != 0)
-            return (_directions[i] & Descending) == 0 ? cmp < 0 : cmp > 0;
-          ++i;
+          size_t nChars = 0;
+          for (row_t i = 0; i < nRows; ++i)
+            nChars += data.at(i, column).stringLength();
+          _folded.resize(nChars);
+        }
+
+        auto folded = _folded.data();
+        for (row_t i = 0; i < nRows; ++i)
+        {
+          const auto& obj = data.at(i, column);
+          auto& key = _keys[i];
+          switch (obj.type())
+          {
+          case ExcelType::Num:
+            key.rank = Number; key.num = obj.val.num; break;
+          case ExcelType::Int:
+            key.rank = Number; key.num = obj.val.w; break;
+          case ExcelType::Bool:
+            key.rank = Number; key.num = obj.val.xbool; break;
+          case ExcelType::Str:
+          {
+            key.rank = String;
+            const auto str = obj.cast<PStringRef>();
+            key.len = str.length();
+            if (caseSensitive)
+              key.str = str.pstr();
+            else
+            {
+              key.str = folded;
+              folded = std::transform(str.begin(), str.end(), folded,
+                [](wchar_t ch) { return (wchar_t)::towlower(ch); });
+            }
+            break;
+          }
+          case ExcelType::Missing:
+            key.rank = Missing; break;
+          case ExcelType::Err:
+            key.rank = Error; key.num = obj.val.err; break;
+          default:
+            key.rank = Nil;
+          }
+        }
+      }
+
+      /// Returns -1, 0, +1 taking account of the sort direction
+      int compare(row_t left, row_t right) const
+      {
+        const auto cmp = compareKeys(_keys[left], _keys[right]);
+        return _descending ? -cmp : cmp;
+      }
+
+    private:
+      enum Rank : uint8_t { Number, String, Missing, Nil, Error };
+
+      struct Key
+      {
+        double num;
+        const wchar_t* str;
+        uint16_t len;
+        Rank rank;
+      };
+
+      vector<Key> _keys;
+      vector<wchar_t> _folded;
+      bool _descending;
+
+      static int compareKeys(const Key& l, const Key& r)
+      {
+        if (l.rank != r.rank)
+          return l.rank < r.rank ? -1 : 1;
+        switch (l.rank)
+        {
+        case Number:
+        case Error:
+          return l.num < r.num ? -1 : (l.num == r.num ? 0 : 1);
+        case String:
+        {
+          const auto c = wmemcmp(l.str, r.str, std::min(l.len, r.len));
+          if (c != 0)
+            return c < 0 ? -1 : 1;
+          return l.len < r.len ? -1 : (l.len == r.len ? 0 : 1);
+        }
+        default:
+          return 0;
         }
-        return false;
       }
-      const MyArray& _directions;
-      const MyArray& _columns;
-      const ExcelArray& _data;
     };
 
-    void swapmem(size_t* a, size_t* b, size_t nBytes)
+    struct LessThan
     {
-      const auto end = (size_t*)((char*)a + nBytes);
+      const vector<SortColumn>& _columns;
 
-      for (; a < end; ++a, ++b)
+      bool operator()(const row_t left, const row_t right) const
       {
-        const auto t = *a;
-        *a = *b;
-        *b = t;
+        for (auto& column : _columns)
+        {
+          const auto cmp = column.compare(left, right);
+          if (cmp != 0)
+            return cmp < 0;
+        }
+        return false;
       }
-    }
+    };
   }
 
   XLO_FUNC_START(
@@ -95,7 +186,7 @@ namespace xloil
     // could use raw pascal str, but that's an unnecessary optimisation
     auto orderStr = order->get<std::wstring>(); 
 
-    MyArray directions, columns;
+    MyArray directions{}, columns;
 
     // Default sort order is left to right on columns
     std::iota(columns.begin(), columns.end(), 0);
@@ -164,44 +255,34 @@ namespace xloil
     }
     directions[nOrders] = StopSearch;
 
-    using row_t = ExcelArray::row_t;
-    using col_t = ExcelArray::col_t;
+    vector<SortColumn> sortColumns;
+    sortColumns.reserve(nOrders);
+    for (size_t i = 0; directions[i] != StopSearch; ++i)
+      sortColumns.emplace_back(arr, columns[i], 
+        (directions[i] & CaseSensitive) != 0, (directions[i] & Descending) != 0);
 
     vector<row_t> indices(nRows);
     std::iota(indices.begin(), indices.end(), 0);
 
-    std::sort(indices.begin() + (hasHeadings ? 1 : 0), indices.end(),
-      LessThan(arr, directions, columns));
-
+    const auto sortBegin = indices.begin() + (hasHeadings ? 1 : 0);
+    if (nRows > PARALLEL_SORT_ROWS)
+      std::stable_sort(std::execution::par, sortBegin, indices.end(), LessThan{ sortColumns });
+    else
+      std::stable_sort(sortBegin, indices.end(), LessThan{ sortColumns });
 
     if (inplace)
     {
-      // For an inplace sort, we note the indices array contains
-      // the inverse of the permutation we need to apply to the rows
-      // so we just step through each cycle, applying transpositions.
-      // We mark moved rows with npos
-      const auto npos = row_t(-1);
-      row_t start = 0;
-      while (true)
-      {
-        while (start < indices.size() && indices[start] == npos) ++start;
-        if (start == indices.size())
-          break;
+      // Gather the rows in sorted order into a buffer then copy back. We
+      // are only permuting the objects, so strings stay where they are.
+      const auto rowBytes = nCols * sizeof(ExcelObj);
+      std::unique_ptr<char[]> buffer(new char[nRows * rowBytes]);
+      auto* target = buffer.get();
+      for (row_t i = 0; i < nRows; ++i, target += rowBytes)
+        memcpy(target, arr.row_begin(indices[i]), rowBytes);
 
-        row_t k = start;
-        while (true)
-        {
-          const auto r = indices[k];
-          indices[k] = npos;
-          if (r == start)
-            break;
-          swapmem(
-            (size_t*)arr.row_begin(k),
-            (size_t*)arr.row_begin(r),
-            nCols * sizeof(ExcelObj));
-          k = r;
-        }
-      }
+      target = buffer.get();
+      for (row_t i = 0; i < nRows; ++i, target += rowBytes)
+        memcpy((void*)arr.row_begin(i), target, rowBytes);
 
       return const_cast<ExcelObj*>(&array);
     }
@@ -71,14 +71,13 @@ namespace xloil
 
       // Location of the sub-string start points
       vector<vector<wchar_t>> found(inputArray.size());
-      size_t totalStrLength = 0, maxTokens = 1;
+      size_t maxTokens = 1;
       size_t iVal = 0;
       for (auto& val : inputArray)
       {
         if (val.isType(ExcelType::Str))
         {
           auto pStr = val.cast<PStringRef>().remove_const();
-          totalStrLength += pStr.length();
           findSplitPoints(found[iVal], pStr, sep, consecutive);
           maxTokens = std::max(maxTokens, found[iVal].size());
         }
@@ -88,10 +87,11 @@ namespace xloil
       // Orient output array consistent with input
       bool byRow = inputArray.nCols() == 1;
 
+      // Tokens are emplaced from the input strings and other values are not
+      // strings, so the builder needs no string storage
       ExcelArrayBuilder builder(
         byRow ? inputArray.size() : (int)maxTokens, 
-        byRow ? (int)maxTokens : inputArray.size(),
-        totalStrLength);
+        byRow ? (int)maxTokens : inputArray.size());
 
       // We don't intend to write to every cell, so need to initialise
       builder.fillNA();
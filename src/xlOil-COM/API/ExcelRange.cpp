@@ -95,14 +95,45 @@ namespace xloil
 
   std::unique_ptr<Range> ExcelRange::trim() const
   {
-    // Better than SpecialCells?
-    size_t nRows = 0, nCols = 0;
-    if (size() == 1 || !COM::trimmedVariantArrayBounds(com().Value2, nRows, nCols))
-      return std::make_unique<ExcelRange>(*this);
-    // 'range' takes the last row/col inclusive so subtract one
-    if (nRows > 0) --nRows;
-    if (nCols > 0) --nCols;
-    return range(0, 0, (int)nRows, (int)nCols);
+    try
+    {
+      if (size() == 1)
+        return std::make_unique<ExcelRange>(*this);
+
+      // Excel uses 1-based indexing
+      const auto row = (size_t)com().Row;
+      const auto col = (size_t)com().Column;
+      auto nRows = (size_t)com().Rows->GetCount();
+      auto nCols = (size_t)com().Columns->GetCount();
+
+      // Cells outside the used range are empty, so we only need to search
+      // its intersection with this range. This makes trimming whole-column
+      // references like A:Z cheap.
+      auto ws = com().Worksheet;
+      auto used = ws->UsedRange;
+      const auto usedRowEnd = (size_t)(used->Row + used->Rows->GetCount());
+      const auto usedColEnd = (size_t)(used->Column + used->Columns->GetCount());
+      nRows = usedRowEnd > row ? std::min(nRows, usedRowEnd - row) : 0;
+      nCols = usedColEnd > col ? std::min(nCols, usedColEnd - col) : 0;
+
+      // Fetch Value2 for blocks working backwards from the end, stopping at
+      // the first which contains a value
+      auto cells = com().Cells;
+      const auto [trimRows, trimCols] = trimmedExtent(nRows, nCols,
+        [&](size_t i, size_t j, size_t n, size_t m)
+        {
+          Excel::RangePtr block(ws->GetRange(
+            cells->Item[i + 1][j + 1],
+            cells->Item[i + n][j + m]));
+          return COM::trimmedVariantExtent(block->Value2);
+        });
+
+      // 'range' takes the last row/col inclusive so subtract one
+      return range(0, 0,
+        trimRows > 0 ? (int)trimRows - 1 : 0,
+        trimCols > 0 ? (int)trimCols - 1 : 0);
+    }
+    XLO_RETHROW_COM_ERROR;
   }
 
   std::tuple<Range::row_t, Range::col_t> ExcelRange::shape() const
@@ -6,6 +6,7 @@
 #include <xloil/ArrayBuilder.h>
 #include <xlOil/ExcelTypeLib.h>
 #include <xlOil/AppObjects.h>
+#include "SafeArrayConvert.h"
 
 using std::shared_ptr;
 using std::unique_ptr;
@@ -16,38 +17,16 @@ namespace xloil
   {
     namespace
     {
-      // Small helper function for array conversion
-      template<class T> 
-      auto elementConvert(const T& val)       { return val; }
-      template<>
-      auto elementConvert(const VARIANT& val) { return variantToExcelObj(val, false); }
-
-      template<typename T>
-      void addStringLength(size_t&, const T&) {}
-
-      template<>
-      void addStringLength(size_t& len, const BSTR& v)
-      {
-        len += wcslen(v);
-      }
-
-      template<>
-      void addStringLength(size_t& len, const VARIANT& v)
-      {
-        if (v.vt == VT_BSTR)
-          len += wcslen(v.bstrVal);
-      }
-
       auto variantErrorToCellError(SCODE scode)
       {
         return (CellError)(scode - 0x800A07D0);
       }
 
-      bool isNonEmpty(VARIANT& obj)
+      bool isNonEmpty(const VARIANT& obj)
       {
         switch (obj.vt)
         {
-        case VT_BSTR: return wcslen(obj.bstrVal) > 0;
+        case VT_BSTR: return SysStringLen(obj.bstrVal) > 0;
         case VT_ERROR:
           return obj.scode != DISP_E_PARAMNOTFOUND
             && variantErrorToCellError(obj.scode) != CellError::NA;
@@ -70,22 +49,72 @@ namespace xloil
       StartRowSearch:
        
         for (; nRows > 0; --nRows)
-          for (p = start + nRows - 1; p < (start + nCols * nRows); p += rows)
+          for (p = start + nRows - 1; p < (start + nCols * rows); p += rows)
             if (isNonEmpty(*p))
               goto SearchDone;
 
       SearchDone:;
       }
 
-      template<typename T>
-      size_t stringLength(const SafeArrayAccessor<T>& array)
+      /// <summary>
+      /// Cell traits for columnMajorToExcelObj, specialised for each
+      /// SafeArray element type we convert. String lengths are read from
+      /// the BSTR prefix rather than scanning for a null terminator.
+      /// </summary>
+      template<class T> struct SafeArrayCell;
+
+      template<> struct SafeArrayCell<double>
       {
-        size_t len = 0;
-        for (auto j = 0u; j < array.cols; j++)
-          for (auto i = 0u; i < array.rows; i++)
-            addStringLength(len, array(i, j));
-        return len;
-      }
+        static size_t stringLength(double) { return 0; }
+        static void write(double x, xloil::detail::ArrayBuilderElement to) { to = x; }
+      };
+
+      template<> struct SafeArrayCell<VARIANT_BOOL>
+      {
+        static size_t stringLength(VARIANT_BOOL) { return 0; }
+        static void write(VARIANT_BOOL x, xloil::detail::ArrayBuilderElement to)
+        {
+          to = x != VARIANT_FALSE;
+        }
+      };
+
+      template<> struct SafeArrayCell<SCODE>
+      {
+        static size_t stringLength(SCODE) { return 0; }
+        static void write(SCODE x, xloil::detail::ArrayBuilderElement to)
+        {
+          to = variantErrorToCellError(x);
+        }
+      };
+
+      template<> struct SafeArrayCell<BSTR>
+      {
+        static size_t stringLength(BSTR x) { return SysStringLen(x); }
+        static void write(BSTR x, xloil::detail::ArrayBuilderElement to)
+        {
+          to = std::wstring_view(x, SysStringLen(x));
+        }
+      };
+
+      template<> struct SafeArrayCell<VARIANT>
+      {
+        static size_t stringLength(const VARIANT& x)
+        {
+          return x.vt == VT_BSTR ? SysStringLen(x.bstrVal) : 0;
+        }
+        static void write(const VARIANT& x, xloil::detail::ArrayBuilderElement to)
+        {
+          // Handle the common cases inline: strings are copied straight into
+          // the array's string store rather than via a temporary ExcelObj
+          switch (x.vt)
+          {
+          case VT_R8:   to = x.dblVal; break;
+          case VT_BSTR: to = std::wstring_view(x.bstrVal, SysStringLen(x.bstrVal)); break;
+          default:
+            to = variantToExcelObj(x, false);
+          }
+        }
+      };
     }
 
     detail::SafeArrayAccessorBase::SafeArrayAccessorBase(SAFEARRAY* pArr)
@@ -112,7 +141,7 @@ namespace xloil
     }
 
     template<class T>
-    auto toExcelObj(SafeArrayAccessor<T> array, bool trimArray)
+    auto toExcelObj(const SafeArrayAccessor<T>& array, bool trimArray)
     {
       if (array.dimensions > 2)
         XLO_THROW("Can only convert 1 or 2 dim arrays");
@@ -122,16 +151,10 @@ namespace xloil
       if (trimArray)
         std::tie(rows, cols) = array.trimmedSize();
 
-      // We need up-front total string length for the ExcelArrayBuilder
-      const auto strLength = stringLength<T>(array);
-      ExcelArrayBuilder builder(
-        (ExcelObj::row_t)rows, (ExcelObj::col_t)cols, strLength);
-
-      for (auto i = 0u; i < rows; i++)
-        for (auto j = 0u; j < cols; j++)
-          builder(i, j) = elementConvert(array(i, j));
-
-      return builder.toExcelObj();
+      // The SafeArray is column-major, so its column stride is the
+      // untrimmed row count
+      return columnMajorToExcelObj<SafeArrayCell<T>>(
+        array.data(), array.rows, rows, cols);
     }
 
     class ToVariant : public ExcelValVisitor<VARIANT>
@@ -172,11 +195,10 @@ namespace xloil
         auto array = unique_ptr<SAFEARRAY, HRESULT(__stdcall *)(SAFEARRAY*)> (
           SafeArrayCreate(VT_VARIANT, 2, bounds), SafeArrayDestroy);
 
-        SafeArrayAccessor<VARIANT> arrayData(array.get());
-
-        for (auto i = 0u; i < nRows; i++)
-          for (auto j = 0u; j < nCols; j++)
-            arrayData(i, j) = (*this)(arr(i, j));
+        {
+          SafeArrayAccessor<VARIANT> arrayData(array.get());
+          excelArrayToColumnMajor<ToVariant>(arr, arrayData.data(), nRows);
+        }
 
         VARIANT result;
         result.vt = VT_VARIANT | VT_ARRAY;
@@ -208,6 +230,19 @@ namespace xloil
       {
         return obj.visit(ToVariant());
       }
+
+      // Cell traits for excelArrayToColumnMajor. SafeArrayCreate has set
+      // the target to VT_EMPTY, so there is nothing to clear.
+      static void write(const ExcelObj& obj, VARIANT& target)
+      {
+        if (obj.isType(ExcelType::Num))
+        {
+          V_VT(&target) = VT_R8;
+          V_R8(&target) = obj.val.num;
+        }
+        else
+          target = obj.visit(ToVariant());
+      }
     };
 
     class ToVariantWithRange : public ToVariant
@@ -280,28 +315,29 @@ namespace xloil
         switch (vartype)
         {
         case VT_R8:    return toExcelObj(SafeArrayAccessor<double>(pArr), trimArray);
-        case VT_BOOL:  return toExcelObj(SafeArrayAccessor<bool>(pArr), trimArray);
+        case VT_BOOL:  return toExcelObj(SafeArrayAccessor<VARIANT_BOOL>(pArr), trimArray);
         case VT_BSTR:  return toExcelObj(SafeArrayAccessor<BSTR>(pArr), trimArray);
-        case VT_ERROR: return toExcelObj(SafeArrayAccessor<long>(pArr), trimArray);
+        case VT_ERROR: return toExcelObj(SafeArrayAccessor<SCODE>(pArr), trimArray);
         case VT_VARIANT: return toExcelObj(SafeArrayAccessor<VARIANT>(pArr), trimArray);
         default:
           XLO_THROW("Unhandled array data type: {0}", variant.vt ^ VT_ARRAY);
         }
       }
     }
-    bool trimmedVariantArrayBounds(const VARIANT& variant, size_t& nRows, size_t& nCols)
+    std::pair<size_t, size_t> trimmedVariantExtent(const VARIANT& variant)
     {
       if ((variant.vt & VT_ARRAY) == 0)
-        return false;
+        return isNonEmpty(variant) ? std::pair(1, 1) : std::pair(0, 0);
 
       auto pArr = variant.parray;
       VARTYPE vartype;
       SafeArrayGetVartype(pArr, &vartype);
       if (vartype != VT_VARIANT)
-        return false;
-
-      std::tie(nRows, nCols) = SafeArrayAccessor<VARIANT>(pArr).trimmedSize();
-      return true;
+      {
+        detail::SafeArrayAccessorBase array(pArr);
+        return std::pair(array.rows, array.cols);
+      }
+      return SafeArrayAccessor<VARIANT>(pArr).trimmedSize();
     }
 
     VARIANT stringToVariant(const char* str)
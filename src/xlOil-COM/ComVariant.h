@@ -54,7 +54,9 @@ namespace xloil
         return std::pair(rows, cols);
       }
 
-    private:
+      /// <summary>
+      /// The underlying column-major data: the column stride is <code>rows</code>
+      /// </summary>
       T* data() const { return (T*)_data; }
     };
 
@@ -67,7 +69,12 @@ namespace xloil
       bool allowRange = false, 
       bool trimArray = true);
 
-    bool trimmedVariantArrayBounds(const VARIANT& variant, size_t& nRows, size_t& nCols);
+    /// <summary>
+    /// Returns the size of a variant array trimmed to the last non-empty 
+    /// (not Nil, \#N/A or "") row and column. A single value gives (1, 1)
+    /// or (0, 0) if it is empty.
+    /// </summary>
+    std::pair<size_t, size_t> trimmedVariantExtent(const VARIANT& variant);
 
     VARIANT stringToVariant(const char* str);
     VARIANT stringToVariant(const wchar_t* str);
@@ -9,6 +9,10 @@
 #include <xloil/StringUtils.h>
 #include <combaseapi.h>
 #include <shared_mutex>
+#include <mutex>
+#include <list>
+#include <vector>
+#include <algorithm>
 
 using std::wstring;
 using std::shared_ptr;
@@ -20,43 +24,6 @@ using std::unique_lock;
 using std::shared_mutex;
 
 
-namespace
-{
-  /// <summary>
-  /// Like a std::scoped_lock but uses a std::atomic_flag rather than a mutex.
-  /// Note it busy-waits for the lock!
-  /// </summary>
-  struct scoped_atomic_flag
-  {
-    std::atomic_flag* _flag;
-
-    scoped_atomic_flag(std::atomic_flag& flag)
-      : _flag(&flag)
-    {
-      while (flag.test_and_set(std::memory_order_acquire))
-      {
-        // Since C++20, it is possible to update atomic_flag's
-        // value only when there is a chance to acquire the lock.
-        // See also: https://stackoverflow.com/questions/62318642
-#if defined(__cpp_lib_atomic_flag_test)
-        while (lock.test(std::memory_order_relaxed))
-#else
-        // spin
-#endif
-      }
-    }
-    ~scoped_atomic_flag()
-    {
-      if (_flag)
-        _flag->clear(std::memory_order_release);
-    }
-    void swap(scoped_atomic_flag& that)
-    {
-      std::swap(_flag, that._flag);
-    }
-  };
-}
-
 namespace xloil
 {
   namespace COM
@@ -69,7 +36,9 @@ namespace xloil
       int arrayCount = 0; // see comment in 'getValue()'
       const wchar_t* arrayTopic = nullptr;
       msxll::XLREF12 caller;
-      std::atomic_flag busy = ATOMIC_FLAG_INIT;
+      // Contention is unlikely as it requires more than one RTD function in 
+      // the cell, but a mutex parks rather than spins if it does occur
+      std::mutex lock;
 
       bool isSubarray(const msxll::XLREF12& ref) const
       {
@@ -82,13 +51,6 @@ namespace xloil
       }
     };
 
-    using CellAddress = std::pair<unsigned, unsigned>;
-
-    using CellTaskMap = std::unordered_map<
-      CellAddress,
-      std::shared_ptr<CellTasks>,
-      pair_hash<unsigned, unsigned>>;
-
     // TODO: could we just create a forwarding IRtdAsyncTask which intercepts 'cancel'
     class AsyncTaskPublisher : public RtdPublisher
     {
@@ -112,7 +74,7 @@ namespace xloil
         auto p = _parent.lock();
         if (p)
         {
-          scoped_atomic_flag lock(p->busy);
+          std::scoped_lock lock(p->lock);
           p->tasks.remove_if([&](auto& t) { return t.get() == this; });
         }
         return true;
@@ -140,37 +102,189 @@ namespace xloil
       _rtd.start(tasks->tasks.back());
     }
 
-    auto newCellTasks(
-      CellTaskMap& tasksPerCell,
-      const CellAddress& address,
-      const msxll::XLREF12& ref)
+    /// <summary>
+    /// The CellTasks for callers on a single sheet, with its own lock. Single
+    /// cell callers are keyed by cell number. Array callers are held once per 
+    /// band of rows they span rather than once per cell, so registering a large 
+    /// array caller takes time proportional to its height / ROW_BAND_SIZE.
+    /// Array formulas cannot overlap, so a new array caller replaces any it
+    /// intersects.
+    /// </summary>
+    class SheetTasks
     {
-      auto [iTask, success] = tasksPerCell.try_emplace(address, new CellTasks());
-      auto tasksInCell = iTask->second;
-      tasksInCell->setCaller(ref);
-      return tasksInCell;
-    }
+    public:
+      shared_ptr<CellTasks> findTarget(
+        const msxll::XLREF12& ref,
+        unsigned arraySize)
+      {
+        // Look for the top-left address of the caller
+        // (1) New master (no previous record)
+        // (2) New master (former slave)
+        //     (a) Shares top left
+        //     (b) Doesn't
+        // (3) Slave increment (arraySize = 1, arrayCount > 0)
 
-    void writeArray(
-      CellTaskMap& tasksPerCell,
-      const shared_ptr<CellTasks>& val,
-      const unsigned sheetId,
-      const msxll::XLREF12& ref)
-    {
-      for (auto j = ref.colFirst; j <= ref.colLast; ++j)
-        for (auto i = ref.rwFirst; i <= ref.rwLast; ++i)
+        std::scoped_lock lock(_lock);
+
+        auto pTasksInCell = find(ref.rwFirst, ref.colFirst);
+        if (!pTasksInCell || !pTasksInCell->isSubarray(ref))
         {
-          unsigned num = i * XL_MAX_COLS + j;
-          tasksPerCell[make_pair(sheetId, num)] = val;
+          pTasksInCell = make_shared<CellTasks>();
+          pTasksInCell->setCaller(ref);
+          if (arraySize == 1)
+            _cells[cellNumber(ref.rwFirst, ref.colFirst)] = pTasksInCell;
         }
-    }
+        else if (arraySize == 1 && pTasksInCell->arrayCount > 0)
+        {
+          // Do nothing for now
+        }
+        else
+        {
+          pTasksInCell->setCaller(ref);
+        }
+
+        // If the caller is an array formula, when RTD is called in the subscribe()
+        // method, it will return xlretUncalced, but will trigger the calling
+        // function to be called again for each cell in the array. The caller in these
+        // subsequent calls will sometimes remain as the top left-cell and will sometimes 
+        // cycle through the cells of the array.
+        // 
+        // We want to start the task only once for the first call, with subsequent
+        // calls invoking subscribe quickly without needing to compare all function args.
+
+        if (arraySize > 1)
+          setArray(ref, pTasksInCell);
+
+        return pTasksInCell;
+      }
+
+    private:
+      static constexpr unsigned ROW_BAND_BITS = 6;
+      static constexpr unsigned ROW_BAND_SIZE = 1 << ROW_BAND_BITS;
+
+      struct ArrayCaller
+      {
+        msxll::XLREF12 ref;
+        shared_ptr<CellTasks> tasks;
+
+        bool contains(int row, int col) const
+        {
+          return row >= ref.rwFirst && row <= ref.rwLast
+            && col >= ref.colFirst && col <= ref.colLast;
+        }
+        bool intersects(const msxll::XLREF12& that) const
+        {
+          return that.rwFirst <= ref.rwLast && that.rwLast >= ref.rwFirst
+            && that.colFirst <= ref.colLast && that.colLast >= ref.colFirst;
+        }
+        bool operator==(const ArrayCaller& that) const
+        {
+          return tasks == that.tasks && memcmp(&ref, &that.ref, sizeof(ref)) == 0;
+        }
+      };
+
+      std::mutex _lock;
+      std::unordered_map<unsigned, shared_ptr<CellTasks>> _cells;
+      std::unordered_map<unsigned, std::vector<ArrayCaller>> _rowBands;
+
+      static unsigned cellNumber(int row, int col)
+      {
+        return row * XL_MAX_COLS + col;
+      }
+
+      shared_ptr<CellTasks> find(int row, int col) const
+      {
+        auto cell = _cells.find(cellNumber(row, col));
+        if (cell != _cells.end())
+          return cell->second;
+
+        auto band = _rowBands.find(row >> ROW_BAND_BITS);
+        if (band != _rowBands.end())
+          for (auto& array : band->second)
+            if (array.contains(row, col))
+              return array.tasks;
+
+        return shared_ptr<CellTasks>();
+      }
+
+      void setArray(const msxll::XLREF12& ref, const shared_ptr<CellTasks>& tasks)
+      {
+        const ArrayCaller caller{ ref, tasks };
+        const auto firstBand = (unsigned)ref.rwFirst >> ROW_BAND_BITS;
+        const auto lastBand = (unsigned)ref.rwLast >> ROW_BAND_BITS;
+
+        // Single cell callers under the array are stale
+        eraseCells(ref);
+
+        auto& topBand = _rowBands[firstBand];
+        if (std::find(topBand.begin(), topBand.end(), caller) != topBand.end())
+          return;
+
+        // Collect then remove any intersecting arrays, which may span other bands
+        std::vector<ArrayCaller> stale;
+        for (auto b = firstBand; b <= lastBand; ++b)
+        {
+          auto band = _rowBands.find(b);
+          if (band == _rowBands.end())
+            continue;
+          for (auto& array : band->second)
+            if (array.intersects(ref) 
+                && std::find(stale.begin(), stale.end(), array) == stale.end())
+              stale.push_back(array);
+        }
+        for (auto& array : stale)
+          eraseArray(array);
+
+        for (auto b = firstBand; b <= lastBand; ++b)
+          _rowBands[b].push_back(caller);
+      }
 
+      void eraseArray(const ArrayCaller& caller)
+      {
+        const auto lastBand = (unsigned)caller.ref.rwLast >> ROW_BAND_BITS;
+        for (auto b = (unsigned)caller.ref.rwFirst >> ROW_BAND_BITS; b <= lastBand; ++b)
+        {
+          auto band = _rowBands.find(b);
+          if (band == _rowBands.end())
+            continue;
+          auto& callers = band->second;
+          callers.erase(std::remove(callers.begin(), callers.end(), caller), callers.end());
+          if (callers.empty())
+            _rowBands.erase(band);
+        }
+      }
+
+      void eraseCells(const msxll::XLREF12& ref)
+      {
+        const auto area = (size_t)(ref.rwLast - ref.rwFirst + 1) * (ref.colLast - ref.colFirst + 1);
+        
+        // Visit whichever is smaller: the single cell callers or the cells in the range
+        if (_cells.size() < area)
+        {
+          for (auto i = _cells.begin(); i != _cells.end();)
+          {
+            const int row = i->first / XL_MAX_COLS, col = i->first % XL_MAX_COLS;
+            if (row >= ref.rwFirst && row <= ref.rwLast && col >= ref.colFirst && col <= ref.colLast)
+              i = _cells.erase(i);
+            else
+              ++i;
+          }
+        }
+        else
+        {
+          for (auto i = ref.rwFirst; i <= ref.rwLast; ++i)
+            for (auto j = ref.colFirst; j <= ref.colLast; ++j)
+              _cells.erase(cellNumber(i, j));
+        }
+      }
+    };
 
     namespace RtdAsyncManager
     {
       namespace
       {
-        // Hold this mutex to a create the Impl class or to call its methods
+        // Hold this mutex exclusively to create or clear the Impl class and 
+        // shared to call its other methods
         static shared_mutex theManagerMutex;
 
         class Impl
@@ -181,6 +295,7 @@ namespace xloil
           {
             // We're a singleton so guaranteed to still exist at autoclose
             Event::AutoClose() += [this]() {
+              unique_lock lock(theManagerMutex);
               clear();
               _rtd.reset();
             };
@@ -189,65 +304,18 @@ namespace xloil
           void clear()
           {
             _rtd->clear();
-            _tasksPerCell.clear();
+            unique_lock lock(_lockSheets);
+            _sheets.clear();
           }
 
           auto findTargetCellTasks(
-            const msxll::XLREF12* ref,
+            const msxll::XLREF12& ref,
             unsigned arraySize,
-            unsigned sheetId,
-            unsigned cellNumber)
+            uintptr_t sheetId)
           {
-            // Lock the dictionary of cell tasks and look for the address
-            // (1) New master (no previous record)
-            // (2) New master (former slave)
-            //     (a) Shares top left
-            //     (b) Doesn't
-            // (3) Slave increment (arraySize = 1, arrayCount > 0)
-
-            // The value we need to populate
-            shared_ptr<CellTasks> pTasksInCell;
-
-            const auto address = std::make_pair(sheetId, cellNumber);
-
-            const auto found = _tasksPerCell.find(address);
-            if (found == _tasksPerCell.end())
-            {
-              pTasksInCell = newCellTasks(_tasksPerCell, address, *ref);
-            }
-            else
-            {
-              pTasksInCell = found->second;
-              auto tasksInCell = pTasksInCell.get();
-
-              if (!pTasksInCell->isSubarray(*ref))
-              {
-                pTasksInCell = newCellTasks(_tasksPerCell, address, *ref);
-              }
-              else if (arraySize == 1 && tasksInCell->arrayCount > 0)
-              {
-                // Do nothing for now
-              }
-              else
-              {
-                tasksInCell->setCaller(*ref);
-              }
-            }
-
-            // If the caller is an array formula, when RTD is called in the subscribe()
-            // method, it will return xlretUncalced, but will trigger the calling
-            // function to be called again for each cell in the array. The caller in these
-            // subsequent calls will sometimes remain as the top left-cell and will sometimes 
-            // cycle through the cells of the array.
-            // 
-            // We want to start the task only once for the first call, with subsequent
-            // calls invoking subscribe quickly without needing to compare all function args.
-
-            if (arraySize > 1)
-              writeArray(_tasksPerCell, pTasksInCell, sheetId, *ref);
-
-            return pTasksInCell;
+            return sheetTasks(sheetId)->findTarget(ref, arraySize);
           }
+
           const std::shared_ptr<IRtdServer>& getRtd() const
           {
             return _rtd;
@@ -255,7 +323,26 @@ namespace xloil
          
         private:
           std::shared_ptr<IRtdServer> _rtd;
-          CellTaskMap _tasksPerCell;
+
+          // Each sheet has its own lock, so _lockSheets is only held 
+          // exclusively when a sheet is first seen
+          std::unordered_map<uintptr_t, shared_ptr<SheetTasks>> _sheets;
+          shared_mutex _lockSheets;
+
+          shared_ptr<SheetTasks> sheetTasks(uintptr_t sheetId)
+          {
+            {
+              shared_lock lock(_lockSheets);
+              auto found = _sheets.find(sheetId);
+              if (found != _sheets.end())
+                return found->second;
+            }
+            unique_lock lock(_lockSheets);
+            auto& sheet = _sheets[sheetId];
+            if (!sheet)
+              sheet = make_shared<SheetTasks>();
+            return sheet;
+          }
         };
 
         static std::unique_ptr<Impl> theInstance;
@@ -308,13 +395,11 @@ namespace xloil
           // Now populate these variables
           shared_ptr<const ExcelObj> result;
           const wchar_t* foundTopic = nullptr;
+          std::vector<shared_ptr<AsyncTaskPublisher>> cellTasks;
 
           {
             // Lock 'tasksInCell' in case there is more than one RTD function in the cell.
-            // This is unlikely in itself and as they all execute on the same thread, contention
-            // problems are improbable, so we use a lightweight atomic_flag which implies a spin 
-            // wait (before C++20).
-            scoped_atomic_flag lockCell(tasksInCell->busy);
+            std::scoped_lock lockCell(tasksInCell->lock);
 
             if (arraySize == 1 && tasksInCell->arrayCount > 0)
             {
@@ -352,6 +437,8 @@ namespace xloil
                 tasksInCell->arrayTopic = nullptr;
               }
             }
+
+            cellTasks.assign(tasksInCell->tasks.begin(), tasksInCell->tasks.end());
           }
 
           assert(foundTopic);
@@ -365,7 +452,7 @@ namespace xloil
           // connection to the inner task and go into a perpetual loop. If the inner task
           // is still connected, xlOil knows it has already produced a result and returns 
           // it, avoiding the loop.
-          for (auto& t : tasksInCell->tasks)
+          for (auto& t : cellTasks)
             if (wcscmp(t->topic(), foundTopic) != 0)
               rtd->subscribe(t->topic());
           return rtd->subscribe(foundTopic);
@@ -396,27 +483,27 @@ namespace xloil
         const auto arraySize = (ref->colLast - ref->colFirst + 1)
           * (ref->rwLast - ref->rwFirst + 1);
 
-        // This is the cell number of the top-left cell for array callers
-        const unsigned cellNumber = ref->rwFirst * XL_MAX_COLS + ref->colFirst;
-
-        // It's OK to cast away half the sheetref ptr: it's likely the detail
-        // is in the lower part and it doesn't matter if we have collisions
-        // in the map since we check for explicit equality later.
-        const auto sheetId = (unsigned)(intptr_t)callExcel(
+        // Tasks are held per sheet, so we keep the whole sheet ID to avoid
+        // two sheets sharing a lock and index
+        const auto sheetId = (uintptr_t)callExcel(
           msxll::xlSheetId, caller.fullSheetName()).val.mref.idSheet;
 
-        // Acquire the lock then check if the instance has been created
-        unique_lock lock(theManagerMutex);
-
-        auto impl = getInstance(lock);
+        // Check if the instance has been created. The Impl has its own 
+        // locks, so we only need to hold this one exclusively to create it
+        shared_lock lock(theManagerMutex);
+        if (!theInstance)
+        {
+          lock.unlock();
+          init();
+          lock.lock();
+        }
 
-        auto tasksInCell = impl->findTargetCellTasks(
-          ref, arraySize, cellNumber, sheetId);
+        auto tasksInCell = theInstance->findTargetCellTasks(
+          *ref, arraySize, sheetId);
 
-        auto rtdServer = impl->getRtd();
+        auto rtdServer = theInstance->getRtd();
 
         // We've finished with the task-per-cell lookup and can drop the lock
-        // required for the Impl
         lock.unlock();
 
         return getValueAndSubscribe(rtdServer, task, arraySize, tasksInCell);
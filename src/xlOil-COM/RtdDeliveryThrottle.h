@@ -0,0 +1,178 @@
+#pragma once
+#include "RtdPublishQueue.h"
+#include <xloil/RtdDeliveryPolicy.h>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+namespace xloil
+{
+  namespace COM
+  {
+    /// <summary>
+    /// Applies an <see cref="RtdDeliveryPolicy"/> to decide when topics with new
+    /// values are passed to Excel. A topic which was delivered less than the
+    /// topic interval ago is held until the interval has elapsed. Ready topics
+    /// are released as a batch no more often than the notify interval. A new
+    /// value for a topic which is held or waiting in a batch is counted as
+    /// coalesced: only the latest value will be seen by Excel.
+    ///
+    /// Apart from <see cref="setPolicy"/> and the counters, methods must be
+    /// called from a single thread. The current time is passed in so the
+    /// policy can be tested without a real clock or Excel. Depends only on
+    /// the standard library, so it can be tested on any platform.
+    /// </summary>
+    class RtdDeliveryThrottle
+    {
+    public:
+      using clock = std::chrono::steady_clock;
+      using time_point = clock::time_point;
+      using duration = clock::duration;
+
+      RtdDeliveryThrottle(const RtdDeliveryPolicy& policy = RtdDeliveryPolicy())
+      {
+        setPolicy(policy);
+      }
+
+      /// <summary>
+      /// Thread-safe
+      /// </summary>
+      void setPolicy(const RtdDeliveryPolicy& policy)
+      {
+        _notifyInterval = duration(policy.notifyInterval).count();
+        _topicInterval = duration(policy.topicInterval).count();
+      }
+
+      RtdDeliveryPolicy policy() const
+      {
+        RtdDeliveryPolicy result;
+        result.notifyInterval = std::chrono::duration_cast<std::chrono::milliseconds>(notifyInterval());
+        result.topicInterval = std::chrono::duration_cast<std::chrono::milliseconds>(topicInterval());
+        return result;
+      }
+
+      /// <summary>
+      /// Records that a topic has a new value
+      /// </summary>
+      void arrived(RtdTopicHandle topic, time_point now)
+      {
+        auto& state = _topics[topic];
+        if (state.pending)
+        {
+          increment(_nCoalesced);
+          return;
+        }
+        state.pending = true;
+        if (now < state.lastDelivered + topicInterval())
+        {
+          increment(_nThrottled);
+          _held.push_back(topic);
+        }
+        else
+          _ready.push_back(topic);
+      }
+
+      /// <summary>
+      /// If any topics are ready and a notify is allowed, appends them to
+      /// <paramref name="topics"/>, marks them as delivered and returns true.
+      /// </summary>
+      bool takeReady(time_point now, std::vector<RtdTopicHandle>& topics)
+      {
+        releaseHeld(now);
+
+        if (_ready.empty() || now < _lastNotify + notifyInterval())
+          return false;
+
+        for (auto topic : _ready)
+        {
+          auto found = _topics.find(topic);
+          if (found == _topics.end())
+            continue; // Forgotten whilst waiting
+          found->second.pending = false;
+          found->second.lastDelivered = now;
+          topics.push_back(topic);
+        }
+        _ready.clear();
+        _lastNotify = now;
+        increment(_nNotifies);
+        return true;
+      }
+
+      /// <summary>
+      /// Returns the time at which <see cref="takeReady"/> will next release
+      /// topics, or time_point::max() if there are none waiting.
+      /// </summary>
+      time_point nextWake() const
+      {
+        // The earliest time any topic is ready, then delay that until a 
+        // notify is allowed
+        auto ready = _ready.empty() ? time_point::max() : time_point::min();
+        const auto interval = topicInterval();
+        for (auto topic : _held)
+        {
+          auto found = _topics.find(topic);
+          if (found != _topics.end())
+            ready = std::min(ready, found->second.lastDelivered + interval);
+        }
+        return ready == time_point::max()
+          ? ready
+          : std::max(ready, _lastNotify + notifyInterval());
+      }
+
+      /// <summary>
+      /// Discards the state for a topic which has been released
+      /// </summary>
+      void forget(RtdTopicHandle topic)
+      {
+        _topics.erase(topic);
+      }
+
+      size_t coalesced() const { return _nCoalesced.load(std::memory_order_relaxed); }
+      size_t throttled() const { return _nThrottled.load(std::memory_order_relaxed); }
+      size_t notifies() const { return _nNotifies.load(std::memory_order_relaxed); }
+
+    private:
+      struct TopicState
+      {
+        time_point lastDelivered;
+        bool pending = false;
+      };
+      std::unordered_map<RtdTopicHandle, TopicState> _topics;
+      std::vector<RtdTopicHandle> _ready;
+      std::vector<RtdTopicHandle> _held;
+      time_point _lastNotify;
+
+      std::atomic<duration::rep> _notifyInterval = 0;
+      std::atomic<duration::rep> _topicInterval = 0;
+      std::atomic<size_t> _nCoalesced = 0, _nThrottled = 0, _nNotifies = 0;
+
+      duration notifyInterval() const { return duration(_notifyInterval.load()); }
+      duration topicInterval() const { return duration(_topicInterval.load()); }
+
+      // Only the owning thread writes the counters, so no read-modify-write
+      static void increment(std::atomic<size_t>& counter)
+      {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      }
+
+      void releaseHeld(time_point now)
+      {
+        const auto interval = topicInterval();
+        auto keep = _held.begin();
+        for (auto topic : _held)
+        {
+          auto found = _topics.find(topic);
+          if (found == _topics.end())
+            continue;
+          if (now >= found->second.lastDelivered + interval)
+            _ready.push_back(topic);
+          else
+            *keep++ = topic;
+        }
+        _held.erase(keep, _held.end());
+      }
+    };
+  }
+}
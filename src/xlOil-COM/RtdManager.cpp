@@ -270,6 +270,16 @@ namespace xloil
         return _registrar.progid();
       }
 
+      void setDeliveryPolicy(const RtdDeliveryPolicy& policy) override
+      {
+        server().setDeliveryPolicy(policy);
+      }
+
+      RtdServerStats stats() const override
+      {
+        return server().stats();
+      }
+
       void clear() override
       {
         // This is likely be to called during teardown, so trap any errors
@@ -1,5 +1,8 @@
 #pragma once
 #include <xloil/RtdServer.h>
+#include "RtdPublishQueue.h"
+#include <string_view>
+#include <unordered_set>
 
 struct tagSAFEARRAY;
 using SAFEARRAY = tagSAFEARRAY;
@@ -38,13 +41,48 @@ namespace xloil
       void quit();
     };
 
+    /// <summary>
+    /// Holds the topicIds with new values until Excel collects them with
+    /// RefreshData. Separated from the worker so the publishing path can be
+    /// exercised without COM.
+    /// </summary>
+    struct IRtdReadyTopics
+    {
+      virtual ~IRtdReadyTopics() {}
+      /// <summary>
+      /// Adds topicIds to the batch awaiting collection. Only called by the
+      /// worker thread.
+      /// </summary>
+      virtual void append(const std::unordered_set<long>& topicIds) = 0;
+      /// <summary>
+      /// Removes and returns the batch awaiting collection, or null if there
+      /// is none. May be called concurrently with <see cref="append"/>.
+      /// </summary>
+      virtual SAFEARRAY* take() = 0;
+    };
+
     template <class TValue>
     struct IRtdPublishManager
     {
-      void update(std::wstring&& topic, const std::shared_ptr<TValue>& value);
-      void addPublisher(const std::shared_ptr<IRtdPublisher>& job);
+      /// <summary>
+      /// Publishes a value for a topic. The value is discarded if the topic
+      /// has no publisher or subscribers.
+      /// </summary>
+      void update(const std::wstring_view& topic, const std::shared_ptr<TValue>& value);
+      /// <summary>
+      /// Publishes a value using a handle returned by <see cref="addPublisher"/>,
+      /// which avoids looking up the topic string.
+      /// </summary>
+      void update(RtdTopicHandle topic, const std::shared_ptr<TValue>& value);
+      /// <summary>
+      /// Starts a publisher, replacing any existing one for the same topic,
+      /// and returns the handle for its topic.
+      /// </summary>
+      RtdTopicHandle addPublisher(const std::shared_ptr<IRtdPublisher>& job);
       bool dropPublisher(const wchar_t* topic);
       bool value(const wchar_t* topic, std::shared_ptr<const TValue>& val) const;
+      void setDeliveryPolicy(const RtdDeliveryPolicy& policy);
+      RtdServerStats stats() const;
       void quit();
       /// <summary>
       /// Calls quit, then joins any publishers and worker threads. The object
@@ -0,0 +1,248 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include <cstdint>
+
+namespace xloil
+{
+  namespace COM
+  {
+    /// <summary>
+    /// Integer handle for an interned RTD topic string. The low 32 bits hold
+    /// the slot index and the high 32 bits a generation count, so a handle
+    /// which outlives its topic can be detected after the slot is reused.
+    /// </summary>
+    using RtdTopicHandle = uint64_t;
+
+    constexpr RtdTopicHandle NO_RTD_TOPIC = ~RtdTopicHandle(0);
+
+    inline RtdTopicHandle makeRtdTopicHandle(uint32_t slot, uint32_t generation)
+    {
+      return (RtdTopicHandle(generation) << 32) | slot;
+    }
+    inline uint32_t rtdTopicSlot(RtdTopicHandle handle)
+    {
+      return (uint32_t)handle;
+    }
+    inline uint32_t rtdTopicGeneration(RtdTopicHandle handle)
+    {
+      return (uint32_t)(handle >> 32);
+    }
+
+    /// <summary>
+    /// Bounded lock-free queue for many producers and a single consumer,
+    /// after Dmitry Vyukov's bounded MPMC queue. Each cell carries a sequence
+    /// number which tells a producer whether the cell is free for the current
+    /// lap and tells the consumer whether the value has been written.
+    /// </summary>
+    template<class T>
+    class MpscRing
+    {
+    public:
+      /// <summary>
+      /// The capacity is rounded up to a power of two
+      /// </summary>
+      explicit MpscRing(size_t capacity)
+      {
+        size_t n = 2;
+        while (n < capacity)
+          n <<= 1;
+        _mask = n - 1;
+        _cells.reset(new Cell[n]);
+        for (size_t i = 0; i < n; ++i)
+          _cells[i].sequence.store(i, std::memory_order_relaxed);
+      }
+
+      size_t capacity() const { return _mask + 1; }
+
+      /// <summary>
+      /// Moves from <paramref name="value"/> and returns true if there is space
+      /// in the queue, otherwise leaves the value untouched and returns false.
+      /// Safe to call from any thread.
+      /// </summary>
+      bool tryPush(T& value)
+      {
+        auto pos = _enqueuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;)
+        {
+          cell = &_cells[pos & _mask];
+          const auto seq = cell->sequence.load(std::memory_order_acquire);
+          const auto diff = (intptr_t)seq - (intptr_t)pos;
+          if (diff == 0)
+          {
+            if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+              break;
+          }
+          else if (diff < 0)
+            return false; // Full
+          else
+            pos = _enqueuePos.load(std::memory_order_relaxed);
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+
+      /// <summary>
+      /// Pops the oldest value if it has been fully written. Must only be
+      /// called from the consumer thread.
+      /// </summary>
+      bool tryPop(T& value)
+      {
+        auto& cell = _cells[_dequeuePos & _mask];
+        const auto seq = cell.sequence.load(std::memory_order_acquire);
+        if ((intptr_t)seq - (intptr_t)(_dequeuePos + 1) < 0)
+          return false;
+        value = std::move(cell.value);
+        cell.value = T();
+        cell.sequence.store(_dequeuePos + _mask + 1, std::memory_order_release);
+        ++_dequeuePos;
+        return true;
+      }
+
+      /// <summary>
+      /// True if no producer has claimed a cell which the consumer has not
+      /// popped. Unlike a failed <see cref="tryPop"/>, this is false whilst a
+      /// push is in progress. Must only be called from the consumer thread.
+      /// </summary>
+      bool empty() const
+      {
+        return _enqueuePos.load(std::memory_order_acquire) == _dequeuePos;
+      }
+
+    private:
+      struct Cell
+      {
+        std::atomic<size_t> sequence;
+        T value;
+      };
+      std::unique_ptr<Cell[]> _cells;
+      size_t _mask;
+      alignas(64) std::atomic<size_t> _enqueuePos = 0;
+      alignas(64) size_t _dequeuePos = 0;
+    };
+
+    /// <summary>
+    /// Queue of published RTD values. Producers push (topic handle, value)
+    /// pairs into a lock-free ring. If the ring fills, values go to a locked
+    /// overflow list until the consumer next drains it; producers stay on the
+    /// overflow list until then so values from any one thread are applied in
+    /// the order they were published.
+    ///
+    /// The consumer drains the queue keeping only the last value for each
+    /// topic, so a topic which ticks many times between drains is only
+    /// processed once.
+    /// </summary>
+    template<class TValue>
+    class RtdPublishQueue
+    {
+    public:
+      using Item = std::pair<RtdTopicHandle, std::shared_ptr<TValue>>;
+
+      explicit RtdPublishQueue(size_t capacity = 1 << 14)
+        : _ring(capacity)
+      {}
+
+      /// <summary>
+      /// Adds a value to the queue. Safe to call from any thread.
+      /// </summary>
+      void push(RtdTopicHandle topic, const std::shared_ptr<TValue>& value)
+      {
+        Item item(topic, value);
+        if (!_overflowing.load(std::memory_order_acquire) && _ring.tryPush(item))
+          return;
+
+        std::scoped_lock lock(_lockOverflow);
+        _overflow.emplace_back(std::move(item));
+        _overflowing.store(true, std::memory_order_release);
+      }
+
+      /// <summary>
+      /// Calls <paramref name="func"/> with (handle, value) for each topic with
+      /// a pending value, passing only the last value published for the topic.
+      /// Returns the number of topics. Must only be called from one thread.
+      /// </summary>
+      template<class TFunc>
+      size_t drain(TFunc&& func)
+      {
+        size_t nReceived = 0;
+        Item item;
+        while (_ring.tryPop(item))
+        {
+          coalesce(item);
+          ++nReceived;
+        }
+
+        // If a push is still in progress, the ring holds values which are
+        // older than any on the overflow list. Leave the overflow for the
+        // next drain: the producer will notify again once it has finished.
+        if (_ring.empty() && _overflowing.load(std::memory_order_acquire))
+        {
+          {
+            std::scoped_lock lock(_lockOverflow);
+            std::swap(_overflow, _overflowTaken);
+            _overflowing.store(false, std::memory_order_release);
+          }
+          for (auto& value : _overflowTaken)
+            coalesce(value);
+          nReceived += _overflowTaken.size();
+          _overflowTaken.clear();
+        }
+
+        for (auto& [handle, value] : _pending)
+          func(handle, value);
+
+        const auto n = _pending.size();
+        _pending.clear();
+        _pendingIndex.clear();
+
+        // Only the consumer writes the counters, so no read-modify-write
+        _nReceived.store(_nReceived.load(std::memory_order_relaxed) + nReceived, 
+          std::memory_order_relaxed);
+        _nCoalesced.store(_nCoalesced.load(std::memory_order_relaxed) + nReceived - n, 
+          std::memory_order_relaxed);
+        return n;
+      }
+
+      size_t capacity() const { return _ring.capacity(); }
+
+      /// <summary>
+      /// Number of values taken from the queue by <see cref="drain"/>
+      /// </summary>
+      size_t received() const { return _nReceived.load(std::memory_order_relaxed); }
+
+      /// <summary>
+      /// Number of values discarded by <see cref="drain"/> because a later value
+      /// for the same topic was in the queue
+      /// </summary>
+      size_t coalesced() const { return _nCoalesced.load(std::memory_order_relaxed); }
+
+    private:
+      MpscRing<Item> _ring;
+      std::atomic<bool> _overflowing = false;
+      std::mutex _lockOverflow;
+      std::vector<Item> _overflow;
+
+      // Consumer-side buffers, retained to avoid reallocating on each drain
+      std::vector<Item> _overflowTaken;
+      std::vector<Item> _pending;
+      std::unordered_map<RtdTopicHandle, size_t> _pendingIndex;
+
+      std::atomic<size_t> _nReceived = 0, _nCoalesced = 0;
+
+      void coalesce(Item& item)
+      {
+        auto [found, isNew] = _pendingIndex.try_emplace(item.first, _pending.size());
+        if (isNew)
+          _pending.emplace_back(std::move(item));
+        else
+          _pending[found->second].second = std::move(item.second);
+      }
+    };
+  }
+}
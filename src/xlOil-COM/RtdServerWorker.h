@@ -1,5 +1,7 @@
 #pragma once
 #include "RtdManager.h"
+#include "RtdPublishQueue.h"
+#include "RtdDeliveryThrottle.h"
 #include <xloil/Log.h>
 #include <xlOilHelpers/Utils.h>
 #include <atlbase.h>
@@ -10,6 +12,9 @@
 #include <shared_mutex>
 #include <memory>
 #include <vector>
+#include <deque>
+#include <string_view>
+#include <condition_variable>
 
 using std::vector;
 using std::shared_ptr;
@@ -28,10 +33,98 @@ namespace xloil
 {
   namespace COM
   {
+    /// <summary>
+    /// Accumulates ready topicIds in the 2 x n SAFEARRAY which Excel 
+    /// collects in RefreshData.
+    /// </summary>
+    class SafeArrayReadyTopics : public IRtdReadyTopics
+    {
+    public:
+      ~SafeArrayReadyTopics()
+      {
+        auto topicArray = _readyUpdates.exchange(nullptr);
+        if (topicArray)
+          SafeArrayDestroy(topicArray);
+      }
+
+      // When Excel calls RefreshData, it will take the SAFEARRAY in _readyUpdates and
+      // atomically replace it with null. If this ptr is not null, we know Excel
+      // has not yet picked up the new values, so we swap it out and resize the array
+      // to include the latest ready topics. 
+      void append(const unordered_set<long>& topicIds) override
+      {
+        const auto nReady = (ULONG)topicIds.size();
+        auto topicArray = _readyUpdates.exchange(nullptr);
+        long nExisting = 0;
+
+        if (topicArray)
+        {
+          SafeArrayGetUBound(topicArray, 2, &nExisting);
+          ++nExisting; // Bound is *inclusive*
+          SAFEARRAYBOUND outer{ nExisting + nReady, 0 };
+          SafeArrayRedim(topicArray, &outer);
+        }
+        else
+        {
+          SAFEARRAYBOUND bounds[] = { { 2u, 0 }, { nReady, 0 } };
+          topicArray = SafeArrayCreate(VT_VARIANT, 2, bounds);
+        }
+
+        writeReadyTopicsArray(topicArray, topicIds, nExisting);
+
+        _readyUpdates.exchange(topicArray);
+      }
+
+      SAFEARRAY* take() override
+      {
+        return _readyUpdates.exchange(nullptr);
+      }
+
+    private:
+      atomic<SAFEARRAY*> _readyUpdates = nullptr;
+
+      // 
+      // Creates a 2 x n safearray which has rows of:
+      //     topicId | empty
+      // With the topicId for each updated topic. The second column can be used
+      // to pass an updated value to Excel, however, only string values are allowed
+      // which is too restricive. Passing empty tells Excel to call the function
+      // again to get the value
+      //
+      static void writeReadyTopicsArray(
+        SAFEARRAY* data,
+        const std::unordered_set<long>& topics,
+        const long startRow = 0)
+      {
+        void* element = nullptr;
+        auto iRow = startRow;
+        for (auto topic : topics)
+        {
+          long index[] = { 0, iRow };
+          auto ret = SafeArrayPtrOfIndex(data, index, &element);
+          assert(S_OK == ret);
+          *(VARIANT*)element = _variant_t(topic);
+
+          index[0] = 1;
+          ret = SafeArrayPtrOfIndex(data, index, &element);
+          assert(S_OK == ret);
+          *(VARIANT*)element = _variant_t();
+
+          ++iRow;
+        }
+      }
+    };
+
     template <class TValue>
     class RtdServerThreadedWorker : public IRtdServerWorker, public IRtdPublishManager<TValue>
     {
     public:
+      RtdServerThreadedWorker(
+        std::unique_ptr<IRtdReadyTopics>&& readyTopics = std::make_unique<SafeArrayReadyTopics>(),
+        size_t queueCapacity = 1 << 14)
+        : _newValues(queueCapacity)
+        , _readyTopics(std::move(readyTopics))
+      {}
 
       void start(std::function<void()>&& updateNotify)
       {
@@ -58,7 +151,7 @@ namespace xloil
 
       SAFEARRAY* getUpdates() 
       { 
-        auto updates = _readyUpdates.exchange(nullptr);
+        auto updates = _readyTopics->take();
         notify();
         return updates;
       }
@@ -80,26 +173,43 @@ namespace xloil
           _workerThread.join();
       }
 
-      void update(wstring&& topic, const shared_ptr<TValue>& value)
+      void update(const std::wstring_view& topic, const shared_ptr<TValue>& value)
       {
         if (!isServerRunning())
           return;
+        RtdTopicHandle handle;
         {
-          scoped_lock lock(_mutexNewValues);
-          // TODO: can this be somehow lock free?
-          _newValues.emplace_back(make_pair(std::move(topic), value));
+          shared_lock lock(_lockRecords);
+          auto record = findRecord(topic);
+          // No publisher or subscribers, so no one to receive the value
+          if (!record)
+          {
+            _nDroppedOnUpdate.fetch_add(1, std::memory_order_relaxed);
+            return;
+          }
+          handle = record->handle();
         }
+        update(handle, value);
+      }
+
+      void update(RtdTopicHandle topic, const shared_ptr<TValue>& value)
+      {
+        if (!isServerRunning())
+          return;
+        _newValues.push(topic, value);
         notify();
       }
 
-      void addPublisher(const shared_ptr<IRtdPublisher>& job)
+      RtdTopicHandle addPublisher(const shared_ptr<IRtdPublisher>& job)
       {
         auto existingJob = job;
+        RtdTopicHandle handle;
         {
           unique_lock lock(_lockRecords);
-          auto& record = _records[job->topic()];
+          auto& record = internTopic(job->topic());
+          handle = record.handle();
           if (record.publisher == job)
-            return;
+            return handle;
 
           std::swap(record.publisher, existingJob);
           if (existingJob)
@@ -107,6 +217,7 @@ namespace xloil
         }
         if (existingJob)
           existingJob->stop();
+        return handle;
       }
 
       bool dropPublisher(const wchar_t* topic)
@@ -114,33 +225,57 @@ namespace xloil
         // We must not hold the lock when calling functions on the publisher
         // as they may try to call other functions on the RTD server. 
         shared_ptr<IRtdPublisher> publisher;
+        RtdTopicHandle handle;
         {
           unique_lock lock(_lockRecords);
-          auto i = _records.find(topic);
-          if (i == _records.end())
+          auto record = findRecord(topic);
+          if (!record)
             return false;
-          std::swap(publisher, i->second.publisher);
+          std::swap(publisher, record->publisher);
+          handle = record->handle();
         }
 
-        // Signal the publisher to stop
-        publisher->stop();
+        if (publisher)
+        {
+          // Signal the publisher to stop
+          publisher->stop();
 
-        // Destroy producer, the dtor of RtdPublisher waits for completion
-        publisher.reset();
+          // Destroy producer, the dtor of RtdPublisher waits for completion
+          publisher.reset();
+        }
 
         // Publish empty value (which triggers a notify)
-        update(topic, shared_ptr<TValue>());
+        update(handle, shared_ptr<TValue>());
         return true;
       }
 
+      void setDeliveryPolicy(const RtdDeliveryPolicy& policy)
+      {
+        _throttle.setPolicy(policy);
+        // Wake the worker in case held topics are now due
+        notify();
+      }
+
+      RtdServerStats stats() const
+      {
+        RtdServerStats result;
+        const auto dropped = _nDropped.load(std::memory_order_relaxed);
+        result.published = _newValues.received() + _nDroppedOnUpdate.load(std::memory_order_relaxed);
+        result.coalesced = _newValues.coalesced() + _throttle.coalesced();
+        result.throttled = _throttle.throttled();
+        result.dropped = dropped + _nDroppedOnUpdate.load(std::memory_order_relaxed);
+        result.notifies = _throttle.notifies();
+        return result;
+      }
+
       bool value(const wchar_t* topic, shared_ptr<const TValue>& val) const
       {
         shared_lock lock(_lockRecords);
-        auto found = _records.find(topic);
-        if (found == _records.end())
+        auto record = findRecord(topic);
+        if (!record)
           return false;
 
-        val = found->second.value;
+        val = record->value;
         return true;
       }
 
@@ -148,14 +283,33 @@ namespace xloil
 
       struct TopicRecord
       {
+        wstring topic;
+        uint32_t slot = 0;
+        uint32_t generation = 0;
+        bool inUse = false;
         shared_ptr<IRtdPublisher> publisher;
         unordered_set<long> subscribers;
         shared_ptr<TValue> value;
-      };
 
-      unordered_map<wstring, TopicRecord> _records;
+        RtdTopicHandle handle() const 
+        { 
+          return makeRtdTopicHandle(slot, generation); 
+        }
+      };
 
-      list<pair<wstring, shared_ptr<TValue>>> _newValues;
+      // Topic strings are interned to a slot in _records when a publisher or 
+      // subscriber first appears, so published values can be queued and applied
+      // using an integer handle. A deque keeps the records, and hence the topic
+      // strings, at fixed addresses so _topicSlots can be keyed on views of them.
+      // Released slots are reused with an incremented generation.
+      std::deque<TopicRecord> _records;
+      unordered_map<std::wstring_view, uint32_t> _topicSlots;
+      vector<uint32_t> _freeSlots;
+
+      RtdPublishQueue<TValue> _newValues;
+      // Only accessed by the worker thread, except for the policy and counters
+      RtdDeliveryThrottle _throttle;
+      atomic<size_t> _nDropped = 0, _nDroppedOnUpdate = 0;
       vector<pair<long, wstring>> _topicsToConnect;
       vector<long> _topicIdsToDisconnect;
 
@@ -163,14 +317,14 @@ namespace xloil
       list<shared_ptr<IRtdPublisher>> _cancelledPublishers;
 
       std::function<void()> _updateNotify;
-      atomic<SAFEARRAY*> _readyUpdates;
-      atomic<bool> _isRunning;
-
-      // We use a separate lock for the newValues to avoid blocking too 
-      // often: value updates are likely to come from other threads and 
-      // simply need to write into newValues without accessing pub/sub info.
-      // We use _lockRecords for all other synchronisation
-      mutable mutex _mutexNewValues;
+      std::unique_ptr<IRtdReadyTopics> _readyTopics;
+      atomic<bool> _isRunning = false;
+
+      // Value updates are likely to come from other threads and are pushed
+      // to the lock-free _newValues queue. _mutexWake only guards the worker's
+      // wait on the condition variable. We use _lockRecords for all other
+      // synchronisation
+      mutable mutex _mutexWake;
       mutable mutex _mutexNewSubscribers;
       mutable std::shared_mutex _lockRecords;
 
@@ -180,8 +334,82 @@ namespace xloil
 
       void notify() noexcept
       {
-        _workPending = true;
-        _workPendingNotifier.notify_one();
+        // If the flag is already set, the worker has yet to clear it, so will
+        // see any work we have queued without another signal. Otherwise take
+        // the mutex to ensure the worker is either waiting or has yet to test
+        // the flag, so the wake cannot be lost.
+        if (!_workPending.exchange(true))
+        {
+          { scoped_lock lock(_mutexWake); }
+          _workPendingNotifier.notify_one();
+        }
+      }
+
+      // The functions below require _lockRecords to be held
+
+      TopicRecord* findRecord(const std::wstring_view& topic)
+      {
+        auto found = _topicSlots.find(topic);
+        return found == _topicSlots.end() ? nullptr : &_records[found->second];
+      }
+
+      const TopicRecord* findRecord(const std::wstring_view& topic) const
+      {
+        auto found = _topicSlots.find(topic);
+        return found == _topicSlots.end() ? nullptr : &_records[found->second];
+      }
+
+      TopicRecord* findRecord(RtdTopicHandle handle)
+      {
+        const auto slot = rtdTopicSlot(handle);
+        if (slot >= _records.size())
+          return nullptr;
+        auto& record = _records[slot];
+        return record.inUse && record.generation == rtdTopicGeneration(handle)
+          ? &record
+          : nullptr;
+      }
+
+      TopicRecord& internTopic(const std::wstring_view& topic)
+      {
+        auto found = findRecord(topic);
+        if (found)
+          return *found;
+
+        uint32_t slot;
+        if (!_freeSlots.empty())
+        {
+          slot = _freeSlots.back();
+          _freeSlots.pop_back();
+        }
+        else
+        {
+          slot = (uint32_t)_records.size();
+          _records.emplace_back().slot = slot;
+        }
+
+        auto& record = _records[slot];
+        record.topic.assign(topic.begin(), topic.end());
+        record.inUse = true;
+        _topicSlots.emplace(record.topic, slot);
+        return record;
+      }
+
+      /// <summary>
+      /// The caller must hold a reference to the publisher (if any) so it is 
+      /// not destroyed under the lock.
+      /// </summary>
+      void releaseTopic(TopicRecord& record)
+      {
+        _topicSlots.erase(record.topic);
+        record.topic.clear();
+        record.publisher.reset();
+        record.subscribers.clear();
+        record.value.reset();
+        record.inUse = false;
+        _throttle.forget(record.handle());
+        ++record.generation;
+        _freeSlots.push_back(record.slot);
       }
 
       void setQuitFlag()
@@ -197,82 +425,80 @@ namespace xloil
       void workerThreadMain()
       {
         unordered_set<long> readyTopicIds;
+        vector<RtdTopicHandle> readyTopics;
         unordered_map<long, wstring> activeTopicIds;
         try
         {
           while (isServerRunning())
           {
             // The worker does all the work!  In this order
-            //   1) Wait for wake notification
+            //   1) Wait for wake notification or for held topics to be due
             //   2) Check if quit/stop has been sent
             //   3) Look for new values.
-            //      a) If any, put the matching topicIds in readyTopicIds
-            //      b) If Excel has picked up previous values, create an array of 
-            //         updates and send an UpdateNotify.
+            //      a) If any, pass the topics to the delivery throttle
+            //      b) If the throttle releases a batch, put the matching topicIds
+            //         in readyTopicIds, add them to the array of updates and send 
+            //         an UpdateNotify.
             //   4) Run any topic connect requests
             //   5) Run any topic disconnect requests
             //   6) Repeat
             //
-            decltype(_newValues) newValues;
-
-            unique_lock lockValues(_mutexNewValues);
+            unique_lock lockWake(_mutexWake);
             // This slightly convoluted code protects against spurious wakes and 
             // 'lost' wakes, i.e. if the CV is signalled but the worker is not
             // in the waiting state.
             if (!_workPending)
-              _workPendingNotifier.wait(lockValues, [&]() { return _workPending.load(); });
+            {
+              const auto isPending = [&]() { return _workPending.load(); };
+              const auto wakeTime = _throttle.nextWake();
+              if (wakeTime == RtdDeliveryThrottle::time_point::max())
+                _workPendingNotifier.wait(lockWake, isPending);
+              else
+                _workPendingNotifier.wait_until(lockWake, wakeTime, isPending);
+            }
             _workPending = false;
+            lockWake.unlock();
 
             if (!isServerRunning())
               break;
 
-            // Since _mutexNewValues is required to send updates, so we avoid holding it  
-            // and quickly swap out the list of new values. 
-            std::swap(newValues, _newValues);
-            lockValues.unlock();
-
-            if (!newValues.empty())
+            // The queue only passes the latest value for each topic. Values
+            // for topics which have since been released fail the lookup. The
+            // record value is always updated, but the throttle decides when
+            // the subscribers are told.
             {
-              shared_lock lock(_lockRecords);
-              auto iValue = newValues.begin();
-              for (; iValue != newValues.end(); ++iValue)
+              const auto now = RtdDeliveryThrottle::clock::now();
+              unique_lock lock(_lockRecords);
+              _newValues.drain([&](RtdTopicHandle handle, shared_ptr<TValue>& value)
               {
-                auto record = _records.find(iValue->first);
-                if (record == _records.end())
-                  continue;
-                record->second.value = iValue->second;
-                readyTopicIds.insert(record->second.subscribers.begin(), record->second.subscribers.end());
+                auto record = findRecord(handle);
+                if (!record)
+                {
+                  _nDropped.fetch_add(1, std::memory_order_relaxed);
+                  return;
+                }
+                record->value = std::move(value);
+                _throttle.arrived(handle, now);
+              });
+
+              if (_throttle.takeReady(now, readyTopics))
+              {
+                for (auto handle : readyTopics)
+                {
+                  auto record = findRecord(handle);
+                  if (record)
+                    readyTopicIds.insert(record->subscribers.begin(), record->subscribers.end());
+                }
+                readyTopics.clear();
               }
             }
 
-            // When Excel calls RefreshData, it will take the SAFEARRAY in _readyUpdates and
-            // atomically replace it with null. If this ptr is not null, we know Excel
-            // has not yet picked up the new values, so we swap it out and resize the array
-            // to include the latest ready topics. We issue another _updateNotify to Excel,
-            // even if there are items in readyUpdates as sometimes things go out of sync and
+            // We issue another _updateNotify to Excel, even if Excel has yet
+            // to collect previous updates as sometimes things go out of sync and
             // Excel does not call RefreshData (exact reasons unknown).
             if (!readyTopicIds.empty())
             {
-              const auto nReady = (ULONG)readyTopicIds.size();
-              auto topicArray = _readyUpdates.exchange(nullptr);
-              long nExisting = 0;
-
-              if (topicArray)
-              {
-                SafeArrayGetUBound(topicArray, 2, &nExisting); 
-                ++nExisting; // Bound is *inclusive*
-                SAFEARRAYBOUND outer{ nExisting + nReady, 0 };
-                SafeArrayRedim(topicArray, &outer);
-              }
-              else
-              {
-                SAFEARRAYBOUND bounds[] = { { 2u, 0 }, { nReady, 0 } };
-                topicArray = SafeArrayCreate(VT_VARIANT, 2, bounds);
-              }
-
-              writeReadyTopicsArray(topicArray, readyTopicIds, nExisting);
-
-              _readyUpdates.exchange(topicArray);
+              _readyTopics->append(readyTopicIds);
 
               _updateNotify();
 
@@ -413,37 +639,6 @@ namespace xloil
         }
       }
 
-      // 
-      // Creates a 2 x n safearray which has rows of:
-      //     topicId | empty
-      // With the topicId for each updated topic. The second column can be used
-      // to pass an updated value to Excel, however, only string values are allowed
-      // which is too restricive. Passing empty tells Excel to call the function
-      // again to get the value
-      //
-      static void writeReadyTopicsArray(
-        SAFEARRAY* data,
-        const std::unordered_set<long>& topics,
-        const long startRow = 0)
-      {
-        void* element = nullptr;
-        auto iRow = startRow;
-        for (auto topic : topics)
-        {
-          long index[] = { 0, iRow };
-          auto ret = SafeArrayPtrOfIndex(data, index, &element);
-          assert(S_OK == ret);
-          *(VARIANT*)element = _variant_t(topic);
-
-          index[0] = 1;
-          ret = SafeArrayPtrOfIndex(data, index, &element);
-          assert(S_OK == ret);
-          *(VARIANT*)element = _variant_t();
-
-          ++iRow;
-        }
-      }
-
       void connectTopic(long topicId, const wstring& topic)
       {
         // We need these values after we release the lock
@@ -453,7 +648,7 @@ namespace xloil
         {
           XLO_TRACE(L"RTD: connecting '{}' to topicId '{}'", topic, topicId);
           unique_lock lock(_lockRecords);
-          auto& record = _records[topic];
+          auto& record = internTopic(topic);
           publisher = record.publisher;
           record.subscribers.insert(topicId);
           numSubscribers = record.subscribers.size();
@@ -480,16 +675,19 @@ namespace xloil
           {
             unique_lock lock(_lockRecords);
   
-            auto& record = _records[topic];
-            record.subscribers.erase(topicId);
+            auto record = findRecord(topic);
+            if (!record)
+              return;
 
-            numSubscribers = record.subscribers.size();
-            publisher = record.publisher;
+            record->subscribers.erase(topicId);
+
+            numSubscribers = record->subscribers.size();
+            publisher = record->publisher;
 
             if (!publisher && numSubscribers == 0)
             {
               XLO_TRACE(L"Removing orphaned topic {}", topic);
-              _records.erase(topic);
+              releaseTopic(*record);
             }
           }
 
@@ -514,7 +712,9 @@ namespace xloil
 
               // Disconnect should only return true when num_subscribers = 0, 
               // so it's safe to erase the entire record
-              _records.erase(topic);
+              auto record = findRecord(topic);
+              if (record)
+                releaseTopic(*record);
             }
           }
         }
@@ -533,10 +733,14 @@ namespace xloil
           unique_lock lock(_lockRecords);
 
           for (auto& record : _records)
-            if (record.second.publisher)
-              publishers.emplace_back(std::move(record.second.publisher));
+          {
+            if (!record.inUse)
+              continue;
+            if (record.publisher)
+              publishers.emplace_back(std::move(record.publisher));
+            releaseTopic(record);
+          }
 
-          _records.clear();
           _cancelledPublishers.clear();
         }
 
@@ -0,0 +1,94 @@
+#pragma once
+#include <xloil/ArrayBuilder.h>
+#include <xloil/ExcelArray.h>
+#include <algorithm>
+
+namespace xloil
+{
+  namespace COM
+  {
+    namespace detail
+    {
+      /// <summary>
+      /// Side of the square tiles used to convert between column-major
+      /// SafeArrays and row-major ExcelObj arrays. A tile of VARIANTs and
+      /// its ExcelObj counterpart fit in L1 cache together.
+      /// </summary>
+      constexpr size_t SAFEARRAY_TILE = 16;
+
+      /// <summary>
+      /// Calls <code>f(i, j)</code> for every element of an nRows x nCols
+      /// array, one tile at a time and walking down the columns inside each
+      /// tile. Both a column-major source and a row-major target are then
+      /// accessed in runs of adjacent elements which stay in cache.
+      /// </summary>
+      template<class F>
+      void forEachTiled(size_t nRows, size_t nCols, F&& f)
+      {
+        for (size_t i0 = 0; i0 < nRows; i0 += SAFEARRAY_TILE)
+        {
+          const auto iEnd = std::min(nRows, i0 + SAFEARRAY_TILE);
+          for (size_t j0 = 0; j0 < nCols; j0 += SAFEARRAY_TILE)
+          {
+            const auto jEnd = std::min(nCols, j0 + SAFEARRAY_TILE);
+            for (auto j = j0; j < jEnd; ++j)
+              for (auto i = i0; i < iEnd; ++i)
+                f(i, j);
+          }
+        }
+      }
+    }
+
+    /// <summary>
+    /// Converts the top-left nRows x nCols block of a column-major array,
+    /// such as SafeArray data, to an ExcelObj array. The column stride is
+    /// <paramref name="stride"/> elements. <typeparamref name="TTraits"/>
+    /// must provide:
+    /// <code>
+    ///   static size_t stringLength(const TCell&);
+    ///   static void write(const TCell&, xloil::detail::ArrayBuilderElement);
+    /// </code>
+    /// The builder needs the total string length before any element is
+    /// written, so <code>stringLength</code> is called once per cell in
+    /// memory order: it should be O(1), e.g. read a BSTR's length prefix.
+    /// The kernel is independent of COM so it can be driven by stand-in
+    /// cell types.
+    /// </summary>
+    template<class TTraits, class TCell>
+    ExcelObj columnMajorToExcelObj(
+      const TCell* data, size_t stride, size_t nRows, size_t nCols)
+    {
+      size_t strLength = 0;
+      for (size_t j = 0; j < nCols; ++j)
+      {
+        const auto* column = data + j * stride;
+        for (size_t i = 0; i < nRows; ++i)
+          strLength += TTraits::stringLength(column[i]);
+      }
+
+      ExcelArrayBuilder builder(
+        (ExcelObj::row_t)nRows, (ExcelObj::col_t)nCols, strLength);
+
+      detail::forEachTiled(nRows, nCols, [&](size_t i, size_t j)
+      {
+        TTraits::write(data[j * stride + i], builder(i, j));
+      });
+
+      return builder.toExcelObj();
+    }
+
+    /// <summary>
+    /// Writes an ExcelArray to column-major storage, such as SafeArray data,
+    /// with the given column stride. <typeparamref name="TTraits"/> must
+    /// provide <code>static void write(const ExcelObj&, TCell&)</code>.
+    /// </summary>
+    template<class TTraits, class TCell>
+    void excelArrayToColumnMajor(const ExcelArray& arr, TCell* data, size_t stride)
+    {
+      detail::forEachTiled(arr.nRows(), arr.nCols(), [&](size_t i, size_t j)
+      {
+        TTraits::write(arr((ExcelObj::row_t)i, (ExcelObj::col_t)j), data[j * stride + i]);
+      });
+    }
+  }
+}
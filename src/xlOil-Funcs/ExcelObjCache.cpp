@@ -18,7 +18,8 @@ XLO_FUNC_START(
   xloRef(const ExcelObj& pxOper)
 )
 {
-  return returnValue(makeCached<ExcelObj>(pxOper));
+  // Cache a shared block so copies of the cached array are cheap
+  return returnValue(makeCached<ExcelObj>(pxOper.share()));
 }
 XLO_FUNC_END(xloRef).threadsafe()
   .help(L"Adds the specified value or range or array to the object cache and "
@@ -31,10 +32,13 @@ XLO_FUNC_START(
 )
 {
   // We return a pointer to the stored object directly without setting
-  // the flag which tells Excel to free it.
+  // the flag which tells Excel to free it. Excel cannot read a shared
+  // array directly, but copying it only increments a refcount.
   auto result = getCached<ExcelObj>(pxOper.asStringView());
   if (result)
-    return returnReference(*result);
+    return result->isShared()
+      ? returnValue(*result)
+      : returnReference(*result);
   return returnValue(CellError::Value);
 }
 XLO_FUNC_END(xloVal).threadsafe()
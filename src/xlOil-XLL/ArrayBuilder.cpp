@@ -1,4 +1,5 @@
 #include <xloil/ArrayBuilder.h>
+#include <unordered_map>
 
 namespace xloil
 {
@@ -99,4 +100,91 @@ namespace xloil
         targetBegin->take(std::move(*sourcePtr));
     }
   }
-}
\ No newline at end of file
+
+  void SequentialArrayBuilder::copyToBuilder(
+    detail::ArrayBuilderIterator targetBegin, detail::ArrayBuilderIterator targetEnd,
+    detail::ArrayBuilderCharAllocator chars)
+  {
+    auto sourcePtr = (ExcelObj*)_objects.data();
+    auto sourceEnd = last();
+    auto pStr = detail::PStringStackIterator(_strings.data());
+
+    for (; targetBegin != targetEnd && sourcePtr != sourceEnd; ++targetBegin, ++sourcePtr)
+    {
+      if (sourcePtr->xltype == msxll::xltypeStr)
+      {
+        auto pbuf = *pStr;
+        targetBegin->take(ExcelObj(BasicPString<wchar_t, detail::ArrayBuilderCharAllocator>(
+          std::wstring_view(pbuf + 1, pbuf[0]), chars)));
+        ++pStr;
+      }
+      else
+        targetBegin->take(std::move(*sourcePtr));
+    }
+  }
+
+  ExcelObj GrowableArrayBuilder::toExcelObj(bool transpose)
+  {
+    const auto nRows = _allocator.nRows();
+    const auto nObjects = nRows * _nColumns;
+    if (nObjects == 0)
+      XLO_THROW("GrowableArrayBuilder: cannot create empty array");
+
+    auto arrayData = new char[sizeof(ExcelObj) * nObjects 
+      + sizeof(wchar_t) * _allocator.stringLength()];
+    auto target = (ExcelObj*)arrayData;
+    auto stringData = (wchar_t*)(target + nObjects);
+
+    // Copy strings we own to the new block.  Any others, for example
+    // from emplace_pstr, are not ours to move. Interned strings are shared
+    // between elements, so we remember where each was moved to.
+    std::unordered_map<const wchar_t*, wchar_t*> relocated;
+    const auto interning = _allocator.interner() != nullptr;
+    auto relocate = [&](ExcelObj& obj)
+    {
+      if (obj.xltype == msxll::xltypeStr && _allocator.ownsString(obj.val.str.data))
+      {
+        if (interning)
+        {
+          const auto [moved, isNew] = relocated.try_emplace(obj.val.str.data, stringData);
+          if (!isNew)
+          {
+            obj.val.str.data = moved->second;
+            return;
+          }
+        }
+        const auto len = obj.val.str.data[0] + 1u;
+        wmemcpy(stringData, obj.val.str.data, len);
+        obj.val.str.data = stringData;
+        stringData += len;
+      }
+    };
+
+    if (!transpose)
+    {
+      for (size_t i = 0; i < nRows; ++i, target += _nColumns)
+      {
+        memcpy(target, _allocator.row(i), sizeof(ExcelObj) * _nColumns);
+        for (auto p = target; p != target + _nColumns; ++p)
+          relocate(*p);
+      }
+    }
+    else
+    {
+      for (size_t j = 0; j < _nColumns; ++j)
+        for (size_t i = 0; i < nRows; ++i, ++target)
+        {
+          memcpy(target, _allocator.row(i) + j, sizeof(ExcelObj));
+          relocate(*target);
+        }
+    }
+
+    // The allocator only holds the pre-compaction copies, which are
+    // POD from this point, so it can simply be discarded
+    _allocator = detail::GrowableArrayAlloc(_nColumns, 0);
+
+    return transpose
+      ? ExcelObj((ExcelObj*)arrayData, _nColumns, (ExcelObj::row_t)nRows)
+      : ExcelObj((ExcelObj*)arrayData, (ExcelObj::row_t)nRows, _nColumns);
+  }
+}
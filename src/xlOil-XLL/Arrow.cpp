@@ -0,0 +1,1164 @@
+#include <xloil/Arrow.h>
+#include <xloil/ExcelArray.h>
+#include <xloil/ArrayBuilder.h>
+#include <xloil/Throw.h>
+#include <xloil/StringUtils.h>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <cstring>
+
+#if defined(_M_X64)
+#  define XLOIL_ARROW_SSE2
+#  include <emmintrin.h>
+#endif
+
+using std::vector;
+using std::string;
+using std::unique_ptr;
+using std::make_unique;
+using row_t = xloil::ExcelArray::row_t;
+using col_t = xloil::ExcelArray::col_t;
+
+namespace xloil
+{
+  namespace
+  {
+    inline bool isHighSurrogate(wchar_t c) { return c >= 0xD800 && c <= 0xDBFF; }
+    inline bool isLowSurrogate(wchar_t c)  { return c >= 0xDC00 && c <= 0xDFFF; }
+    inline bool isContinuation(unsigned char c) { return (c & 0xC0) == 0x80; }
+
+#ifdef XLOIL_ARROW_SSE2
+    static_assert(sizeof(wchar_t) == 2);
+
+    /// <summary>
+    /// Loads eight UTF-16 chars and returns true if they are all ASCII
+    /// </summary>
+    inline bool loadAscii8(const wchar_t* p, __m128i& chars)
+    {
+      chars = _mm_loadu_si128((const __m128i*)p);
+      const auto high = _mm_and_si128(chars, _mm_set1_epi16((short)0xFF80));
+      return _mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) == 0xFFFF;
+    }
+#endif
+
+    // Rows in a table below which we don't bother with parallel conversion
+    constexpr size_t theParallelMinSize = 1 << 15;
+
+    /// <summary>
+    /// Runs func(i) for i in [0, n), in parallel if <paramref name="parallel"/>.
+    /// Rethrows the first exception on the calling thread.
+    /// </summary>
+    template<class TFunc>
+    void forEachColumn(size_t n, bool parallel, TFunc&& func)
+    {
+      vector<size_t> indices(n);
+      std::iota(indices.begin(), indices.end(), 0);
+      std::exception_ptr error;
+      std::mutex lockError;
+      auto wrapped = [&](size_t i)
+      {
+        try
+        {
+          func(i);
+        }
+        catch (...)
+        {
+          std::scoped_lock lock(lockError);
+          error = std::current_exception();
+        }
+      };
+      if (parallel)
+        std::for_each(std::execution::par, indices.begin(), indices.end(), wrapped);
+      else
+        std::for_each(indices.begin(), indices.end(), wrapped);
+      if (error)
+        std::rethrow_exception(error);
+    }
+
+    string toUtf8(const wchar_t* str, size_t len)
+    {
+      string result(detail::utf8Length(str, len), '\0');
+      detail::transcodeUtf16ToUtf8(str, len, result.data());
+      return result;
+    }
+  }
+
+  namespace detail
+  {
+    size_t utf8Length(const wchar_t* p, size_t len) noexcept
+    {
+      const auto end = p + len;
+      size_t n = 0;
+      while (p != end)
+      {
+#ifdef XLOIL_ARROW_SSE2
+        __m128i chars;
+        if (end - p >= 8 && loadAscii8(p, chars))
+        {
+          p += 8;
+          n += 8;
+          continue;
+        }
+#endif
+        const auto c = *p++;
+        if (c < 0x80)
+          n += 1;
+        else if (c < 0x800)
+          n += 2;
+        else if (isHighSurrogate(c) && p != end && isLowSurrogate(*p))
+        {
+          ++p;
+          n += 4;
+        }
+        else
+          n += 3; // Includes unpaired surrogates written as U+FFFD
+      }
+      return n;
+    }
+
+    size_t transcodeUtf16ToUtf8(const wchar_t* p, size_t len, char* out) noexcept
+    {
+      const auto end = p + len;
+      const auto start = out;
+      while (p != end)
+      {
+#ifdef XLOIL_ARROW_SSE2
+        __m128i chars;
+        if (end - p >= 8 && loadAscii8(p, chars))
+        {
+          // Narrow the eight chars to bytes
+          _mm_storel_epi64((__m128i*)out, _mm_packus_epi16(chars, chars));
+          p += 8;
+          out += 8;
+          continue;
+        }
+#endif
+        char32_t c = *p++;
+        if (c < 0x80)
+        {
+          *out++ = (char)c;
+          continue;
+        }
+        if (c < 0x800)
+        {
+          *out++ = (char)(0xC0 | (c >> 6));
+          *out++ = (char)(0x80 | (c & 0x3F));
+          continue;
+        }
+        if (isHighSurrogate((wchar_t)c) && p != end && isLowSurrogate(*p))
+        {
+          c = ((c - 0xD800) << 10) + (*p++ - 0xDC00) + 0x10000;
+          *out++ = (char)(0xF0 | (c >> 18));
+          *out++ = (char)(0x80 | ((c >> 12) & 0x3F));
+          *out++ = (char)(0x80 | ((c >> 6) & 0x3F));
+          *out++ = (char)(0x80 | (c & 0x3F));
+          continue;
+        }
+        if (c >= 0xD800 && c <= 0xDFFF)
+          c = 0xFFFD;
+        *out++ = (char)(0xE0 | (c >> 12));
+        *out++ = (char)(0x80 | ((c >> 6) & 0x3F));
+        *out++ = (char)(0x80 | (c & 0x3F));
+      }
+      return out - start;
+    }
+
+    size_t transcodeUtf8ToUtf16(const char* str, size_t len, wchar_t* out) noexcept
+    {
+      auto p = (const unsigned char*)str;
+      const auto end = p + len;
+      const auto start = out;
+      while (p != end)
+      {
+#ifdef XLOIL_ARROW_SSE2
+        if (end - p >= 16)
+        {
+          const auto bytes = _mm_loadu_si128((const __m128i*)p);
+          if (_mm_movemask_epi8(bytes) == 0)
+          {
+            // All ASCII: widen the sixteen bytes to chars
+            const auto zero = _mm_setzero_si128();
+            _mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi8(bytes, zero));
+            _mm_storeu_si128((__m128i*)(out + 8), _mm_unpackhi_epi8(bytes, zero));
+            p += 16;
+            out += 16;
+            continue;
+          }
+        }
+#endif
+        const auto c = *p;
+        const auto avail = end - p;
+        char32_t cp = 0xFFFD;
+        auto n = 1;
+        if (c < 0x80)
+          cp = c;
+        else if (c >= 0xC2 && c < 0xE0)
+        {
+          if (avail >= 2 && isContinuation(p[1]))
+          {
+            cp = ((c & 0x1F) << 6) | (p[1] & 0x3F);
+            n = 2;
+          }
+        }
+        else if (c >= 0xE0 && c < 0xF0)
+        {
+          if (avail >= 3 && isContinuation(p[1]) && isContinuation(p[2]))
+          {
+            const char32_t x = ((c & 0x0F) << 12) | ((p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+            if (x >= 0x800 && (x < 0xD800 || x > 0xDFFF))
+            {
+              cp = x;
+              n = 3;
+            }
+          }
+        }
+        else if (c >= 0xF0 && c < 0xF5)
+        {
+          if (avail >= 4 && isContinuation(p[1]) && isContinuation(p[2]) && isContinuation(p[3]))
+          {
+            const char32_t x = ((c & 0x07) << 18) | ((p[1] & 0x3F) << 12)
+              | ((p[2] & 0x3F) << 6) | (p[3] & 0x3F);
+            if (x >= 0x10000 && x <= 0x10FFFF)
+            {
+              cp = x;
+              n = 4;
+            }
+          }
+        }
+        p += n;
+        if (cp >= 0x10000)
+        {
+          cp -= 0x10000;
+          *out++ = (wchar_t)(0xD800 + (cp >> 10));
+          *out++ = (wchar_t)(0xDC00 + (cp & 0x3FF));
+        }
+        else
+          *out++ = (wchar_t)cp;
+      }
+      return out - start;
+    }
+  }
+
+  /*******************
+   * Export to Arrow *
+   *******************/
+
+  namespace
+  {
+    /// <summary>
+    /// Buffer aligned to 64 bytes as recommended by the Arrow specification
+    /// </summary>
+    class AlignedBuffer
+    {
+    public:
+      explicit AlignedBuffer(size_t size, bool zero = false)
+        : _data(size > 0 ? ::operator new(size, std::align_val_t(64)) : nullptr)
+      {
+        if (zero && _data)
+          memset(_data, 0, size);
+      }
+      AlignedBuffer(AlignedBuffer&& that) noexcept
+        : _data(that._data)
+      {
+        that._data = nullptr;
+      }
+      AlignedBuffer(const AlignedBuffer&) = delete;
+      AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+      ~AlignedBuffer()
+      {
+        if (_data)
+          ::operator delete(_data, std::align_val_t(64));
+      }
+      template<class T = void>
+      T* get() const { return (T*)_data; }
+
+    private:
+      void* _data;
+    };
+
+    struct ExportedArray
+    {
+      vector<AlignedBuffer> owned;
+      vector<const void*> buffers;
+      vector<ArrowArray> children;
+      vector<ArrowArray*> childPtrs;
+    };
+
+    struct ExportedSchema
+    {
+      string format;
+      string name;
+      vector<ArrowSchema> children;
+      vector<ArrowSchema*> childPtrs;
+    };
+
+    void releaseArray(ArrowArray* array)
+    {
+      for (int64_t i = 0; i < array->n_children; ++i)
+      {
+        auto child = array->children[i];
+        // A consumer may have moved the child out, marking it released
+        if (child->release)
+          child->release(child);
+      }
+      delete (ExportedArray*)array->private_data;
+      array->release = nullptr;
+    }
+
+    void releaseSchema(ArrowSchema* schema)
+    {
+      for (int64_t i = 0; i < schema->n_children; ++i)
+      {
+        auto child = schema->children[i];
+        if (child->release)
+          child->release(child);
+      }
+      delete (ExportedSchema*)schema->private_data;
+      schema->release = nullptr;
+    }
+
+    void fillSchema(ArrowSchema& schema, unique_ptr<ExportedSchema>&& exported, int64_t flags)
+    {
+      schema.format = exported->format.c_str();
+      schema.name = exported->name.c_str();
+      schema.metadata = nullptr;
+      schema.flags = flags;
+      schema.n_children = (int64_t)exported->childPtrs.size();
+      schema.children = exported->childPtrs.empty() ? nullptr : exported->childPtrs.data();
+      schema.dictionary = nullptr;
+      schema.release = releaseSchema;
+      schema.private_data = exported.release();
+    }
+
+    void fillArray(ArrowArray& array, unique_ptr<ExportedArray>&& exported, int64_t length, int64_t nullCount)
+    {
+      array.length = length;
+      array.null_count = nullCount;
+      array.offset = 0;
+      array.n_buffers = (int64_t)exported->buffers.size();
+      array.n_children = (int64_t)exported->childPtrs.size();
+      array.buffers = exported->buffers.empty() ? nullptr : exported->buffers.data();
+      array.children = exported->childPtrs.empty() ? nullptr : exported->childPtrs.data();
+      array.dictionary = nullptr;
+      array.release = releaseArray;
+      array.private_data = exported.release();
+    }
+
+    inline void setBit(uint8_t* bits, size_t i)
+    {
+      bits[i >> 3] |= (uint8_t)(1 << (i & 7));
+    }
+
+    inline bool getBit(const void* bits, int64_t i)
+    {
+      return (((const uint8_t*)bits)[i >> 3] & (1 << (i & 7))) != 0;
+    }
+
+    bool isNull(const ExcelObj& x)
+    {
+      switch (x.type())
+      {
+      case ExcelType::Num: case ExcelType::Int: case ExcelType::Bool: case ExcelType::Str:
+        return false;
+      default:
+        return true;
+      }
+    }
+
+    /// <summary>
+    /// Gives the Arrow format string for one column of an ExcelArray, starting
+    /// at row <paramref name="start"/>. For string columns, sets the number
+    /// of UTF-8 bytes required and, if <paramref name="converted"/> is given,
+    /// fills it with the string representation of any non-string values.
+    /// </summary>
+    const char* columnFormat(
+      const ExcelArray& arr,
+      row_t start,
+      col_t col,
+      size_t& totalBytes,
+      vector<std::wstring>* converted)
+    {
+      const auto length = (size_t)(arr.nRows() - start);
+      bool hasNumber = false, hasBool = false, hasString = false;
+      for (size_t i = 0; i < length; ++i)
+      {
+        switch (arr(start + (row_t)i, col).type())
+        {
+        case ExcelType::Num: case ExcelType::Int: hasNumber = true; break;
+        case ExcelType::Bool: hasBool = true; break;
+        case ExcelType::Str: hasString = true; break;
+        default: break;
+        }
+      }
+
+      totalBytes = 0;
+      if (hasString)
+      {
+        // Non-string values are written as their string representation
+        const auto convert = converted && (hasNumber || hasBool);
+        if (convert)
+          converted->resize(length);
+        for (size_t i = 0; i < length; ++i)
+        {
+          const auto& x = arr(start + (row_t)i, col);
+          if (x.type() == ExcelType::Str)
+          {
+            const auto str = x.cast<PStringRef>();
+            totalBytes += detail::utf8Length(str.pstr(), str.length());
+          }
+          else if (!isNull(x))
+          {
+            auto str = x.toString();
+            totalBytes += detail::utf8Length(str.data(), str.length());
+            if (convert)
+              (*converted)[i] = std::move(str);
+          }
+        }
+        return totalBytes > INT32_MAX ? "U" : "u";
+      }
+      if (hasNumber)
+        return "g";
+      if (hasBool)
+        return "b";
+      return "n";
+    }
+
+    /// <summary>
+    /// Gives the name of a column of the exported struct array
+    /// </summary>
+    string columnName(const ExcelArray& arr, bool headings, col_t col)
+    {
+      if (!headings || arr.nRows() == 0)
+        return std::to_string(col);
+      const auto& heading = arr(0, col);
+      if (heading.type() == ExcelType::Str)
+      {
+        const auto str = heading.cast<PStringRef>();
+        return toUtf8(str.pstr(), str.length());
+      }
+      const auto str = heading.toString();
+      return toUtf8(str.data(), str.length());
+    }
+
+    /// <summary>
+    /// Writes one column of an ExcelArray, starting at row <paramref name="start"/>,
+    /// to a child of the exported struct array
+    /// </summary>
+    class ColumnExporter
+    {
+      const ExcelArray& _arr;
+      row_t _start;
+      col_t _col;
+      size_t _length;
+      ExportedArray& _exported;
+      AlignedBuffer _validity;
+      int64_t _nullCount = 0;
+
+      const ExcelObj& at(size_t i) const { return _arr(_start + (row_t)i, _col); }
+
+      void addValidity()
+      {
+        // Bits are set for valid values. The buffer can be omitted if there
+        // are no nulls.
+        if (_nullCount == 0)
+          _exported.buffers.push_back(nullptr);
+        else
+        {
+          _exported.buffers.push_back(_validity.get());
+          _exported.owned.emplace_back(std::move(_validity));
+        }
+      }
+
+      void addBuffer(AlignedBuffer&& buffer)
+      {
+        _exported.buffers.push_back(buffer.get());
+        _exported.owned.emplace_back(std::move(buffer));
+      }
+
+      void writeDoubles()
+      {
+        AlignedBuffer data(_length * sizeof(double));
+        auto* out = data.get<double>();
+        auto* validity = _validity.get<uint8_t>();
+        for (size_t i = 0; i < _length; ++i)
+        {
+          const auto& x = at(i);
+          switch (x.type())
+          {
+          case ExcelType::Num:  out[i] = x.val.num; break;
+          case ExcelType::Int:  out[i] = x.val.w; break;
+          case ExcelType::Bool: out[i] = x.val.xbool ? 1.0 : 0.0; break;
+          default:
+            out[i] = 0;
+            ++_nullCount;
+            continue;
+          }
+          setBit(validity, i);
+        }
+        addValidity();
+        addBuffer(std::move(data));
+      }
+
+      void writeBools()
+      {
+        AlignedBuffer data((_length + 7) / 8, true);
+        auto* validity = _validity.get<uint8_t>();
+        for (size_t i = 0; i < _length; ++i)
+        {
+          const auto& x = at(i);
+          if (x.type() != ExcelType::Bool)
+          {
+            ++_nullCount;
+            continue;
+          }
+          setBit(validity, i);
+          if (x.val.xbool)
+            setBit(data.get<uint8_t>(), i);
+        }
+        addValidity();
+        addBuffer(std::move(data));
+      }
+
+      template<class TOffset>
+      void writeStrings(const vector<std::wstring>& converted, size_t totalBytes)
+      {
+        AlignedBuffer offsetBuffer((_length + 1) * sizeof(TOffset));
+        AlignedBuffer data(totalBytes);
+        auto* offsets = offsetBuffer.get<TOffset>();
+        auto* validity = _validity.get<uint8_t>();
+        auto* out = data.get<char>();
+        TOffset pos = 0;
+        for (size_t i = 0; i < _length; ++i)
+        {
+          offsets[i] = pos;
+          const auto& x = at(i);
+          if (x.type() == ExcelType::Str)
+          {
+            const auto str = x.cast<PStringRef>();
+            pos += (TOffset)detail::transcodeUtf16ToUtf8(str.pstr(), str.length(), out + pos);
+          }
+          else if (!isNull(x))
+          {
+            const auto& str = converted[i];
+            pos += (TOffset)detail::transcodeUtf16ToUtf8(str.data(), str.length(), out + pos);
+          }
+          else
+          {
+            ++_nullCount;
+            continue;
+          }
+          setBit(validity, i);
+        }
+        offsets[_length] = pos;
+        addValidity();
+        addBuffer(std::move(offsetBuffer));
+        addBuffer(std::move(data));
+      }
+
+    public:
+      ColumnExporter(const ExcelArray& arr, row_t start, col_t col, ExportedArray& exported)
+        : _arr(arr)
+        , _start(start)
+        , _col(col)
+        , _length(arr.nRows() - start)
+        , _exported(exported)
+        , _validity((_length + 7) / 8, true)
+      {}
+
+      /// <summary>
+      /// Writes the buffers and returns the Arrow format string
+      /// </summary>
+      const char* operator()()
+      {
+        vector<std::wstring> converted;
+        size_t totalBytes;
+        const auto format = columnFormat(_arr, _start, _col, totalBytes, &converted);
+        switch (format[0])
+        {
+        case 'U':
+          writeStrings<int64_t>(converted, totalBytes);
+          break;
+        case 'u':
+          writeStrings<int32_t>(converted, totalBytes);
+          break;
+        case 'g':
+          writeDoubles();
+          break;
+        case 'b':
+          writeBools();
+          break;
+        default:
+          // The null type has no buffers
+          _nullCount = (int64_t)_length;
+        }
+        return format;
+      }
+
+      int64_t nullCount() const { return _nullCount; }
+    };
+  }
+
+  void arrowExport(
+    const ExcelArray& arr,
+    bool headings,
+    ArrowSchema* schema,
+    ArrowArray* array)
+  {
+    const row_t start = headings && arr.nRows() > 0 ? 1 : 0;
+    const auto length = (int64_t)arr.nRows() - start;
+    const auto nCols = arr.nCols();
+
+    auto exportedSchema = make_unique<ExportedSchema>();
+    exportedSchema->format = "+s";
+    exportedSchema->children.resize(nCols);
+
+    auto exported = make_unique<ExportedArray>();
+    // A struct array has only a validity buffer, which we omit
+    exported->buffers.push_back(nullptr);
+    exported->children.resize(nCols);
+
+    for (col_t j = 0; j < nCols; ++j)
+    {
+      exportedSchema->childPtrs.push_back(&exportedSchema->children[j]);
+      exported->childPtrs.push_back(&exported->children[j]);
+      exportedSchema->children[j].release = nullptr;
+      exported->children[j].release = nullptr;
+    }
+
+    try
+    {
+      // Columns are independent so can be written concurrently
+      forEachColumn(nCols, arr.size() >= theParallelMinSize, [&](size_t j)
+      {
+        auto childSchema = make_unique<ExportedSchema>();
+        childSchema->name = columnName(arr, headings, (col_t)j);
+
+        auto childArray = make_unique<ExportedArray>();
+        ColumnExporter writer(arr, start, (col_t)j, *childArray);
+        childSchema->format = writer();
+        const auto nullCount = writer.nullCount();
+
+        fillSchema(exportedSchema->children[j], std::move(childSchema), ARROW_FLAG_NULLABLE);
+        fillArray(exported->children[j], std::move(childArray), length, nullCount);
+      });
+    }
+    catch (...)
+    {
+      for (auto& child : exportedSchema->children)
+        if (child.release)
+          child.release(&child);
+      for (auto& child : exported->children)
+        if (child.release)
+          child.release(&child);
+      throw;
+    }
+
+    fillSchema(*schema, std::move(exportedSchema), 0);
+    fillArray(*array, std::move(exported), length, 0);
+  }
+
+  void arrowExportSchema(
+    const ExcelArray& arr,
+    bool headings,
+    ArrowSchema* schema)
+  {
+    const row_t start = headings && arr.nRows() > 0 ? 1 : 0;
+    const auto nCols = arr.nCols();
+
+    auto exportedSchema = make_unique<ExportedSchema>();
+    exportedSchema->format = "+s";
+    exportedSchema->children.resize(nCols);
+    for (col_t j = 0; j < nCols; ++j)
+    {
+      exportedSchema->childPtrs.push_back(&exportedSchema->children[j]);
+      exportedSchema->children[j].release = nullptr;
+    }
+
+    try
+    {
+      forEachColumn(nCols, arr.size() >= theParallelMinSize, [&](size_t j)
+      {
+        auto childSchema = make_unique<ExportedSchema>();
+        childSchema->name = columnName(arr, headings, (col_t)j);
+        size_t totalBytes;
+        childSchema->format = columnFormat(arr, start, (col_t)j, totalBytes, nullptr);
+        fillSchema(exportedSchema->children[j], std::move(childSchema), ARROW_FLAG_NULLABLE);
+      });
+    }
+    catch (...)
+    {
+      for (auto& child : exportedSchema->children)
+        if (child.release)
+          child.release(&child);
+      throw;
+    }
+
+    fillSchema(*schema, std::move(exportedSchema), 0);
+  }
+
+  /*********************
+   * Import from Arrow *
+   *********************/
+
+  namespace
+  {
+    // Days from the Excel epoch to the Unix epoch
+    constexpr int theUnixEpochSerial = 25569;
+
+    enum class ArrowType
+    {
+      Null, Bool, Int8, UInt8, Int16, UInt16, Int32, UInt32, Int64, UInt64,
+      Float32, Float64, Utf8, LargeUtf8, Date32, Date64, Timestamp
+    };
+
+    /// <summary>
+    /// Parses a format string. For timestamps, also gives the number of
+    /// ticks per day.
+    /// </summary>
+    ArrowType parseFormat(const char* format, double& ticksPerDay)
+    {
+      const auto f = std::string_view(format ? format : "");
+      if (f.size() == 1)
+      {
+        switch (f[0])
+        {
+        case 'n': return ArrowType::Null;
+        case 'b': return ArrowType::Bool;
+        case 'c': return ArrowType::Int8;
+        case 'C': return ArrowType::UInt8;
+        case 's': return ArrowType::Int16;
+        case 'S': return ArrowType::UInt16;
+        case 'i': return ArrowType::Int32;
+        case 'I': return ArrowType::UInt32;
+        case 'l': return ArrowType::Int64;
+        case 'L': return ArrowType::UInt64;
+        case 'f': return ArrowType::Float32;
+        case 'g': return ArrowType::Float64;
+        case 'u': return ArrowType::Utf8;
+        case 'U': return ArrowType::LargeUtf8;
+        }
+      }
+      else if (f == "tdD")
+        return ArrowType::Date32;
+      else if (f == "tdm")
+        return ArrowType::Date64;
+      else if (f.size() >= 4 && f.substr(0, 2) == "ts" && f[3] == ':')
+      {
+        switch (f[2])
+        {
+        case 's': ticksPerDay = 86400.0; return ArrowType::Timestamp;
+        case 'm': ticksPerDay = 86400e3; return ArrowType::Timestamp;
+        case 'u': ticksPerDay = 86400e6; return ArrowType::Timestamp;
+        case 'n': ticksPerDay = 86400e9; return ArrowType::Timestamp;
+        }
+      }
+      XLO_THROW("Unsupported Arrow format '{0}'", f);
+    }
+
+    bool isInteger(ArrowType t)
+    {
+      return t >= ArrowType::Int8 && t <= ArrowType::UInt64;
+    }
+
+    int64_t readInteger(ArrowType type, const void* data, int64_t i)
+    {
+      switch (type)
+      {
+      case ArrowType::Int8:   return ((const int8_t*)data)[i];
+      case ArrowType::UInt8:  return ((const uint8_t*)data)[i];
+      case ArrowType::Int16:  return ((const int16_t*)data)[i];
+      case ArrowType::UInt16: return ((const uint16_t*)data)[i];
+      case ArrowType::Int32:  return ((const int32_t*)data)[i];
+      case ArrowType::UInt32: return ((const uint32_t*)data)[i];
+      case ArrowType::Int64:  return ((const int64_t*)data)[i];
+      case ArrowType::UInt64: return (int64_t)((const uint64_t*)data)[i];
+      default:
+        XLO_THROW("Expected integer type");
+      }
+    }
+
+    /// <summary>
+    /// The part of a column in one record batch
+    /// </summary>
+    struct ColumnSlice
+    {
+      const ArrowArray* array;
+      // The enclosing struct array, whose offset and validity also apply
+      const ArrowArray* parent;
+      row_t firstRow;
+      // Decoded values for dictionary-encoded columns
+      ExcelObj dictionary;
+
+      int64_t length() const { return parent ? parent->length : array->length; }
+
+      int64_t index(int64_t i) const
+      {
+        return array->offset + (parent ? parent->offset : 0) + i;
+      }
+
+      bool isValid(int64_t i) const
+      {
+        if (parent && parent->null_count != 0 && parent->buffers[0]
+          && !getBit(parent->buffers[0], parent->offset + i))
+          return false;
+        return array->null_count == 0 || !array->buffers[0] || getBit(array->buffers[0], index(i));
+      }
+    };
+
+    struct ColumnImporter
+    {
+      const ArrowSchema* schema;
+      ArrowType type;
+      double ticksPerDay = 1;
+      vector<ColumnSlice> slices;
+
+      ColumnImporter(const ArrowSchema& s)
+        : schema(&s)
+        , type(parseFormat(s.format, ticksPerDay))
+      {
+        if (s.dictionary && !isInteger(type))
+          XLO_THROW("Arrow dictionary indices must be integers");
+      }
+
+      /// <summary>
+      /// Decodes the dictionary of each slice: batches in a stream may each
+      /// carry a different one, for example after a dictionary delta
+      /// </summary>
+      void decodeDictionary()
+      {
+        if (!schema->dictionary)
+          return;
+        const ArrowArray* previous = nullptr;
+        for (auto& s : slices)
+        {
+          const auto* values = s.array->dictionary;
+          if (!values)
+            XLO_THROW("Arrow array is missing its dictionary");
+          // Slices of the same array share its dictionary
+          if (values == previous)
+            s.dictionary = (&s - 1)->dictionary;
+          else
+            s.dictionary = arrowImport(*schema->dictionary, *values, false);
+          previous = values;
+        }
+      }
+
+      /// <summary>
+      /// Upper bound on the string store required, including the length
+      /// prefix of each string
+      /// </summary>
+      size_t stringLength() const
+      {
+        size_t total = 0;
+        for (auto& s : slices)
+        {
+          const auto n = s.length();
+          if (schema->dictionary)
+          {
+            const ExcelArray values(s.dictionary, false);
+            for (int64_t i = 0; i < n; ++i)
+            {
+              if (!s.isValid(i))
+                continue;
+              const auto k = readInteger(type, s.array->buffers[1], s.index(i));
+              if (k >= 0 && (size_t)k < values.size())
+                total += values((size_t)k).stringLength() + 1;
+            }
+          }
+          else if (type == ArrowType::Utf8 || type == ArrowType::LargeUtf8)
+          {
+            // Each UTF-8 byte gives at most one UTF-16 char
+            const auto bytes = type == ArrowType::Utf8
+              ? ((const int32_t*)s.array->buffers[1])[s.index(n)] - ((const int32_t*)s.array->buffers[1])[s.index(0)]
+              : ((const int64_t*)s.array->buffers[1])[s.index(n)] - ((const int64_t*)s.array->buffers[1])[s.index(0)];
+            total += (size_t)bytes + n;
+          }
+        }
+        return total;
+      }
+
+      template<class TOffset>
+      static void writeString(
+        detail::ArrayBuilderElement&& target,
+        const ColumnSlice& s,
+        int64_t i,
+        detail::ArrayBuilderCharAllocator& chars)
+      {
+        const auto* offsets = (const TOffset*)s.array->buffers[1];
+        const auto* data = (const char*)s.array->buffers[2];
+        const auto idx = s.index(i);
+        const auto begin = data + offsets[idx];
+        const auto bytes = (size_t)(offsets[idx + 1] - offsets[idx]);
+
+        constexpr size_t maxLength = 32767; // Excel's limit
+        if (bytes == 0)
+        {
+          target = std::wstring_view();
+        }
+        else if (bytes <= maxLength)
+        {
+          BasicPString<wchar_t, detail::ArrayBuilderCharAllocator> pstr((wchar_t)bytes, chars);
+          pstr.resize((wchar_t)detail::transcodeUtf8ToUtf16(begin, bytes, pstr.pstr()));
+          target.take(ExcelObj(std::move(pstr)));
+        }
+        else
+        {
+          vector<wchar_t> buffer(bytes);
+          const auto n = std::min(maxLength, detail::transcodeUtf8ToUtf16(begin, bytes, buffer.data()));
+          BasicPString<wchar_t, detail::ArrayBuilderCharAllocator> pstr((wchar_t)n, chars);
+          std::copy(buffer.data(), buffer.data() + n, pstr.pstr());
+          target.take(ExcelObj(std::move(pstr)));
+        }
+      }
+
+      /// <summary>
+      /// Copies a value into the builder using the given string allocator
+      /// </summary>
+      static void writeValue(
+        detail::ArrayBuilderElement&& target,
+        const ExcelObj& value,
+        detail::ArrayBuilderCharAllocator& chars)
+      {
+        if (value.type() == ExcelType::Str)
+        {
+          const auto str = value.cast<PStringRef>();
+          BasicPString<wchar_t, detail::ArrayBuilderCharAllocator> pstr(str.length(), chars);
+          std::copy(str.begin(), str.end(), pstr.pstr());
+          target.take(ExcelObj(std::move(pstr)));
+        }
+        else
+          target = value;
+      }
+
+      template<class T, class TFunc>
+      void writeTyped(ExcelArrayBuilder& builder, col_t col, TFunc&& convert)
+      {
+        for (auto& s : slices)
+        {
+          const auto* data = (const T*)s.array->buffers[1];
+          const auto n = s.length();
+          for (int64_t i = 0; i < n; ++i)
+          {
+            auto target = builder(s.firstRow + (row_t)i, col);
+            if (s.isValid(i))
+              convert(std::move(target), data[s.index(i)]);
+            else
+              target = CellError::NA;
+          }
+        }
+      }
+
+      template<class T>
+      void writeNumbers(ExcelArrayBuilder& builder, col_t col)
+      {
+        writeTyped<T>(builder, col, [](auto&& target, T x)
+        {
+          // Only types which fit in an int are written as one
+          if constexpr (std::is_integral_v<T> && (sizeof(T) < sizeof(int) || std::is_same_v<T, int32_t>))
+            target = (int)x;
+          else
+            target = (double)x;
+        });
+      }
+
+      void write(ExcelArrayBuilder& builder, col_t col, detail::ArrayBuilderCharAllocator chars)
+      {
+        if (schema->dictionary)
+        {
+          for (auto& s : slices)
+          {
+            const ExcelArray values(s.dictionary, false);
+            const auto n = s.length();
+            for (int64_t i = 0; i < n; ++i)
+            {
+              auto target = builder(s.firstRow + (row_t)i, col);
+              const auto k = s.isValid(i)
+                ? readInteger(type, s.array->buffers[1], s.index(i)) : -1;
+              if (k >= 0 && (size_t)k < values.size())
+                writeValue(std::move(target), values((size_t)k), chars);
+              else
+                target = CellError::NA;
+            }
+          }
+          return;
+        }
+
+        switch (type)
+        {
+        case ArrowType::Null:
+          for (auto& s : slices)
+            for (int64_t i = 0; i < s.length(); ++i)
+              builder(s.firstRow + (row_t)i, col) = CellError::NA;
+          return;
+        case ArrowType::Bool:
+          for (auto& s : slices)
+            for (int64_t i = 0; i < s.length(); ++i)
+            {
+              auto target = builder(s.firstRow + (row_t)i, col);
+              if (s.isValid(i))
+                target = getBit(s.array->buffers[1], s.index(i));
+              else
+                target = CellError::NA;
+            }
+          return;
+        case ArrowType::Int8:    return writeNumbers<int8_t>(builder, col);
+        case ArrowType::UInt8:   return writeNumbers<uint8_t>(builder, col);
+        case ArrowType::Int16:   return writeNumbers<int16_t>(builder, col);
+        case ArrowType::UInt16:  return writeNumbers<uint16_t>(builder, col);
+        case ArrowType::Int32:   return writeNumbers<int32_t>(builder, col);
+        case ArrowType::UInt32:  return writeNumbers<uint32_t>(builder, col);
+        case ArrowType::Int64:   return writeNumbers<int64_t>(builder, col);
+        case ArrowType::UInt64:  return writeNumbers<uint64_t>(builder, col);
+        case ArrowType::Float32: return writeNumbers<float>(builder, col);
+        case ArrowType::Float64: return writeNumbers<double>(builder, col);
+        case ArrowType::Date32:
+          return writeTyped<int32_t>(builder, col, [](auto&& target, int32_t x)
+          {
+            target = x + theUnixEpochSerial;
+          });
+        case ArrowType::Date64:
+          return writeTyped<int64_t>(builder, col, [](auto&& target, int64_t x)
+          {
+            target = x / 86400e3 + theUnixEpochSerial;
+          });
+        case ArrowType::Timestamp:
+          return writeTyped<int64_t>(builder, col, [ticks = ticksPerDay](auto&& target, int64_t x)
+          {
+            target = x / ticks + theUnixEpochSerial;
+          });
+        case ArrowType::Utf8:
+        case ArrowType::LargeUtf8:
+          for (auto& s : slices)
+            for (int64_t i = 0; i < s.length(); ++i)
+            {
+              auto target = builder(s.firstRow + (row_t)i, col);
+              if (!s.isValid(i))
+                target = CellError::NA;
+              else if (type == ArrowType::Utf8)
+                writeString<int32_t>(std::move(target), s, i, chars);
+              else
+                writeString<int64_t>(std::move(target), s, i, chars);
+            }
+          return;
+        }
+      }
+    };
+  }
+
+  ExcelObj arrowImport(
+    const ArrowSchema& schema,
+    const ArrowArray* batches,
+    size_t nBatches,
+    bool headings)
+  {
+    const auto isStruct = schema.format && std::string_view(schema.format) == "+s";
+    const auto nCols = isStruct ? (size_t)schema.n_children : 1;
+
+    vector<ColumnImporter> columns;
+    columns.reserve(nCols);
+    for (size_t j = 0; j < nCols; ++j)
+      columns.emplace_back(isStruct ? *schema.children[j] : schema);
+
+    row_t nRows = headings ? 1 : 0;
+    for (size_t b = 0; b < nBatches; ++b)
+    {
+      const auto& batch = batches[b];
+      if (isStruct && batch.n_children != (int64_t)nCols)
+        XLO_THROW("Arrow batch has {0} columns, expected {1}", batch.n_children, nCols);
+      for (size_t j = 0; j < nCols; ++j)
+        columns[j].slices.push_back(isStruct
+          ? ColumnSlice{ batch.children[j], &batch, nRows }
+          : ColumnSlice{ &batch, nullptr, nRows });
+      nRows += (row_t)batch.length;
+    }
+
+    if (nRows == 0 || nCols == 0)
+      return CellError::NA;
+
+    for (auto& column : columns)
+      column.decodeDictionary();
+
+    vector<std::wstring> names;
+    vector<size_t> stringLengths(nCols);
+    size_t totalStringLength = 0;
+    for (size_t j = 0; j < nCols; ++j)
+    {
+      if (headings)
+      {
+        const auto name = columns[j].schema->name;
+        names.emplace_back(name ? utf8ToUtf16(name) : std::wstring());
+        totalStringLength += names.back().length() + 1;
+      }
+      stringLengths[j] = columns[j].stringLength();
+      totalStringLength += stringLengths[j];
+    }
+
+    ExcelArrayBuilder builder(nRows, (col_t)nCols, totalStringLength);
+    for (size_t j = 0; j < names.size(); ++j)
+      builder(0, j) = std::wstring_view(names[j]);
+
+    // Give each column its own region of the string store so they can be
+    // written concurrently
+    vector<wchar_t*> regions(nCols);
+    auto builderChars = builder.charAllocator();
+    for (size_t j = 0; j < nCols; ++j)
+      regions[j] = builderChars.allocate(stringLengths[j]);
+
+    forEachColumn(nCols, (size_t)nRows * nCols >= theParallelMinSize, [&](size_t j)
+    {
+      auto stringData = regions[j];
+      detail::ArrayBuilderCharAllocator chars(stringData, stringData + stringLengths[j]);
+      columns[j].write(builder, (col_t)j, chars);
+    });
+
+    return builder.toExcelObj();
+  }
+
+  ExcelObj arrowImport(ArrowArrayStream& stream, bool headings)
+  {
+    ArrowSchema schema;
+    schema.release = nullptr;
+    vector<ArrowArray> batches;
+
+    auto cleanup = [&]()
+    {
+      for (auto& batch : batches)
+        if (batch.release)
+          batch.release(&batch);
+      if (schema.release)
+        schema.release(&schema);
+      if (stream.release)
+        stream.release(&stream);
+    };
+
+    try
+    {
+      if (stream.get_schema(&stream, &schema) != 0)
+        XLO_THROW("Failed to read Arrow stream schema: {0}", stream.get_last_error(&stream));
+
+      while (true)
+      {
+        ArrowArray batch;
+        if (stream.get_next(&stream, &batch) != 0)
+          XLO_THROW("Failed to read Arrow stream: {0}", stream.get_last_error(&stream));
+        // A released array marks the end of the stream
+        if (!batch.release)
+          break;
+        batches.push_back(batch);
+      }
+      auto result = arrowImport(schema, batches.data(), batches.size(), headings);
+      cleanup();
+      return result;
+    }
+    catch (...)
+    {
+      cleanup();
+      throw;
+    }
+  }
+}
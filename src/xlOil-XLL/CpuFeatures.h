@@ -0,0 +1,17 @@
+#pragma once
+
+// The vectorised kernels use AVX2, selected at runtime, on x64 builds
+#if defined(_M_X64)
+#  define XLOIL_HAS_AVX2_KERNELS
+#endif
+
+namespace xloil
+{
+  namespace detail
+  {
+    /// <summary>
+    /// Returns true if the CPU and OS support AVX2. The result is cached.
+    /// </summary>
+    bool hasAvx2() noexcept;
+  }
+}
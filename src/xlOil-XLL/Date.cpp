@@ -1,11 +1,18 @@
 #include <xlOil/Date.h>
+#include "CpuFeatures.h"
 #include <cmath>
+#include <limits>
 #include <chrono>
 #include <streambuf>
 #include <istream>
 #include <iomanip>
 #include <unordered_set>
 
+#ifdef XLOIL_HAS_AVX2_KERNELS
+#  define XLOIL_DATE_AVX2
+#  include <immintrin.h>
+#endif
+
 using namespace std::chrono;
 using std::vector;
 using std::string;
@@ -119,6 +126,145 @@ namespace xloil
     return serial;
   }
 
+  namespace
+  {
+    // The serial number of 1970-01-01
+    constexpr double theUnixEpochSerial = 25569;
+    // Serials before 1-Mar-1900 are one day off due to the 29-Feb-1900 bug
+    constexpr double theLeapBugSerial = 61;
+    constexpr double theMaxSerial = XL_MAX_SERIAL_DATE + 1;
+    // 2^63 as a double: tick counts must be strictly less in magnitude
+    constexpr double theTicksLimit = 9223372036854775808.0;
+
+    inline int64_t serialToTicks(double serial, double ticksPerDay) noexcept
+    {
+      if (!(serial >= 0 && serial < theMaxSerial))
+        return XL_NULL_DATE_TICKS;
+      const auto days = serial - theUnixEpochSerial + (serial < theLeapBugSerial ? 1.0 : 0.0);
+      const auto ticks = std::nearbyint(days * ticksPerDay);
+      if (!(ticks > -theTicksLimit && ticks < theTicksLimit))
+        return XL_NULL_DATE_TICKS;
+      return (int64_t)ticks;
+    }
+
+    inline double ticksToSerial(int64_t ticks, double ticksPerDay) noexcept
+    {
+      if (ticks == XL_NULL_DATE_TICKS)
+        return std::numeric_limits<double>::quiet_NaN();
+      const auto serial = (double)ticks / ticksPerDay + theUnixEpochSerial;
+      return serial < theLeapBugSerial ? serial - 1.0 : serial;
+    }
+
+#ifdef XLOIL_DATE_AVX2
+    // The kernels apply the same operations in the same order as the scalar
+    // functions above so give identical results. There is no AVX2 conversion
+    // between doubles and int64, so the values are split into high and low
+    // 32-bit parts which are converted separately.
+
+    void serialToTicksAvx2(const double*& in, size_t& n, int64_t*& out, double ticksPerDay) noexcept
+    {
+      const auto zero = _mm256_setzero_pd();
+      const auto one = _mm256_set1_pd(1.0);
+      const auto maxSerial = _mm256_set1_pd(theMaxSerial);
+      const auto epoch = _mm256_set1_pd(theUnixEpochSerial);
+      const auto leapBug = _mm256_set1_pd(theLeapBugSerial);
+      const auto perDay = _mm256_set1_pd(ticksPerDay);
+      const auto limit = _mm256_set1_pd(theTicksLimit);
+      const auto minusLimit = _mm256_set1_pd(-theTicksLimit);
+      const auto twoTo32 = _mm256_set1_pd(4294967296.0);
+      const auto twoToMinus32 = _mm256_set1_pd(1.0 / 4294967296.0);
+      const auto twoTo52 = _mm256_set1_pd(4503599627370496.0);
+      const auto nullTicks = _mm256_set1_epi64x(XL_NULL_DATE_TICKS);
+
+      for (; n >= 4; n -= 4, in += 4, out += 4)
+      {
+        const auto serial = _mm256_loadu_pd(in);
+        auto valid = _mm256_and_pd(
+          _mm256_cmp_pd(serial, zero, _CMP_GE_OQ),
+          _mm256_cmp_pd(serial, maxSerial, _CMP_LT_OQ));
+        const auto adjust = _mm256_and_pd(_mm256_cmp_pd(serial, leapBug, _CMP_LT_OQ), one);
+        const auto days = _mm256_add_pd(_mm256_sub_pd(serial, epoch), adjust);
+        const auto ticks = _mm256_round_pd(_mm256_mul_pd(days, perDay),
+          _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        valid = _mm256_and_pd(valid, _mm256_and_pd(
+          _mm256_cmp_pd(ticks, minusLimit, _CMP_GT_OQ),
+          _mm256_cmp_pd(ticks, limit, _CMP_LT_OQ)));
+        // Invalid lanes may hold NaN, which would make the conversion below
+        // raise an FP exception, so zero them
+        const auto safe = _mm256_and_pd(ticks, valid);
+
+        // ticks = hi * 2^32 + lo with 0 <= lo < 2^32, both exact
+        const auto hi = _mm256_floor_pd(_mm256_mul_pd(safe, twoToMinus32));
+        const auto lo = _mm256_sub_pd(safe, _mm256_mul_pd(hi, twoTo32));
+        const auto hiBits = _mm256_slli_epi64(
+          _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(hi)), 32);
+        // Adding 2^52 puts an integer below 2^52 in the mantissa bits
+        const auto loBits = _mm256_sub_epi64(
+          _mm256_castpd_si256(_mm256_add_pd(lo, twoTo52)),
+          _mm256_castpd_si256(twoTo52));
+
+        const auto result = _mm256_blendv_epi8(nullTicks,
+          _mm256_add_epi64(hiBits, loBits), _mm256_castpd_si256(valid));
+        _mm256_storeu_si256((__m256i*)out, result);
+      }
+    }
+
+    void ticksToSerialAvx2(const int64_t*& in, size_t& n, double*& out, double ticksPerDay) noexcept
+    {
+      const auto one = _mm256_set1_pd(1.0);
+      const auto epoch = _mm256_set1_pd(theUnixEpochSerial);
+      const auto leapBug = _mm256_set1_pd(theLeapBugSerial);
+      const auto perDay = _mm256_set1_pd(ticksPerDay);
+      const auto twoTo32 = _mm256_set1_pd(4294967296.0);
+      const auto twoTo52 = _mm256_set1_pd(4503599627370496.0);
+      const auto nan = _mm256_set1_pd(std::numeric_limits<double>::quiet_NaN());
+      const auto nullTicks = _mm256_set1_epi64x(XL_NULL_DATE_TICKS);
+      const auto lowMask = _mm256_set1_epi64x(0xFFFFFFFF);
+      const auto oddInts = _mm256_setr_epi32(1, 3, 5, 7, 0, 0, 0, 0);
+
+      for (; n >= 4; n -= 4, in += 4, out += 4)
+      {
+        const auto ticks = _mm256_loadu_si256((const __m256i*)in);
+        const auto isNull = _mm256_castsi256_pd(_mm256_cmpeq_epi64(ticks, nullTicks));
+
+        // The signed high halves convert directly, the unsigned low halves
+        // by setting the exponent bits of 2^52 and subtracting 2^52
+        const auto hi = _mm256_cvtepi32_pd(_mm256_castsi256_si128(
+          _mm256_permutevar8x32_epi32(ticks, oddInts)));
+        const auto lo = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(
+          _mm256_and_si256(ticks, lowMask), _mm256_castpd_si256(twoTo52))), twoTo52);
+        const auto value = _mm256_add_pd(_mm256_mul_pd(hi, twoTo32), lo);
+
+        const auto serial = _mm256_add_pd(_mm256_div_pd(value, perDay), epoch);
+        const auto adjust = _mm256_and_pd(_mm256_cmp_pd(serial, leapBug, _CMP_LT_OQ), one);
+        _mm256_storeu_pd(out, _mm256_blendv_pd(_mm256_sub_pd(serial, adjust), nan, isNull));
+      }
+    }
+#endif
+  }
+
+  void excelSerialToTicks(
+    const double* serials, size_t n, int64_t* ticks, double ticksPerDay) noexcept
+  {
+#ifdef XLOIL_DATE_AVX2
+    if (detail::hasAvx2())
+      serialToTicksAvx2(serials, n, ticks, ticksPerDay);
+#endif
+    for (size_t i = 0; i < n; ++i)
+      ticks[i] = serialToTicks(serials[i], ticksPerDay);
+  }
+
+  void ticksToExcelSerial(
+    const int64_t* ticks, size_t n, double* serials, double ticksPerDay) noexcept
+  {
+#ifdef XLOIL_DATE_AVX2
+    if (detail::hasAvx2())
+      ticksToSerialAvx2(ticks, n, serials, ticksPerDay);
+#endif
+    for (size_t i = 0; i < n; ++i)
+      serials[i] = ticksToSerial(ticks[i], ticksPerDay);
+  }
+
   // Thanks to:
   // https://stackoverflow.com/questions/13059091/creating-an-input-stream-from-constant-memory/13059195#13059195
   struct wmembuf : std::wstreambuf 
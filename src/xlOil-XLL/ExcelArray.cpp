@@ -2,9 +2,308 @@
 #include <xlOil/ExcelObj.h>
 #include <xlOil/Range.h>
 #include <xloil/ArrayBuilder.h>
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+
+#ifdef XLOIL_HAS_AVX2_KERNELS
+#  define XLOIL_ARRAY_AVX2
+#  include <immintrin.h>
+#  include <intrin.h>
+#endif
+
+using namespace msxll;
 
 namespace xloil
 {
+#ifdef XLOIL_ARRAY_AVX2
+  namespace detail
+  {
+    bool hasAvx2() noexcept
+    {
+      static const bool result = []()
+      {
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+          return false;
+        __cpuid(info, 1);
+        // Require OSXSAVE and AVX, and that the OS saves the YMM registers
+        if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0
+            || (_xgetbv(0) & 6) != 6)
+          return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+      }();
+      return result;
+    }
+  }
+#endif
+
+  namespace
+  {
+    inline bool isNumeric(const ExcelObj& x, double& out)
+    {
+      switch (x.xltype)
+      {
+      case xltypeNum:  out = x.val.num; return true;
+      case xltypeInt:  out = x.val.w; return true;
+      case xltypeBool: out = x.val.xbool ? 1.0 : 0.0; return true;
+      default: return false;
+      }
+    }
+
+#ifdef XLOIL_ARRAY_AVX2
+    // The AVX2 kernels load one xloper12 per 256-bit register, so rely 
+    // on the 64-bit layout: the value at offset 0 and xltype at offset 24
+    static_assert(sizeof(ExcelObj) == 32 && offsetof(xloper12, xltype) == 24);
+
+    inline __m256i loadObj(const ExcelObj* p)
+    {
+      return _mm256_loadu_si256((const __m256i*)p);
+    }
+
+    /// <summary>
+    /// Loads four consecutive objects, returning their xltypes in the 64-bit 
+    /// lanes of the result and their values in <paramref name="vals"/>
+    /// </summary>
+    inline __m256i loadTypes4(const ExcelObj* p, __m256d& vals)
+    {
+      const auto a = _mm256_castsi256_pd(loadObj(p));
+      const auto b = _mm256_castsi256_pd(loadObj(p + 1));
+      const auto c = _mm256_castsi256_pd(loadObj(p + 2));
+      const auto d = _mm256_castsi256_pd(loadObj(p + 3));
+      vals = _mm256_permute2f128_pd(
+        _mm256_unpacklo_pd(a, b), _mm256_unpacklo_pd(c, d), 0x20);
+      const auto hi = _mm256_permute2f128_pd(
+        _mm256_unpackhi_pd(a, b), _mm256_unpackhi_pd(c, d), 0x31);
+      // Mask off the padding after the 32-bit xltype
+      return _mm256_and_si256(_mm256_castpd_si256(hi), _mm256_set1_epi64x(0xFFFFFFFF));
+    }
+
+    inline int laneMask(__m256i x)
+    {
+      return _mm256_movemask_pd(_mm256_castsi256_pd(x));
+    }
+
+    int typeMaskAvx2(const ExcelObj*& p, const ExcelObj* end)
+    {
+      // Or-ing whole objects is fine as we only read the xltype lane
+      auto acc = _mm256_setzero_si256();
+      for (; end - p >= 4; p += 4)
+        acc = _mm256_or_si256(acc, _mm256_or_si256(
+          _mm256_or_si256(loadObj(p), loadObj(p + 1)),
+          _mm256_or_si256(loadObj(p + 2), loadObj(p + 3))));
+      const auto result = _mm256_extract_epi32(acc, 6);
+      _mm256_zeroupper();
+      return result;
+    }
+
+    size_t stringLengthAvx2(const ExcelObj*& p, const ExcelObj* end, size_t& nStrings)
+    {
+      size_t total = 0;
+      const auto strType = _mm256_set1_epi64x(xltypeStr);
+      // Ignore memory flags, as ExcelObj::xtype does
+      const auto typeBits = _mm256_set1_epi64x(
+        ~(xlbitXLFree | xlbitDLLFree | xlbitXloilShared) & 0xFFFFFFFF);
+      __m256d vals;
+      for (; end - p >= 4; p += 4)
+      {
+        const auto types = _mm256_and_si256(loadTypes4(p, vals), typeBits);
+        auto mask = laneMask(_mm256_cmpeq_epi64(types, strType));
+        for (auto i = 0; mask != 0; ++i, mask >>= 1)
+          if (mask & 1)
+          {
+            total += p[i].val.str.data[0];
+            ++nStrings;
+          }
+      }
+      _mm256_zeroupper();
+      return total;
+    }
+
+    void lastNonEmptyAvx2(const ExcelObj* begin, const ExcelObj*& end)
+    {
+      const auto nilType = _mm256_set1_epi64x(xltypeNil);
+      const auto missingType = _mm256_set1_epi64x(xltypeMissing);
+      const auto errType = _mm256_set1_epi64x(xltypeErr);
+      const auto errNA = _mm256_set1_epi64x(xlerrNA);
+      const auto lowBits = _mm256_set1_epi64x(0xFFFFFFFF);
+      __m256d vals;
+      // Skip blocks of four empties from the end. Strings need a pointer
+      // dereference to check for "", so we stop at any string.
+      for (; end - begin >= 4; end -= 4)
+      {
+        const auto types = loadTypes4(end - 4, vals);
+        const auto errs = _mm256_and_si256(_mm256_castpd_si256(vals), lowBits);
+        const auto empty = _mm256_or_si256(
+          _mm256_or_si256(
+            _mm256_cmpeq_epi64(types, nilType),
+            _mm256_cmpeq_epi64(types, missingType)),
+          _mm256_and_si256(
+            _mm256_cmpeq_epi64(types, errType),
+            _mm256_cmpeq_epi64(errs, errNA)));
+        if (laneMask(empty) != 0xF)
+          break;
+      }
+      _mm256_zeroupper();
+    }
+
+    bool gatherDoublesAvx2(const ExcelObj*& p, const ExcelObj* end, double*& out)
+    {
+      const auto numType = _mm256_set1_epi64x(xltypeNum);
+      __m256d vals;
+      for (; end - p >= 4; p += 4, out += 4)
+      {
+        const auto types = loadTypes4(p, vals);
+        if (laneMask(_mm256_cmpeq_epi64(types, numType)) == 0xF)
+          _mm256_storeu_pd(out, vals);
+        else
+        {
+          for (auto i = 0; i < 4; ++i)
+            if (!isNumeric(p[i], out[i]))
+            {
+              p += i;
+              out += i;
+              _mm256_zeroupper();
+              return false;
+            }
+        }
+      }
+      _mm256_zeroupper();
+      return true;
+    }
+
+    // Builds an object from the value in lane 0 of x and the xltype in lane 3
+    // of t. The bytes between are zeroed, which is fine for Num and Int.
+    template<int Lane>
+    inline void storeObj(ExcelObj* p, __m256i x, __m256i t)
+    {
+      _mm256_storeu_si256((__m256i*)p, 
+        _mm256_blend_epi32(t, _mm256_permute4x64_epi64(x, Lane * 0x55), 0x03));
+    }
+
+    void scatterDoublesAvx2(const double*& in, size_t& n, ExcelObj*& out)
+    {
+      const auto numType = _mm256_set_epi64x(xltypeNum, 0, 0, 0);
+      const auto absMask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7FFFFFFFFFFFFFFF));
+      const auto inf = _mm256_set1_pd(std::numeric_limits<double>::infinity());
+      for (; n >= 4; n -= 4, in += 4, out += 4)
+      {
+        const auto vals = _mm256_loadu_pd(in);
+        // The ordered comparison is false for NaN as well as infinities
+        const auto finite = _mm256_cmp_pd(_mm256_and_pd(vals, absMask), inf, _CMP_LT_OQ);
+        if (_mm256_movemask_pd(finite) == 0xF)
+        {
+          const auto x = _mm256_castpd_si256(vals);
+          storeObj<0>(out, x, numType);
+          storeObj<1>(out + 1, x, numType);
+          storeObj<2>(out + 2, x, numType);
+          storeObj<3>(out + 3, x, numType);
+        }
+        else
+          for (auto i = 0; i < 4; ++i)
+            new (out + i) ExcelObj(in[i]);
+      }
+      _mm256_zeroupper();
+    }
+
+    void scatterIntsAvx2(const int*& in, size_t& n, ExcelObj*& out)
+    {
+      const auto intType = _mm256_set_epi64x(xltypeInt, 0, 0, 0);
+      for (; n >= 4; n -= 4, in += 4, out += 4)
+      {
+        // Widening puts each int in the low half of a 64-bit lane
+        const auto x = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)in));
+        storeObj<0>(out, x, intType);
+        storeObj<1>(out + 1, x, intType);
+        storeObj<2>(out + 2, x, intType);
+        storeObj<3>(out + 3, x, intType);
+      }
+      _mm256_zeroupper();
+    }
+#endif
+  }
+
+  namespace detail
+  {
+    int arrayTypeMask(const ExcelObj* p, const ExcelObj* end) noexcept
+    {
+      int result = 0;
+#ifdef XLOIL_ARRAY_AVX2
+      if (hasAvx2())
+        result = typeMaskAvx2(p, end);
+#endif
+      for (; p != end; ++p)
+        result |= p->xltype;
+      return result;
+    }
+
+    size_t arrayStringLength(
+      const ExcelObj* p, const ExcelObj* end, size_t* nStrings) noexcept
+    {
+      size_t total = 0, count = 0;
+#ifdef XLOIL_ARRAY_AVX2
+      if (hasAvx2())
+        total = stringLengthAvx2(p, end, count);
+#endif
+      for (; p != end; ++p)
+        if (p->xtype() == xltypeStr)
+        {
+          total += p->val.str.data[0];
+          ++count;
+        }
+      if (nStrings)
+        *nStrings = count;
+      return total;
+    }
+
+    const ExcelObj* arrayLastNonEmpty(const ExcelObj* begin, const ExcelObj* end) noexcept
+    {
+#ifdef XLOIL_ARRAY_AVX2
+      if (hasAvx2())
+        lastNonEmptyAvx2(begin, end);
+#endif
+      while (end != begin && !(end - 1)->isNonEmpty())
+        --end;
+      return end;
+    }
+
+    size_t arrayGatherDoubles(const ExcelObj* begin, const ExcelObj* end, double* out) noexcept
+    {
+      auto p = begin;
+#ifdef XLOIL_ARRAY_AVX2
+      if (hasAvx2() && !gatherDoublesAvx2(p, end, out))
+        return p - begin;
+#endif
+      for (; p != end; ++p, ++out)
+        if (!isNumeric(*p, *out))
+          break;
+      return p - begin;
+    }
+
+    void arrayScatterDoubles(const double* in, size_t n, ExcelObj* out) noexcept
+    {
+#ifdef XLOIL_ARRAY_AVX2
+      if (hasAvx2())
+        scatterDoublesAvx2(in, n, out);
+#endif
+      for (; n > 0; --n, ++in, ++out)
+        new (out) ExcelObj(*in);
+    }
+
+    void arrayScatterInts(const int* in, size_t n, ExcelObj* out) noexcept
+    {
+#ifdef XLOIL_ARRAY_AVX2
+      if (hasAvx2())
+        scatterIntsAvx2(in, n, out);
+#endif
+      for (; n > 0; --n, ++in, ++out)
+        new (out) ExcelObj(*in);
+    }
+  }
+
   ExcelArray::ExcelArray(const ExcelObj& obj, bool trim)
   {
     if (obj.isType(ExcelType::Multi))
@@ -41,8 +340,8 @@ namespace xloil
       return ExcelObj();
 
     size_t strLen = 0;
-    for (auto& v : (*this))
-      strLen += v.stringLength();
+    for (auto i = 0u; i < nRows(); ++i)
+      strLen += detail::arrayStringLength(row_begin(i), row_end(i));
 
     ExcelArrayBuilder builder(nRows(), nCols(), strLen);
     for (auto i = 0u; i < nRows(); ++i)
@@ -65,20 +364,87 @@ namespace xloil
     nRows = arr.rows;
     nCols = arr.columns;
 
-    auto p = start + nCols * nRows - 1;
+    // The last non-empty element gives the number of rows
+    const auto last = detail::arrayLastNonEmpty(start, start + (size_t)nCols * nRows);
+    nRows = (row_t)((last - start + nCols - 1) / nCols);
 
-    for (; nRows > 0; --nRows)
-      for (int c = (int)nCols - 1; c >= 0; --c, --p)
-        if (p->isNonEmpty())
-          goto StartColSearch;
+    // Scan each row, which is contiguous, for its extent. We can stop 
+    // when a row is full.
+    col_t maxCols = nRows > 0 ? (col_t)((last - start) - (size_t)(nRows - 1) * nCols) : 0;
+    for (row_t i = 0; i + 1 < nRows && maxCols < nCols; ++i)
+    {
+      const auto row = start + (size_t)i * nCols;
+      maxCols = std::max(maxCols, 
+        (col_t)(detail::arrayLastNonEmpty(row + maxCols, row + nCols) - row));
+    }
+    nCols = maxCols;
+    return true;
+  }
 
-  StartColSearch:
-    for (; nCols > 0; --nCols)
-      for (p = start + nCols - 1; p < (start + nCols * nRows); p += arr.columns)
-        if (p->isNonEmpty())
-          goto SearchDone;
+  bool ExcelArray::toDoubles(double* out, size_t outSize) const
+  {
+    if (outSize < size())
+      XLO_THROW("Output buffer of size {0} too small for array of size {1}", outSize, size());
 
-  SearchDone:
+    if (_columns == _baseCols)
+      return detail::arrayGatherDoubles(_data, _data + size(), out) == size();
+
+    for (row_t i = 0; i < _rows; ++i, out += _columns)
+      if (detail::arrayGatherDoubles(row_begin(i), row_end(i), out) != _columns)
+        return false;
     return true;
   }
+
+  namespace detail
+  {
+    std::vector<const ExcelObj*> arrayDictionaryEncode(const ExcelArray& arr, int32_t* codes)
+    {
+      std::unordered_map<std::wstring_view, int32_t> strings;
+      std::unordered_map<double, int32_t> numbers;
+      int32_t bools[] = { -1, -1 };
+      std::vector<const ExcelObj*> categories;
+
+      auto encode = [&](auto& map, auto key, const ExcelObj& value)
+      {
+        auto [found, isNew] = map.try_emplace(key, (int32_t)categories.size());
+        if (isNew)
+          categories.push_back(&value);
+        return found->second;
+      };
+
+      for (auto p = arr.begin(); p != arr.end(); ++p, ++codes)
+      {
+        switch (p->xtype())
+        {
+        case xltypeStr:
+        {
+          // Excel shows an empty string like an empty cell
+          const auto str = p->cast<PStringRef>().view();
+          *codes = str.empty() ? -1 : encode(strings, str, *p);
+          break;
+        }
+        case xltypeNum:
+          *codes = encode(numbers, p->val.num, *p);
+          break;
+        case xltypeInt:
+          *codes = encode(numbers, (double)p->val.w, *p);
+          break;
+        case xltypeBool:
+        {
+          auto& code = bools[p->val.xbool ? 1 : 0];
+          if (code < 0)
+          {
+            code = (int32_t)categories.size();
+            categories.push_back(&*p);
+          }
+          *codes = code;
+          break;
+        }
+        default:
+          *codes = -1;
+        }
+      }
+      return categories;
+    }
+  }
 }
\ No newline at end of file
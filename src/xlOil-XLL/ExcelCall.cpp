@@ -2,6 +2,7 @@
 #include <xlOil/ExcelObj.h>
 #include "ExcelCallMapping.h"
 #include <cassert>
+#include <algorithm>
 using namespace msxll;
 using std::string;
 
@@ -56,6 +57,29 @@ namespace xloil
   XLOIL_EXPORT int callExcelRaw(
     int func, ExcelObj* result, size_t nArgs, const ExcelObj** args) noexcept
   {
+    // Excel12v accepts at most 255 arguments
+    constexpr size_t MAX_ARGS = 255;
+    if (nArgs > MAX_ARGS)
+      return xlretInvCount;
+
+    // Excel does not recognise xlOil's shared array bit, so we pass views
+    // of any shared arrays
+    if (args && std::any_of(args, args + nArgs, [](auto p) { return p && p->isShared(); }))
+    {
+      ExcelObj views[MAX_ARGS];
+      const ExcelObj* viewArgs[MAX_ARGS];
+      for (size_t i = 0; i < nArgs; ++i)
+      {
+        viewArgs[i] = args[i];
+        if (args[i] && args[i]->isShared())
+        {
+          ExcelObj::overwriteView(views[i], *args[i]);
+          viewArgs[i] = &views[i];
+        }
+      }
+      return callExcelRaw(func, result, nArgs, viewArgs);
+    }
+
     auto ret = Excel12v(func, result, (int)nArgs, (XLOIL_XLOPER**)args);
     if (result)
       result->resultFromExcel();
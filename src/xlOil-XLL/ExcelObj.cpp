@@ -11,6 +11,7 @@
 #include <xloil/StringUtils.h>
 #include <array>
 #include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <vector>
 #include <string>
@@ -51,14 +52,63 @@ namespace
     return pstr;
   }
 
-  size_t totalStringLength(const xloper12* arr, size_t nRows, size_t nCols)
+  /// <summary>
+  /// Placed before the array data in blocks created by ExcelObj::share
+  /// </summary>
+  struct SharedArrayHeader
   {
-    size_t total = 0;
-    auto endData = arr + (nRows * nCols);
-    for (; arr != endData; ++arr)
-      if (arr->xltype == xltypeStr)
-        total += arr->val.str.data[0];
-    return total;
+    std::atomic<size_t> refCount;
+    SharedArrayHeader() : refCount(1) {}
+  };
+  static_assert(sizeof(SharedArrayHeader) % alignof(ExcelObj) == 0);
+
+  SharedArrayHeader* sharedArrayHeader(const xloper12& obj)
+  {
+    return (SharedArrayHeader*)obj.val.array.lparray - 1;
+  }
+
+  void releaseSharedArray(const xloper12& obj) noexcept
+  {
+    auto header = sharedArrayHeader(obj);
+    if (header->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+      header->~SharedArrayHeader();
+      delete[] (char*)header;
+    }
+  }
+
+  /// <summary>
+  /// Deep copies an array into a single block laid out in the usual way: 
+  /// objects followed by their strings. Leaves space for a header of the
+  /// specified size at the start of the block, which is returned.
+  /// </summary>
+  char* copyArrayBlock(const ExcelObj* pSrc, size_t nObjects, size_t headerBytes)
+  {
+    // Each string needs an extra char for its length
+    size_t nStrings;
+    const auto nChars = detail::arrayStringLength(pSrc, pSrc + nObjects, &nStrings) + nStrings;
+
+    auto block = new char[
+      headerBytes + sizeof(ExcelObj) * nObjects + sizeof(wchar_t) * nChars];
+    auto pDst = (ExcelObj*)(block + headerBytes);
+    const auto pDstEnd = pDst + nObjects;
+
+    // Copy all the objects in one go, then fix up the strings
+    memcpy(pDst, pSrc, sizeof(ExcelObj) * nObjects);
+    auto pStr = (wchar_t*)pDstEnd;
+    for (auto p = pDst; p != pDstEnd; ++p)
+    {
+      p->xltype = p->xtype();
+      if (p->xltype == xltypeStr)
+      {
+        const auto len = p->val.str.data[0] + 1u;
+        wmemcpy(pStr, p->val.str.data, len);
+        p->val.str.data = pStr;
+        p->val.str.xloil_view = true;
+        pStr += len;
+      }
+    }
+    return block;
   }
 }
 
@@ -169,8 +219,11 @@ namespace
         // Arrays are allocated as an array of char which contains all their strings
         // So we don't need to loop and free them individually. If we are at this point
         // we must have created the ExcelObj ourselves, so it is safe to use the
-        // xloil_view extension.
-        if (!val.array.xloil_view)
+        // xloil_view and xloil_shared extensions. The latter is only trusted with
+        // the DLLFree bit, see setDllFreeFlag.
+        if (isShared() || ((xltype & xlbitDLLFree) != 0 && val.array.xloil_shared))
+          releaseSharedArray(*this);
+        else if (!val.array.xloil_view)
           delete[] (char*)(val.array.lparray);
         break;
 
@@ -422,7 +475,7 @@ namespace
 
   void ExcelObj::overwriteComplex(ExcelObj& to, const ExcelObj& from)
   {
-    switch (from.xltype & ~(xlbitXLFree | xlbitDLLFree))
+    switch (from.xtype())
     {
     case xltypeNum:
     case xltypeBool:
@@ -450,32 +503,21 @@ namespace
     }
     case xltypeMulti:
     {
+      if (from.isShared())
+      {
+        sharedArrayHeader(from)->refCount.fetch_add(1, std::memory_order_relaxed);
+        (msxll::XLOPER12&)to = (const msxll::XLOPER12&)from;
+        to.xltype = xltypeMulti | xlbitXloilShared;
+        break;
+      }
+
       const auto nRows = from.val.array.rows;
       const auto nCols = from.val.array.columns;
-
-      const auto* pSrc = (const ExcelObj*)from.val.array.lparray;
-
-      size_t strLength = totalStringLength(pSrc, nRows, nCols);
-      ExcelArrayBuilder arr(nRows, (ExcelArray::col_t)nCols, strLength, false);
-
-      for (auto i = 0; i < nRows; ++i)
-        for (auto j = 0; j < nCols; ++j)
-        {
-          switch (pSrc->xltype)
-          {
-          case xltypeStr:
-          {
-            arr(i, j) = pSrc->cast<PStringRef>();
-            break;
-          }
-          default:
-            arr(i, j) = *pSrc;
-          }
-          ++pSrc;
-        }
+      const auto block = copyArrayBlock(
+        (const ExcelObj*)from.val.array.lparray, (size_t)nRows * nCols, 0);
 
       // Overwrite "to"
-      new (&to) ExcelObj(arr.toExcelObj());
+      new (&to) ExcelObj((const ExcelObj*)block, nRows, nCols);
       break;
     }
 
@@ -523,6 +565,36 @@ namespace
     }
   }
 
+  ExcelObj ExcelObj::share() const
+  {
+    if (xtype() != xltypeMulti || isShared())
+      return *this;
+
+    const auto nRows = val.array.rows;
+    const auto nCols = val.array.columns;
+    const auto block = copyArrayBlock(
+      (const ExcelObj*)val.array.lparray, (size_t)nRows * nCols, sizeof(SharedArrayHeader));
+    new (block) SharedArrayHeader();
+
+    ExcelObj result((const ExcelObj*)(block + sizeof(SharedArrayHeader)), nRows, nCols);
+    result.val.array.xloil_shared = true;
+    result.xltype |= xlbitXloilShared;
+    return result;
+  }
+
+  ExcelObj& ExcelObj::unshare()
+  {
+    if (isShared())
+    {
+      const auto nRows = val.array.rows;
+      const auto nCols = val.array.columns;
+      const auto block = copyArrayBlock(
+        (const ExcelObj*)val.array.lparray, (size_t)nRows * nCols, 0);
+      *this = ExcelObj((const ExcelObj*)block, nRows, nCols);
+    }
+    return *this;
+  }
+
   namespace Const
   {
     namespace
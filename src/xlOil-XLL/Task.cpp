@@ -0,0 +1,287 @@
+#include <xloil/Task.h>
+#include <xloil/Async.h>
+#include <xloil/Events.h>
+#include <xloil/Log.h>
+#include <xloil/Throw.h>
+#include <deque>
+#include <algorithm>
+#include <thread>
+
+using std::scoped_lock;
+using std::unique_lock;
+using std::function;
+
+namespace xloil
+{
+  struct TaskExecutor::Impl
+  {
+    struct Worker
+    {
+      std::mutex lock;
+      std::deque<function<void()>> jobs;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    // Number of jobs in all queues. It is incremented after a job is pushed
+    // so can briefly go negative when a job is taken before the increment.
+    std::atomic<intptr_t> queued = 0;
+    std::atomic<int> sleeping = 0;
+    std::atomic<bool> stop = false;
+    // Set before stop: no more jobs are accepted from outside the workers
+    std::atomic<bool> closed = false;
+    // Number of posts in progress, which shutdown waits for
+    std::atomic<int> posting = 0;
+    std::atomic<size_t> nextQueue = 0;
+    std::atomic<size_t> nStolen = 0;
+    std::mutex lockWake;
+    std::condition_variable wake;
+
+    static thread_local Impl* thisPool;
+    static thread_local size_t thisWorker;
+
+    Impl(size_t nThreads)
+    {
+      for (size_t i = 0; i < nThreads; ++i)
+        workers.emplace_back(new Worker());
+      for (size_t i = 0; i < nThreads; ++i)
+        threads.emplace_back([this, i]() { run(i); });
+    }
+
+    /// <summary>
+    /// Stops accepting jobs from other threads, runs the queued jobs then
+    /// joins the workers. Continuations may hold a reference to the Impl 
+    /// beyond this, so the workers are not joined in the destructor.
+    /// </summary>
+    void shutdown()
+    {
+      // The sequentially consistent store then load pairs with the poster's
+      // increment of 'posting' then load of 'closed', so either the poster
+      // sees we are closed or we wait for its job to be queued
+      closed = true;
+      while (posting > 0)
+        std::this_thread::yield();
+      {
+        scoped_lock lock(lockWake);
+        stop = true;
+      }
+      wake.notify_all();
+      for (auto& thread : threads)
+        thread.join();
+    }
+
+    bool post(function<void()>&& job)
+    {
+      ++posting;
+      struct Posted
+      {
+        std::atomic<int>& n;
+        ~Posted() { --n; }
+      } posted{ posting };
+
+      const auto fromWorker = thisPool == this;
+      if (closed && !fromWorker)
+        return false;
+
+      const auto i = fromWorker
+        ? thisWorker
+        : nextQueue.fetch_add(1, std::memory_order_relaxed) % workers.size();
+      {
+        scoped_lock lock(workers[i]->lock);
+        workers[i]->jobs.emplace_back(std::move(job));
+      }
+      // The sequentially consistent increment then load pairs with the
+      // sleeper's increment of 'sleeping' then load of 'queued', so either
+      // the sleeper sees the job or we see the sleeper.
+      ++queued;
+      if (sleeping > 0)
+      {
+        { scoped_lock lock(lockWake); }
+        wake.notify_one();
+      }
+      return true;
+    }
+
+    bool take(size_t self, function<void()>& job)
+    {
+      {
+        auto& own = *workers[self];
+        scoped_lock lock(own.lock);
+        if (!own.jobs.empty())
+        {
+          job = std::move(own.jobs.back());
+          own.jobs.pop_back();
+          return true;
+        }
+      }
+      const auto n = workers.size();
+      for (size_t k = 1; k < n; ++k)
+      {
+        auto& other = *workers[(self + k) % n];
+        scoped_lock lock(other.lock);
+        if (!other.jobs.empty())
+        {
+          job = std::move(other.jobs.front());
+          other.jobs.pop_front();
+          nStolen.fetch_add(1, std::memory_order_relaxed);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    void run(size_t index)
+    {
+      thisPool = this;
+      thisWorker = index;
+      function<void()> job;
+      while (true)
+      {
+        if (take(index, job))
+        {
+          --queued;
+          try
+          {
+            job();
+          }
+          catch (const std::exception& e)
+          {
+            XLO_ERROR("Task executor job failed: {}", e.what());
+          }
+          catch (...)
+          {
+            XLO_ERROR("Task executor job failed with unknown exception");
+          }
+          job = nullptr;
+          continue;
+        }
+
+        unique_lock lock(lockWake);
+        ++sleeping;
+        wake.wait(lock, [&]() { return queued > 0 || stop; });
+        --sleeping;
+        // Keep going until all jobs, including any posted by jobs, are done
+        if (stop && queued <= 0)
+          return;
+      }
+    }
+  };
+
+  thread_local TaskExecutor::Impl* TaskExecutor::Impl::thisPool = nullptr;
+  thread_local size_t TaskExecutor::Impl::thisWorker = 0;
+
+  TaskExecutor::TaskExecutor(size_t nThreads)
+    : _impl(new Impl(nThreads > 0
+        ? nThreads
+        : std::max<size_t>(1, std::thread::hardware_concurrency())))
+  {}
+
+  TaskExecutor::~TaskExecutor()
+  {
+    _impl->shutdown();
+  }
+
+  void TaskExecutor::post(function<void()>&& job)
+  {
+    if (!_impl->post(std::move(job)))
+      XLO_THROW("Task executor has stopped");
+  }
+
+  bool TaskExecutor::Ref::post(function<void()>&& job) const
+  {
+    auto impl = _impl.lock();
+    return impl && impl->post(std::move(job));
+  }
+
+  TaskExecutor::Ref TaskExecutor::ref() const
+  {
+    Ref result;
+    result._impl = _impl;
+    return result;
+  }
+
+  size_t TaskExecutor::nThreads() const
+  {
+    return _impl->threads.size();
+  }
+
+  size_t TaskExecutor::nStolen() const
+  {
+    return _impl->nStolen.load(std::memory_order_relaxed);
+  }
+
+  namespace
+  {
+    std::mutex theSharedLock;
+    // Deliberately not a unique_ptr: joining threads in a static destructor
+    // at DLL unload can deadlock on the loader lock. The executor is stopped
+    // on AutoClose, whilst plugin code which jobs may call is still loaded.
+    TaskExecutor* theSharedExecutor = nullptr;
+    bool theSharedStopped = false;
+  }
+
+  TaskExecutor& TaskExecutor::shared()
+  {
+    scoped_lock lock(theSharedLock);
+    if (!theSharedExecutor)
+    {
+      // A new executor would never be stopped, so its threads would
+      // outlive the plugin code they call
+      if (theSharedStopped)
+        XLO_THROW("Task executor has stopped");
+      theSharedExecutor = new TaskExecutor();
+      static auto handler = Event::AutoClose().bind([]()
+      {
+        TaskExecutor* executor;
+        {
+          scoped_lock lock(theSharedLock);
+          executor = theSharedExecutor;
+          theSharedExecutor = nullptr;
+          theSharedStopped = true;
+        }
+        delete executor;
+      });
+    }
+    return *theSharedExecutor;
+  }
+
+  CancellationToken calcCancellationToken()
+  {
+    static std::mutex lock;
+    static CancellationToken current;
+    static auto handler = Event::CalcCancelled().bind([]()
+    {
+      scoped_lock l(lock);
+      current.cancel();
+      current = CancellationToken();
+    });
+    scoped_lock l(lock);
+    return current;
+  }
+
+  void asyncReturn(const ExcelObj& asyncHandle, const Task<ExcelObj>& task)
+  {
+    task.onComplete([handle = ExcelObj(asyncHandle), task, calc = calcCancellationToken()]()
+    {
+      ExcelObj result;
+      try
+      {
+        result = task.get();
+      }
+      catch (const TaskCancelled&)
+      {
+        // If the calculation was cancelled, Excel has abandoned the call.
+        // Otherwise the cell would wait for a result which never comes.
+        if (calc.cancelled())
+          return;
+        result = ExcelObj(CellError::NA);
+      }
+      catch (const std::exception& e)
+      {
+        result = ExcelObj(e.what());
+      }
+      asyncReturn(handle, result);
+    });
+  }
+}
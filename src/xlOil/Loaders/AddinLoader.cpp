@@ -3,6 +3,7 @@
 #include <xlOil-XLL/FuncRegistry.h>
 #include <xlOilHelpers/Settings.h>
 #include <xlOil/Date.h>
+#include <xlOil/ExcelObjCache.h>
 #include <xlOil/Loaders/PluginLoader.h>
 #include <xlOil/Log.h>
 #include <xlOil/Events.h>
@@ -72,6 +73,15 @@ namespace xloil
           XLO_DEBUG(L"Registering date format '{}'", form);
           theDateTimeFormats().push_back(form);
         }
+
+        // As for the log settings, the last addin to specify a budget wins
+        auto [cacheMaxMb, cacheMinIdle] = Settings::objectCacheBudget(*settings);
+        if (cacheMaxMb > 0)
+        {
+          XLO_DEBUG("Setting Excel object cache budget to {}Mb", cacheMaxMb);
+          ObjectCacheFactory<std::unique_ptr<const ExcelObj>>::cache()
+            .setBudget(cacheMaxMb << 20, cacheMinIdle);
+        }
       }
 
       auto [ctx, isNew] = theAddinContexts.insert_or_assign(
@@ -86,6 +86,13 @@ namespace xloil
       auto addinRoot = root[XLOIL_SETTINGS_ADDIN_SECTION];
       return findVecStr(addinRoot, "DateFormats");
     }
+    std::pair<size_t, size_t> objectCacheBudget(const toml::table& root)
+    {
+      auto addinRoot = root[XLOIL_SETTINGS_ADDIN_SECTION];
+      return std::make_pair(
+        (size_t)addinRoot["ObjectCacheMaxMb"].value_or(0u),
+        (size_t)addinRoot["ObjectCacheMinIdleCalcs"].value_or(2u));
+    }
 
     namespace
     {
@@ -33,6 +33,12 @@ namespace xloil
 
     std::vector<std::wstring> dateFormats(const toml::table& root);
 
+    /// <summary>
+    /// Returns the Excel object cache budget in Mb (zero means unlimited)
+    /// and the minimum number of idle calc cycles before eviction
+    /// </summary>
+    std::pair<size_t, size_t> objectCacheBudget(const toml::table& root);
+
     std::vector<std::pair<std::wstring, std::wstring>>
       environmentVariables(const toml::view_node& root);
 
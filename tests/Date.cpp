@@ -1,6 +1,7 @@
 #include "CppUnitTest.h"
 #include <xlOil/Date.h>
 #include <xloil/ExcelObj.h>
+#include <cmath>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -77,5 +78,55 @@ namespace Tests
       testVisitorRoundTrip(L"2017-01-01", 2017, 1, 1);
       testVisitorRoundTrip(L"1914-02-28", 1914, 2, 28);
     }
+
+    TEST_METHOD(Test_SerialToTicks)
+    {
+      constexpr double microsPerDay = 86400e6;
+      // An odd length exercises the vectorised and scalar paths. Includes
+      // the dates either side of the non-existent 29-Feb-1900 and some
+      // invalid serials.
+      const double serials[] = {
+        1, 59, 61, 25569, 25569.5, 43831.25, NAN, -1, XL_MAX_SERIAL_DATE + 2.0, 44000 };
+      constexpr auto N = _countof(serials);
+      int64_t ticks[N];
+      excelSerialToTicks(serials, N, ticks, microsPerDay);
+
+      for (auto i = 0u; i < N; ++i)
+      {
+        int year, month, day, hours, mins, secs, usecs;
+        if (std::isnan(serials[i])
+          || !excelSerialDatetoYMDHMS(serials[i], year, month, day, hours, mins, secs, usecs))
+        {
+          Assert::AreEqual(XL_NULL_DATE_TICKS, ticks[i]);
+          continue;
+        }
+        // Days since 1970-01-01 from the civil date
+        const auto y = month <= 2 ? year - 1 : year;
+        const auto era = y / 400;
+        const auto yearOfEra = y - era * 400;
+        const auto dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        const auto dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+        const auto days = (int64_t)era * 146097 + dayOfEra - 719468;
+        const auto expected = days * (int64_t)microsPerDay
+          + ((hours * 60 + mins) * 60 + secs) * (int64_t)1000000 + usecs;
+        Assert::AreEqual(expected, ticks[i]);
+      }
+
+      double back[N];
+      ticksToExcelSerial(ticks, N, back, microsPerDay);
+      for (auto i = 0u; i < N; ++i)
+      {
+        if (ticks[i] == XL_NULL_DATE_TICKS)
+          Assert::IsTrue(std::isnan(back[i]));
+        else
+          Assert::AreEqual(serials[i], back[i], 1e-9);
+      }
+
+      // The non-existent date is read as the following day
+      const double leapDay = 60;
+      int64_t leapDayTicks;
+      excelSerialToTicks(&leapDay, 1, &leapDayTicks, 1);
+      Assert::AreEqual(ticks[2] / (int64_t)microsPerDay, leapDayTicks);
+    }
   };
 }
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include <xloil/Async.h>
 #include <xloil/FPArray.h>
 #include <xloil/ExcelRef.h>
+#include <xloil/Task.h>
 
 using std::shared_ptr;
 
@@ -49,6 +50,20 @@ namespace xloil
   }
   XLO_STATIC_REGISTER(testAsync);
 
+  XLO_ENTRY_POINT(void) testTaskAsync(
+    const AsyncHandle& handle,
+    const ExcelObj& val
+  )
+  {
+    asyncReturn(handle, spawn([val](const CancellationToken& token)
+    {
+      for (auto i = 0; i < 10 && !token.cancelled(); ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      return ExcelObj(val);
+    }, calcCancellationToken()));
+  }
+  XLO_STATIC_REGISTER(testTaskAsync);
+
   XLO_FUNC_START( testFP(const FPArray& array))
   {
     ExcelArrayBuilder builder(array.rows, array.columns);
@@ -3,6 +3,7 @@
 #include <xloil/ExcelCall.h>
 #include <xloil/ExcelObj.h>
 #include <xloil/Events.h>
+#include <xloil/Task.h>
 //#include "Main.h"
 
 using std::shared_ptr;
@@ -51,6 +52,23 @@ namespace xloil
     }
     XLO_FUNC_END(xloRtdCounter);
 
+    XLO_FUNC_START(
+      xloRtdTask(const ExcelObj& val)
+    )
+    {
+      auto value = rtdAsync(L"xloRtdTask", { val }, [val](const CancellationToken& token)
+      {
+        return spawn([val](const CancellationToken& cancel)
+        {
+          for (auto i = 0; i < 10 && !cancel.cancelled(); ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+          return ExcelObj(val);
+        }, token);
+      });
+      return returnValue(value ? *value : CellError::NA);
+    }
+    XLO_FUNC_END(xloRtdTask);
+
 
     IRtdServer* getAnotherRtdServer()
     {
@@ -169,5 +169,182 @@ namespace Tests
         Assert::IsTrue(sub(0) == array(n < 0 ? R + n : n, 1));
       }
     }
+  
+    TEST_METHOD(GrowableArrayBuild)
+    {
+      // Use enough rows and string data to span several chunks
+      constexpr auto N = 5000u;
+      GrowableArrayBuilder builder(3);
+      for (auto i = 0u; i < N; ++i)
+      {
+        auto row = builder.appendRow();
+        builder(row, 0) = i;
+        builder(row, 1) = std::to_wstring(i);
+        if (i % 2 == 0)
+          builder(row, 2) = L"Hello";
+      }
+
+      Assert::AreEqual<size_t>(N, builder.nRows());
+
+      auto arrayData = builder.toExcelObj();
+      ExcelArray array(arrayData, false);
+
+      Assert::AreEqual<size_t>(N, array.nRows());
+      Assert::AreEqual<size_t>(3, array.nCols());
+      for (auto i = 0u; i < N; ++i)
+      {
+        Assert::AreEqual<int>(i, array(i, 0).get<int>());
+        Assert::AreEqual(std::to_wstring(i), array(i, 1).toString());
+        if (i % 2 == 0)
+          Assert::AreEqual(wstring(L"Hello"), array(i, 2).toString());
+        else
+          Assert::IsTrue(array(i, 2).isNA());
+      }
+
+      // Strings should have been compacted into the array block
+      auto blockStart = (const char*)arrayData.val.array.lparray;
+      auto pStr = (const char*)array(N - 1, 1).val.str.data;
+      Assert::IsTrue(pStr > blockStart && pStr < blockStart + 
+        sizeof(ExcelObj) * N * 3 + sizeof(wchar_t) * N * 16);
+    }
+
+    TEST_METHOD(GrowableArrayTranspose)
+    {
+      GrowableArrayBuilder builder(2);
+      builder(0, 0) = L"a";
+      builder(0, 1) = 1;
+      builder(2, 0) = L"c";
+      builder(2, 1) = 3;
+
+      auto arrayData = builder.toExcelObj(true);
+      ExcelArray array(arrayData, false);
+
+      Assert::AreEqual<size_t>(2, array.nRows());
+      Assert::AreEqual<size_t>(3, array.nCols());
+      Assert::AreEqual(wstring(L"a"), array(0, 0).toString());
+      Assert::IsTrue(array(0, 1).isNA());
+      Assert::AreEqual(wstring(L"c"), array(0, 2).toString());
+      Assert::AreEqual(1, array(1, 0).get<int>());
+      Assert::IsTrue(array(1, 1).isNA());
+      Assert::AreEqual(3, array(1, 2).get<int>());
+    }
+
+    TEST_METHOD(InternedStrings)
+    {
+      const wchar_t* labels[] = { L"apple", L"banana", L"cherry" };
+      constexpr size_t N = 300;
+
+      ExcelArrayBuilder builder(N, 1, N * 6);
+      builder.internStrings();
+      for (auto i = 0u; i < N; ++i)
+        builder(i, 0) = labels[i % 3];
+
+      const auto stats = builder.internStats();
+      Assert::AreEqual(N, stats.strings);
+      Assert::AreEqual<size_t>(3, stats.unique);
+      Assert::AreEqual<size_t>((N / 3 - 1) * (6 + 7 + 7), stats.charsSaved);
+
+      auto arrayData = builder.toExcelObj();
+      ExcelArray array(arrayData, false);
+      for (auto i = 0u; i < N; ++i)
+      {
+        Assert::AreEqual(wstring(labels[i % 3]), array(i, 0).toString());
+        Assert::IsTrue(array(i, 0).val.str.data == array(i % 3, 0).val.str.data);
+      }
+
+      // Most of the string store was unused so the array has been moved to
+      // a smaller block which still contains the strings
+      auto blockStart = (const char*)arrayData.val.array.lparray;
+      auto pStr = (const char*)array(2, 0).val.str.data;
+      Assert::IsTrue(pStr > blockStart && pStr < blockStart +
+        sizeof(ExcelObj) * N + sizeof(wchar_t) * (6 + 7 + 7));
+
+      // Copies of the array own their strings as usual
+      ExcelObj copy(arrayData);
+      arrayData.reset();
+      Assert::AreEqual(wstring(L"banana"), ExcelArray(copy, false)(N - 2, 0).toString());
+    }
+
+    TEST_METHOD(ExpandDictionaryCodes)
+    {
+      // Codes of mixed sign read with a stride, as from a numpy array view
+      const int16_t codes[] = { 0, 99, 2, 99, -1, 99, 0, 99, 1, 99, 2, 99 };
+      constexpr size_t N = 6;
+
+      ExcelArrayBuilder builder(N, 1, 6 + 7);
+      using StorePString = BasicPString<wchar_t, detail::ArrayBuilderCharAllocator>;
+      vector<ExcelObj> values;
+      values.reserve(3);
+      values.emplace_back(StorePString(std::wstring_view(L"apple"), builder.charAllocator()));
+      values.emplace_back(1.5);
+      values.emplace_back(StorePString(std::wstring_view(L"banana"), builder.charAllocator()));
+
+      auto start = builder.col_begin(0);
+      detail::arrayExpandCodes<int16_t>(
+        (const char*)codes, 2 * sizeof(int16_t), values, start, builder.col_end(0));
+
+      auto arrayData = builder.toExcelObj();
+      ExcelArray array(arrayData, false);
+      Assert::AreEqual(wstring(L"apple"), array(0).toString());
+      Assert::AreEqual(wstring(L"banana"), array(1).toString());
+      Assert::IsTrue(array(2) == CellError::NA);
+      Assert::IsTrue(array(4) == 1.5);
+      // Elements share the string in the store rather than copying it
+      Assert::IsTrue(array(0).val.str.data == values[0].val.str.data);
+      Assert::IsTrue(array(3).val.str.data == values[0].val.str.data);
+      Assert::IsTrue(array(5).val.str.data == values[2].val.str.data);
+
+      ExcelArrayBuilder other(1, 1);
+      auto otherStart = other.col_begin(0);
+      Assert::ExpectException<std::exception>([&]()
+      {
+        detail::arrayExpandCodes<int16_t>(
+          (const char*)(codes + 1), 0, values, otherStart, other.col_end(0));
+      });
+    }
+
+    TEST_METHOD(SequentialCopyToRegion)
+    {
+      SequentialArrayBuilder source(3, 1);
+      source.emplace(std::wstring_view(L"ab"));
+      source.emplace(2.5);
+      source.emplace(std::wstring_view(L"cde"));
+      Assert::AreEqual<size_t>(3 + 4, source.stringLength());
+
+      ExcelArrayBuilder builder(3, 2, source.stringLength());
+      auto region = builder.charAllocator().allocate(source.stringLength());
+      auto stringData = region;
+      source.copyToBuilder(builder.col_begin(1), builder.col_end(1),
+        detail::ArrayBuilderCharAllocator(stringData, region + source.stringLength()));
+      Assert::IsTrue(stringData == region + source.stringLength());
+
+      auto arrayData = builder.toExcelObj();
+      ExcelArray array(arrayData, false);
+      Assert::AreEqual(wstring(L"ab"), array(0, 1).toString());
+      Assert::IsTrue(array(1, 1) == 2.5);
+      Assert::AreEqual(wstring(L"cde"), array(2, 1).toString());
+    }
+
+    TEST_METHOD(GrowableInternedStrings)
+    {
+      GrowableArrayBuilder builder(2);
+      builder.internStrings();
+      for (auto i = 0; i < 100; ++i)
+      {
+        const auto row = builder.appendRow();
+        builder(row, 0) = i % 2 == 0 ? L"even" : L"odd";
+        builder(row, 1) = L"same";
+      }
+      Assert::AreEqual<size_t>(3, builder.internStats().unique);
+      Assert::AreEqual<size_t>(5 + 4 + 5, builder.stringLength());
+
+      auto arrayData = builder.toExcelObj(true);
+      ExcelArray array(arrayData, false);
+      Assert::AreEqual<size_t>(2, array.nRows());
+      Assert::AreEqual<size_t>(100, array.nCols());
+      Assert::AreEqual(wstring(L"odd"), array(0, 99).toString());
+      Assert::AreEqual(wstring(L"same"), array(1, 50).toString());
+      Assert::IsTrue(array(1, 0).val.str.data == array(1, 99).val.str.data);
+    }
   };
 }
\ No newline at end of file
@@ -0,0 +1,193 @@
+#include "CppUnitTest.h"
+#include <xloil/Arrow.h>
+#include <xlOil/ArrayBuilder.h>
+#include <xlOil/ExcelArray.h>
+#include <xlOil/StringUtils.h>
+
+#include <vector>
+#include <string>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+using namespace xloil;
+using std::wstring;
+using std::string;
+using std::vector;
+
+namespace Tests
+{
+  TEST_CLASS(TestArrow)
+  {
+  public:
+
+    TEST_METHOD(TestTranscoding)
+    {
+      // Long enough to use the vectorised path, with a surrogate pair and
+      // two-byte and three-byte chars after it
+      const wstring str = L"The quick brown fox jumps over \xD83D\xDE00 caf\x00E9 \x20AC!";
+      const auto expected = utf16ToUtf8(str);
+      Assert::AreEqual(expected.size(), detail::utf8Length(str.data(), str.size()));
+
+      string utf8(expected.size(), '\0');
+      detail::transcodeUtf16ToUtf8(str.data(), str.size(), utf8.data());
+      Assert::IsTrue(expected == utf8);
+
+      wstring back(utf8.size(), L'\0');
+      back.resize(detail::transcodeUtf8ToUtf16(utf8.data(), utf8.size(), back.data()));
+      Assert::AreEqual(str, back);
+
+      // Invalid sequences are replaced
+      const string invalid = "a\xFF" "b";
+      wstring replaced(invalid.size(), L'\0');
+      replaced.resize(detail::transcodeUtf8ToUtf16(invalid.data(), invalid.size(), replaced.data()));
+      Assert::AreEqual(wstring(L"a\xFFFD" L"b"), replaced);
+    }
+
+    TEST_METHOD(TestRoundTrip)
+    {
+      ExcelArrayBuilder builder(4, 4, 100);
+      builder(0, 0) = L"Num";
+      builder(0, 1) = L"Str";
+      builder(0, 2) = L"Bool";
+      builder(0, 3) = L"Mixed";
+      builder(1, 0) = 1.5;
+      builder(2, 0) = 2;
+      builder(3, 0) = CellError::Div0;
+      builder(1, 1) = L"Hello";
+      builder(2, 1) = L"\x00E9t\x00E9 \xD83D\xDE00";
+      builder(3, 1) = L"";
+      builder(1, 2) = true;
+      builder(2, 2) = false;
+      builder(3, 2) = CellError::NA;
+      builder(1, 3) = L"A";
+      builder(2, 3) = 3;
+      builder(3, 3) = CellError::Value;
+      const auto obj = builder.toExcelObj();
+
+      ArrowSchema schema;
+      ArrowArray array;
+      arrowExport(ExcelArray(obj), true, &schema, &array);
+
+      Assert::AreEqual("+s", schema.format);
+      Assert::AreEqual<int64_t>(4, schema.n_children);
+      Assert::AreEqual("g", schema.children[0]->format);
+      Assert::AreEqual("u", schema.children[1]->format);
+      Assert::AreEqual("b", schema.children[2]->format);
+      Assert::AreEqual("u", schema.children[3]->format);
+      Assert::AreEqual("Num", schema.children[0]->name);
+      Assert::AreEqual<int64_t>(3, array.length);
+      Assert::AreEqual<int64_t>(1, array.children[0]->null_count);
+      Assert::AreEqual(2.0, ((const double*)array.children[0]->buffers[1])[1]);
+
+      // The schema alone infers the same types
+      ArrowSchema schemaOnly;
+      arrowExportSchema(ExcelArray(obj), true, &schemaOnly);
+      Assert::AreEqual<int64_t>(4, schemaOnly.n_children);
+      for (auto j = 0; j < 4; ++j)
+      {
+        Assert::AreEqual(schema.children[j]->format, schemaOnly.children[j]->format);
+        Assert::AreEqual(schema.children[j]->name, schemaOnly.children[j]->name);
+      }
+      schemaOnly.release(&schemaOnly);
+
+      const auto result = arrowImport(schema, array, true);
+      ExcelArray arr(result);
+      Assert::AreEqual(4u, arr.nRows());
+      Assert::AreEqual(4u, arr.nCols());
+      Assert::IsTrue(arr(0, 3) == L"Mixed");
+      Assert::IsTrue(arr(1, 0) == 1.5);
+      Assert::IsTrue(arr(2, 0) == 2.0);
+      Assert::IsTrue(arr(3, 0) == CellError::NA);
+      Assert::IsTrue(arr(2, 1) == L"\x00E9t\x00E9 \xD83D\xDE00");
+      Assert::IsTrue(arr(3, 1) == L"");
+      Assert::IsTrue(arr(1, 2) == true);
+      Assert::IsTrue(arr(3, 2) == CellError::NA);
+      Assert::IsTrue(arr(2, 3) == L"3");
+      Assert::IsTrue(arr(3, 3) == CellError::NA);
+
+      schema.release(&schema);
+      array.release(&array);
+      Assert::IsTrue(schema.release == nullptr);
+      Assert::IsTrue(array.release == nullptr);
+    }
+
+    TEST_METHOD(TestImportSlicedAndDictionary)
+    {
+      // A struct of an int32 column and a dictionary-encoded string column,
+      // sliced to start at the second row
+      const int32_t ints[] = { 10, 20, 30, 40 };
+      const uint8_t intValidity[] = { 0x0B }; // 40 is valid, 30 is null
+      const int8_t indices[] = { 1, 0, 1, 1 };
+
+      const int32_t dictOffsets[] = { 0, 3, 6 };
+      const char dictData[] = "foobar";
+
+      const void* intBuffers[] = { intValidity, ints };
+      const void* indexBuffers[] = { nullptr, indices };
+      const void* dictBuffers[] = { nullptr, dictOffsets, dictData };
+      const void* structBuffers[] = { nullptr };
+
+      ArrowSchema intSchema = { "i", "Ints", nullptr, ARROW_FLAG_NULLABLE, 0, nullptr, nullptr, nullptr, nullptr };
+      ArrowSchema dictSchema = { "u", nullptr, nullptr, 0, 0, nullptr, nullptr, nullptr, nullptr };
+      ArrowSchema catSchema = { "c", "Cats", nullptr, 0, 0, nullptr, &dictSchema, nullptr, nullptr };
+      ArrowSchema* children[] = { &intSchema, &catSchema };
+      ArrowSchema schema = { "+s", "", nullptr, 0, 2, children, nullptr, nullptr, nullptr };
+
+      ArrowArray intArray = { 4, 1, 0, 2, 0, intBuffers, nullptr, nullptr, nullptr, nullptr };
+      ArrowArray dictArray = { 2, 0, 0, 3, 0, dictBuffers, nullptr, nullptr, nullptr, nullptr };
+      ArrowArray catArray = { 4, 0, 0, 2, 0, indexBuffers, nullptr, &dictArray, nullptr, nullptr };
+      ArrowArray* childArrays[] = { &intArray, &catArray };
+      ArrowArray array = { 3, 0, 1, 1, 2, structBuffers, childArrays, nullptr, nullptr, nullptr };
+
+      const auto result = arrowImport(schema, array, true);
+      ExcelArray arr(result, false);
+      Assert::AreEqual(4u, arr.nRows());
+      Assert::AreEqual(2u, arr.nCols());
+      Assert::IsTrue(arr(0, 0) == L"Ints");
+      Assert::IsTrue(arr(0, 1) == L"Cats");
+      Assert::IsTrue(arr(1, 0) == 20);
+      Assert::IsTrue(arr(2, 0) == CellError::NA);
+      Assert::IsTrue(arr(3, 0) == 40);
+      Assert::IsTrue(arr(1, 1) == L"foo");
+      Assert::IsTrue(arr(2, 1) == L"bar");
+      Assert::IsTrue(arr(3, 1) == L"bar");
+    }
+
+    TEST_METHOD(TestImportBatchDictionaries)
+    {
+      // Two batches of a dictionary-encoded column, each with its own
+      // dictionary, so the same index decodes to different values
+      const int8_t indices1[] = { 0, 1 };
+      const int8_t indices2[] = { 1, 0, 1 };
+
+      const int32_t dictOffsets1[] = { 0, 3, 6 };
+      const char dictData1[] = "foobar";
+      const int32_t dictOffsets2[] = { 0, 1, 5 };
+      const char dictData2[] = "xyzzy";
+
+      const void* indexBuffers1[] = { nullptr, indices1 };
+      const void* indexBuffers2[] = { nullptr, indices2 };
+      const void* dictBuffers1[] = { nullptr, dictOffsets1, dictData1 };
+      const void* dictBuffers2[] = { nullptr, dictOffsets2, dictData2 };
+
+      ArrowSchema dictSchema = { "u", nullptr, nullptr, 0, 0, nullptr, nullptr, nullptr, nullptr };
+      ArrowSchema schema = { "c", "Cats", nullptr, 0, 0, nullptr, &dictSchema, nullptr, nullptr };
+
+      ArrowArray dictArray1 = { 2, 0, 0, 3, 0, dictBuffers1, nullptr, nullptr, nullptr, nullptr };
+      ArrowArray dictArray2 = { 2, 0, 0, 3, 0, dictBuffers2, nullptr, nullptr, nullptr, nullptr };
+      const ArrowArray batches[] = {
+        { 2, 0, 0, 2, 0, indexBuffers1, nullptr, &dictArray1, nullptr, nullptr },
+        { 3, 0, 0, 2, 0, indexBuffers2, nullptr, &dictArray2, nullptr, nullptr }
+      };
+
+      const auto result = arrowImport(schema, batches, 2, false);
+      ExcelArray arr(result, false);
+      Assert::AreEqual(5u, arr.nRows());
+      Assert::IsTrue(arr(0) == L"foo");
+      Assert::IsTrue(arr(1) == L"bar");
+      Assert::IsTrue(arr(2) == L"yzzy");
+      Assert::IsTrue(arr(3) == L"x");
+      Assert::IsTrue(arr(4) == L"yzzy");
+    }
+  };
+}
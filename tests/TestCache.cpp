@@ -1,6 +1,9 @@
 #include "CppUnitTest.h"
 #include <xloil/ExcelObjCache.h>
 #include <chrono>
+#include <functional>
+#include <limits>
+#include <thread>
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
 using namespace xloil;
@@ -12,6 +15,12 @@ using std::unique_ptr;
 
 namespace Tests
 {
+  struct CompactUniquifier
+  {
+    static constexpr wchar_t value = L'\x6D38';
+    static constexpr bool compactKeys = true;
+  };
+
   TEST_CLASS(TestCache)
   {
   public:
@@ -41,6 +50,126 @@ namespace Tests
       }
     }
 
+    TEST_METHOD(CompactKeyCacheTest)
+    {
+      auto cache = ObjectCache<std::unique_ptr<int>, CompactUniquifier>::create(false);
+      const int N = 1000;
+
+      vector<ExcelObj> keys(N);
+      for (auto i = 0; i < N; ++i)
+        keys[i] = cache->add(make_unique<int>(i), format(L"Key_{0}", i));
+
+      for (auto i = 0; i < N; ++i)
+      {
+        Assert::IsTrue(cache->valid(keys[i].asStringView()));
+        auto* val = cache->fetch(keys[i].asStringView());
+        Assert::AreEqual<int>(i, **val);
+      }
+
+      // A recycled slot should reject the old reference
+      const auto oldKey = keys[7].toString();
+      Assert::IsTrue(cache->erase(oldKey));
+      Assert::IsNull(cache->fetch(oldKey));
+      auto newKey = cache->add(make_unique<int>(-7), wstring(L"Key_7"));
+      Assert::AreNotEqual(oldKey, newKey.toString());
+      Assert::IsNull(cache->fetch(oldKey));
+      Assert::AreEqual(-7, **cache->fetch(newKey.asStringView()));
+
+      // Corrupt the slot characters
+      auto badKey = keys[8].toString();
+      badKey[badKey.size() - 4] = L'x';
+      Assert::IsNull(cache->fetch(badKey));
+    }
+
+    TEST_METHOD(CacheBudgetTest)
+    {
+      auto cache = ObjectCache<std::unique_ptr<int>, CompactUniquifier>::create(false);
+      const int N = 100;
+      const auto entrySize = CacheObjectSize<std::unique_ptr<int>>()(make_unique<int>(0));
+
+      // Without a budget, object sizes are not measured
+      {
+        auto unbudgeted = ObjectCache<std::unique_ptr<int>, CompactUniquifier>::create(false);
+        unbudgeted->add(make_unique<int>(-1), wstring(L"Unsized"));
+        Assert::AreEqual<size_t>(0, unbudgeted->stats().residentBytes);
+      }
+
+      // A budget which is never reached
+      cache->setBudget(std::numeric_limits<size_t>::max(), 2);
+
+      vector<ExcelObj> keys(N);
+      for (auto i = 0; i < N; ++i)
+        keys[i] = cache->add(make_unique<int>(i), format(L"Key_{0}", i));
+
+      Assert::AreEqual<size_t>(N * entrySize, cache->stats().residentBytes);
+
+      // Nothing has been idle long enough to evict, so the budget is exceeded
+      const auto budget = N / 2 * entrySize;
+      cache->setBudget(budget, 2);
+      Assert::AreEqual<size_t>(0, cache->stats().evictions);
+
+      Event::AfterCalculate().fire();
+      Event::AfterCalculate().fire();
+
+      // Keep the first few keys alive
+      for (auto i = 0; i < 10; ++i)
+        Assert::IsNotNull(cache->fetch(keys[i].asStringView()));
+
+      auto extraKey = cache->add(make_unique<int>(N), wstring(L"Extra"));
+
+      const auto stats = cache->stats();
+      Assert::IsTrue(stats.evictions > 0);
+      Assert::IsTrue(stats.residentBytes <= budget);
+      Assert::AreEqual<size_t>(N + 1 - stats.evictions, stats.keys);
+      Assert::AreEqual<size_t>(10, stats.hits);
+
+      for (auto i = 0; i < 10; ++i)
+        Assert::AreEqual(i, **cache->fetch(keys[i].asStringView()));
+      Assert::AreEqual(N, **cache->fetch(extraKey.asStringView()));
+
+      size_t misses = 0;
+      for (auto i = 10; i < N; ++i)
+        misses += cache->fetch(keys[i].asStringView()) ? 0 : 1;
+      Assert::AreEqual(stats.evictions, misses);
+      Assert::AreEqual(misses, cache->stats().misses);
+    }
+
+    TEST_METHOD(CacheEvictionReentryTest)
+    {
+      struct OnDestroy
+      {
+        std::function<void()> func;
+        ~OnDestroy() { if (func) func(); }
+      };
+
+      auto cache = ObjectCache<unique_ptr<OnDestroy>, CompactUniquifier>::create(false);
+      const int N = 20;
+      const auto entrySize = CacheObjectSize<unique_ptr<OnDestroy>>()(make_unique<OnDestroy>());
+      cache->setBudget(std::numeric_limits<size_t>::max(), 1);
+
+      // Each object erases its own key when destroyed, which takes the shard
+      // lock, as a Python object's __del__ might do
+      size_t destroyed = 0;
+      for (auto i = 0; i < N; ++i)
+      {
+        auto obj = make_unique<OnDestroy>();
+        auto pObj = obj.get();
+        const auto key = cache->add(std::move(obj), format(L"Key_{0}", i)).toString();
+        pObj->func = [&cache, key, &destroyed]()
+        {
+          Assert::IsFalse(cache->erase(key));
+          ++destroyed;
+        };
+      }
+
+      cache->setBudget(entrySize, 1);
+      Event::AfterCalculate().fire();
+      cache->add(make_unique<OnDestroy>(), wstring(L"Extra"));
+
+      Assert::AreEqual<size_t>(N, cache->stats().evictions);
+      Assert::AreEqual<size_t>(N, destroyed);
+    }
+
     TEST_METHOD(CallerAddressTypes)
     {
       auto F3 = ExcelObj(msxll::xlref12{ 2, 3, 5, 6 });
@@ -89,5 +218,55 @@ namespace Tests
       Logger::WriteMessage(format("CacheSpeedTest1 - Time 1: {0},   Time 2: {1}", duration1, duration2).c_str());
 #endif
     }
+
+    TEST_METHOD(CacheContentionTest)
+    {
+      // Drives several threads through add and fetch on a large cache to 
+      // measure lock contention. Each thread adds to its own set of keys,
+      // then fetches keys across the whole cache.
+      auto cache = ObjectCache<
+        std::unique_ptr<int>,
+        CacheUniquifier<std::unique_ptr<int>>>::create(false);
+      const int N = 100000;
+      const int NumThreads = std::max(2u, std::thread::hardware_concurrency());
+      const int NumReps = 5;
+
+      vector<ExcelObj> keys(N);
+      for (auto i = 0; i < N; ++i)
+        keys[i] = cache->add(make_unique<int>(i), format(L"Key_{0}", i));
+
+      vector<int> failures(NumThreads);
+
+      auto t1 = std::chrono::high_resolution_clock::now();
+
+      vector<std::thread> threads;
+      for (auto t = 0; t < NumThreads; ++t)
+      {
+        threads.emplace_back([&, t]()
+        {
+          for (auto rep = 0; rep < NumReps; ++rep)
+          {
+            for (auto i = t; i < N; i += NumThreads)
+              cache->add(make_unique<int>(i), format(L"Thread_{0}_{1}", t, i));
+            for (auto i = 0; i < N; ++i)
+            {
+              auto* val = cache->fetch(keys[(i + t * 7919) % N].asStringView());
+              if (!val || **val != (i + t * 7919) % N)
+                ++failures[t];
+            }
+          }
+        });
+      }
+      for (auto& thread : threads)
+        thread.join();
+
+      auto t2 = std::chrono::high_resolution_clock::now();
+
+      for (auto t = 0; t < NumThreads; ++t)
+        Assert::AreEqual(0, failures[t]);
+
+      auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+      Logger::WriteMessage(format("CacheContentionTest - {0} threads: {1}", NumThreads, duration).c_str());
+    }
   };
 }
\ No newline at end of file
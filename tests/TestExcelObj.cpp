@@ -5,6 +5,9 @@
 #include <xlOil/Date.h>
 
 #include <vector>
+#include <chrono>
+#include <cmath>
+#include <climits>
 
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
@@ -84,6 +87,228 @@ namespace Tests
       // Out-of-bounds slice
       Assert::ExpectException<std::out_of_range>([&]() { arr.slice(3, 0, 5, 0); });
     }
+    TEST_METHOD(TestArrayScanKernels)
+    {
+      // Odd sizes exercise the scalar tails of the vectorised kernels
+      ExcelArrayBuilder builder(7, 5, 20);
+      for (auto i = 0u; i < 7; ++i)
+        for (auto j = 0u; j < 5; ++j)
+          builder(i, j) = CellError::NA;
+      for (auto i = 0u; i < 5; ++i)
+        for (auto j = 0u; j < 3; ++j)
+          builder(i, j) = i * 3.0 + j;
+      builder(1, 1) = 4;
+      builder(0, 1) = true;
+      builder(4, 3) = L"Hello";
+      builder(0, 4) = L"";
+      const auto obj = builder.toExcelObj();
+
+      ExcelArray arr(obj);
+      Assert::AreEqual(5u, arr.nRows());
+      Assert::AreEqual(4u, arr.nCols());
+
+      const auto* data = (const ExcelObj*)obj.val.array.lparray;
+      size_t nStrings;
+      Assert::AreEqual<size_t>(5, detail::arrayStringLength(data, data + 35, &nStrings));
+      Assert::AreEqual<size_t>(2, nStrings);
+      Assert::AreEqual<int>(msxll::xltypeNum | msxll::xltypeInt | msxll::xltypeBool
+        | msxll::xltypeErr | msxll::xltypeStr, detail::arrayTypeMask(data, data + 35));
+
+      auto numeric = arr.slice(0, 0, 5, 3);
+      Assert::IsTrue(numeric.dataType() == ExcelType::Num);
+      vector<double> values(numeric.size());
+      Assert::IsTrue(numeric.toDoubles(values.data(), values.size()));
+      for (auto i = 0u; i < values.size(); ++i)
+        Assert::AreEqual((double)i, values[i]);
+
+      values.resize(arr.size());
+      Assert::IsFalse(arr.toDoubles(values.data(), values.size()));
+      Assert::ExpectException<std::exception>([&]() { numeric.toDoubles(values.data(), 2); });
+    }
+
+    TEST_METHOD(TestArrayFlaggedStrings)
+    {
+      // Strings carrying memory flags are counted and copied like any other.
+      // Enough elements to exercise both the vectorised and scalar paths.
+      ExcelArrayBuilder builder(9, 1, 25);
+      for (auto i = 0u; i < 9; ++i)
+      {
+        const auto str = std::to_wstring(i * 111);
+        builder(i, 0) = std::wstring_view(str);
+      }
+      auto obj = builder.toExcelObj();
+
+      auto* data = (ExcelObj*)obj.val.array.lparray;
+      data[1].xltype |= msxll::xlbitDLLFree;
+      data[8].xltype |= msxll::xlbitXLFree;
+
+      size_t nStrings;
+      Assert::AreEqual<size_t>(1 + 8 * 3, detail::arrayStringLength(data, data + 9, &nStrings));
+      Assert::AreEqual<size_t>(9, nStrings);
+
+      const ExcelObj copy(obj);
+      ExcelArray arr(copy, false);
+      for (auto i = 0u; i < 9; ++i)
+      {
+        Assert::IsTrue(arr(i).isType(ExcelType::Str));
+        Assert::AreEqual(std::to_wstring(i * 111), arr(i).toString());
+      }
+    }
+
+    TEST_METHOD(TestArrayDictionaryEncode)
+    {
+      ExcelArrayBuilder builder(10, 1, 20);
+      builder(0, 0) = L"apple";
+      builder(1, 0) = 2.0;
+      builder(2, 0) = L"";
+      builder(3, 0) = L"banana";
+      builder(4, 0) = CellError::NA;
+      builder(5, 0) = 2;
+      builder(6, 0) = true;
+      builder(7, 0) = L"apple";
+      builder(8, 0) = false;
+      builder(9, 0) = true;
+      const auto obj = builder.toExcelObj();
+      ExcelArray arr(obj, false);
+
+      int32_t codes[10];
+      const auto categories = detail::arrayDictionaryEncode(arr, codes);
+      // Nil, errors and empty strings are missing values. Ints and doubles
+      // which compare equal share a code.
+      const int32_t expected[] = { 0, 1, -1, 2, -1, 1, 3, 0, 4, 3 };
+      for (auto i = 0; i < 10; ++i)
+        Assert::AreEqual(expected[i], codes[i]);
+      Assert::AreEqual<size_t>(5, categories.size());
+      Assert::IsTrue(categories[0] == &arr(0));
+      Assert::IsTrue(*categories[2] == L"banana");
+      Assert::IsTrue(*categories[4] == false);
+    }
+
+    TEST_METHOD(TestArrayScatterKernels)
+    {
+      // Non-finite values in the middle of a block of four and an odd size
+      // exercise both the vectorised and scalar paths
+      const vector<double> doubles = { 1.5, -2, 0, 3, 4, NAN, INFINITY, -INFINITY, 8, 9, 10 };
+      ExcelArrayBuilder builder((ExcelObj::row_t)doubles.size(), 1);
+      detail::arrayScatterDoubles(doubles.data(), doubles.size(), &builder.element(0, 0));
+      const auto obj = builder.toExcelObj();
+      ExcelArray arr(obj, false);
+      for (auto i = 0u; i < doubles.size(); ++i)
+        Assert::IsTrue(ExcelObj(doubles[i]) == arr(i));
+      Assert::IsTrue(arr(5) == CellError::NA);
+      Assert::IsTrue(arr(6) == CellError::Num);
+
+      const vector<int> ints = { 1, -2, 3, 4, 5, INT_MIN, INT_MAX };
+      ExcelArrayBuilder intBuilder(1, (ExcelObj::col_t)ints.size());
+      detail::arrayScatterInts(ints.data(), ints.size(), &intBuilder.element(0, 0));
+      const auto intObj = intBuilder.toExcelObj();
+      ExcelArray intArr(intObj, false);
+      for (auto i = 0u; i < ints.size(); ++i)
+      {
+        Assert::IsTrue(intArr(i).type() == ExcelType::Int);
+        Assert::AreEqual(ints[i], intArr(i).val.w);
+      }
+    }
+
+    TEST_METHOD(ArrayScanSpeedTest)
+    {
+      // Compares the kernels against the element-by-element loops they 
+      // replaced on a 1M-cell array
+      const ExcelObj::row_t N = 1000;
+      ExcelArrayBuilder builder(N, N, N * 5);
+      for (auto i = 0u; i < N; ++i)
+        for (auto j = 0u; j < N; ++j)
+          builder(i, j) = i * 1.0 + j;
+      for (auto i = 0u; i < N; ++i)
+        builder(i, N - 1) = L"Hello";
+      for (auto i = 0u; i < N; ++i)
+        builder(N - 1, i) = CellError::NA;
+      const auto obj = builder.toExcelObj();
+      const auto* begin = (const ExcelObj*)obj.val.array.lparray;
+      const auto* end = begin + N * N;
+
+      using clock = std::chrono::high_resolution_clock;
+      auto micros = [](auto t0, auto t1) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count(); };
+
+      auto t0 = clock::now();
+      int refType = 0;
+      size_t refStrLen = 0;
+      for (auto p = begin; p != end; ++p)
+        refType |= p->xltype;
+      for (auto p = begin; p != end; ++p)
+        refStrLen += p->stringLength();
+      auto refLast = end;
+      while (refLast != begin && !(refLast - 1)->isNonEmpty())
+        --refLast;
+      auto t1 = clock::now();
+
+      const auto type = detail::arrayTypeMask(begin, end);
+      const auto strLen = detail::arrayStringLength(begin, end);
+      const auto last = detail::arrayLastNonEmpty(begin, end);
+      auto t2 = clock::now();
+
+      Assert::AreEqual(refType, type);
+      Assert::AreEqual(refStrLen, strLen);
+      Assert::IsTrue(refLast == last);
+
+      // Numeric gather from a slice which excludes the strings and errors
+      auto block = ExcelArray(obj, false).slice(0, 0, N - 1, N - 1);
+      vector<double> values(block.size());
+      auto t3 = clock::now();
+      Assert::IsTrue(block.toDoubles(values.data(), values.size()));
+      auto t4 = clock::now();
+      vector<double> refBlock;
+      refBlock.reserve(block.size());
+      for (auto& v : block)
+        refBlock.push_back(v.get<double>());
+      auto t5 = clock::now();
+      Assert::IsTrue(refBlock == values);
+
+      Logger::WriteMessage(fmt::format(
+        "ArrayScanSpeedTest - Reference loops: {0}us, Kernels: {1}us, "
+        "toDoubles on slice: {2}us, Reference: {3}us",
+        micros(t0, t1), micros(t1, t2), micros(t3, t4), micros(t4, t5)).c_str());
+    }
+
+    TEST_METHOD(TestSharedArray)
+    {
+      ExcelArrayBuilder builder(2, 2, 10);
+      builder(0, 0) = L"Hello";
+      builder(0, 1) = 1.5;
+      builder(1, 0) = L"World";
+      builder(1, 1) = 7;
+      const auto original = builder.toExcelObj();
+
+      auto shared = original.share();
+      Assert::IsTrue(shared.isShared());
+      Assert::IsTrue(shared == original);
+      Assert::IsTrue(shared.type() == ExcelType::Multi);
+
+      // Copies share the same block
+      auto copy = shared;
+      Assert::IsTrue(copy.isShared());
+      Assert::IsTrue(copy.val.array.lparray == shared.val.array.lparray);
+
+      // Releasing one reference leaves the other valid
+      shared.reset();
+      Assert::IsTrue(copy == original);
+
+      // Unsharing gives a plain deep copy
+      auto unique = copy;
+      unique.unshare();
+      Assert::IsFalse(unique.isShared());
+      Assert::IsTrue(unique.val.array.lparray != copy.val.array.lparray);
+      Assert::IsTrue(unique == original);
+
+      // The object handed to Excel must have a plain type
+      auto* result = (new ExcelObj(copy))->setDllFreeFlag();
+      Assert::AreEqual<int>(msxll::xltypeMulti | msxll::xlbitDLLFree, result->xltype);
+      Assert::AreEqual(L"World", ExcelArray(*result)(1, 0).toString().c_str());
+      delete result;
+      Assert::IsTrue(copy == original);
+    }
+
     TEST_METHOD(TestCreateFromDate)
     {
       {
@@ -1,8 +1,13 @@
 #include "CppUnitTest.h"
 #include <xlOil/ExcelRef.h>
 #include <xlOil/ExcelObj.h>
+#include <xlOil/ArrayBuilder.h>
+#include <xlOil/ExcelArray.h>
 #include <chrono>
 #include <iostream>
+#include <set>
+#include <map>
+#include <random>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -31,6 +36,109 @@ namespace Microsoft {
 
 namespace Tests
 {
+  namespace
+  {
+    // An in-memory sheet which records its non-empty cells and counts the
+    // cells read, to check the behaviour of trimmedExtent
+    struct SheetModel
+    {
+      std::set<std::pair<size_t, size_t>> values;
+      size_t cellsRead = 0;
+      size_t blocksRead = 0;
+
+      std::pair<size_t, size_t> operator()(size_t i, size_t j, size_t n, size_t m)
+      {
+        cellsRead += n * m;
+        ++blocksRead;
+        size_t rows = 0, cols = 0;
+        for (auto [r, c] : values)
+          if (r >= i && r < i + n && c >= j && c < j + m)
+          {
+            rows = std::max(rows, r - i + 1);
+            cols = std::max(cols, c - j + 1);
+          }
+        return { rows, cols };
+      }
+
+      std::pair<size_t, size_t> expected(size_t nRows, size_t nCols) const
+      {
+        size_t rows = 0, cols = 0;
+        for (auto [r, c] : values)
+          if (r < nRows && c < nCols)
+          {
+            rows = std::max(rows, r + 1);
+            cols = std::max(cols, c + 1);
+          }
+        return { rows, cols };
+      }
+    };
+  }
+
+  namespace
+  {
+    // A Range over an in-memory sheet which counts the calls to value and
+    // set, to check the block read and write functions
+    class MemoryRange : public Range
+    {
+    public:
+      using Sheet = std::map<std::pair<int, int>, double>;
+
+      MemoryRange(std::shared_ptr<Sheet> sheet, int row, int col, int nRows, int nCols,
+          std::shared_ptr<int> calls = std::make_shared<int>(0))
+        : _sheet(sheet), _row(row), _col(col), _nRows(nRows), _nCols(nCols), _calls(calls)
+      {}
+
+      int calls() const { return *_calls; }
+
+      std::unique_ptr<Range> range(int fromRow, int fromCol, int toRow, int toCol) const override
+      {
+        return std::make_unique<MemoryRange>(_sheet, _row + fromRow, _col + fromCol,
+          toRow - fromRow + 1, toCol - fromCol + 1, _calls);
+      }
+      std::unique_ptr<Range> trim() const override { return range(0, 0, _nRows - 1, _nCols - 1); }
+      std::tuple<row_t, col_t> shape() const override { return { _nRows, _nCols }; }
+      std::tuple<row_t, col_t, row_t, col_t> bounds() const override
+      {
+        return { _row, _col, _row + _nRows - 1, _col + _nCols - 1 };
+      }
+      size_t nAreas() const override { return 1; }
+      std::wstring address(AddressStyle) const override { return std::wstring(); }
+      ExcelObj value() const override
+      {
+        ++*_calls;
+        ExcelArrayBuilder builder(_nRows, _nCols);
+        for (auto i = 0; i < _nRows; ++i)
+          for (auto j = 0; j < _nCols; ++j)
+          {
+            auto found = _sheet->find({ _row + i, _col + j });
+            if (found == _sheet->end())
+              builder(i, j) = CellError::NA;
+            else
+              builder(i, j) = found->second;
+          }
+        return builder.toExcelObj();
+      }
+      ExcelObj value(row_t i, col_t j) const override { return range(i, j, i, j)->value(); }
+      void set(const ExcelObj& value) override
+      {
+        ++*_calls;
+        ExcelArray arr(value, false);
+        for (auto i = 0u; i < arr.nRows(); ++i)
+          for (auto j = 0u; j < arr.nCols(); ++j)
+            (*_sheet)[{ _row + (int)i, _col + (int)j }] = arr(i, j).get<double>();
+      }
+      ExcelObj formula() const override { return ExcelObj(); }
+      std::optional<bool> hasFormula() const override { return false; }
+      void clear() override { _sheet->clear(); }
+      Excel::Range* asComPtr() const override { return nullptr; }
+
+    private:
+      std::shared_ptr<Sheet> _sheet;
+      int _row, _col, _nRows, _nCols;
+      std::shared_ptr<int> _calls;
+    };
+  }
+
   TEST_CLASS(TestRange)
   {
   public:
@@ -192,5 +300,94 @@ namespace Tests
         Logger::WriteMessage(("_itoa_s: " + to_string(method2.count()) + "ms\n").c_str());
       }
     }
+
+    TEST_METHOD(TestTrimmedExtent)
+    {
+      using extent = std::pair<size_t, size_t>;
+      {
+        // A tall range with a little data at the top: the row scan reads
+        // every row once, in blocks of 630 rows from the end, then the column
+        // scan reads only the columns after the last one it found
+        SheetModel sheet;
+        sheet.values = { {0, 0}, {99, 3}, {50, 10} };
+        const auto nRows = 2000u, nCols = 26u;
+        Assert::IsTrue(extent(100, 11) == trimmedExtent(nRows, nCols, sheet));
+        Assert::IsTrue(extent(100, 11) == sheet.expected(nRows, nCols));
+        Assert::AreEqual<size_t>(5, sheet.blocksRead);
+        Assert::AreEqual<size_t>(nRows * nCols + 100 * (26 - 11), sheet.cellsRead);
+      }
+      {
+        // A value in the last cell needs a single block
+        SheetModel sheet;
+        sheet.values = { {999, 25} };
+        Assert::IsTrue(extent(1000, 26) == trimmedExtent(1000, 26, sheet));
+        Assert::AreEqual<size_t>(detail::TRIM_BLOCK_CELLS / 26 * 26, sheet.cellsRead);
+      }
+      {
+        SheetModel sheet;
+        Assert::IsTrue(extent(0, 0) == trimmedExtent(100, 100, sheet));
+        Assert::IsTrue(extent(0, 0) == trimmedExtent(0, 100, sheet));
+      }
+
+      // Small blocks on random sheets exercise the chunking
+      std::mt19937 rng(42);
+      for (auto trial = 0; trial < 200; ++trial)
+      {
+        SheetModel sheet;
+        const size_t nRows = 1 + rng() % 40, nCols = 1 + rng() % 40;
+        for (auto k = rng() % 6; k > 0; --k)
+          sheet.values.insert({ rng() % nRows, rng() % nCols });
+        const auto blockCells = 1 + rng() % 50;
+        Assert::IsTrue(sheet.expected(nRows, nCols)
+          == trimmedExtent(nRows, nCols, sheet, blockCells));
+      }
+    }
+
+    TEST_METHOD(TestBlockReadWrite)
+    {
+      auto sheet = std::make_shared<MemoryRange::Sheet>();
+      MemoryRange target(sheet, 5, 2, 1, 3);
+
+      // Write 3 blocks of differing sizes downwards from the top-left
+      auto nextBlock = 0;
+      const auto rowsWritten = target.writeBlocks([&](ExcelObj& block)
+      {
+        if (nextBlock == 3)
+          return false;
+        const auto nRows = 4 + nextBlock;
+        ExcelArrayBuilder builder(nRows, 3);
+        for (auto i = 0; i < nRows; ++i)
+          for (auto j = 0; j < 3; ++j)
+            builder(i, j) = nextBlock * 100 + i * 10 + j;
+        block = builder.toExcelObj();
+        ++nextBlock;
+        return true;
+      });
+      Assert::AreEqual<size_t>(15, rowsWritten);
+      Assert::AreEqual(3, target.calls());
+      Assert::AreEqual(210.0, (*sheet)[{ 5 + 4 + 5 + 1, 2 }]);
+
+      // Read back in blocks which do not divide the row count
+      MemoryRange source(sheet, 5, 2, 15, 3);
+      vector<Range::row_t> firstRows;
+      size_t cellsRead = 0;
+      source.readBlocks(4, [&](Range::row_t row, const ExcelObj& block)
+      {
+        firstRows.push_back(row);
+        ExcelArray arr(block, false);
+        Assert::AreEqual(3u, (unsigned)arr.nCols());
+        for (auto i = 0u; i < arr.nRows(); ++i)
+          Assert::IsTrue(arr(i, 0) == (*sheet)[{ 5 + (int)(row + i), 2 }]);
+        cellsRead += arr.size();
+        return true;
+      });
+      Assert::IsTrue(vector<Range::row_t>{ 0, 4, 8, 12 } == firstRows);
+      Assert::AreEqual<size_t>(45, cellsRead);
+
+      // Returning false stops the read
+      auto nBlocks = 0;
+      source.readBlocks(2, [&](Range::row_t, const ExcelObj&) { return ++nBlocks < 3; });
+      Assert::AreEqual(3, nBlocks);
+    }
   };
 }
\ No newline at end of file
@@ -0,0 +1,130 @@
+#include "CppUnitTest.h"
+#include "../libs/xlOil_Utils/RegexHelpers.h"
+#include <xlOil/StringUtils.h>
+
+#include <vector>
+#include <chrono>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+using namespace xloil;
+using std::wstring;
+using std::vector;
+
+namespace Tests
+{
+  TEST_CLASS(Regex)
+  {
+  public:
+    TEST_METHOD(TestLiteralMatchesRegex)
+    {
+      const vector<wstring> subjects = {
+        L"", L"Hello", L"hello world", L"say HELLO twice, hello", L"hell", L"xhellox"
+      };
+
+      for (auto icase : { false, true })
+      {
+        auto options = std::regex_constants::ECMAScript;
+        if (icase)
+          options |= std::regex_constants::icase;
+
+        CompiledRegex literal(L"hello", options);
+        Assert::IsTrue(literal.isLiteral());
+        Assert::AreEqual<size_t>(5, literal.literalLength());
+
+        const std::wregex reference(L"hello", options);
+        for (auto& str : subjects)
+        {
+          Assert::AreEqual(
+            std::regex_search(str, reference), literal.test(str, false), str.c_str());
+          Assert::AreEqual(
+            std::regex_match(str, reference), literal.test(str, true), str.c_str());
+        }
+      }
+    }
+
+    TEST_METHOD(TestLiteralFindAll)
+    {
+      CompiledRegex regex(L"ab", std::regex_constants::ECMAScript | std::regex_constants::icase);
+      const std::wstring_view str = L"abAbxaB ab";
+      vector<size_t> found;
+      for (auto pos = regex.findLiteral(str); pos != std::wstring_view::npos;
+        pos = regex.findLiteral(str, pos + regex.literalLength()))
+        found.push_back(pos);
+
+      Assert::IsTrue(vector<size_t>{ 0, 2, 5, 8 } == found);
+      Assert::AreEqual(std::wstring_view::npos, regex.findLiteral(str, 100));
+    }
+
+    TEST_METHOD(TestNonLiteralPatterns)
+    {
+      for (auto pattern : { L"a.c", L"^abc", L"a|b", L"(ab)", L"a\\d", L"" })
+      {
+        CompiledRegex regex(pattern, std::regex_constants::ECMAScript);
+        Assert::IsFalse(regex.isLiteral(), pattern);
+      }
+
+      CompiledRegex groups(L"(\\w+)@(\\w+)", std::regex_constants::ECMAScript);
+      Assert::AreEqual<size_t>(2, groups.markCount());
+      Assert::IsTrue(groups.test(L"me@home", true));
+      Assert::IsFalse(groups.test(L"me at home", false));
+    }
+
+    TEST_METHOD(TestRegexCache)
+    {
+      RegexCache cache(4);
+      const auto ecma = std::regex_constants::ECMAScript;
+
+      auto a = cache.get(L"a+", ecma);
+      Assert::IsTrue(a == cache.get(L"a+", ecma));
+      Assert::IsTrue(a != cache.get(L"a+", ecma | std::regex_constants::icase));
+      Assert::IsTrue(a != cache.get(L"a+", std::regex_constants::extended));
+      Assert::AreEqual<size_t>(1, cache.hits());
+      Assert::AreEqual<size_t>(3, cache.misses());
+
+      // Fill past capacity: "a+" was used least recently so is evicted
+      cache.get(L"b+", ecma);
+      cache.get(L"c+", ecma);
+      Assert::AreEqual<size_t>(4, cache.size());
+      Assert::IsTrue(a != cache.get(L"a+", ecma));
+
+      // Invalid patterns throw and are not cached
+      Assert::ExpectException<std::regex_error>([&]() { cache.get(L"(", ecma); });
+      Assert::AreEqual<size_t>(4, cache.size());
+    }
+
+    TEST_METHOD(RegexCacheSpeedTest)
+    {
+      constexpr size_t N = 100000;
+      const wstring patterns[] = { L"[0-9]+x", L"foo", L"(\\w+)@(\\w+)", L"bar" };
+      const std::wstring_view subject = L"some text with foo, 123x and bar@baz in it";
+      const auto ecma = std::regex_constants::ECMAScript;
+
+      using clock = std::chrono::high_resolution_clock;
+      auto millis = [](auto t0, auto t1) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count(); };
+
+      auto t0 = clock::now();
+      size_t refCount = 0;
+      for (size_t i = 0; i < N; ++i)
+      {
+        const std::wregex regex(patterns[i % _countof(patterns)], ecma);
+        refCount += std::regex_search(subject.begin(), subject.end(), regex);
+      }
+      auto t1 = clock::now();
+
+      RegexCache cache;
+      size_t count = 0;
+      for (size_t i = 0; i < N; ++i)
+        count += cache.get(patterns[i % _countof(patterns)], ecma)->test(subject, false);
+      auto t2 = clock::now();
+
+      Assert::AreEqual(refCount, count);
+      Assert::AreEqual<size_t>(N - _countof(patterns), cache.hits());
+
+      Logger::WriteMessage(formatStr(
+        L"RegexCacheSpeedTest - Compile each call: %dms, Cached: %dms",
+        (int)millis(t0, t1), (int)millis(t1, t2)).c_str());
+    }
+  };
+}
@@ -0,0 +1,317 @@
+#include "CppUnitTest.h"
+#include <xlOil-COM/RtdPublishQueue.h>
+#include <xlOil-COM/RtdDeliveryThrottle.h>
+#include <xlOil/StringUtils.h>
+
+#include <vector>
+#include <list>
+#include <thread>
+#include <chrono>
+#include <unordered_map>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+using namespace xloil;
+using namespace xloil::COM;
+using std::vector;
+using std::shared_ptr;
+using std::make_shared;
+
+namespace Tests
+{
+  TEST_CLASS(RtdQueue)
+  {
+  public:
+    TEST_METHOD(TestTopicHandles)
+    {
+      const auto handle = makeRtdTopicHandle(12, 3);
+      Assert::AreEqual(12u, rtdTopicSlot(handle));
+      Assert::AreEqual(3u, rtdTopicGeneration(handle));
+      Assert::IsTrue(handle != makeRtdTopicHandle(12, 4));
+    }
+
+    TEST_METHOD(TestRingWrapsAround)
+    {
+      MpscRing<int> ring(5);
+      Assert::AreEqual<size_t>(8, ring.capacity());
+
+      int value;
+      for (int lap = 0; lap < 3; ++lap)
+      {
+        for (int i = 0; i < 8; ++i)
+        {
+          auto v = lap * 8 + i;
+          Assert::IsTrue(ring.tryPush(v));
+        }
+        auto extra = -1;
+        Assert::IsFalse(ring.tryPush(extra));
+        Assert::AreEqual(-1, extra);
+
+        for (int i = 0; i < 8; ++i)
+        {
+          Assert::IsTrue(ring.tryPop(value));
+          Assert::AreEqual(lap * 8 + i, value);
+        }
+        Assert::IsFalse(ring.tryPop(value));
+        Assert::IsTrue(ring.empty());
+      }
+    }
+
+    TEST_METHOD(TestLastValueWins)
+    {
+      RtdPublishQueue<int> queue(4);
+
+      // More values than the ring can hold, so some go to the overflow
+      for (int i = 0; i < 20; ++i)
+        queue.push(i % 3, make_shared<int>(i));
+
+      std::unordered_map<RtdTopicHandle, int> latest;
+      const auto n = queue.drain([&](RtdTopicHandle h, shared_ptr<int>& v)
+      {
+        latest[h] = *v;
+      });
+
+      Assert::AreEqual<size_t>(3, n);
+      Assert::AreEqual(18, latest[0]);
+      Assert::AreEqual(19, latest[1]);
+      Assert::AreEqual(17, latest[2]);
+
+      Assert::AreEqual<size_t>(0, queue.drain([](auto, auto&) {}));
+
+      // Once drained, the ring is used again
+      queue.push(5, make_shared<int>(1));
+      Assert::AreEqual<size_t>(1, queue.drain([](auto, auto&) {}));
+    }
+
+    TEST_METHOD(TestConcurrentProducers)
+    {
+      constexpr int nThreads = 4, nTopics = 100, nTicks = 1000;
+      RtdPublishQueue<int> queue(256);
+
+      vector<int> latest(nThreads * nTopics, -1);
+      auto consume = [&]()
+      {
+        return queue.drain([&](RtdTopicHandle h, shared_ptr<int>& v)
+        {
+          // Each producer publishes increasing values
+          Assert::IsTrue(*v > latest[h]);
+          latest[h] = *v;
+        });
+      };
+
+      std::atomic<int> running = nThreads;
+      vector<std::thread> producers;
+      for (int t = 0; t < nThreads; ++t)
+        producers.emplace_back([&queue, &running, t]()
+        {
+          for (int tick = 0; tick < nTicks; ++tick)
+            for (int topic = 0; topic < nTopics; ++topic)
+              queue.push(t * nTopics + topic, make_shared<int>(tick));
+          --running;
+        });
+
+      // Drain concurrently with the producers
+      while (running > 0)
+        consume();
+      for (auto& thread : producers)
+        thread.join();
+      consume();
+
+      for (auto v : latest)
+        Assert::AreEqual(nTicks - 1, v);
+    }
+
+    TEST_METHOD(TestThrottleDefaultPolicy)
+    {
+      using namespace std::chrono_literals;
+      RtdDeliveryThrottle throttle;
+      auto now = RtdDeliveryThrottle::time_point(100s);
+      vector<RtdTopicHandle> ready;
+
+      Assert::IsFalse(throttle.takeReady(now, ready));
+      Assert::IsTrue(throttle.nextWake() == RtdDeliveryThrottle::time_point::max());
+
+      // With no limits, every batch is released immediately
+      throttle.arrived(1, now);
+      throttle.arrived(2, now);
+      throttle.arrived(1, now);
+      Assert::IsTrue(throttle.takeReady(now, ready));
+      Assert::IsTrue(vector<RtdTopicHandle>{ 1, 2 } == ready);
+      Assert::AreEqual<size_t>(1, throttle.coalesced());
+
+      ready.clear();
+      throttle.arrived(1, now);
+      Assert::IsTrue(throttle.takeReady(now, ready));
+      Assert::AreEqual<size_t>(2, throttle.notifies());
+      Assert::AreEqual<size_t>(0, throttle.throttled());
+    }
+
+    TEST_METHOD(TestThrottleSimulation)
+    {
+      using namespace std::chrono_literals;
+      RtdDeliveryPolicy policy;
+      policy.notifyInterval = 100ms;
+      policy.topicInterval = 250ms;
+      RtdDeliveryThrottle throttle(policy);
+
+      // A fake notifier records the batches which would be sent to Excel
+      vector<vector<RtdTopicHandle>> batches;
+      vector<RtdDeliveryThrottle::time_point> notifyTimes;
+      vector<int> deliveries(10), latest(10, -1), delivered(10, -1);
+
+      // Ten topics each tick every millisecond for a second. The worker wakes
+      // on each tick or when the throttle asks, whichever is sooner.
+      const auto start = RtdDeliveryThrottle::time_point(100s);
+      vector<RtdTopicHandle> ready;
+      for (auto now = start; now <= start + 2s; now += 1ms)
+      {
+        if (now < start + 1s)
+        {
+          const auto tick = (int)((now - start) / 1ms);
+          for (RtdTopicHandle topic = 0; topic < 10; ++topic)
+          {
+            latest[topic] = tick;
+            throttle.arrived(topic, now);
+          }
+        }
+        if (throttle.nextWake() > now)
+          continue;
+        if (throttle.takeReady(now, ready))
+        {
+          for (auto topic : ready)
+          {
+            ++deliveries[topic];
+            delivered[topic] = latest[topic];
+          }
+          batches.emplace_back(std::move(ready));
+          notifyTimes.push_back(now);
+          ready.clear();
+        }
+      }
+
+      for (size_t i = 1; i < notifyTimes.size(); ++i)
+        Assert::IsTrue(notifyTimes[i] - notifyTimes[i - 1] >= 100ms);
+
+      for (int topic = 0; topic < 10; ++topic)
+      {
+        // Deliveries at 0, 250, 500, 750ms then the final value at 1000ms
+        Assert::AreEqual(5, deliveries[topic]);
+        Assert::AreEqual(999, delivered[topic]);
+      }
+      Assert::AreEqual<size_t>(5, throttle.notifies());
+      Assert::AreEqual<size_t>(10 * 1000 - 50, throttle.coalesced());
+      Assert::AreEqual<size_t>(40, throttle.throttled());
+      Assert::IsTrue(throttle.nextWake() == RtdDeliveryThrottle::time_point::max());
+    }
+
+    TEST_METHOD(TestThrottleForget)
+    {
+      using namespace std::chrono_literals;
+      RtdDeliveryPolicy policy;
+      policy.topicInterval = 1s;
+      RtdDeliveryThrottle throttle(policy);
+      auto now = RtdDeliveryThrottle::time_point(100s);
+      vector<RtdTopicHandle> ready;
+
+      throttle.arrived(7, now);
+      Assert::IsTrue(throttle.takeReady(now, ready));
+      throttle.arrived(7, now + 1ms);
+      Assert::IsTrue(throttle.nextWake() == now + 1s);
+
+      // A released topic is never delivered
+      throttle.forget(7);
+      ready.clear();
+      Assert::IsFalse(throttle.takeReady(now + 2s, ready));
+      Assert::IsTrue(ready.empty());
+    }
+
+    TEST_METHOD(RtdQueueSpeedTest)
+    {
+      constexpr int nThreads = 4, nTopics = 1000, nTicks = 200;
+
+      using clock = std::chrono::high_resolution_clock;
+      auto millis = [](auto t0, auto t1) {
+        return (int)std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count(); };
+
+      // Reference: the previous design of a locked list of topic strings
+      // which are hashed by the consumer
+      vector<std::wstring> topics;
+      for (int i = 0; i < nTopics; ++i)
+        topics.push_back(formatStr(L"MarketData.Ticker%d", i));
+
+      std::mutex lock;
+      std::list<std::pair<std::wstring, shared_ptr<int>>> listQueue;
+      std::unordered_map<std::wstring, shared_ptr<int>> listRecords;
+      std::atomic<bool> done = false;
+
+      auto runProducers = [&](auto&& push)
+      {
+        vector<std::thread> producers;
+        for (int t = 0; t < nThreads; ++t)
+          producers.emplace_back([&, t]()
+          {
+            for (int tick = 0; tick < nTicks; ++tick)
+              for (int topic = t; topic < nTopics; topic += nThreads)
+                push(topic, make_shared<int>(tick));
+          });
+        for (auto& thread : producers)
+          thread.join();
+      };
+
+      auto t0 = clock::now();
+      std::thread listConsumer([&]()
+      {
+        while (!done)
+        {
+          decltype(listQueue) values;
+          {
+            std::scoped_lock l(lock);
+            std::swap(values, listQueue);
+          }
+          for (auto& [topic, value] : values)
+            listRecords[topic] = value;
+        }
+      });
+      runProducers([&](int topic, shared_ptr<int>&& value)
+      {
+        std::scoped_lock l(lock);
+        listQueue.emplace_back(topics[topic], std::move(value));
+      });
+      done = true;
+      listConsumer.join();
+      for (auto& [topic, value] : listQueue)
+        listRecords[topic] = value;
+      auto t1 = clock::now();
+
+      RtdPublishQueue<int> queue;
+      vector<shared_ptr<int>> records(nTopics);
+      done = false;
+      auto t2 = clock::now();
+      std::thread queueConsumer([&]()
+      {
+        auto apply = [&](RtdTopicHandle h, shared_ptr<int>& v) { records[h] = std::move(v); };
+        while (!done)
+          queue.drain(apply);
+        queue.drain(apply);
+        queue.drain(apply);
+      });
+      runProducers([&](int topic, shared_ptr<int>&& value)
+      {
+        queue.push(topic, value);
+      });
+      done = true;
+      queueConsumer.join();
+      auto t3 = clock::now();
+
+      for (int i = 0; i < nTopics; ++i)
+      {
+        Assert::AreEqual(nTicks - 1, *listRecords[topics[i]]);
+        Assert::AreEqual(nTicks - 1, *records[i]);
+      }
+
+      Logger::WriteMessage(formatStr(
+        L"RtdQueueSpeedTest - Locked list: %dms, Lock-free queue: %dms",
+        millis(t0, t1), millis(t2, t3)).c_str());
+    }
+  };
+}
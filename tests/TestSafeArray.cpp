@@ -0,0 +1,137 @@
+#include "CppUnitTest.h"
+#include <xlOil-COM/SafeArrayConvert.h>
+
+#include <vector>
+#include <string>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+using namespace xloil;
+using std::wstring;
+using std::vector;
+
+namespace Tests
+{
+  namespace
+  {
+    // A minimal stand-in for VARIANT, so the conversion kernels can be
+    // exercised without creating SafeArrays
+    struct FakeVariant
+    {
+      enum { Empty, Num, Str } type = Empty;
+      double num = 0;
+      wstring str;
+    };
+
+    struct FakeVariantCell
+    {
+      static size_t stringLength(const FakeVariant& x)
+      {
+        return x.str.size();
+      }
+      static void write(const FakeVariant& x, xloil::detail::ArrayBuilderElement to)
+      {
+        switch (x.type)
+        {
+        case FakeVariant::Num: to = x.num; break;
+        case FakeVariant::Str: to = std::wstring_view(x.str); break;
+        default: to = ExcelObj();
+        }
+      }
+      static void write(const ExcelObj& x, FakeVariant& to)
+      {
+        if (x.isType(ExcelType::Num))
+        {
+          to.type = FakeVariant::Num;
+          to.num = x.get<double>();
+        }
+        else if (x.isType(ExcelType::Str))
+        {
+          to.type = FakeVariant::Str;
+          to.str = x.toString();
+        }
+      }
+    };
+
+    FakeVariant expectedCell(size_t i, size_t j)
+    {
+      FakeVariant result;
+      if ((i + j) % 3 == 0)
+      {
+        result.type = FakeVariant::Str;
+        result.str = std::to_wstring(i) + L"," + std::to_wstring(j);
+      }
+      else if ((i + j) % 3 == 1)
+      {
+        result.type = FakeVariant::Num;
+        result.num = i * 1000.0 + j;
+      }
+      return result;
+    }
+  }
+
+  TEST_CLASS(TestSafeArray)
+  {
+  public:
+
+    TEST_METHOD(TestColumnMajorRoundTrip)
+    {
+      // Sizes which are not a multiple of the tile size, and a column
+      // stride longer than the rows read, as for a trimmed SafeArray
+      constexpr size_t nRows = 37, nCols = 21, stride = 40;
+      vector<FakeVariant> source(stride * nCols);
+      for (auto j = 0u; j < nCols; ++j)
+        for (auto i = 0u; i < stride; ++i)
+          source[j * stride + i] = expectedCell(i, j);
+
+      const auto obj = COM::columnMajorToExcelObj<FakeVariantCell>(
+        source.data(), stride, nRows, nCols);
+
+      ExcelArray arr(obj, false);
+      Assert::AreEqual<size_t>(nRows, arr.nRows());
+      Assert::AreEqual<size_t>(nCols, arr.nCols());
+      for (auto i = 0u; i < nRows; ++i)
+        for (auto j = 0u; j < nCols; ++j)
+        {
+          const auto expected = expectedCell(i, j);
+          const auto& actual = arr(i, j);
+          switch (expected.type)
+          {
+          case FakeVariant::Num: Assert::IsTrue(actual == expected.num); break;
+          case FakeVariant::Str: Assert::AreEqual(expected.str, actual.toString()); break;
+          default: Assert::IsTrue(actual.isType(ExcelType::Nil));
+          }
+        }
+
+      vector<FakeVariant> target(nRows * nCols);
+      COM::excelArrayToColumnMajor<FakeVariantCell>(arr, target.data(), nRows);
+      for (auto j = 0u; j < nCols; ++j)
+        for (auto i = 0u; i < nRows; ++i)
+        {
+          const auto expected = expectedCell(i, j);
+          const auto& actual = target[j * nRows + i];
+          Assert::IsTrue(expected.type == actual.type);
+          Assert::AreEqual(expected.num, actual.num);
+          Assert::AreEqual(expected.str, actual.str);
+        }
+    }
+
+    TEST_METHOD(TestTiledTraversal)
+    {
+      // Every element is visited exactly once, for shapes smaller than,
+      // equal to and larger than a tile
+      for (auto [nRows, nCols] : {
+        std::pair<size_t, size_t>(1, 1), { 1, 50 }, { 50, 1 },
+        { COM::detail::SAFEARRAY_TILE, COM::detail::SAFEARRAY_TILE }, { 33, 17 } })
+      {
+        vector<int> visits(nRows * nCols);
+        COM::detail::forEachTiled(nRows, nCols, [&](size_t i, size_t j)
+        {
+          ++visits[i * nCols + j];
+        });
+        for (auto v : visits)
+          Assert::AreEqual(1, v);
+      }
+    }
+  };
+}
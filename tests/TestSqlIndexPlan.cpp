@@ -0,0 +1,93 @@
+#include "CppUnitTest.h"
+#include "../libs/xlOil_SQL/IndexPlan.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+using namespace xloil::SQL;
+
+namespace Tests
+{
+  TEST_CLASS(SqlIndexPlan)
+  {
+  public:
+    TEST_METHOD(TestRangeConstraints)
+    {
+      // c > 1 AND c <= 10 AND c >= 2: the first of each bound is kept
+      ColumnPlan plan;
+      plan.addLower(0, false);
+      plan.addUpper(1, true);
+      plan.addLower(2, true);
+      Assert::AreEqual((int)(PLAN_GT | PLAN_LE), plan.flags);
+      Assert::AreEqual(0, plan.lower);
+      Assert::AreEqual(1, plan.upper);
+      Assert::AreEqual(2, ColumnPlan::nArgs(plan.flags));
+    }
+
+    TEST_METHOD(TestEqualWithRangeConstraints)
+    {
+      // c < 10 AND c = 5: the equality replaces the upper bound
+      {
+        ColumnPlan plan;
+        plan.addUpper(0, false);
+        plan.addEqual(1);
+        Assert::AreEqual((int)PLAN_EQ, plan.flags);
+        Assert::AreEqual(1, plan.lower);
+        Assert::AreEqual(-1, plan.upper);
+        Assert::AreEqual(1, ColumnPlan::nArgs(plan.flags));
+      }
+      // c = 5 AND c < 10 AND c >= 1: bounds after the equality are ignored
+      {
+        ColumnPlan plan;
+        plan.addEqual(0);
+        plan.addUpper(1, false);
+        plan.addLower(2, true);
+        Assert::AreEqual((int)PLAN_EQ, plan.flags);
+        Assert::AreEqual(0, plan.lower);
+        Assert::AreEqual(-1, plan.upper);
+        Assert::AreEqual(1, ColumnPlan::nArgs(plan.flags));
+      }
+      // c >= 1 AND c <= 10 AND c = 5
+      {
+        ColumnPlan plan;
+        plan.addLower(0, true);
+        plan.addUpper(1, true);
+        plan.addEqual(2);
+        Assert::AreEqual((int)PLAN_EQ, plan.flags);
+        Assert::AreEqual(2, plan.lower);
+        Assert::AreEqual(-1, plan.upper);
+        Assert::AreEqual(1, ColumnPlan::nArgs(plan.flags));
+      }
+    }
+
+    TEST_METHOD(TestNonBinaryCollation)
+    {
+      // name = 'abc' COLLATE NOCASE: the index would miss 'ABC'
+      {
+        ColumnPlan plan;
+        Assert::IsFalse(plan.addConstraint(0, PLAN_EQ, "NOCASE"));
+        Assert::AreEqual(0, plan.flags);
+      }
+      // name > 'a' COLLATE NOCASE AND name <= 'm' COLLATE NOCASE
+      {
+        ColumnPlan plan;
+        Assert::IsFalse(plan.addConstraint(0, PLAN_GT, "NOCASE"));
+        Assert::IsFalse(plan.addConstraint(1, PLAN_LE, "NOCASE"));
+        Assert::AreEqual(0, plan.flags);
+        Assert::AreEqual(0, ColumnPlan::nArgs(plan.flags));
+      }
+      // A BINARY range is kept when a NOCASE equality is skipped
+      {
+        ColumnPlan plan;
+        Assert::IsTrue(plan.addConstraint(0, PLAN_GE, "BINARY"));
+        Assert::IsFalse(plan.addConstraint(1, PLAN_EQ, "RTRIM"));
+        Assert::IsTrue(plan.addConstraint(2, PLAN_LT, "binary"));
+        Assert::AreEqual((int)(PLAN_GE | PLAN_LT), plan.flags);
+        Assert::AreEqual(0, plan.lower);
+        Assert::AreEqual(2, plan.upper);
+      }
+      Assert::IsTrue(ColumnPlan::isBinaryCollation(nullptr));
+      Assert::IsFalse(ColumnPlan::isBinaryCollation("BINARYX"));
+      Assert::IsFalse(ColumnPlan::isBinaryCollation("BIN"));
+    }
+  };
+}
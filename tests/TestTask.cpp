@@ -0,0 +1,173 @@
+#include "CppUnitTest.h"
+#include <xloil/Task.h>
+#include <xlOil/StringUtils.h>
+
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+using namespace xloil;
+using std::vector;
+
+namespace Tests
+{
+  TEST_CLASS(Tasks)
+  {
+  public:
+    TEST_METHOD(TestSpawnAndThen)
+    {
+      TaskExecutor executor(4);
+
+      auto task = spawn([]() { return 20; }, CancellationToken(), executor)
+        .then([](int x) { return x + 1; }, executor)
+        .then([](int x) { return std::to_wstring(x * 2); }, executor);
+      Assert::AreEqual(std::wstring(L"42"), task.get());
+
+      // A continuation which returns a task is flattened
+      auto nested = makeReadyTask(3)
+        .then([&](int x) { return spawn([x]() { return x * x; }, CancellationToken(), executor); }, executor);
+      Assert::AreEqual(9, nested.get());
+    }
+
+    TEST_METHOD(TestExceptionsPropagate)
+    {
+      TaskExecutor executor(2);
+      std::atomic<bool> called = false;
+
+      auto task = spawn([]() -> int { throw std::runtime_error("Bad"); }, CancellationToken(), executor)
+        .then([&](int x) { called = true; return x; }, executor);
+
+      Assert::ExpectException<std::runtime_error>([&]() { task.get(); });
+      Assert::IsTrue(task.exception() != nullptr);
+      Assert::IsFalse(called);
+    }
+
+    TEST_METHOD(TestCancellation)
+    {
+      TaskExecutor executor(1);
+      CancellationToken token;
+
+      // Block the only worker so later jobs are queued
+      TaskSource<int> gate;
+      auto blocker = spawn([gate]() { return gate.task().get(); }, CancellationToken(), executor);
+
+      std::atomic<int> nRun = 0;
+      auto queued = spawn([&]() { ++nRun; return 1; }, token, executor);
+      auto running = spawn([&](const CancellationToken& t)
+      {
+        while (!t.cancelled())
+          std::this_thread::yield();
+        return 2;
+      }, token, executor);
+
+      token.cancel();
+      gate.setValue(0);
+
+      Assert::ExpectException<TaskCancelled>([&]() { queued.get(); });
+      Assert::ExpectException<TaskCancelled>([&]() { running.get(); });
+      Assert::AreEqual(0, nRun.load());
+      Assert::AreEqual(0, blocker.get());
+    }
+
+    TEST_METHOD(TestTaskSource)
+    {
+      TaskSource<int> source;
+      auto task = source.task();
+      Assert::IsFalse(task.ready());
+
+      int seen = 0;
+      task.onComplete([&]() { seen = task.get(); });
+      source.setValue(5);
+      source.setValue(6); // Ignored, the first value wins
+      Assert::IsTrue(task.ready());
+      Assert::AreEqual(5, seen);
+      Assert::AreEqual(5, task.get());
+    }
+
+    TEST_METHOD(TestWorkStealing)
+    {
+      constexpr int N = 10000;
+      TaskExecutor executor(4);
+
+      // One job fans out many small jobs onto its own queue: the idle
+      // workers should steal some of them
+      vector<Task<int>> tasks(N);
+      spawn([&]()
+      {
+        for (int i = 0; i < N; ++i)
+          tasks[i] = spawn([i]()
+          {
+            std::this_thread::sleep_for(std::chrono::microseconds(10));
+            return i;
+          }, CancellationToken(), executor);
+        return 0;
+      }, CancellationToken(), executor).get();
+
+      long long total = 0;
+      for (auto& t : tasks)
+        total += t.get();
+      Assert::AreEqual((long long)N * (N - 1) / 2, total);
+      Assert::IsTrue(executor.nStolen() > 0);
+    }
+
+    TEST_METHOD(TestExecutorDrainsOnDestruction)
+    {
+      std::atomic<int> count = 0;
+      {
+        TaskExecutor executor(2);
+        for (int i = 0; i < 100; ++i)
+          executor.post([&, ex = &executor]()
+          {
+            ex->post([&]() { ++count; });
+          });
+      }
+      Assert::AreEqual(100, count.load());
+    }
+
+    TEST_METHOD(TestThenAfterExecutorStops)
+    {
+      TaskSource<int> source;
+      Task<int> next;
+      {
+        TaskExecutor executor(2);
+        next = source.task().then([](int x) { return x + 1; }, executor);
+      }
+      // The executor has gone, so the continuation cannot be run
+      source.setValue(1);
+      Assert::IsTrue(next.ready());
+      Assert::ExpectException<TaskCancelled>([&]() { next.get(); });
+    }
+
+    TEST_METHOD(TestRtdTaskAdapter)
+    {
+      struct Publisher : public IRtdPublish
+      {
+        std::vector<ExcelObj> values;
+        bool publish(ExcelObj&& value) noexcept override
+        {
+          values.emplace_back(std::move(value));
+          return true;
+        }
+      } publisher;
+
+      TaskExecutor executor(2);
+      auto factory = [&](const CancellationToken& token)
+      {
+        return spawn([]() { return ExcelObj(7); }, token, executor);
+      };
+      RtdTaskAdapter adapter(L"f", { ExcelObj(1) }, factory);
+      Assert::IsTrue(adapter == RtdTaskAdapter(L"f", { ExcelObj(1) }, factory));
+      Assert::IsFalse(adapter == RtdTaskAdapter(L"f", { ExcelObj(2) }, factory));
+      Assert::IsFalse(adapter == RtdTaskAdapter(L"g", { ExcelObj(1) }, factory));
+
+      adapter.start(publisher);
+      adapter.wait();
+      Assert::IsTrue(adapter.done());
+      Assert::AreEqual<size_t>(1, publisher.values.size());
+      Assert::IsTrue(publisher.values[0] == 7);
+    }
+  };
+}